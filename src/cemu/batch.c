@@ -0,0 +1,317 @@
+/**
+ * @file batch.c
+ * @author lancer (lancerstadium@163.com)
+ * @brief 批量运行实现
+ * @version 0.1
+ * @date 2024-02-01
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+// ==================================================================== //
+//                              Include
+// ==================================================================== //
+
+#include "batch.h"
+#include "chan.h"
+#include "loader.h"
+#include "log.h"
+#include "macro.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+
+// ==================================================================== //
+//                          Private Func: BATCH
+// ==================================================================== //
+
+/** 工作线程参数 */
+typedef struct BATCH_WORKER_t {
+    BATCH* batch;
+    int id;
+} BATCH_WORKER;
+
+static inline u64 batch_now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/** 取出一个字段：以制表符结束，`-`视为空 */
+static char* batch_field(char** line) {
+    char* s = *line;
+    if (!s)
+        return NULL;
+    char* tab = strchr(s, '\t');
+    if (tab) {
+        *tab = '\0';
+        *line = tab + 1;
+    } else {
+        *line = NULL;
+    }
+    if (s[0] == '\0' || strcmp(s, "-") == 0)
+        return NULL;
+    return strdup(s);
+}
+
+/** 以空格拆分参数（就地修改`buf`），返回以`NULL`结尾的`argv` */
+static char** batch_split_args(char* buf, char* argv[BATCH_MAX_ARG + 1]) {
+    int n = 0;
+    char* save;
+    for (char* a = strtok_r(buf, " ", &save); a && n < BATCH_MAX_ARG; a = strtok_r(NULL, " ", &save))
+        argv[n++] = a;
+    argv[n] = NULL;
+    return argv;
+}
+
+/** 以 JSON 字符串形式输出 */
+static void batch_json_str(FILE* out, const char* s) {
+    fputc('"', out);
+    for (; s && *s; s++) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\')
+            fprintf(out, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(out, "\\u%04x", c);
+        else
+            fputc(c, out);
+    }
+    fputc('"', out);
+}
+
+/**
+ * @brief 把输入文件写入数据通道的 h2g 环并关闭该环，通道大小按文件大小取整
+ * @return int 0 成功，-1 失败
+ */
+static int batch_feed_input(CHAN* chan, BUS* bus, char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f)
+        return -1;
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    u64 ring = CHAN_PAGE_SIZE;
+    while (ring < (u64)len)
+        ring <<= 1;
+    u8* buf = malloc(len > 0 ? len : 1);
+    int ok = buf && fread(buf, 1, len, f) == (size_t)len
+          && chan_init(chan, bus, CHAN_PAGE_SIZE + 2 * ring) == 0;
+    fclose(f);
+    if (ok) {
+        chan_ring_write(chan->shm, CHAN_RING_H2G, buf, len);
+        chan_ring_close(chan->shm, CHAN_RING_H2G);
+    }
+    free(buf);
+    return ok ? 0 : -1;
+}
+
+/**
+ * @brief 在新建的机器上运行一个任务，并输出一行 JSON 结果
+ */
+static void batch_run_job(BATCH* batch, int id) {
+    BATCH_JOB* job = &batch->jobs[id];
+    u64 start = batch_now_us();
+    const char* status = "error";
+    u64 insns = 0, pc = 0;
+    int64_t code = 0;
+
+    MACHINE* m = NULL;
+    CHAN chan = { .listen_fd = -1 };
+    if (!(m = malloc(sizeof(MACHINE)))) {
+        log_error("Batch job %d: machine alloc failed", id);
+    } else {
+        machine_init(m, batch->nhart);
+        machine_set_quantum(m, batch->quantum);
+        if (job->input && batch_feed_input(&chan, &m->bus, job->input) < 0) {
+            log_error("Batch job %d: unable to feed input %s", id, job->input);
+        } else {
+            char* args = strdup(job->args);
+            char* argv[BATCH_MAX_ARG + 1];
+            proc_set_args(&m->proc, args ? batch_split_args(args, argv) : NULL, NULL);
+            int loaded = machine_load_elf(m, job->elf);
+            free(args);
+            if (loaded < 0) {
+                log_error("Batch job %d: unable to load %s", id, job->elf);
+            } else {
+                machine_run(m);
+                CPU* boot = m->harts[0];
+                status = boot->pc == 0 ? "exit" : "fault";
+                code = (int64_t)boot->regs[10];
+                pc = boot->pc - boot->ilen;
+                for (int i = 0; i < m->nhart; i++)
+                    insns += m->harts[i]->instret;
+            }
+        }
+        if (job->input)
+            chan_free(&chan);
+        machine_free(m);
+        free(m);
+    }
+    u64 wall = batch_now_us() - start;
+
+    pthread_mutex_lock(&batch->out_lock);
+    fprintf(batch->out, "{\"id\":%d,\"elf\":", id);
+    batch_json_str(batch->out, job->elf);
+    fprintf(batch->out, ",\"args\":");
+    batch_json_str(batch->out, job->args);
+    fprintf(batch->out, ",\"status\":\"%s\"", status);
+    if (strcmp(status, "exit") == 0)
+        fprintf(batch->out, ",\"code\":%ld", code);
+    else if (strcmp(status, "fault") == 0)
+        fprintf(batch->out, ",\"pc\":%lu", pc);
+    fprintf(batch->out, ",\"insns\":%lu,\"wall_us\":%lu}\n", insns, wall);
+    fflush(batch->out);
+    pthread_mutex_unlock(&batch->out_lock);
+}
+
+/** 所有者从自己队列的尾部取任务，空则返回 -1 */
+static int batch_pop(BATCH_DEQUE* dq) {
+    int id = -1;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->top < dq->bottom)
+        id = dq->jobs[--dq->bottom];
+    pthread_mutex_unlock(&dq->lock);
+    return id;
+}
+
+/** 从其它队列的头部窃取任务，空则返回 -1 */
+static int batch_steal(BATCH_DEQUE* dq) {
+    int id = -1;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->top < dq->bottom)
+        id = dq->jobs[dq->top++];
+    pthread_mutex_unlock(&dq->lock);
+    return id;
+}
+
+static void* batch_worker(void* arg) {
+    BATCH_WORKER* w = arg;
+    BATCH* batch = w->batch;
+    for (;;) {
+        int id = batch_pop(&batch->deques[w->id]);
+        // 自己的队列为空：从相邻的线程开始依次窃取
+        for (int i = 1; id < 0 && i < batch->nworker; i++)
+            id = batch_steal(&batch->deques[(w->id + i) % batch->nworker]);
+        if (id < 0)
+            break;
+        batch_run_job(batch, id);
+    }
+    return NULL;
+}
+
+
+// ==================================================================== //
+//                            Func API: BATCH
+// ==================================================================== //
+
+int batch_load(BATCH* batch, char* path) {
+    memset(batch, 0, sizeof(BATCH));
+    batch->nhart = 1;
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        log_error("Unable to open manifest %s", path);
+        return -1;
+    }
+    int cap = 0;
+    char* line = NULL;
+    size_t n = 0;
+    while (getline(&line, &n, f) >= 0) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0' || line[0] == '#')
+            continue;
+        if (batch->njob == cap) {
+            BATCH_JOB* jobs = realloc(batch->jobs, (cap ? cap * 2 : 64) * sizeof(BATCH_JOB));
+            if (!jobs) {
+                // 已读入的任务留给 batch_free() 释放
+                log_error("Out of memory reading manifest %s", path);
+                free(line);
+                fclose(f);
+                return -1;
+            }
+            batch->jobs = jobs;
+            cap = cap ? cap * 2 : 64;
+        }
+        char* s = line;
+        BATCH_JOB* job = &batch->jobs[batch->njob];
+        job->elf = batch_field(&s);
+        job->args = batch_field(&s);
+        job->input = batch_field(&s);
+        if (!job->elf) {
+            log_warn("Manifest line without ELF skipped");
+            free(job->args);
+            free(job->input);
+            continue;
+        }
+        if (!job->args)
+            job->args = strdup("");
+        batch->njob++;
+    }
+    free(line);
+    fclose(f);
+    return 0;
+}
+
+int batch_run(BATCH* batch, int nworker, FILE* out) {
+    if (nworker <= 0)
+        nworker = sysconf(_SC_NPROCESSORS_ONLN);
+    nworker = MAX(1, MIN(MIN(nworker, BATCH_MAX_WORKER), MAX(batch->njob, 1)));
+    batch->nworker = nworker;
+    batch->out = out;
+    pthread_mutex_init(&batch->out_lock, NULL);
+    batch->deques = aligned_alloc(64, nworker * sizeof(BATCH_DEQUE));
+    int* ids = malloc(MAX(batch->njob, 1) * sizeof(int));
+    if (!batch->deques || !ids) {
+        log_error("Batch alloc failed");
+        free(ids);
+        return -1;
+    }
+    // 按清单顺序把连续的一段任务分给每个工作线程
+    for (int i = 0; i < batch->njob; i++)
+        ids[i] = i;
+    for (int w = 0; w < nworker; w++) {
+        BATCH_DEQUE* dq = &batch->deques[w];
+        pthread_mutex_init(&dq->lock, NULL);
+        dq->jobs = ids;
+        dq->top = (long)batch->njob * w / nworker;
+        dq->bottom = (long)batch->njob * (w + 1) / nworker;
+    }
+
+    pthread_t threads[BATCH_MAX_WORKER];
+    BATCH_WORKER workers[BATCH_MAX_WORKER];
+    int started[BATCH_MAX_WORKER] = { 0 };
+    for (int w = 1; w < nworker; w++) {
+        workers[w] = (BATCH_WORKER){ .batch = batch, .id = w };
+        // 未能启动的线程的任务由其它线程窃取
+        if (pthread_create(&threads[w], NULL, batch_worker, &workers[w]) != 0)
+            log_warn("Batch worker %d create failed", w);
+        else
+            started[w] = 1;
+    }
+    workers[0] = (BATCH_WORKER){ .batch = batch, .id = 0 };
+    batch_worker(&workers[0]);
+    for (int w = 1; w < nworker; w++)
+        if (started[w])
+            pthread_join(threads[w], NULL);
+
+    for (int w = 0; w < nworker; w++)
+        pthread_mutex_destroy(&batch->deques[w].lock);
+    pthread_mutex_destroy(&batch->out_lock);
+    free(ids);
+    log_info("Batch done: %d jobs on %d workers", batch->njob, nworker);
+    return 0;
+}
+
+void batch_free(BATCH* batch) {
+    for (int i = 0; i < batch->njob; i++) {
+        free(batch->jobs[i].elf);
+        free(batch->jobs[i].args);
+        free(batch->jobs[i].input);
+    }
+    free(batch->jobs);
+    free(batch->deques);
+    batch->jobs = NULL;
+    batch->deques = NULL;
+    batch->njob = 0;
+}
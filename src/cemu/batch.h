@@ -0,0 +1,129 @@
+/**
+ * @file batch.h
+ * @author lancer (lancerstadium@163.com)
+ * @brief 批量运行头文件
+ * @version 0.1
+ * @date 2024-02-01
+ * @copyright Copyright (c) 2024
+ *
+ * # 批量运行介绍
+ * - `cemu batch`从清单中读取大量相互独立的短任务，每个任务在自己的`MACHINE`中运行，
+ * 多个任务由工作窃取线程池在主机线程上并行执行。
+ *
+ * - 清单每行一个任务，字段以制表符分隔，后两个字段可省略或写作`-`，`#`开头为注释：
+ * ```
+ *
+ *   <elf>\t<args>\t<input>
+ *
+ * ```
+ * `input`文件的内容在启动前写入数据通道（见`chan.h`）的 h2g 环并关闭该环，
+ * 来宾按数据通道协议读取；`args`原样记录在结果中，静态链接的 Linux 程序（见`proc.h`）
+ * 还以空格拆分后作为`argv[1..]`，环境变量为空，同一清单重复运行的结果不受主机环境影响。
+ *
+ * - 线程池：每个工作线程一个双端队列，初始时按清单顺序分到连续的一段任务。
+ * 工作线程从自己队列的尾部取任务，队列为空时从其它线程队列的头部窃取，
+ * 所有队列都为空时退出。任务在运行前全部已知，不会动态产生新任务。
+ * ```
+ *
+ *   worker 0: [ 0  1  2  3 ]    <- 自己从尾部取
+ *   worker 1: [ 4  5  6  7 ]    <- 他人从头部窃取
+ *   ...
+ *
+ * ```
+ *
+ * - 每个任务结束后输出一行 JSON（按完成顺序，`id`为清单中的任务序号）：
+ * ```
+ *
+ *   {"id":0,"elf":"a.out","args":"","status":"exit","code":0,"insns":1234,"wall_us":56}
+ *
+ * ```
+ * `status`为`exit`（0 号处理器跳转到 0 地址结束，`code`为其`a0`）、
+ * `fault`（非法指令等，附带`pc`）或`error`（任务无法启动）。
+ */
+
+
+#ifndef BATCH_H
+#define BATCH_H
+
+// ==================================================================== //
+//                             Include
+// ==================================================================== //
+
+#include "machine.h"
+#include <stdio.h>
+
+// ==================================================================== //
+//                              Defines
+// ==================================================================== //
+
+#define BATCH_MAX_WORKER    256     /** 工作线程数上限 */
+#define BATCH_MAX_ARG       64      /** 每个任务的参数个数上限 */
+
+
+// ==================================================================== //
+//                             Data: BATCH
+// ==================================================================== //
+
+/**
+ * @brief 批量任务
+ */
+typedef struct BATCH_JOB_t {
+    char* elf;                      /** ELF 文件 */
+    char* args;                     /** 参数，无则为空串 */
+    char* input;                    /** 输入文件，无则为`NULL` */
+} BATCH_JOB;
+
+/**
+ * @brief 工作线程的任务队列：[top, bottom) 为尚未执行的任务序号
+ */
+typedef struct BATCH_DEQUE_t {
+    pthread_mutex_t lock;
+    int top;                        /** 窃取端 */
+    int bottom;                     /** 所有者端 */
+    int* jobs;                      /** 任务序号 */
+} __attribute__((aligned(64))) BATCH_DEQUE;
+
+/**
+ * @brief 批量运行
+ */
+typedef struct BATCH_t {
+    BATCH_JOB* jobs;                /** 任务表 */
+    int njob;                       /** 任务数 */
+    int nhart;                      /** 每个任务的处理器个数 */
+    u64 quantum;                    /** 每个任务的确定性时间片，0 表示自由并行 */
+    int nworker;                    /** 工作线程数 */
+    BATCH_DEQUE* deques;            /** 每个工作线程一个队列 */
+    FILE* out;                      /** JSON 行输出 */
+    pthread_mutex_t out_lock;       /** 输出锁 */
+} BATCH;
+
+
+// ==================================================================== //
+//                            Declare API: BATCH
+// ==================================================================== //
+
+/**
+ * @brief 读取任务清单
+ * @param batch 批量运行
+ * @param path 清单文件
+ * @return int 0 成功，-1 失败
+ */
+int batch_load(BATCH* batch, char* path);
+
+/**
+ * @brief 在`nworker`个工作线程上运行全部任务，结果逐行写入`out`
+ * @param batch 批量运行（已读取清单，并设置`nhart`、`quantum`）
+ * @param nworker 工作线程数，不大于 0 时取主机处理器个数
+ * @param out 输出
+ * @return int 0 成功，-1 失败
+ */
+int batch_run(BATCH* batch, int nworker, FILE* out);
+
+/**
+ * @brief 释放任务表与队列
+ * @param batch 批量运行
+ */
+void batch_free(BATCH* batch);
+
+
+#endif // BATCH_H
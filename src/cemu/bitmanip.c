@@ -0,0 +1,212 @@
+/**
+ * @file bitmanip.c
+ * @author lancer (lancerstadium@163.com)
+ * @brief 位操作扩展（Zba/Zbb/Zbc）实现
+ * @version 0.1
+ * @date 2024-01-28
+ * @copyright Copyright (c) 2024
+ * @note `bitmanip_exec()`强制内联进两个包装函数：一个以
+ * `target("popcnt,lzcnt,bmi,pclmul")`编译，计数类内建函数直接生成单条主机指令；
+ * 另一个按默认目标编译，作为不支持这些指令的主机上的回退。
+ */
+
+// ==================================================================== //
+//                              Include
+// ==================================================================== //
+
+#include "bitmanip.h"
+#include "utils.h"
+#include <pthread.h>
+#if defined(__x86_64__)
+#include <wmmintrin.h>
+#endif
+
+// ==================================================================== //
+//                              Defines
+// ==================================================================== //
+
+#define BM_TARGET   "popcnt,lzcnt,bmi,pclmul"   /** 主机加速版本的编译目标 */
+
+typedef int (*BITMANIP_EXEC)(CPU* cpu, u32 inst);
+
+// ==================================================================== //
+//                        Private Func: BITMANIP
+// ==================================================================== //
+
+static void print_op(char* s) {
+    if (log_trace_on)
+        printf(_blue("%s"), s);
+}
+
+static inline u64 rd(u32 inst)  { return (inst >> 7) & 0x1f; }
+static inline u64 rs1(u32 inst) { return (inst >> 15) & 0x1f; }
+static inline u64 rs2(u32 inst) { return (inst >> 20) & 0x1f; }
+
+/** 无进位乘法的 128 位结果：软件实现 */
+static inline void clmul_soft(u64 a, u64 b, u64* lo, u64* hi) {
+    unsigned __int128 p = 0;
+    for (int i = 0; i < 64; i++)
+        if ((b >> i) & 1)
+            p ^= (unsigned __int128)a << i;
+    *lo = (u64)p;
+    *hi = (u64)(p >> 64);
+}
+
+#if defined(__x86_64__)
+/** 无进位乘法的 128 位结果：pclmulqdq */
+static inline __attribute__((target("pclmul"))) void clmul_host(u64 a, u64 b, u64* lo, u64* hi) {
+    __m128i p = _mm_clmulepi64_si128(_mm_cvtsi64_si128(a), _mm_cvtsi64_si128(b), 0x00);
+    *lo = (u64)_mm_cvtsi128_si64(p);
+    *hi = (u64)_mm_cvtsi128_si64(_mm_unpackhi_epi64(p, p));
+}
+#endif
+
+static inline u64 rol64(u64 x, u32 n) { n &= 63; return (x << n) | (x >> ((64 - n) & 63)); }
+static inline u64 ror64(u64 x, u32 n) { n &= 63; return (x >> n) | (x << ((64 - n) & 63)); }
+static inline u32 rol32(u32 x, u32 n) { n &= 31; return (x << n) | (x >> ((32 - n) & 31)); }
+static inline u32 ror32(u32 x, u32 n) { n &= 31; return (x >> n) | (x << ((32 - n) & 31)); }
+
+/** orc.b：每个非零字节置为 0xff */
+static inline u64 orc_b(u64 x) {
+    u64 lo7 = 0x7f7f7f7f7f7f7f7full;
+    u64 t = ((x & lo7) + lo7) | x;      // 每字节最高位 = 该字节非零
+    t &= ~lo7;
+    return (t >> 7) * 0xff;
+}
+
+/**
+ * @brief 执行一条位操作指令，`host`为编译期常量
+ */
+static inline __attribute__((always_inline)) int bitmanip_exec(CPU* cpu, u32 inst, int host) {
+    u32 opcode = inst & 0x7f;
+    u32 funct3 = (inst >> 12) & 0x7;
+    u32 funct7 = inst >> 25;
+    u64 a = cpu->regs[rs1(inst)];
+    u64 b = cpu->regs[rs2(inst)];
+    u32 imm = inst >> 20;
+    u32 shamt = imm & 0x3f;
+    u64 r, lo, hi;
+    char* name;
+
+    switch (opcode) {
+        case R_TYPE:
+            switch (funct7 << 3 | funct3) {
+                case ZB_SHADD << 3 | 2:     r = b + (a << 1); name = "sh1add"; break;
+                case ZB_SHADD << 3 | 4:     r = b + (a << 2); name = "sh2add"; break;
+                case ZB_SHADD << 3 | 6:     r = b + (a << 3); name = "sh3add"; break;
+                case ZB_NOT << 3 | 4:       r = ~(a ^ b);     name = "xnor";   break;
+                case ZB_NOT << 3 | 6:       r = a | ~b;       name = "orn";    break;
+                case ZB_NOT << 3 | 7:       r = a & ~b;       name = "andn";   break;
+                case ZB_MINMAX << 3 | 4:    r = (int64_t)a < (int64_t)b ? a : b; name = "min";  break;
+                case ZB_MINMAX << 3 | 5:    r = a < b ? a : b;                   name = "minu"; break;
+                case ZB_MINMAX << 3 | 6:    r = (int64_t)a > (int64_t)b ? a : b; name = "max";  break;
+                case ZB_MINMAX << 3 | 7:    r = a > b ? a : b;                   name = "maxu"; break;
+                case ZB_MINMAX << 3 | 1:
+                case ZB_MINMAX << 3 | 2:
+                case ZB_MINMAX << 3 | 3:
+#if defined(__x86_64__)
+                    if (host) clmul_host(a, b, &lo, &hi);
+                    else
+#endif
+                    clmul_soft(a, b, &lo, &hi);
+                    r = funct3 == 1 ? lo : funct3 == 3 ? hi : (hi << 1) | (lo >> 63);
+                    name = funct3 == 1 ? "clmul" : funct3 == 3 ? "clmulh" : "clmulr";
+                    break;
+                case ZB_ROT << 3 | 1:       r = rol64(a, b);  name = "rol";    break;
+                case ZB_ROT << 3 | 5:       r = ror64(a, b);  name = "ror";    break;
+                default: return 0;
+            } break;
+
+        case R_TYPE_64:
+            switch (funct7 << 3 | funct3) {
+                case ZB_ADDUW << 3 | 0:     r = b + (u32)a;        name = "add.uw";    break;
+                case ZB_ADDUW << 3 | 4:
+                    if (rs2(inst) != 0) return 0;
+                    r = (u16)a;                                    name = "zext.h";    break;
+                case ZB_SHADD << 3 | 2:     r = b + ((u64)(u32)a << 1); name = "sh1add.uw"; break;
+                case ZB_SHADD << 3 | 4:     r = b + ((u64)(u32)a << 2); name = "sh2add.uw"; break;
+                case ZB_SHADD << 3 | 6:     r = b + ((u64)(u32)a << 3); name = "sh3add.uw"; break;
+                case ZB_ROT << 3 | 1:       r = (int32_t)rol32(a, b);   name = "rolw";      break;
+                case ZB_ROT << 3 | 5:       r = (int32_t)ror32(a, b);   name = "rorw";      break;
+                default: return 0;
+            } break;
+
+        case I_TYPE:
+            if (funct3 == 0x1 && funct7 == ZB_UNARY) {
+                switch (rs2(inst)) {
+                    case 0: r = a ? __builtin_clzll(a) : 64;    name = "clz";    break;
+                    case 1: r = a ? __builtin_ctzll(a) : 64;    name = "ctz";    break;
+                    case 2: r = __builtin_popcountll(a);        name = "cpop";   break;
+                    case 4: r = (int64_t)(int8_t)a;             name = "sext.b"; break;
+                    case 5: r = (int64_t)(int16_t)a;            name = "sext.h"; break;
+                    default: return 0;
+                }
+            } else if (funct3 == 0x5 && (imm >> 6) == ZB_RORI) {
+                r = ror64(a, shamt);                            name = "rori";
+            } else if (funct3 == 0x5 && imm == ZB_ORCB) {
+                r = orc_b(a);                                   name = "orc.b";
+            } else if (funct3 == 0x5 && imm == ZB_REV8) {
+                r = __builtin_bswap64(a);                       name = "rev8";
+            } else {
+                return 0;
+            } break;
+
+        case I_TYPE_64:
+            if (funct3 == 0x1 && funct7 == ZB_UNARY) {
+                switch (rs2(inst)) {
+                    case 0: r = (u32)a ? __builtin_clz((u32)a) : 32; name = "clzw";  break;
+                    case 1: r = (u32)a ? __builtin_ctz((u32)a) : 32; name = "ctzw";  break;
+                    case 2: r = __builtin_popcount((u32)a);          name = "cpopw"; break;
+                    default: return 0;
+                }
+            } else if (funct3 == 0x1 && (imm >> 6) == ZB_SLLIUW) {
+                r = (u64)(u32)a << shamt;                       name = "slli.uw";
+            } else if (funct3 == 0x5 && funct7 == ZB_ROT) {
+                r = (int32_t)ror32(a, shamt);                   name = "roriw";
+            } else {
+                return 0;
+            } break;
+
+        default:
+            return 0;
+    }
+    cpu->regs[rd(inst)] = r;
+    print_op(name);
+    print_op("\n");
+    return 1;
+}
+
+#if defined(__x86_64__)
+static __attribute__((target(BM_TARGET))) int bitmanip_exec_host(CPU* cpu, u32 inst) {
+    return bitmanip_exec(cpu, inst, 1);
+}
+#endif
+
+static int bitmanip_exec_generic(CPU* cpu, u32 inst) {
+    return bitmanip_exec(cpu, inst, 0);
+}
+
+/** 当前选用的执行函数 */
+static BITMANIP_EXEC bm_exec = bitmanip_exec_generic;
+static pthread_once_t bm_once = PTHREAD_ONCE_INIT;
+
+static void bitmanip_select() {
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("popcnt") && __builtin_cpu_supports("abm")
+        && __builtin_cpu_supports("bmi") && __builtin_cpu_supports("pclmul"))
+        bm_exec = bitmanip_exec_host;
+#endif
+}
+
+// ==================================================================== //
+//                          Func API: BITMANIP
+// ==================================================================== //
+
+void bitmanip_init() {
+    pthread_once(&bm_once, bitmanip_select);
+}
+
+int bitmanip_execute(CPU* cpu, u32 inst) {
+    return bm_exec(cpu, inst);
+}
@@ -0,0 +1,52 @@
+/**
+ * @file bitmanip.h
+ * @author lancer (lancerstadium@163.com)
+ * @brief 位操作扩展（Zba/Zbb/Zbc）头文件
+ * @version 0.1
+ * @date 2024-01-28
+ * @copyright Copyright (c) 2024
+ *
+ * # 位操作扩展介绍
+ * - Zba：地址生成，`sh1add`/`sh2add`/`sh3add`及其`.uw`形式、`add.uw`、`slli.uw`；
+ * - Zbb：基本位操作，`andn`/`orn`/`xnor`、`clz`/`ctz`/`cpop`（含`w`形式）、
+ * `min`/`max`、`sext.b`/`sext.h`/`zext.h`、循环移位、`orc.b`、`rev8`；
+ * - Zbc：无进位乘法`clmul`/`clmulh`/`clmulr`。
+ *
+ * - 这些指令与基础整数指令共用操作码，在`cpu.c`的指令表中按 funct7/立即数高位逐条登记，
+ * 由译码表直接分派到`bitmanip_execute()`，基础指令不经过额外判断。
+ *
+ * - 每条指令对应一条主机指令：`clz`/`ctz`/`cpop`/`rev8`映射为`lzcnt`/`tzcnt`/`popcnt`/`bswap`，
+ * `clmul*`映射为`pclmulqdq`。执行函数编写一次，分别以主机特性目标与通用目标编译，
+ * 在`bitmanip_init()`中按`__builtin_cpu_supports()`选择其一。
+ */
+
+
+#ifndef BITMANIP_H
+#define BITMANIP_H
+
+// ==================================================================== //
+//                             Include
+// ==================================================================== //
+
+#include "cpu.h"
+#include "opcode.h"
+
+// ==================================================================== //
+//                         Declare API: BITMANIP
+// ==================================================================== //
+
+/**
+ * @brief 按主机 CPU 特性选择执行函数（可重复调用，只选择一次）
+ */
+void bitmanip_init();
+
+/**
+ * @brief 执行一条位操作指令
+ * @param cpu 中央处理器
+ * @param inst 32-bit 指令数据
+ * @return int 1 成功，0 非法指令
+ */
+int bitmanip_execute(CPU* cpu, u32 inst);
+
+
+#endif // BITMANIP_H
@@ -9,20 +9,228 @@
  */
 
 
+#define _GNU_SOURCE
 #include "bus.h"
 #include "log.h"
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+// ==================================================================== //
+//                            Private Func: BUS
+// ==================================================================== //
+
+/**
+ * @brief 查找地址所在的设备
+ * @param bus 总线
+ * @param addr 来宾物理地址
+ * @return DEV* 设备，未找到返回`NULL`
+ */
+static inline DEV* bus_find_device(BUS* bus, u64 addr) {
+    for (int i = 0; i < bus->ndev; i++) {
+        DEV* dev = &bus->devs[i];
+        if (addr >= dev->base && addr - dev->base < dev->size)
+            return dev;
+    }
+    return NULL;
+}
+
+/**
+ * @brief 取得处理器的唤醒描述符，第一次使用时创建。
+ * 等待方与唤醒方都可能先到，以 CAS 安装保证双方用同一个 eventfd，唤醒计数不会丢失。
+ * @return int eventfd，失败返回 -1
+ */
+static int bus_wake_fd(BUS* bus, int hart) {
+    int fd = __atomic_load_n(&bus->wake_fd[hart], __ATOMIC_ACQUIRE);
+    if (fd >= 0)
+        return fd;
+    int nfd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (nfd < 0) {
+        log_error("Bus wake eventfd failed");
+        return -1;
+    }
+    int expect = -1;
+    if (__atomic_compare_exchange_n(&bus->wake_fd[hart], &expect, nfd, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+        return nfd;
+    close(nfd);
+    return expect;
+}
+
+/** 轮询用的描述符：暂停的为 -1，`poll()`忽略它 */
+static inline int bus_poll_fd(BUS* bus, int i) {
+    return __atomic_load_n(&bus->polls[i].paused, __ATOMIC_RELAXED) ? -1 : bus->polls[i].fd;
+}
+
 
 // ==================================================================== //
 //                            Func API: BUS
 // ==================================================================== //
 
+void bus_init(BUS* bus, int nhart) {
+    dram_init(&bus->dram);
+    bus->ndev = 0;
+    bus->npoll = 0;
+    bus->irq_pending = 0;
+    bus->nhart = nhart;
+    bus->sleeping = 0;
+    bus->halt = 0;
+    pthread_mutex_init(&bus->dev_lock, NULL);
+    for (int i = 0; i < BUS_MAX_HART; i++)
+        bus->wake_fd[i] = -1;
+}
+
+void bus_free(BUS* bus) {
+    dram_free(&bus->dram);
+    for (int i = 0; i < BUS_MAX_HART; i++) {
+        if (bus->wake_fd[i] >= 0)
+            close(bus->wake_fd[i]);
+        bus->wake_fd[i] = -1;
+    }
+    pthread_mutex_destroy(&bus->dev_lock);
+    bus->ndev = 0;
+    bus->npoll = 0;
+}
+
 u64 bus_load(BUS* bus, u64 addr, u64 size) {
-    
+    if (addr < DRAM_BASE) {
+        DEV* dev = bus_find_device(bus, addr);
+        if (dev && dev->load) {
+            pthread_mutex_lock(&bus->dev_lock);
+            u64 v = dev->load(dev->opaque, addr - dev->base, size);
+            pthread_mutex_unlock(&bus->dev_lock);
+            return v;
+        }
+        log_error("Bus load fault: (0x%.8lx)", addr);
+        return 0;
+    }
     u64 data_addr = dram_load_data(&(bus->dram), mmu_get_offset(bus->dram.mem_addr, addr), size);
-    log_info("Bus load data addr: (0x%.8x)", data_addr);
+    log_trace("Bus load data addr: (0x%.8x)", data_addr);
     return data_addr;
 }
 
 void bus_store(BUS* bus, u64 addr, u64 size, u64 value) {
+    if (addr < DRAM_BASE) {
+        DEV* dev = bus_find_device(bus, addr);
+        if (dev && dev->store) {
+            pthread_mutex_lock(&bus->dev_lock);
+            dev->store(dev->opaque, addr - dev->base, size, value);
+            pthread_mutex_unlock(&bus->dev_lock);
+        } else
+            log_error("Bus store fault: (0x%.8lx)", addr);
+        return;
+    }
     dram_write_data(&(bus->dram), mmu_get_offset(bus->dram.mem_addr, addr), size, value);
-}
\ No newline at end of file
+}
+
+int bus_add_device(BUS* bus, DEV dev) {
+    if (bus->ndev >= BUS_MAX_DEV) {
+        log_error("Bus device table full: %s", dev.name);
+        return -1;
+    }
+    bus->devs[bus->ndev++] = dev;
+    log_info("Bus add device: %s at (0x%.8lx)", dev.name, dev.base);
+    return 0;
+}
+
+int bus_add_poll(BUS* bus, int fd, dev_poll_t poll, void* opaque) {
+    if (bus->npoll >= BUS_MAX_POLL) {
+        log_error("Bus poll table full");
+        return -1;
+    }
+    bus->polls[bus->npoll++] = (BUS_POLL){ .fd = fd, .opaque = opaque, .poll = poll };
+    return 0;
+}
+
+void bus_pause_poll(BUS* bus, int fd, int paused) {
+    for (int i = 0; i < bus->npoll; i++)
+        if (bus->polls[i].fd == fd)
+            __atomic_store_n(&bus->polls[i].paused, paused, __ATOMIC_RELAXED);
+}
+
+int bus_poll(BUS* bus, int timeout_ms) {
+    if (bus->npoll == 0)
+        return 0;
+    struct pollfd pfds[BUS_MAX_POLL];
+    for (int i = 0; i < bus->npoll; i++)
+        pfds[i] = (struct pollfd){ .fd = bus_poll_fd(bus, i), .events = POLLIN };
+    int n = poll(pfds, bus->npoll, timeout_ms);
+    pthread_mutex_lock(&bus->dev_lock);
+    for (int i = 0; n > 0 && i < bus->npoll; i++) {
+        if (pfds[i].revents & (POLLIN | POLLHUP | POLLERR))
+            bus->polls[i].poll(bus->polls[i].opaque);
+    }
+    pthread_mutex_unlock(&bus->dev_lock);
+    return n;
+}
+
+int bus_wait(BUS* bus, int hart, long timeout_ns) {
+    struct pollfd pfds[BUS_MAX_POLL + 1];
+    int n = hart == 0 ? bus->npoll : 0;     // 设备描述符只由 0 号处理器等待
+    for (int i = 0; i < n; i++)
+        pfds[i] = (struct pollfd){ .fd = bus_poll_fd(bus, i), .events = POLLIN };
+    int wake_fd = bus_wake_fd(bus, hart);
+    pfds[n] = (struct pollfd){ .fd = wake_fd, .events = POLLIN };
+
+    // 先声明睡眠再检查中断：与`bus_raise_irq()`的“先置位再检查睡眠”配对，
+    // 保证二者至少有一方看到对方，不会丢失唤醒
+    u64 bit = (u64)1 << hart;
+    __atomic_or_fetch(&bus->sleeping, bit, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&bus->irq_pending, __ATOMIC_SEQ_CST) || __atomic_load_n(&bus->halt, __ATOMIC_SEQ_CST)) {
+        __atomic_and_fetch(&bus->sleeping, ~bit, __ATOMIC_RELAXED);
+        return 0;
+    }
+    struct timespec ts = { .tv_sec = timeout_ns / 1000000000, .tv_nsec = timeout_ns % 1000000000 };
+    int r = ppoll(pfds, n + 1, timeout_ns < 0 ? NULL : &ts, NULL);
+    __atomic_and_fetch(&bus->sleeping, ~bit, __ATOMIC_RELAXED);
+
+    if (r > 0 && n > 0) {
+        pthread_mutex_lock(&bus->dev_lock);
+        for (int i = 0; i < n; i++) {
+            if (pfds[i].revents & (POLLIN | POLLHUP | POLLERR))
+                bus->polls[i].poll(bus->polls[i].opaque);
+        }
+        pthread_mutex_unlock(&bus->dev_lock);
+    }
+    if (r > 0 && (pfds[n].revents & POLLIN)) {
+        u64 cnt;
+        if (read(wake_fd, &cnt, sizeof(cnt)) < 0)
+            log_warn("Bus wake read failed");
+    }
+    return r < 0 ? 0 : r;
+}
+
+void bus_wake_hart(BUS* bus, int hart) {
+    // eventfd 计数保留到下次等待：即使目标尚未进入`bus_wait()`也不会丢失唤醒
+    u64 one = 1;
+    if (write(bus_wake_fd(bus, hart), &one, sizeof(one)) < 0)
+        log_warn("Bus wake failed");
+}
+
+void bus_wake(BUS* bus) {
+    for (int i = 0; i < bus->nhart; i++)
+        bus_wake_hart(bus, i);
+}
+
+void bus_halt(BUS* bus) {
+    __atomic_store_n(&bus->halt, 1, __ATOMIC_SEQ_CST);
+    // 还没有唤醒描述符的处理器会在安装描述符之后、睡眠之前看到 halt，无需为它创建
+    u64 one = 1;
+    for (int i = 0; i < bus->nhart; i++) {
+        int fd = __atomic_load_n(&bus->wake_fd[i], __ATOMIC_SEQ_CST);
+        if (fd >= 0 && write(fd, &one, sizeof(one)) < 0)
+            log_warn("Bus wake failed");
+    }
+}
+
+void bus_raise_irq(BUS* bus, u32 irq) {
+    __atomic_or_fetch(&bus->irq_pending, (u64)1 << irq, __ATOMIC_SEQ_CST);
+    u64 sleeping = __atomic_load_n(&bus->sleeping, __ATOMIC_SEQ_CST);
+    for (int i = 0; sleeping; i++, sleeping >>= 1)
+        if (sleeping & 1)
+            bus_wake_hart(bus, i);
+}
+
+void bus_lower_irq(BUS* bus, u32 irq) {
+    __atomic_and_fetch(&bus->irq_pending, ~((u64)1 << irq), __ATOMIC_RELEASE);
+}
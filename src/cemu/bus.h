@@ -12,6 +12,21 @@
  * 宽总线（对于 64 位实现）。
  * - 本例中的总线连接 CPU 与 DRAM。因此我们编写的总线结构
  * 有一个 DRAM 对象，表示我们要连接到的 DRAM。
+ *
+ * - 除 DRAM 外，总线上还可以挂载内存映射 I/O 设备（`DEV`）：
+ * 不落在 DRAM 范围内的访问按地址分发给对应设备的`load`/`store`回调。
+ * 设备若有需要等待的主机文件描述符（socket、eventfd 等），
+ * 可通过`bus_add_poll()`注册，由执行循环定期调用`bus_poll()`处理。
+ * 设备中断以位图形式记录在`irq_pending`中。
+ *
+ * - 处理器执行`WFI`时调用`bus_wait()`阻塞主机线程，直到下列事件之一发生：
+ * 1. 已注册的描述符可读（设备 I/O，只由 0 号处理器等待）；
+ * 2. 到达超时（下一个定时器截止时间）；
+ * 3. 其它线程置起中断或调用`bus_wake()`/`bus_wake_hart()`（每个处理器一个`wake_fd`）。
+ * `wake_fd`在第一次等待或唤醒时才创建，从不睡眠的实例不占用描述符。
+ *
+ * - 总线由所有处理器线程共享：DRAM 访问不加锁（见`dram.c`），
+ * 设备回调（MMIO 读写与描述符就绪回调）在`dev_lock`下串行执行，设备实现无需考虑并发。
  */
 
 
@@ -24,13 +39,63 @@
 
 
 #include "mmu.h"
+#include <pthread.h>
+
+// ==================================================================== //
+//                              Defines
+// ==================================================================== //
+
+#define BUS_MAX_DEV         16      /** 总线最多挂载的设备数 */
+#define BUS_MAX_POLL        16      /** 总线最多注册的轮询描述符数 */
+#define BUS_POLL_INTERVAL   4096    /** 执行循环每隔多少条指令轮询一次 */
+#define BUS_MAX_HART        32      /** 总线最多连接的处理器数 */
+
 
 // ==================================================================== //
 //                             Data: BUS
 // ==================================================================== //
 
+/** 设备读回调：offset 为相对设备基址的偏移，size 为位数 */
+typedef u64 (*dev_load_t)(void* opaque, u64 offset, u64 size);
+/** 设备写回调：offset 为相对设备基址的偏移，size 为位数 */
+typedef void (*dev_store_t)(void* opaque, u64 offset, u64 size, u64 value);
+/** 轮询回调：描述符可读时调用 */
+typedef void (*dev_poll_t)(void* opaque);
+
+/**
+ * @brief 内存映射 I/O 设备
+ */
+typedef struct DEV_t {
+    char* name;         /** 设备名 */
+    u64 base;           /** 来宾物理基址 */
+    u64 size;           /** 地址空间大小 */
+    void* opaque;       /** 设备私有数据 */
+    dev_load_t load;    /** 读回调 */
+    dev_store_t store;  /** 写回调 */
+} DEV;
+
+/**
+ * @brief 轮询描述符
+ */
+typedef struct BUS_POLL_t {
+    int fd;             /** 主机文件描述符 */
+    void* opaque;       /** 设备私有数据 */
+    dev_poll_t poll;    /** 可读回调 */
+    int paused;         /** 暂停：不等待也不回调，见`bus_pause_poll()` */
+} BUS_POLL;
+
 typedef struct BUS_t {
-    DRAM dram;          /** 动态随机存取存储器 */
+    DRAM dram;                      /** 动态随机存取存储器 */
+    DEV devs[BUS_MAX_DEV];          /** 内存映射设备 */
+    int ndev;                       /** 设备个数 */
+    BUS_POLL polls[BUS_MAX_POLL];   /** 轮询描述符 */
+    int npoll;                      /** 轮询描述符个数 */
+    u64 irq_pending;                /** 待处理中断位图 */
+    int nhart;                      /** 处理器个数 */
+    int wake_fd[BUS_MAX_HART];      /** 每个处理器的唤醒 eventfd，-1 表示尚未创建 */
+    u64 sleeping;                   /** 正阻塞在`bus_wait()`中的处理器位图 */
+    int halt;                       /** 机器停止：所有处理器退出执行循环 */
+    pthread_mutex_t dev_lock;       /** 串行化设备回调 */
 } BUS;
 
 
@@ -38,6 +103,19 @@ typedef struct BUS_t {
 //                            Declare API: BUS
 // ==================================================================== //
 
+/**
+ * @brief 初始化总线：初始化 DRAM，清空设备与轮询表
+ * @param bus 总线
+ * @param nhart 处理器个数（1 ~ BUS_MAX_HART）
+ */
+void bus_init(BUS* bus, int nhart);
+
+/**
+ * @brief 释放总线：释放 DRAM 与唤醒描述符（设备由各自的所有者释放）
+ * @param bus 总线
+ */
+void bus_free(BUS* bus);
+
 /**
  * @brief 总线加载数据
  * @param bus 总线
@@ -56,5 +134,83 @@ u64 bus_load(BUS* bus, u64 addr, u64 size);
  */
 void bus_store(BUS* bus, u64 addr, u64 size, u64 value);
 
+/**
+ * @brief 总线挂载内存映射设备
+ * @param bus 总线
+ * @param dev 设备描述（按值复制）
+ * @return int 0 成功，-1 失败
+ */
+int bus_add_device(BUS* bus, DEV dev);
+
+/**
+ * @brief 总线注册轮询描述符
+ * @param bus 总线
+ * @param fd 主机文件描述符
+ * @param poll 可读回调
+ * @param opaque 设备私有数据
+ * @return int 0 成功，-1 失败
+ */
+int bus_add_poll(BUS* bus, int fd, dev_poll_t poll, void* opaque);
+
+/**
+ * @brief 暂停或恢复轮询描述符：设备暂时无法消费输入（如接收队列没有缓冲区）时暂停，
+ * 否则描述符一直可读，等待它的处理器会空转；设备能够消费时再恢复
+ * @param bus 总线
+ * @param fd 已注册的主机文件描述符
+ * @param paused 1 暂停，0 恢复
+ */
+void bus_pause_poll(BUS* bus, int fd, int paused);
+
+/**
+ * @brief 总线轮询已注册的描述符，并调用就绪者的回调
+ * @param bus 总线
+ * @param timeout_ms 超时（毫秒），0 表示不阻塞，-1 表示一直等待
+ * @return int 就绪描述符个数
+ */
+int bus_poll(BUS* bus, int timeout_ms);
+
+/**
+ * @brief 阻塞等待设备 I/O、超时或唤醒，并调用就绪描述符的回调。
+ * 若已有待处理中断或机器已停止则立即返回。
+ * @param bus 总线
+ * @param hart 处理器编号，只有 0 号处理器等待设备描述符
+ * @param timeout_ns 超时（纳秒），-1 表示一直等待
+ * @return int 就绪描述符个数（含唤醒）
+ */
+int bus_wait(BUS* bus, int hart, long timeout_ns);
+
+/**
+ * @brief 唤醒所有阻塞在`bus_wait()`中的处理器（可在任意线程调用）
+ * @param bus 总线
+ */
+void bus_wake(BUS* bus);
+
+/**
+ * @brief 唤醒指定处理器（可在任意线程调用）
+ * @param bus 总线
+ * @param hart 处理器编号
+ */
+void bus_wake_hart(BUS* bus, int hart);
+
+/**
+ * @brief 停止机器：置起`halt`并唤醒所有处理器
+ * @param bus 总线
+ */
+void bus_halt(BUS* bus);
+
+/**
+ * @brief 设备置起中断
+ * @param bus 总线
+ * @param irq 中断号（0 ~ 63）
+ */
+void bus_raise_irq(BUS* bus, u32 irq);
+
+/**
+ * @brief 设备清除中断
+ * @param bus 总线
+ * @param irq 中断号（0 ~ 63）
+ */
+void bus_lower_irq(BUS* bus, u32 irq);
+
 
 #endif // BUS_H
\ No newline at end of file
@@ -16,13 +16,38 @@
 //                                Include
 // ==================================================================== //
 
-#include "cpu.h"
+#include "machine.h"
+#include "batch.h"
+#include "forksrv.h"
+#include "snapshot.h"
 #include "loader.h"
+#include "chan.h"
+#include "rdev.h"
+#include "vnet.h"
+#include "vblk.h"
+#include "unit.h"
 #include "utils.h"
+#include <dirent.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
 
 // 测试
 void run_unit_test() {
-    // test
+    ut_run_test(fpu_det);
+    ut_run_test(fpu_rm);
+    ut_run_test(lrsc_smp);
+    ut_run_test(lrsc_word);
+    ut_run_test(rvv_known);
+    ut_run_test(zb_known);
+    ut_run_test(zk_known);
+    ut_run_test(rv32_elf);
+    ut_run_test(chan_guard);
+    ut_run_test(rdev_reply_fds);
+    ut_run_test(vnet_switch_fd);
+    ut_run_test(vnet_rx_pause);
+    ut_run_test(disk_validate);
+    ut_run_test(vblk_rw);
     ut_print_test();
 }
 
@@ -38,6 +63,27 @@ void run_command_callback(char *args, CPU *cpu) {
     cpu_step(cpu, -1);
 }
 
+/**
+ * @brief 快照命令：`snapshot save <file>`或`snapshot load <file>`，
+ * 恢复成功后以快照中的机器替换当前机器，失败时保留当前机器
+ */
+void snapshot_command_callback(char *args, char *path, MACHINE **m) {
+    if (args && path && strcmp(args, "save") == 0) {
+        snapshot_save(*m, path);
+    } else if (args && path && strcmp(args, "load") == 0) {
+        MACHINE* restored = malloc(sizeof(MACHINE));
+        if (restored && snapshot_load(restored, path) == 0) {
+            machine_free(*m);
+            free(*m);
+            *m = restored;
+        } else {
+            free(restored);
+        }
+    } else {
+        log_warn("usage: snapshot save|load <file>");
+    }
+}
+
 void step_command_callback(char *args, CPU *cpu) {
     if(args != NULL && strlen(args) > 0){
         if(!cpu_step(cpu, atoi(args))) 
@@ -53,13 +99,59 @@ void step_command_callback(char *args, CPU *cpu) {
 //                        Argparse Command Callback
 // ==================================================================== //
 
+/**
+ * @brief 命令行中`--`之后的来宾程序参数：`arg_parser()`只把`--`之前的部分交给解析器，
+ * 回调收到的`argv[argc]`因此为`--`，其后直到`NULL`即为来宾参数
+ * @return char** 以`NULL`结尾的参数，没有`--`时返回`NULL`
+ */
+static inline char** cemu_guest_args(int argc, char *argv[]) {
+    return argv[argc] ? argv + argc + 1 : NULL;
+}
+
 ap_def_callback(default_callback) {
     if(argc <= 1) {
         log_error("No input file");
         exit(-1);
     }
-    CPU cpu;
-    cpu_loop(&cpu, ap_get("input")->value);
+    static MACHINE m;
+    int trace = ap_get("trace")->value ? atoi(ap_get("trace")->value) : ap_get("trace")->init.i;
+    log_set_trace(trace != 0);
+    int nhart = ap_get("smp")->value ? atoi(ap_get("smp")->value) : ap_get("smp")->init.i;
+    machine_init(&m, nhart);
+    int quantum = ap_get("det")->value ? atoi(ap_get("det")->value) : ap_get("det")->init.i;
+    machine_set_quantum(&m, quantum > 0 ? quantum : 0);
+    CHAN chan;
+    char* chan_path = ap_get("chan")->value;
+    if (chan_path && (chan_init(&chan, &m.bus, 0) < 0 || chan_listen(&chan, chan_path) < 0))
+        exit(-1);
+    RDEV rdev;
+    char* rdev_path = ap_get("rdev")->value;
+    if (rdev_path && rdev_connect(&rdev, &m.bus, rdev_path, RDEV_MMIO_BASE, RDEV_IRQ) < 0)
+        exit(-1);
+    static VNET net;
+    static u8 net_mac[6] = { 0x52, 0x54, 0x00, 0x12, 0x34, 0x56 };
+    char* net_path = ap_get("net")->value;
+    if (net_path && (vnet_init(&net, &m.bus, VNET_MMIO_BASE, VNET_IRQ, net_mac) < 0 || vnet_connect(&net, net_path) < 0))
+        exit(-1);
+    static VBLK blk;
+    char* disk_path = ap_get("disk")->value;
+    if (disk_path && vblk_init(&blk, &m.bus, VBLK_MMIO_BASE, VBLK_IRQ, disk_path) < 0)
+        exit(-1);
+    char* env = ap_get("env")->value ? ap_get("env")->value : ap_get("env")->init.s;
+    if (strcmp(env, "host") != 0 && strcmp(env, "none") != 0) {
+        log_error("Unknown environment: %s (host or none)", env);
+        exit(-1);
+    }
+    proc_set_args(&m.proc, cemu_guest_args(argc, argv), strcmp(env, "host") == 0 ? envp : NULL);
+    if (machine_load_elf(&m, ap_get("input")->value) < 0)
+        exit(1);
+    machine_run(&m);
+    // Linux 用户程序：以客户机退出码（a0）作为进程退出码
+    int code = m.proc.user ? (int)(u8)m.harts[0]->regs[10] : 0;
+    if (disk_path)
+        vblk_close(&blk);
+    machine_free(&m);
+    exit(code);
 }
 
 ap_def_callback(hello_callback) {
@@ -90,20 +182,273 @@ ap_def_callback(test_callback) {
     printf("set quiet: %d\n", q_l);
     ut_set_quiet(q_l);
     run_unit_test();
+    printf("\n");
+    exit(ut.n_fail > 0);
+}
+
+/**
+ * @brief 数据通道主机工具：标准输入写入 h2g 环，g2h 环写到标准输出
+ */
+ap_def_callback(chan_callback) {
+    CHAN_HOST host;
+    char* path = ap_get("input")->value;
+    if (!path || chan_connect(&host, path) < 0) {
+        log_error("No data channel socket");
+        exit(-1);
+    }
+    static u8 ibuf[65536], obuf[65536];
+    size_t ipos = 0, ilen = 0;
+    int in_eof = 0, closed = 0;
+    u64 one = 1;
+    while (!chan_ring_eof(host.shm, CHAN_RING_G2H)) {
+        int kick = 0;
+        // 1. 标准输入 -> h2g
+        if (ipos < ilen) {
+            size_t n = chan_ring_write(host.shm, CHAN_RING_H2G, ibuf + ipos, ilen - ipos);
+            ipos += n;
+            kick |= n > 0;
+        }
+        if (in_eof && ipos == ilen && !closed) {
+            chan_ring_close(host.shm, CHAN_RING_H2G);
+            closed = kick = 1;
+        }
+        // 2. g2h -> 标准输出
+        size_t n;
+        while ((n = chan_ring_read(host.shm, CHAN_RING_G2H, obuf, sizeof(obuf))) > 0) {
+            fwrite(obuf, 1, n, stdout);
+            kick = 1;
+        }
+        fflush(stdout);
+        if (kick && write(host.kick_fd, &one, sizeof(one)) < 0)
+            break;
+        // 3. 等待标准输入或来宾门铃
+        struct pollfd pfds[2] = {
+            { .fd = host.call_fd, .events = POLLIN },
+            { .fd = (ipos == ilen && !in_eof) ? 0 : -1, .events = POLLIN },
+        };
+        if (poll(pfds, 2, -1) < 0)
+            break;
+        if (pfds[0].revents & POLLIN) {
+            u64 cnt;
+            if (read(host.call_fd, &cnt, sizeof(cnt)) < 0)
+                break;
+        }
+        if (pfds[1].revents & (POLLIN | POLLHUP)) {
+            ssize_t r = read(0, ibuf, sizeof(ibuf));
+            if (r <= 0)
+                in_eof = 1;
+            else
+                ipos = 0, ilen = r;
+        }
+    }
+    chan_disconnect(&host);
+}
+
+/**
+ * @brief 批量运行：清单中的每个任务在独立的机器上运行，结果按 JSON 行输出
+ */
+ap_def_callback(batch_callback) {
+    static BATCH batch;
+    char* path = ap_get("input")->value;
+    if (!path || batch_load(&batch, path) < 0) {
+        log_error("No batch manifest");
+        exit(-1);
+    }
+    batch.nhart = ap_get("smp")->value ? atoi(ap_get("smp")->value) : ap_get("smp")->init.i;
+    int quantum = ap_get("det")->value ? atoi(ap_get("det")->value) : ap_get("det")->init.i;
+    batch.quantum = quantum > 0 ? quantum : 0;
+    int nworker = ap_get("jobs")->value ? atoi(ap_get("jobs")->value) : ap_get("jobs")->init.i;
+    char* out_path = ap_get("output")->value ? ap_get("output")->value : ap_get("output")->init.s;
+    FILE* out = strcmp(out_path, "-") == 0 ? stdout : fopen(out_path, "w");
+    if (!out) {
+        log_error("Unable to open %s", out_path);
+        exit(-1);
+    }
+    batch_run(&batch, nworker, out);
+    if (out != stdout)
+        fclose(out);
+    batch_free(&batch);
+}
+
+/**
+ * @brief 预启动服务：执行到启动点后，每个请求 fork 一个子进程从快照继续执行
+ */
+ap_def_callback(serve_callback) {
+    static FORKSRV srv;
+    char* elf = ap_get("input")->value;
+    char* path = ap_get("listen")->value ? ap_get("listen")->value : ap_get("listen")->init.s;
+    char* at = ap_get("at")->value ? ap_get("at")->value : ap_get("at")->init.s;
+    int nhart = ap_get("smp")->value ? atoi(ap_get("smp")->value) : ap_get("smp")->init.i;
+    int quantum = ap_get("det")->value ? atoi(ap_get("det")->value) : ap_get("det")->init.i;
+    int count = ap_get("count")->value ? atoi(ap_get("count")->value) : ap_get("count")->init.i;
+    int jobs = ap_get("jobs")->value ? atoi(ap_get("jobs")->value) : ap_get("jobs")->init.i;
+    int timeout = ap_get("timeout")->value ? atoi(ap_get("timeout")->value) : ap_get("timeout")->init.i;
+    char* out_path = ap_get("output")->value ? ap_get("output")->value : ap_get("output")->init.s;
+    if (!elf) {
+        log_error("No input ELF");
+        exit(-1);
+    }
+    if (strcmp(at, "entry") != 0 && strcmp(at, "marker") != 0) {
+        log_error("Unknown fork point %s, expect entry or marker", at);
+        exit(-1);
+    }
+    FILE* out = strcmp(out_path, "-") == 0 ? stdout : fopen(out_path, "a");
+    if (!out) {
+        log_error("Unable to open %s", out_path);
+        exit(-1);
+    }
+    int ret = forksrv_init(&srv, elf, nhart, quantum > 0 ? quantum : 0,
+                           strcmp(at, "marker") == 0 ? FORKSRV_AT_MARKER : FORKSRV_AT_ENTRY);
+    if (ret == 0)
+        ret = forksrv_serve(&srv, path, count, jobs, timeout > 0 ? timeout : 0, out);
+    if (out != stdout)
+        fclose(out);
+    forksrv_free(&srv);
+    if (ret < 0)
+        exit(-1);
+}
+
+/**
+ * @brief 快照：`-w`启动 ELF（可执行到标记指令）后保存快照，
+ * `-r`从快照恢复并运行`count`次，报告每次恢复的耗时
+ */
+ap_def_callback(snapshot_callback) {
+    static MACHINE m;
+    char* elf = ap_get("input")->value;
+    char* save = ap_get("save")->value;
+    char* load = ap_get("load")->value;
+    char* at = ap_get("at")->value ? ap_get("at")->value : ap_get("at")->init.s;
+    int count = ap_get("count")->value ? atoi(ap_get("count")->value) : ap_get("count")->init.i;
+    if (!save == !load) {
+        log_error("Expect exactly one of --save or --load");
+        exit(-1);
+    }
+    if (save) {
+        if (!elf || access(elf, R_OK) != 0) {
+            log_error("No input ELF");
+            exit(-1);
+        }
+        int nhart = ap_get("smp")->value ? atoi(ap_get("smp")->value) : ap_get("smp")->init.i;
+        int quantum = ap_get("det")->value ? atoi(ap_get("det")->value) : ap_get("det")->init.i;
+        machine_init(&m, nhart);
+        machine_set_quantum(&m, quantum > 0 ? quantum : 0);
+        int ret = machine_load_elf(&m, elf);
+        if (ret == 0 && strcmp(at, "marker") == 0)
+            ret = machine_run_to_marker(&m);
+        if (ret == 0)
+            ret = snapshot_save(&m, save);
+        machine_free(&m);
+        if (ret < 0)
+            exit(-1);
+        return;
+    }
+    u64 restore_ns = 0;
+    int64_t code = 0;
+    for (int i = 0; i < MAX(count, 1); i++) {
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        if (snapshot_load(&m, load) < 0)
+            exit(-1);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        restore_ns += (t1.tv_sec - t0.tv_sec) * 1000000000 + t1.tv_nsec - t0.tv_nsec;
+        machine_run(&m);
+        code = (int64_t)m.harts[0]->regs[10];
+        machine_free(&m);
+    }
+    printf("snapshot: %d runs, %lu ns/restore, last a0 %ld\n", MAX(count, 1), restore_ns / MAX(count, 1), code);
+}
+
+/**
+ * @brief 进程私有内存（匿名页、共享内存页与页表）的大小，单位 KB
+ */
+static long footprint_private_kb() {
+    char line[256];
+    long total = 0, v;
+    FILE* f = fopen("/proc/self/status", "r");
+    if (!f)
+        return 0;
+    while (fgets(line, sizeof(line), f)) {
+        if ((strncmp(line, "RssAnon:", 8) == 0 || strncmp(line, "RssShmem:", 9) == 0
+             || strncmp(line, "VmPTE:", 6) == 0) && sscanf(strchr(line, ':') + 1, "%ld", &v) == 1)
+            total += v;
+    }
+    fclose(f);
+    return total;
+}
+
+static int footprint_nfd() {
+    int n = 0;
+    DIR* d = opendir("/proc/self/fd");
+    if (!d)
+        return 0;
+    while (readdir(d))
+        n++;
+    closedir(d);
+    return n;
+}
+
+/**
+ * @brief 创建块设备的写时复制覆盖镜像（见`disk.h`）
+ */
+ap_def_callback(mkdisk_callback) {
+    char* path = ap_get("output")->value;
+    char* base = ap_get("base")->value;
+    u64 size = ap_get("size")->value ? strtoull(ap_get("size")->value, NULL, 0) : 0;
+    int bits = ap_get("cluster")->value ? atoi(ap_get("cluster")->value) : ap_get("cluster")->init.i;
+    if (!path) {
+        log_error("No overlay path, use: -o <overlay>");
+        exit(-1);
+    }
+    if (disk_create(path, base, size, bits) < 0)
+        exit(-1);
+}
+
+/**
+ * @brief 测量空闲实例的开销：创建`count`台（可选加载同一 ELF 的）机器，
+ * 统计进程私有内存与描述符的增量；设置`max`时超过该字节数返回失败，可用于回归检查
+ */
+ap_def_callback(footprint_callback) {
+    int count = ap_get("count")->value ? atoi(ap_get("count")->value) : ap_get("count")->init.i;
+    long max = ap_get("max")->value ? atol(ap_get("max")->value) : ap_get("max")->init.i;
+    char* elf = ap_get("input")->value;
+    MACHINE** ms = calloc(count, sizeof(MACHINE*));
+    long kb0 = footprint_private_kb();
+    int fd0 = footprint_nfd();
+    for (int i = 0; i < count; i++) {
+        ms[i] = malloc(sizeof(MACHINE));
+        machine_init(ms[i], 1);
+        if (elf && machine_load_elf(ms[i], elf) < 0)
+            exit(1);
+    }
+    long bytes = (footprint_private_kb() - kb0) * 1024 / MAX(count, 1);
+    int fds = footprint_nfd() - fd0;
+    printf("footprint: %d instances, %ld bytes/instance, %d fds\n", count, bytes, fds);
+    for (int i = 0; i < count; i++) {
+        machine_free(ms[i]);
+        free(ms[i]);
+    }
+    free(ms);
+    if (max > 0 && bytes > max) {
+        log_error("Footprint %ld bytes/instance exceeds %ld", bytes, max);
+        exit(1);
+    }
 }
 
 ap_def_callback(debug_callback) {
 
-    CPU cpu;
-    // 1. 初始化：cpu, 寄存器 regs 和程序计数器 pc
-    cpu_init(&cpu);
+    // 1. 初始化：单处理器机器，寄存器 regs 和程序计数器 pc；调试模式打开逐条指令跟踪
+    log_set_trace(true);
+    MACHINE* m = malloc(sizeof(MACHINE));
+    machine_init(m, 1);
+    CPU* cpu = m->harts[0];
     // 2. 加载文件
     if(!ap_get("input")->value) {
         char* default_input = "./test/temp_02.out";
         log_warn("No input file, use: %s", default_input);
-        load_elf(&cpu, default_input);
-    } else {
-        load_elf(&cpu, ap_get("input")->value);
+        if (load_elf(cpu, default_input) < 0)
+            exit(1);
+    } else if (load_elf(cpu, ap_get("input")->value) < 0) {
+        exit(1);
     }
     linenoiseHistoryLoad("history.txt"); // Load command history from file
     char *line;
@@ -116,11 +461,14 @@ ap_def_callback(debug_callback) {
             if (strcmp(command, "help") == 0 || strcmp(command, "h" ) == 0) {
                 help_command_callback();
             } else if (strcmp(command, "run" ) == 0 || strcmp(command, "r" ) == 0) {
-                run_command_callback(args, &cpu);
+                run_command_callback(args, cpu);
             } else if (strcmp(command, "step") == 0 || strcmp(command, "si") == 0) {
-                step_command_callback(args, &cpu);
+                step_command_callback(args, cpu);
             } else if (strcmp(command, "load") == 0 || strcmp(command, "l" ) == 0) {
-                load_elf(&cpu, args);
+                load_elf(cpu, args);
+            } else if (strcmp(command, "snapshot") == 0 || strcmp(command, "snap") == 0) {
+                snapshot_command_callback(args, strtok(NULL, " "), &m);
+                cpu = m->harts[0];
             } else if (strcmp(command, "quit") == 0 || strcmp(command, "q" ) == 0) {
                 free(line);
                 log_info("Bye!");
@@ -0,0 +1,355 @@
+/**
+ * @file chan.c
+ * @author lancer (lancerstadium@163.com)
+ * @brief 主机与来宾共享内存数据通道实现
+ * @version 0.1
+ * @date 2024-01-22
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+
+// ==================================================================== //
+//                             Include
+// ==================================================================== //
+
+#define _GNU_SOURCE
+#include "chan.h"
+#include "log.h"
+#include "macro.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <sys/un.h>
+
+
+// ==================================================================== //
+//                          Private Func: CHAN
+// ==================================================================== //
+
+/**
+ * @brief 连接建立时随描述符一起发送的握手信息
+ */
+typedef struct CHAN_HELLO_t {
+    u32 magic;
+    u32 nfds;
+    u64 size;
+} CHAN_HELLO;
+
+static inline CHAN_RING* chan_ring(u8* shm, int ring) {
+    return &((CHAN_SHM_HDR*)shm)->ring[ring];
+}
+
+/**
+ * @brief 共享内存窗口读：来宾直接访问主机映射
+ */
+static u64 chan_shm_load(void* opaque, u64 offset, u64 size) {
+    CHAN* chan = opaque;
+    u8* p = chan->shm + offset;
+    if (offset + size / 8 > chan->size)
+        return 0;
+    switch (size) {
+        case  8: return *p;
+        case 16: return *(u16*)p;
+        case 32: return __atomic_load_n((u32*)p, __ATOMIC_ACQUIRE);
+        case 64: return __atomic_load_n((u64*)p, __ATOMIC_ACQUIRE);
+        default: return 0;
+    }
+}
+
+/**
+ * @brief 来宾能否写共享内存`[offset, offset + len)`：数据区可写；头部页中只有来宾一侧的
+ * 索引字可写（h2g 的`tail`，g2h 的`head`与`closed`），环的几何参数由`chan_init()`设定后对来宾只读
+ */
+static int chan_guest_writable(u64 offset, u64 len) {
+    static const u64 words[3] = {
+        offsetof(CHAN_SHM_HDR, ring[CHAN_RING_H2G].tail),
+        offsetof(CHAN_SHM_HDR, ring[CHAN_RING_G2H].head),
+        offsetof(CHAN_SHM_HDR, ring[CHAN_RING_G2H].closed),
+    };
+    if (offset >= CHAN_PAGE_SIZE)
+        return 1;
+    for (int i = 0; i < 3; i++)
+        if (offset >= words[i] && offset + len <= words[i] + 8)
+            return 1;
+    return 0;
+}
+
+/**
+ * @brief 共享内存窗口写：来宾直接访问主机映射（头部只允许写索引字）
+ */
+static void chan_shm_store(void* opaque, u64 offset, u64 size, u64 value) {
+    CHAN* chan = opaque;
+    u8* p = chan->shm + offset;
+    if (offset + size / 8 > chan->size || !chan_guest_writable(offset, size / 8))
+        return;
+    switch (size) {
+        case  8: *p = value; break;
+        case 16: *(u16*)p = value; break;
+        case 32: __atomic_store_n((u32*)p, value, __ATOMIC_RELEASE); break;
+        case 64: __atomic_store_n((u64*)p, value, __ATOMIC_RELEASE); break;
+        default:;
+    }
+}
+
+static u64 chan_reg_load(void* opaque, u64 offset, u64 size) {
+    CHAN* chan = opaque;
+    switch (offset) {
+        case CHAN_REG_MAGIC:    return CHAN_MAGIC;
+        case CHAN_REG_SHM_BASE: return CHAN_SHM_BASE;
+        case CHAN_REG_SHM_SIZE: return chan->size;
+        case CHAN_REG_ISR:      return __atomic_load_n(&chan->isr, __ATOMIC_ACQUIRE);
+        default:                return 0;
+    }
+}
+
+static void chan_reg_store(void* opaque, u64 offset, u64 size, u64 value) {
+    CHAN* chan = opaque;
+    u64 one = 1;
+    switch (offset) {
+        case CHAN_REG_DOORBELL:
+            if (write(chan->call_fd, &one, sizeof(one)) < 0)
+                log_warn("chan: doorbell failed");
+            break;
+        case CHAN_REG_ACK:
+            if (!__atomic_and_fetch(&chan->isr, ~(u32)value, __ATOMIC_ACQ_REL))
+                bus_lower_irq(chan->bus, CHAN_IRQ);
+            break;
+        default:;
+    }
+}
+
+/**
+ * @brief 主机工具敲门铃：置起来宾中断
+ */
+static void chan_kick_poll(void* opaque) {
+    CHAN* chan = opaque;
+    u64 cnt;
+    if (read(chan->kick_fd, &cnt, sizeof(cnt)) == sizeof(cnt)) {
+        __atomic_or_fetch(&chan->isr, 1, __ATOMIC_RELEASE);
+        bus_raise_irq(chan->bus, CHAN_IRQ);
+    }
+}
+
+/**
+ * @brief 主机工具连接：发送握手信息与描述符后关闭连接
+ */
+static void chan_accept_poll(void* opaque) {
+    CHAN* chan = opaque;
+    int conn = accept(chan->listen_fd, NULL, NULL);
+    if (conn < 0)
+        return;
+    int fds[3] = { chan->memfd, chan->kick_fd, chan->call_fd };
+    CHAN_HELLO hello = { .magic = CHAN_MAGIC, .nfds = 3, .size = chan->size };
+    struct iovec iov = { .iov_base = &hello, .iov_len = sizeof(hello) };
+    union {
+        char buf[CMSG_SPACE(sizeof(fds))];
+        struct cmsghdr align;
+    } u;
+    struct msghdr msg = {
+        .msg_iov = &iov, .msg_iovlen = 1,
+        .msg_control = u.buf, .msg_controllen = sizeof(u.buf),
+    };
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    if (sendmsg(conn, &msg, 0) < 0)
+        log_warn("chan: send fds failed");
+    else
+        log_info("chan: host tool connected");
+    close(conn);
+}
+
+
+// ==================================================================== //
+//                            Func API: CHAN
+// ==================================================================== //
+
+int chan_init(CHAN* chan, BUS* bus, u64 size) {
+    memset(chan, 0, sizeof(CHAN));
+    chan->bus = bus;
+    chan->listen_fd = -1;
+    chan->size = size ? (size + CHAN_PAGE_SIZE - 1) & ~(u64)(CHAN_PAGE_SIZE - 1) : CHAN_DEFAULT_SIZE;
+    u64 ring_size = (chan->size - CHAN_PAGE_SIZE) / 2;
+    // 环大小取 2 的幂，便于取模
+    while (ring_size & (ring_size - 1))
+        ring_size &= ring_size - 1;
+    if (ring_size < CHAN_PAGE_SIZE) {
+        log_error("chan: size too small");
+        return -1;
+    }
+
+    chan->memfd = memfd_create("cemu-chan", MFD_CLOEXEC);
+    if (chan->memfd < 0 || ftruncate(chan->memfd, chan->size) < 0) {
+        log_error("chan: memfd failed");
+        return -1;
+    }
+    chan->shm = mmap(NULL, chan->size, PROT_READ | PROT_WRITE, MAP_SHARED, chan->memfd, 0);
+    if (chan->shm == MAP_FAILED) {
+        log_error("chan: mmap failed");
+        return -1;
+    }
+    chan->kick_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    chan->call_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (chan->kick_fd < 0 || chan->call_fd < 0) {
+        log_error("chan: eventfd failed");
+        return -1;
+    }
+
+    CHAN_SHM_HDR* hdr = (CHAN_SHM_HDR*)chan->shm;
+    hdr->magic = CHAN_MAGIC;
+    hdr->version = 1;
+    hdr->size = chan->size;
+    for (int i = 0; i < 2; i++) {
+        hdr->ring[i].data_off = CHAN_PAGE_SIZE + i * ring_size;
+        hdr->ring[i].data_size = ring_size;
+    }
+
+    if (bus_add_device(bus, (DEV){
+            .name = "chan-regs", .base = CHAN_MMIO_BASE, .size = CHAN_MMIO_SIZE,
+            .opaque = chan, .load = chan_reg_load, .store = chan_reg_store }) < 0
+        || bus_add_device(bus, (DEV){
+            .name = "chan-shm", .base = CHAN_SHM_BASE, .size = chan->size,
+            .opaque = chan, .load = chan_shm_load, .store = chan_shm_store }) < 0
+        || bus_add_poll(bus, chan->kick_fd, chan_kick_poll, chan) < 0)
+        return -1;
+    return 0;
+}
+
+void chan_free(CHAN* chan) {
+    if (chan->shm && chan->shm != MAP_FAILED)
+        munmap(chan->shm, chan->size);
+    if (chan->memfd > 0)
+        close(chan->memfd);
+    if (chan->kick_fd > 0)
+        close(chan->kick_fd);
+    if (chan->call_fd > 0)
+        close(chan->call_fd);
+    if (chan->listen_fd >= 0)
+        close(chan->listen_fd);
+    chan->shm = NULL;
+    chan->memfd = chan->kick_fd = chan->call_fd = chan->listen_fd = -1;
+}
+
+int chan_listen(CHAN* chan, char* path) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        log_error("chan: socket path too long");
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    chan->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (chan->listen_fd < 0
+        || bind(chan->listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0
+        || listen(chan->listen_fd, 4) < 0) {
+        log_error("chan: listen %s failed", path);
+        return -1;
+    }
+    log_info("chan: listening on %s", path);
+    return bus_add_poll(chan->bus, chan->listen_fd, chan_accept_poll, chan);
+}
+
+int chan_connect(CHAN_HOST* host, char* path) {
+    memset(host, 0, sizeof(CHAN_HOST));
+    host->memfd = host->kick_fd = host->call_fd = -1;
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path))
+        return -1;
+    strcpy(addr.sun_path, path);
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0 || connect(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        log_error("chan: connect %s failed", path);
+        if (sock >= 0)
+            close(sock);
+        return -1;
+    }
+
+    CHAN_HELLO hello;
+    int fds[3];
+    struct iovec iov = { .iov_base = &hello, .iov_len = sizeof(hello) };
+    union {
+        char buf[CMSG_SPACE(sizeof(fds))];
+        struct cmsghdr align;
+    } u;
+    struct msghdr msg = {
+        .msg_iov = &iov, .msg_iovlen = 1,
+        .msg_control = u.buf, .msg_controllen = sizeof(u.buf),
+    };
+    ssize_t n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    close(sock);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (n != sizeof(hello) || hello.magic != CHAN_MAGIC || !cmsg
+        || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(sizeof(fds))) {
+        log_error("chan: bad handshake");
+        return -1;
+    }
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+    host->memfd = fds[0];
+    host->kick_fd = fds[1];
+    host->call_fd = fds[2];
+    host->size = hello.size;
+    host->shm = mmap(NULL, host->size, PROT_READ | PROT_WRITE, MAP_SHARED, host->memfd, 0);
+    if (host->shm == MAP_FAILED) {
+        host->shm = NULL;
+        chan_disconnect(host);
+        return -1;
+    }
+    return 0;
+}
+
+void chan_disconnect(CHAN_HOST* host) {
+    if (host->shm)
+        munmap(host->shm, host->size);
+    if (host->memfd >= 0)
+        close(host->memfd);
+    if (host->kick_fd >= 0)
+        close(host->kick_fd);
+    if (host->call_fd >= 0)
+        close(host->call_fd);
+    memset(host, 0, sizeof(CHAN_HOST));
+    host->memfd = host->kick_fd = host->call_fd = -1;
+}
+
+size_t chan_ring_write(u8* shm, int ring, void* buf, size_t len) {
+    CHAN_RING* r = chan_ring(shm, ring);
+    u64 head = r->head;
+    u64 tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+    u64 mask = r->data_size - 1;
+    // 对端可改写索引：已用字节数按数据区大小截断，下标一律取模
+    u64 used = MIN(head - tail, r->data_size);
+    len = MIN(len, r->data_size - used);
+    size_t first = MIN(len, r->data_size - (head & mask));
+    memcpy(shm + r->data_off + (head & mask), buf, first);
+    memcpy(shm + r->data_off, (u8*)buf + first, len - first);
+    __atomic_store_n(&r->head, head + len, __ATOMIC_RELEASE);
+    return len;
+}
+
+size_t chan_ring_read(u8* shm, int ring, void* buf, size_t len) {
+    CHAN_RING* r = chan_ring(shm, ring);
+    u64 tail = r->tail;
+    u64 head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    u64 mask = r->data_size - 1;
+    len = MIN(len, MIN(head - tail, r->data_size));
+    size_t first = MIN(len, r->data_size - (tail & mask));
+    memcpy(buf, shm + r->data_off + (tail & mask), first);
+    memcpy((u8*)buf + first, shm + r->data_off, len - first);
+    __atomic_store_n(&r->tail, tail + len, __ATOMIC_RELEASE);
+    return len;
+}
+
+void chan_ring_close(u8* shm, int ring) {
+    __atomic_store_n(&chan_ring(shm, ring)->closed, 1, __ATOMIC_RELEASE);
+}
+
+int chan_ring_eof(u8* shm, int ring) {
+    CHAN_RING* r = chan_ring(shm, ring);
+    return __atomic_load_n(&r->closed, __ATOMIC_ACQUIRE)
+        && __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == r->tail;
+}
@@ -0,0 +1,207 @@
+/**
+ * @file chan.h
+ * @author lancer (lancerstadium@163.com)
+ * @brief 主机与来宾共享内存数据通道头文件
+ * @version 0.1
+ * @date 2024-01-22
+ * @copyright Copyright (c) 2024
+ *
+ * # 数据通道介绍
+ * - 数据通道是一个半虚拟化设备，用于在主机工具与来宾程序之间批量传输数据，
+ * 不经过串口或磁盘。共享内存由`memfd`创建，模拟器与主机工具分别`mmap`同一块内存，
+ * 来宾则在物理地址`CHAN_SHM_BASE`处直接访问它。
+ *
+ * - 共享内存中有两个单生产者/单消费者环形缓冲区：
+ * ```
+ *
+ *   +-------------------+  CHAN_SHM_BASE
+ *   |   CHAN_SHM_HDR    |  魔数、大小、两个环的 head/tail/closed
+ *   +-------------------+  + CHAN_PAGE_SIZE
+ *   |  ring 0: h2g data |  主机 -> 来宾
+ *   +-------------------+
+ *   |  ring 1: g2h data |  来宾 -> 主机
+ *   +-------------------+
+ *
+ * ```
+ * 生产者写入数据后以 release 语义更新`head`，消费者读完后以 release 语义更新`tail`，
+ * 生产者结束时置`closed`。
+ *
+ * - 来宾对头部页只能写自己一侧的索引字（h2g 的`tail`，g2h 的`head`与`closed`），
+ * 数据区偏移与大小只由`chan_init()`设定；读写环时已用字节数按数据区大小截断、下标取模，
+ * 来宾写入任意索引值也不会越出数据区。
+ *
+ * - 门铃通过`eventfd`完成：
+ * 1. 来宾写 MMIO 寄存器`CHAN_REG_DOORBELL` -> 模拟器写`call_fd` -> 主机工具被唤醒；
+ * 2. 主机工具写`kick_fd` -> 模拟器轮询到后置起中断`CHAN_IRQ`。
+ *
+ * - 主机工具连接`chan_listen()`给出的 Unix socket，
+ * 通过`SCM_RIGHTS`取得 memfd 与两个 eventfd（见`chan_connect()`）。
+ */
+
+
+#ifndef CHAN_H
+#define CHAN_H
+
+// ==================================================================== //
+//                             Include
+// ==================================================================== //
+
+#include "bus.h"
+
+// ==================================================================== //
+//                              Defines
+// ==================================================================== //
+
+#define CHAN_MMIO_BASE      0x10008000  /** 通道寄存器基址 */
+#define CHAN_MMIO_SIZE      0x1000      /** 通道寄存器地址空间大小 */
+#define CHAN_SHM_BASE       0x40000000  /** 共享内存在来宾物理地址空间中的位置 */
+#define CHAN_IRQ            8           /** 通道中断号 */
+#define CHAN_MAGIC          0x6e616863  /** "chan" */
+#define CHAN_PAGE_SIZE      4096
+#define CHAN_DEFAULT_SIZE   (16 * 1024 * 1024)  /** 默认共享内存大小 */
+
+#define CHAN_RING_H2G       0           /** 主机 -> 来宾 */
+#define CHAN_RING_G2H       1           /** 来宾 -> 主机 */
+
+// MMIO 寄存器偏移（均为 64 位）
+#define CHAN_REG_MAGIC      0x00        /** R: CHAN_MAGIC */
+#define CHAN_REG_SHM_BASE   0x08        /** R: 共享内存来宾物理地址 */
+#define CHAN_REG_SHM_SIZE   0x10        /** R: 共享内存大小 */
+#define CHAN_REG_DOORBELL   0x18        /** W: 通知主机 */
+#define CHAN_REG_ISR        0x20        /** R: 中断状态 */
+#define CHAN_REG_ACK        0x28        /** W: 清除中断 */
+
+
+// ==================================================================== //
+//                             Data: CHAN
+// ==================================================================== //
+
+/**
+ * @brief 环形缓冲区头（独占一个缓存行，避免生产者与消费者伪共享）
+ */
+typedef struct CHAN_RING_t {
+    u64 head;           /** 生产者写入总字节数 */
+    u64 pad0[7];
+    u64 tail;           /** 消费者读取总字节数 */
+    u64 pad1[7];
+    u64 data_off;       /** 数据区相对共享内存起始的偏移 */
+    u64 data_size;      /** 数据区大小（2 的幂） */
+    u64 closed;         /** 生产者已结束 */
+    u64 pad2[5];
+} CHAN_RING;
+
+/**
+ * @brief 共享内存头
+ */
+typedef struct CHAN_SHM_HDR_t {
+    u32 magic;          /** CHAN_MAGIC */
+    u32 version;        /** 格式版本 */
+    u64 size;           /** 共享内存总大小 */
+    u64 pad[6];
+    CHAN_RING ring[2];  /** 两个方向的环 */
+} CHAN_SHM_HDR;
+
+/**
+ * @brief 模拟器侧的通道设备
+ */
+typedef struct CHAN_t {
+    BUS* bus;           /** 所在总线 */
+    u8* shm;            /** 共享内存主机映射 */
+    u64 size;           /** 共享内存大小 */
+    int memfd;          /** 共享内存描述符 */
+    int kick_fd;        /** 主机 -> 模拟器门铃（eventfd） */
+    int call_fd;        /** 模拟器 -> 主机门铃（eventfd） */
+    int listen_fd;      /** 导出描述符的 Unix socket，-1 表示无 */
+    u32 isr;            /** 中断状态 */
+} CHAN;
+
+/**
+ * @brief 主机工具侧的通道连接
+ */
+typedef struct CHAN_HOST_t {
+    u8* shm;            /** 共享内存映射 */
+    u64 size;           /** 共享内存大小 */
+    int memfd;          /** 共享内存描述符 */
+    int kick_fd;        /** 通知来宾 */
+    int call_fd;        /** 来宾通知 */
+} CHAN_HOST;
+
+
+// ==================================================================== //
+//                            Declare API: CHAN
+// ==================================================================== //
+
+/**
+ * @brief 创建共享内存与门铃，并将通道挂载到总线
+ * @param chan 通道
+ * @param bus 总线
+ * @param size 共享内存大小，为 0 时取`CHAN_DEFAULT_SIZE`
+ * @return int 0 成功，-1 失败
+ */
+int chan_init(CHAN* chan, BUS* bus, u64 size);
+
+/**
+ * @brief 释放通道的共享内存与描述符（总线释放前调用）
+ * @param chan 通道
+ */
+void chan_free(CHAN* chan);
+
+/**
+ * @brief 在 Unix socket 上导出通道描述符，供主机工具连接
+ * @param chan 通道
+ * @param path socket 路径
+ * @return int 0 成功，-1 失败
+ */
+int chan_listen(CHAN* chan, char* path);
+
+/**
+ * @brief 主机工具连接通道
+ * @param host 主机侧连接
+ * @param path socket 路径
+ * @return int 0 成功，-1 失败
+ */
+int chan_connect(CHAN_HOST* host, char* path);
+
+/**
+ * @brief 主机工具断开通道
+ * @param host 主机侧连接
+ */
+void chan_disconnect(CHAN_HOST* host);
+
+/**
+ * @brief 向环中写入数据（生产者）
+ * @param shm 共享内存起始
+ * @param ring 环编号
+ * @param buf 数据
+ * @param len 长度
+ * @return size_t 实际写入字节数（环满时可能小于 len）
+ */
+size_t chan_ring_write(u8* shm, int ring, void* buf, size_t len);
+
+/**
+ * @brief 从环中读取数据（消费者）
+ * @param shm 共享内存起始
+ * @param ring 环编号
+ * @param buf 缓冲区
+ * @param len 长度
+ * @return size_t 实际读取字节数（环空时可能为 0）
+ */
+size_t chan_ring_read(u8* shm, int ring, void* buf, size_t len);
+
+/**
+ * @brief 标记环的生产者已结束
+ * @param shm 共享内存起始
+ * @param ring 环编号
+ */
+void chan_ring_close(u8* shm, int ring);
+
+/**
+ * @brief 判断环是否已结束且读空
+ * @param shm 共享内存起始
+ * @param ring 环编号
+ * @return int 1 已结束
+ */
+int chan_ring_eof(u8* shm, int ring);
+
+
+#endif // CHAN_H
@@ -0,0 +1,137 @@
+/**
+ * @file clint.c
+ * @author lancer (lancerstadium@163.com)
+ * @brief 核心本地中断器（定时器）实现
+ * @version 0.1
+ * @date 2024-01-24
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+
+// ==================================================================== //
+//                             Include
+// ==================================================================== //
+
+#include "clint.h"
+#include "csr.h"
+#include <time.h>
+
+
+// ==================================================================== //
+//                          Private Func: CLINT
+// ==================================================================== //
+
+#define NS_PER_TICK (1000000000 / CLINT_FREQ)
+
+static inline u64 clint_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @brief 读取 64 位寄存器中的一部分（支持 32 位访问高低半字）
+ */
+static inline u64 clint_reg_load(u64 reg, u64 shift, u64 size) {
+    reg >>= shift;
+    return size < 64 ? reg & (((u64)1 << size) - 1) : reg;
+}
+
+static inline u64 clint_reg_store(u64 reg, u64 shift, u64 size, u64 value) {
+    u64 mask = (size < 64 ? ((u64)1 << size) - 1 : ~(u64)0) << shift;
+    return (reg & ~mask) | ((value << shift) & mask);
+}
+
+/**
+ * @note 设备回调在总线的`dev_lock`下执行；处理器线程在`WFI`中不加锁读取
+ * `msip`/`mtimecmp`，因此这两项用原子读写。
+ */
+static u64 clint_load(void* opaque, u64 offset, u64 size) {
+    CLINT* clint = opaque;
+    u64 nhart = clint->bus->nhart;
+    if (offset < CLINT_MSIP + 4 * nhart)
+        return clint->msip[offset / 4];
+    if (offset >= CLINT_MTIMECMP && offset < CLINT_MTIMECMP + 8 * nhart) {
+        u64 hart = (offset - CLINT_MTIMECMP) / 8;
+        return clint_reg_load(clint->mtimecmp[hart], (offset - CLINT_MTIMECMP - hart * 8) * 8, size);
+    }
+    if (offset >= CLINT_MTIME && offset < CLINT_MTIME + 8)
+        return clint_reg_load(clint_mtime(clint), (offset - CLINT_MTIME) * 8, size);
+    return 0;
+}
+
+static void clint_store(void* opaque, u64 offset, u64 size, u64 value) {
+    CLINT* clint = opaque;
+    u64 nhart = clint->bus->nhart;
+    if (offset < CLINT_MSIP + 4 * nhart) {
+        u64 hart = offset / 4;
+        __atomic_store_n(&clint->msip[hart], value & 1, __ATOMIC_SEQ_CST);
+        // 软件中断通常来自其它处理器，需要唤醒睡眠中的目标处理器
+        if (value & 1)
+            bus_wake_hart(clint->bus, hart);
+    } else if (offset >= CLINT_MTIMECMP && offset < CLINT_MTIMECMP + 8 * nhart) {
+        u64 hart = (offset - CLINT_MTIMECMP) / 8;
+        u64 cmp = clint_reg_store(clint->mtimecmp[hart], (offset - CLINT_MTIMECMP - hart * 8) * 8, size, value);
+        __atomic_store_n(&clint->mtimecmp[hart], cmp, __ATOMIC_SEQ_CST);
+        // 目标处理器可能正按旧的截止时间睡眠
+        bus_wake_hart(clint->bus, hart);
+    } else if (offset >= CLINT_MTIME && offset < CLINT_MTIME + 8) {
+        clint_set_mtime(clint, clint_reg_store(clint_mtime(clint), (offset - CLINT_MTIME) * 8, size, value));
+    }
+}
+
+
+// ==================================================================== //
+//                            Func API: CLINT
+// ==================================================================== //
+
+int clint_init(CLINT* clint, BUS* bus) {
+    clint->bus = bus;
+    clint->start_ns = clint_now_ns();
+    clint->virt = 0;
+    clint->vtime = 0;
+    for (int i = 0; i < BUS_MAX_HART; i++) {
+        clint->mtimecmp[i] = ~(u64)0;
+        clint->msip[i] = 0;
+    }
+    return bus_add_device(bus, (DEV){
+        .name = "clint", .base = CLINT_BASE, .size = CLINT_SIZE,
+        .opaque = clint, .load = clint_load, .store = clint_store });
+}
+
+u64 clint_mtime(CLINT* clint) {
+    if (clint->virt)
+        return clint->vtime;
+    return (clint_now_ns() - clint->start_ns) / NS_PER_TICK;
+}
+
+void clint_set_mtime(CLINT* clint, u64 mtime) {
+    if (clint->virt)
+        clint->vtime = mtime;
+    else
+        clint->start_ns = clint_now_ns() - mtime * NS_PER_TICK;
+}
+
+u64 clint_pending(CLINT* clint, int hart) {
+    u64 mip = 0;
+    if (__atomic_load_n(&clint->msip[hart], __ATOMIC_SEQ_CST))
+        mip |= MIP_MSIP;
+    if (clint_mtime(clint) >= __atomic_load_n(&clint->mtimecmp[hart], __ATOMIC_SEQ_CST))
+        mip |= MIP_MTIP;
+    return mip;
+}
+
+long clint_timeout_ns(CLINT* clint, int hart) {
+    u64 cmp = __atomic_load_n(&clint->mtimecmp[hart], __ATOMIC_SEQ_CST);
+    if (cmp == ~(u64)0)
+        return -1;
+    u64 mtime = clint_mtime(clint);
+    if (mtime >= cmp)
+        return 0;
+    u64 ticks = cmp - mtime;
+    // 远期截止时间按“一直等待”处理，避免换算溢出
+    if (ticks > (u64)0x7fffffffffffffff / NS_PER_TICK)
+        return -1;
+    return ticks * NS_PER_TICK;
+}
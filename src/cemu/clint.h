@@ -0,0 +1,110 @@
+/**
+ * @file clint.h
+ * @author lancer (lancerstadium@163.com)
+ * @brief 核心本地中断器（定时器）头文件
+ * @version 0.1
+ * @date 2024-01-24
+ * @copyright Copyright (c) 2024
+ *
+ * # CLINT 介绍
+ * - CLINT（Core Local Interruptor）提供机器模式定时器与软件中断，
+ * 寄存器布局与 SiFive CLINT 一致：
+ * ```
+ *
+ *   0x0000  msip[hart]       软件中断挂起（写 1 置起），每个处理器 4 字节
+ *   0x4000  mtimecmp[hart]   定时器比较值，mtime >= mtimecmp 时定时器中断挂起，每个处理器 8 字节
+ *   0xBFF8  mtime            定时器计数值（频率`CLINT_FREQ`），所有处理器共用
+ *
+ * ```
+ * - 写其它处理器的`msip`或`mtimecmp`时唤醒该处理器，使其按新的状态重新等待。
+ * - `mtime`不逐条指令累加，而是由主机单调时钟换算得到，
+ * 因此处理器在`WFI`中睡眠时时间照常流逝，
+ * 睡眠超时可直接由`mtimecmp`算出（见`clint_timeout_ns()`）。
+ * - 确定性模式下（见`machine_set_quantum()`）改用虚拟时钟：`mtime`取`vtime`，
+ * 由调度器按已调度的指令数推进（每`CLINT_INSN_PER_TICK`条指令一个节拍），与主机时间无关。
+ */
+
+
+#ifndef CLINT_H
+#define CLINT_H
+
+// ==================================================================== //
+//                             Include
+// ==================================================================== //
+
+#include "bus.h"
+
+// ==================================================================== //
+//                              Defines
+// ==================================================================== //
+
+#define CLINT_BASE          0x02000000  /** CLINT 基址 */
+#define CLINT_SIZE          0x10000     /** CLINT 地址空间大小 */
+#define CLINT_MSIP          0x0000      /** 软件中断寄存器偏移 */
+#define CLINT_MTIMECMP      0x4000      /** 定时器比较寄存器偏移 */
+#define CLINT_MTIME         0xBFF8      /** 定时器计数寄存器偏移 */
+#define CLINT_FREQ          10000000    /** mtime 频率：10 MHz */
+#define CLINT_INSN_PER_TICK 10          /** 虚拟时钟下每个节拍的指令数：按 100 MIPS 折算 */
+
+
+// ==================================================================== //
+//                             Data: CLINT
+// ==================================================================== //
+
+/**
+ * @brief 核心本地中断器
+ */
+typedef struct CLINT_t {
+    BUS* bus;                       /** 所在总线 */
+    u64 start_ns;                   /** mtime 为 0 时对应的主机单调时钟 */
+    int virt;                       /** 1：使用虚拟时钟`vtime` */
+    u64 vtime;                      /** 虚拟时钟下的 mtime */
+    u64 mtimecmp[BUS_MAX_HART];     /** 定时器比较值 */
+    u32 msip[BUS_MAX_HART];         /** 软件中断挂起 */
+} CLINT;
+
+
+// ==================================================================== //
+//                            Declare API: CLINT
+// ==================================================================== //
+
+/**
+ * @brief 初始化 CLINT 并挂载到总线
+ * @param clint CLINT
+ * @param bus 总线
+ * @return int 0 成功，-1 失败
+ */
+int clint_init(CLINT* clint, BUS* bus);
+
+/**
+ * @brief 读取当前 mtime
+ * @param clint CLINT
+ * @return u64 mtime
+ */
+u64 clint_mtime(CLINT* clint);
+
+/**
+ * @brief 设置 mtime：虚拟时钟直接赋值，主机时钟调整起点，此后从该值继续计时
+ * @param clint CLINT
+ * @param mtime 新的 mtime
+ */
+void clint_set_mtime(CLINT* clint, u64 mtime);
+
+/**
+ * @brief 查询 CLINT 挂起的中断
+ * @param clint CLINT
+ * @param hart 处理器编号
+ * @return u64 `mip`中的 MSIP/MTIP 位
+ */
+u64 clint_pending(CLINT* clint, int hart);
+
+/**
+ * @brief 距定时器中断挂起还有多久
+ * @param clint CLINT
+ * @param hart 处理器编号
+ * @return long 纳秒；已挂起返回 0，未设置定时器返回 -1
+ */
+long clint_timeout_ns(CLINT* clint, int hart);
+
+
+#endif // CLINT_H
@@ -18,13 +18,20 @@
 
 #include "csr.h"
 #include "opcode.h"
+#include "rvc.h"
+#include "fpu.h"
+#include "rvv.h"
+#include "bitmanip.h"
+#include "crypto.h"
+#include "decode.h"
 #include "utils.h"
+#include <pthread.h>
 
 // ==================================================================== //
 //                                Define
 // ==================================================================== //
 
-#define ADDR_MISALIGNED(addr) (addr & 0x3)
+#define ADDR_MISALIGNED(addr) (addr & 0x1)     // IALIGN = 16（C 扩展）
 #define MAX_CPU_STEP 10
 
 // ==================================================================== //
@@ -39,7 +46,7 @@
  * @return u64 数据
  */
 static inline u64 cpu_load(CPU* cpu, u64 addr, u64 size) {
-    return bus_load(&(cpu->bus), addr, size);
+    return bus_load(cpu->bus, addr + cpu->seg, size);
 }
 
 /**
@@ -50,7 +57,7 @@ static inline u64 cpu_load(CPU* cpu, u64 addr, u64 size) {
  * @param value 数据
  */
 static inline void cpu_store(CPU* cpu, u64 addr, u64 size, u64 value) {
-    bus_store(&(cpu->bus), addr, size, value);
+    bus_store(cpu->bus, addr + cpu->seg, size, value);
 }
 
 /**
@@ -58,7 +65,8 @@ static inline void cpu_store(CPU* cpu, u64 addr, u64 size, u64 value) {
  * @param s 操作码字符串
  */
 static void print_op(char* s) {
-    printf(_blue("%s"), s);
+    if (log_trace_on)
+        printf(_blue("%s"), s);
 }
 
 /**
@@ -69,10 +77,20 @@ static void print_op(char* s) {
 static int cpu_step_one(CPU* cpu) {
     // 取指令 fetch
     u32 inst = cpu_fetch(cpu);
+    // 压缩指令查表扩展为 32 位指令，执行函数与普通指令共用
+    if ((inst & 0x3) != 0x3) {
+        inst = cpu->rvc[inst & 0xffff];
+        cpu->ilen = 2;
+    } else {
+        cpu->ilen = 4;
+    }
     // 增长程序计数器
-    cpu->pc += 4;
-    // 指令执行
-    return cpu_execute(cpu, inst);
+    cpu->pc += cpu->ilen;
+    // 指令执行，cycle/instret 在读 CSR 时由退休数换算
+    if (!cpu_execute(cpu, inst))
+        return 0;
+    cpu->instret++;
+    return 1;
 }
 
 // ==================================================================== //
@@ -106,7 +124,7 @@ static inline u64 imm_B(u32 inst) {
 }
 static inline u64 imm_U(u32 inst) {
     // imm[31:12] = inst[31:12]
-    return (int64_t)(int32_t)(inst & 0xfffff999);
+    return (int64_t)(int32_t)(inst & 0xfffff000);
 }
 static inline u64 imm_J(u32 inst) {
     // imm[20|10:1|11|19:12] = inst[31|30:21|20|19:12]
@@ -117,8 +135,8 @@ static inline u64 imm_J(u32 inst) {
 }
 static inline u32 shamt(u32 inst) {
     // shamt(shift amount) only required for immediate shift instructions
-    // shamt[4:5] = imm[5:0]
-    return (u32) (imm_I(inst) & 0x1f); // TODO: 0x1f / 0x3f ?
+    // shamt[5:0] = imm[5:0]，RV32 形式的 *W 移位只用低 5 位
+    return (u32) (imm_I(inst) & 0x3f);
 }
 
 static inline u64 csr(u32 inst) {
@@ -127,674 +145,227 @@ static inline u64 csr(u32 inst) {
 }
 
 // ==================================================================== //
-//                       CPU Inst Exec: U-type
+//                       CPU Inst Exec: System
 // ==================================================================== //
 
-void exec_LUI(CPU* cpu, u32 inst) {
-    // LUI places upper 20 bits of U-immediate value to rd
-    cpu->regs[rd(inst)] = (u64)(int64_t)(int32_t)(inst & 0xfffff000);
-    print_op("lui\n");
+/**
+ * @note 内存模型：来宾内存的普通访存是主机上的 relaxed 原子访问（见`dram.c`），
+ * `FENCE`不区分前驱/后继集合，一律映射为主机的顺序一致栅栏，
+ * 比 RVWMO 要求的更强；`FENCE.I`共用此编码，没有指令缓存需要同步。
+ * 原子指令的 aq/rl 位映射为 C11 内存序（见下文）。
+ */
+int exec_FENCE(CPU* cpu, u32 inst) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    print_op("fence\n");
+    return 1;
 }
 
-void exec_AUIPC(CPU* cpu, u32 inst) {
-    // AUIPC forms a 32-bit offset from the 20 upper bits 
-    // of the U-immediate
-    u64 imm = imm_U(inst);
-    cpu->regs[rd(inst)] = ((int64_t) cpu->pc + (int64_t) imm) - 4;
-    print_op("auipc\n");
+int exec_ECALL(CPU* cpu, u32 inst) {
+    print_op("ecall\n");
+    if (cpu->proc && cpu->proc->user)
+        return proc_syscall(cpu);
+    return 1;
 }
 
-void exec_JAL(CPU* cpu, u32 inst) {
-    u64 imm = imm_J(inst);
-    cpu->regs[rd(inst)] = cpu->pc;
-    /*print_op("JAL-> rd:%ld, pc:%lx\n", rd(inst), cpu->pc);*/
-    cpu->pc = cpu->pc + (int64_t) imm - 4;
-    print_op("jal\n");
-    if (ADDR_MISALIGNED(cpu->pc)) {
-        fprintf(stderr, "JAL pc address misalligned");
-        exit(0);
-    }
+int exec_EBREAK(CPU* cpu, u32 inst) {
+    print_op("ebreak\n");
+    return 1;
 }
 
-void exec_JALR(CPU* cpu, u32 inst) {
-    u64 imm = imm_I(inst);
-    u64 tmp = cpu->pc;
-    cpu->pc = (cpu->regs[rs1(inst)] + (int64_t) imm) & 0xfffffffe;
-    cpu->regs[rd(inst)] = tmp;
-    /*print_op("NEXT -> %#lx, imm:%#lx\n", cpu->pc, imm);*/
-    print_op("jalr\n");
-    if (ADDR_MISALIGNED(cpu->pc)) {
-        fprintf(stderr, "JAL pc address misalligned");
-        exit(0);
+/**
+ * @brief 等待中断：没有挂起的中断时阻塞主机线程，
+ * 直到设备 I/O、下一个定时器截止时间或外部唤醒，而不是空转。
+ * 规范允许`WFI`提前返回，来宾会在循环中重新执行它。
+ * 确定性模式（虚拟时钟）下不阻塞，只标记空闲并结束时间片，由调度器推进时间。
+ */
+int exec_WFI(CPU* cpu, u32 inst) {
+    u64 mip = clint_pending(cpu->clint, cpu->hartid);
+    if (!mip && !cpu->bus->irq_pending) {
+        if (cpu->clint->virt)
+            cpu->idle = 1;
+        else
+            bus_wait(cpu->bus, cpu->hartid, clint_timeout_ns(cpu->clint, cpu->hartid));
     }
+    mip = clint_pending(cpu->clint, cpu->hartid);
+    if (__atomic_load_n(&cpu->bus->irq_pending, __ATOMIC_ACQUIRE))
+        mip |= MIP_MEIP;
+    cpu->csr[CS_MIP] = (cpu->csr[CS_MIP] & ~(MIP_MSIP | MIP_MTIP | MIP_MEIP)) | mip;
+    print_op("wfi\n");
+    return 1;
 }
 
-void exec_BEQ(CPU* cpu, u32 inst) {
-    u64 imm = imm_B(inst);
-    if ((int64_t) cpu->regs[rs1(inst)] == (int64_t) cpu->regs[rs2(inst)])
-        cpu->pc = cpu->pc + (int64_t) imm - 4;
-    print_op("beq\n");
-}
-void exec_BNE(CPU* cpu, u32 inst) {
-    u64 imm = imm_B(inst);
-    if ((int64_t) cpu->regs[rs1(inst)] != (int64_t) cpu->regs[rs2(inst)])
-        cpu->pc = (cpu->pc + (int64_t) imm - 4);
-    print_op("bne\n");
-}
-void exec_BLT(CPU* cpu, u32 inst) {
-    /*print_op("Operation: BLT\n");*/
-    u64 imm = imm_B(inst);
-    if ((int64_t) cpu->regs[rs1(inst)] < (int64_t) cpu->regs[rs2(inst)])
-        cpu->pc = cpu->pc + (int64_t) imm - 4;
-    print_op("blt\n");
-}
-void exec_BGE(CPU* cpu, u32 inst) {
-    u64 imm = imm_B(inst);
-    if ((int64_t) cpu->regs[rs1(inst)] >= (int64_t) cpu->regs[rs2(inst)])
-        cpu->pc = cpu->pc + (int64_t) imm - 4;
-    print_op("bge\n");
-}
-void exec_BLTU(CPU* cpu, u32 inst) {
-    u64 imm = imm_B(inst);
-    if (cpu->regs[rs1(inst)] < cpu->regs[rs2(inst)])
-        cpu->pc = cpu->pc + (int64_t) imm - 4;
-    print_op("bltu\n");
-}
-void exec_BGEU(CPU* cpu, u32 inst) {
-    u64 imm = imm_B(inst);
-    if (cpu->regs[rs1(inst)] >= cpu->regs[rs2(inst)])
-        cpu->pc = (int64_t) cpu->pc + (int64_t) imm - 4;
-    print_op("jal\n");
-}
-void exec_LB(CPU* cpu, u32 inst) {
-    // load 1 byte to rd from address in rs1
-    u64 imm = imm_I(inst);
-    u64 addr = cpu->regs[rs1(inst)] + (int64_t) imm;
-    cpu->regs[rd(inst)] = (int64_t)(int8_t) cpu_load(cpu, addr, 8);
-    print_op("lb\n");
-}
-void exec_LH(CPU* cpu, u32 inst) {
-    // load 2 byte to rd from address in rs1
-    u64 imm = imm_I(inst);
-    u64 addr = cpu->regs[rs1(inst)] + (int64_t) imm;
-    cpu->regs[rd(inst)] = (int64_t)(int16_t) cpu_load(cpu, addr, 16);
-    print_op("lh\n");
-}
-void exec_LW(CPU* cpu, u32 inst) {
-    // load 4 byte to rd from address in rs1
-    u64 imm = imm_I(inst);
-    u64 addr = cpu->regs[rs1(inst)] + (int64_t) imm;
-    cpu->regs[rd(inst)] = (int64_t)(int32_t) cpu_load(cpu, addr, 32);
-    print_op("lw\n");
-}
-void exec_LD(CPU* cpu, u32 inst) {
-    // load 8 byte to rd from address in rs1
-    u64 imm = imm_I(inst);
-    u64 addr = cpu->regs[rs1(inst)] + (int64_t) imm;
-    cpu->regs[rd(inst)] = (int64_t) cpu_load(cpu, addr, 64);
-    print_op("ld\n");
-}
-void exec_LBU(CPU* cpu, u32 inst) {
-    // load unsigned 1 byte to rd from address in rs1
-    u64 imm = imm_I(inst);
-    u64 addr = cpu->regs[rs1(inst)] + (int64_t) imm;
-    cpu->regs[rd(inst)] = cpu_load(cpu, addr, 8);
-    print_op("lbu\n");
-}
-void exec_LHU(CPU* cpu, u32 inst) {
-    // load unsigned 2 byte to rd from address in rs1
-    u64 imm = imm_I(inst);
-    u64 addr = cpu->regs[rs1(inst)] + (int64_t) imm;
-    cpu->regs[rd(inst)] = cpu_load(cpu, addr, 16);
-    print_op("lhu\n");
-}
-void exec_LWU(CPU* cpu, u32 inst) {
-    // load unsigned 2 byte to rd from address in rs1
-    u64 imm = imm_I(inst);
-    u64 addr = cpu->regs[rs1(inst)] + (int64_t) imm;
-    cpu->regs[rd(inst)] = cpu_load(cpu, addr, 32);
-    print_op("lwu\n");
-}
-void exec_SB(CPU* cpu, u32 inst) {
-    u64 imm = imm_S(inst);
-    u64 addr = cpu->regs[rs1(inst)] + (int64_t) imm;
-    cpu_store(cpu, addr, 8, cpu->regs[rs2(inst)]);
-    print_op("sb\n");
-}
-void exec_SH(CPU* cpu, u32 inst) {
-    u64 imm = imm_S(inst);
-    u64 addr = cpu->regs[rs1(inst)] + (int64_t) imm;
-    cpu_store(cpu, addr, 16, cpu->regs[rs2(inst)]);
-    print_op("sh\n");
-}
-void exec_SW(CPU* cpu, u32 inst) {
-    u64 imm = imm_S(inst);
-    u64 addr = cpu->regs[rs1(inst)] + (int64_t) imm;
-    cpu_store(cpu, addr, 32, cpu->regs[rs2(inst)]);
-    print_op("sw\n");
-}
-void exec_SD(CPU* cpu, u32 inst) {
-    u64 imm = imm_S(inst);
-    u64 addr = cpu->regs[rs1(inst)] + (int64_t) imm;
-    cpu_store(cpu, addr, 64, cpu->regs[rs2(inst)]);
-    print_op("sd\n");
-}
 
 // ==================================================================== //
-//                       CPU Inst Exec: I-type
+//                       CPU Inst Exec: RV64A
 // ==================================================================== //
 
 /**
- * @brief 立即数相加
- * @param cpu 处理器
- * @param inst 指令
+ * @note 原子指令直接在来宾内存的主机指针上使用`__atomic`内建函数，
+ * 多个处理器在不同主机线程上并行执行时同样保证原子性。
+ * - aq/rl 位映射为对应的 C11 内存序；
+ * - LR 记录地址与读到的值，SC 地址相同时以该值为期望值做 CAS。保留按字比较值：
+ *   其它处理器在 LR/SC 之间改变了该字则 SC 失败，但写同一缓存行的其它字、
+ *   或把该字改写后又写回原值（A→B→A）都不会使 SC 失败。这比 RVWMO 的保留集弱，
+ *   对 CAS 循环、自旋锁等常见用法等价，且无需在每次普通存储时检查保留；
+ * - 不在 DRAM 内（MMIO）或未对齐的地址退化为经总线的非原子读-改-写。
  */
-void exec_ADDI(CPU* cpu, u32 inst) {
-    u64 imm = imm_I(inst);
-    cpu->regs[rd(inst)] = cpu->regs[rs1(inst)] + (int64_t) imm;
-    print_op("addi\n");
-}
-
-void exec_SLLI(CPU* cpu, u32 inst) {
-    cpu->regs[rd(inst)] = cpu->regs[rs1(inst)] << shamt(inst);
-    print_op("slli\n");
-}
-
-void exec_SLTI(CPU* cpu, u32 inst) {
-    u64 imm = imm_I(inst);
-    cpu->regs[rd(inst)] = (cpu->regs[rs1(inst)] < (int64_t) imm)?1:0;
-    print_op("slti\n");
-}
-
-void exec_SLTIU(CPU* cpu, u32 inst) {
-    u64 imm = imm_I(inst);
-    cpu->regs[rd(inst)] = (cpu->regs[rs1(inst)] < imm)?1:0;
-    print_op("sltiu\n");
-}
-
-void exec_XORI(CPU* cpu, u32 inst) {
-    u64 imm = imm_I(inst);
-    cpu->regs[rd(inst)] = cpu->regs[rs1(inst)] ^ imm;
-    print_op("xori\n");
-}
-
-void exec_SRLI(CPU* cpu, u32 inst) {
-    u64 imm = imm_I(inst);
-    cpu->regs[rd(inst)] = cpu->regs[rs1(inst)] >> imm;
-    print_op("srli\n");
-}
-
-void exec_SRAI(CPU* cpu, u32 inst) {
-    u64 imm = imm_I(inst);
-    cpu->regs[rd(inst)] = (int32_t)cpu->regs[rs1(inst)] >> imm;
-    print_op("srai\n");
-}
-
-void exec_ORI(CPU* cpu, u32 inst) {
-    u64 imm = imm_I(inst);
-    cpu->regs[rd(inst)] = cpu->regs[rs1(inst)] | imm;
-    print_op("ori\n");
-}
-
-void exec_ANDI(CPU* cpu, u32 inst) {
-    u64 imm = imm_I(inst);
-    cpu->regs[rd(inst)] = cpu->regs[rs1(inst)] & imm;
-    print_op("andi\n");
-}
-
-
-void exec_ADD(CPU* cpu, u32 inst) {
-    cpu->regs[rd(inst)] =
-        (u64) ((int64_t)cpu->regs[rs1(inst)] + (int64_t)cpu->regs[rs2(inst)]);
-    print_op("add\n");
-}
-
-void exec_SUB(CPU* cpu, u32 inst) {
-    cpu->regs[rd(inst)] =
-        (u64) ((int64_t)cpu->regs[rs1(inst)] - (int64_t)cpu->regs[rs2(inst)]);
-    print_op("sub\n");
-}
-
-void exec_SLL(CPU* cpu, u32 inst) {
-    cpu->regs[rd(inst)] = cpu->regs[rs1(inst)] << (int64_t)cpu->regs[rs2(inst)];
-    print_op("sll\n");
-}
-
-void exec_SLT(CPU* cpu, u32 inst) {
-    cpu->regs[rd(inst)] = (cpu->regs[rs1(inst)] < (int64_t) cpu->regs[rs2(inst)])?1:0;
-    print_op("slt\n");
-}
-
-void exec_SLTU(CPU* cpu, u32 inst) {
-    cpu->regs[rd(inst)] = (cpu->regs[rs1(inst)] < cpu->regs[rs2(inst)])?1:0;
-    print_op("slti\n");
-}
-
-void exec_XOR(CPU* cpu, u32 inst) {
-    cpu->regs[rd(inst)] = cpu->regs[rs1(inst)] ^ cpu->regs[rs2(inst)];
-    print_op("xor\n");
-}
 
-void exec_SRL(CPU* cpu, u32 inst) {
-    cpu->regs[rd(inst)] = cpu->regs[rs1(inst)] >> cpu->regs[rs2(inst)];
-    print_op("srl\n");
-}
-
-void exec_SRA(CPU* cpu, u32 inst) {
-    cpu->regs[rd(inst)] = (int32_t)cpu->regs[rs1(inst)] >> 
-        (int64_t) cpu->regs[rs2(inst)];
-    print_op("sra\n");
-}
-
-void exec_OR(CPU* cpu, u32 inst) {
-    cpu->regs[rd(inst)] = cpu->regs[rs1(inst)] | cpu->regs[rs2(inst)];
-    print_op("or\n");
-}
-
-void exec_AND(CPU* cpu, u32 inst) {
-    cpu->regs[rd(inst)] = cpu->regs[rs1(inst)] & cpu->regs[rs2(inst)];
-    print_op("and\n");
-}
-
-void exec_FENCE(CPU* cpu, u32 inst) {
-    print_op("fence\n");
-}
-
-void exec_ECALL(CPU* cpu, u32 inst) {}
-void exec_EBREAK(CPU* cpu, u32 inst) {}
-
-void exec_ECALLBREAK(CPU* cpu, u32 inst) {
-    if (imm_I(inst) == 0x0)
-        exec_ECALL(cpu, inst);
-    if (imm_I(inst) == 0x1)
-        exec_EBREAK(cpu, inst);
-    print_op("ecallbreak\n");
-}
-
-
-void exec_ADDIW(CPU* cpu, u32 inst) {
-    u64 imm = imm_I(inst);
-    cpu->regs[rd(inst)] = cpu->regs[rs1(inst)] + (int64_t) imm;
-    print_op("addiw\n");
+/** 根据 aq/rl 位选择内存序 */
+static inline int amo_order(u32 inst) {
+    switch ((inst >> 25) & 0x3) {
+        case 0x3: return __ATOMIC_SEQ_CST;
+        case 0x2: return __ATOMIC_ACQUIRE;
+        case 0x1: return __ATOMIC_RELEASE;
+        default:  return __ATOMIC_RELAXED;
+    }
 }
 
-// TODO
-void exec_SLLIW(CPU* cpu, u32 inst) {
-    cpu->regs[rd(inst)] = (int64_t)(int32_t) (cpu->regs[rs1(inst)] <<  shamt(inst));
-    print_op("slliw\n");
-}
-void exec_SRLIW(CPU* cpu, u32 inst) {
-    cpu->regs[rd(inst)] = (int64_t)(int32_t) (cpu->regs[rs1(inst)] >>  shamt(inst));
-    print_op("srliw\n");
-}
-void exec_SRAIW(CPU* cpu, u32 inst) {
-    u64 imm = imm_I(inst);
-    cpu->regs[rd(inst)] = (int64_t)(int32_t) (cpu->regs[rs1(inst)] >> (u64)(int64_t)(int32_t) imm);
-    print_op("sraiw\n");
-}
-void exec_ADDW(CPU* cpu, u32 inst) {
-    cpu->regs[rd(inst)] = (int64_t)(int32_t) (cpu->regs[rs1(inst)] 
-            + (int64_t) cpu->regs[rs2(inst)]);
-    print_op("addw\n");
-}
-void exec_MULW(CPU* cpu, u32 inst) {
-    cpu->regs[rd(inst)] = (int64_t)(int32_t) (cpu->regs[rs1(inst)] 
-            * (int64_t) cpu->regs[rs2(inst)]);
-    print_op("mulw\n");
-}
-void exec_SUBW(CPU* cpu, u32 inst) {
-    cpu->regs[rd(inst)] = (int64_t)(int32_t) (cpu->regs[rs1(inst)] 
-            - (int64_t) cpu->regs[rs2(inst)]);
-    print_op("subw\n");
-}
-void exec_DIVW(CPU* cpu, u32 inst) {
-    cpu->regs[rd(inst)] = (int64_t)(int32_t) (cpu->regs[rs1(inst)] 
-            / (int64_t) cpu->regs[rs2(inst)]);
-    print_op("divw\n");
-}
-void exec_SLLW(CPU* cpu, u32 inst) {
-    cpu->regs[rd(inst)] = (int64_t)(int32_t) (cpu->regs[rs1(inst)] <<  cpu->regs[rs2(inst)]);
-    print_op("sllw\n");
-}
-void exec_SRLW(CPU* cpu, u32 inst) {
-    cpu->regs[rd(inst)] = (int64_t)(int32_t) (cpu->regs[rs1(inst)] >>  cpu->regs[rs2(inst)]);
-    print_op("srlw\n");
-}
-void exec_DIVUW(CPU* cpu, u32 inst) {
-    cpu->regs[rd(inst)] = cpu->regs[rs1(inst)] / (int64_t) cpu->regs[rs2(inst)];
-    print_op("divuw\n");
-}
-void exec_SRAW(CPU* cpu, u32 inst) {
-    cpu->regs[rd(inst)] = (int64_t)(int32_t) (cpu->regs[rs1(inst)] >>  (u64)(int64_t)(int32_t) cpu->regs[rs2(inst)]);
-    print_op("sraw\n");
-}
-void exec_REMW(CPU* cpu, u32 inst) {
-    cpu->regs[rd(inst)] = (int64_t)(int32_t) (cpu->regs[rs1(inst)] 
-            % (int64_t) cpu->regs[rs2(inst)]);
-    print_op("remw\n");
-}
-void exec_REMUW(CPU* cpu, u32 inst) {
-    cpu->regs[rd(inst)] = cpu->regs[rs1(inst)] % (int64_t) cpu->regs[rs2(inst)];
-    print_op("remuw\n");
+/** LR 的读取内存序：读操作不能使用 release，仅 rl 时按 seq_cst */
+static inline int amo_load_order(u32 inst) {
+    int order = amo_order(inst);
+    return order == __ATOMIC_RELEASE ? __ATOMIC_SEQ_CST : order;
 }
 
+/**
+ * @brief 取得原子访问的主机指针
+ * @return void* 主机指针，不在 DRAM 内或未对齐时返回`NULL`
+ */
+static inline void* amo_ptr(CPU* cpu, u64 addr, u64 bytes) {
+    addr += cpu->seg;
+    if (addr < DRAM_BASE || addr - DRAM_BASE > DRAM_SIZE - bytes || (addr & (bytes - 1)))
+        return NULL;
+    return (void*)mmu_GPA_to_HVA((u64)cpu->bus->dram.mem_addr, addr);
+}
+
+/** 读-改-写：返回旧值，`p`可以是来宾内存或本地变量 */
+#define AMO_RMW_DEFINE(bits, T, S)                                                  \
+static T amo_rmw_##bits(T* p, u32 funct5, T v, int order) {                         \
+    T old, val;                                                                     \
+    switch (funct5) {                                                               \
+        case AMOSWAP: return __atomic_exchange_n(p, v, order);                      \
+        case AMOADD:  return __atomic_fetch_add(p, v, order);                       \
+        case AMOXOR:  return __atomic_fetch_xor(p, v, order);                       \
+        case AMOAND:  return __atomic_fetch_and(p, v, order);                       \
+        case AMOOR:   return __atomic_fetch_or(p, v, order);                        \
+        default: ;                                                                  \
+    }                                                                               \
+    old = __atomic_load_n(p, __ATOMIC_RELAXED);                                     \
+    do {                                                                            \
+        switch (funct5) {                                                           \
+            case AMOMIN:  val = (S)old < (S)v ? old : v; break;                     \
+            case AMOMAX:  val = (S)old > (S)v ? old : v; break;                     \
+            case AMOMINU: val = old < v ? old : v; break;                           \
+            default:      val = old > v ? old : v; break;                           \
+        }                                                                           \
+    } while (!__atomic_compare_exchange_n(p, &old, val, 1, order, __ATOMIC_RELAXED)); \
+    return old;                                                                     \
+}
+
+AMO_RMW_DEFINE(32, u32, int32_t)
+AMO_RMW_DEFINE(64, u64, int64_t)
 
 // ==================================================================== //
-//                            CSR instructions
+//                       CPU Inst Exec: RV32/RV64
 // ==================================================================== //
 
-void exec_CSRRW(CPU* cpu, u32 inst) {
-    cpu->regs[rd(inst)] = csr_read(cpu, csr(inst));
-    csr_write(cpu, csr(inst), cpu->regs[rs1(inst)]);
-    print_op("csrrw\n");
-}
-void exec_CSRRS(CPU* cpu, u32 inst) {
-    csr_write(cpu, csr(inst), cpu->csr[csr(inst)] | cpu->regs[rs1(inst)]);
-    print_op("csrrs\n");
-}
-void exec_CSRRC(CPU* cpu, u32 inst) {
-    csr_write(cpu, csr(inst), cpu->csr[csr(inst)] & !(cpu->regs[rs1(inst)]) );
-    print_op("csrrc\n");
-}
-void exec_CSRRWI(CPU* cpu, u32 inst) {
-    csr_write(cpu, csr(inst), rs1(inst));
-    print_op("csrrwi\n");
-}
-void exec_CSRRSI(CPU* cpu, u32 inst) {
-    csr_write(cpu, csr(inst), cpu->csr[csr(inst)] | rs1(inst));
-    print_op("csrrsi\n");
-}
-void exec_CSRRCI(CPU* cpu, u32 inst) {
-    csr_write(cpu, csr(inst), cpu->csr[csr(inst)] & !rs1(inst));
-    print_op("csrrci\n");
-}
+/**
+ * @note 整数指令按 XLEN 各展开一份：`rv32_insts`为 RV32IMAC + Zicsr，
+ * `rv64_insts`另含 RV64 专有指令与 F/D、V、Zb、Zk 扩展。
+ * 处理器按 ELF 类别选择其中一张译码表，执行函数内不再判断 XLEN。
+ */
+#define XLEN 32
+#include "cpu_xlen.h"
+#undef XLEN
 
-// AMO_W
-void exec_LR_W(CPU* cpu, u32 inst) {}  
-void exec_SC_W(CPU* cpu, u32 inst) {}  
-void exec_AMOSWAP_W(CPU* cpu, u32 inst) {}  
-void exec_AMOADD_W(CPU* cpu, u32 inst) {
-    u32 tmp = cpu_load(cpu, cpu->regs[rs1(inst)], 32);
-    u32 res = tmp + (u32)cpu->regs[rs2(inst)];
-    cpu->regs[rd(inst)] = tmp;
-    cpu_store(cpu, cpu->regs[rs1(inst)], 32, res);
-    print_op("amoadd.w\n");
-} 
-void exec_AMOXOR_W(CPU* cpu, u32 inst) {
-    u32 tmp = cpu_load(cpu, cpu->regs[rs1(inst)], 32);
-    u32 res = tmp ^ (u32)cpu->regs[rs2(inst)];
-    cpu->regs[rd(inst)] = tmp;
-    cpu_store(cpu, cpu->regs[rs1(inst)], 32, res);
-    print_op("amoxor.w\n");
-} 
-void exec_AMOAND_W(CPU* cpu, u32 inst) {
-    u32 tmp = cpu_load(cpu, cpu->regs[rs1(inst)], 32);
-    u32 res = tmp & (u32)cpu->regs[rs2(inst)];
-    cpu->regs[rd(inst)] = tmp;
-    cpu_store(cpu, cpu->regs[rs1(inst)], 32, res);
-    print_op("amoand.w\n");
-} 
-void exec_AMOOR_W(CPU* cpu, u32 inst) {
-    u32 tmp = cpu_load(cpu, cpu->regs[rs1(inst)], 32);
-    u32 res = tmp | (u32)cpu->regs[rs2(inst)];
-    cpu->regs[rd(inst)] = tmp;
-    cpu_store(cpu, cpu->regs[rs1(inst)], 32, res);
-    print_op("amoor.w\n");
-} 
-void exec_AMOMIN_W(CPU* cpu, u32 inst) {} 
-void exec_AMOMAX_W(CPU* cpu, u32 inst) {} 
-void exec_AMOMINU_W(CPU* cpu, u32 inst) {} 
-void exec_AMOMAXU_W(CPU* cpu, u32 inst) {} 
-
-// AMO_D TODO
-void exec_LR_D(CPU* cpu, u32 inst) {}  
-void exec_SC_D(CPU* cpu, u32 inst) {}  
-void exec_AMOSWAP_D(CPU* cpu, u32 inst) {}  
-void exec_AMOADD_D(CPU* cpu, u32 inst) {
-    u32 tmp = cpu_load(cpu, cpu->regs[rs1(inst)], 32);
-    u32 res = tmp + (u32)cpu->regs[rs2(inst)];
-    cpu->regs[rd(inst)] = tmp;
-    cpu_store(cpu, cpu->regs[rs1(inst)], 32, res);
-    print_op("amoadd.w\n");
-} 
-void exec_AMOXOR_D(CPU* cpu, u32 inst) {
-    u32 tmp = cpu_load(cpu, cpu->regs[rs1(inst)], 32);
-    u32 res = tmp ^ (u32)cpu->regs[rs2(inst)];
-    cpu->regs[rd(inst)] = tmp;
-    cpu_store(cpu, cpu->regs[rs1(inst)], 32, res);
-    print_op("amoxor.w\n");
-} 
-void exec_AMOAND_D(CPU* cpu, u32 inst) {
-    u32 tmp = cpu_load(cpu, cpu->regs[rs1(inst)], 32);
-    u32 res = tmp & (u32)cpu->regs[rs2(inst)];
-    cpu->regs[rd(inst)] = tmp;
-    cpu_store(cpu, cpu->regs[rs1(inst)], 32, res);
-    print_op("amoand.w\n");
-} 
-void exec_AMOOR_D(CPU* cpu, u32 inst) {
-    u32 tmp = cpu_load(cpu, cpu->regs[rs1(inst)], 32);
-    u32 res = tmp | (u32)cpu->regs[rs2(inst)];
-    cpu->regs[rd(inst)] = tmp;
-    cpu_store(cpu, cpu->regs[rs1(inst)], 32, res);
-    print_op("amoor.w\n");
-} 
-void exec_AMOMIN_D(CPU* cpu, u32 inst) {} 
-void exec_AMOMAX_D(CPU* cpu, u32 inst) {} 
-void exec_AMOMINU_D(CPU* cpu, u32 inst) {} 
-void exec_AMOMAXU_D(CPU* cpu, u32 inst) {} 
+#define XLEN 64
+#include "cpu_xlen.h"
+#undef XLEN
 
+static DECODER cpu_decoder32, cpu_decoder64;
+static pthread_once_t cpu_decoder_once = PTHREAD_ONCE_INIT;
+
+static void cpu_decoder_build() {
+    decode_build(&cpu_decoder32, rv32_insts, sizeof(rv32_insts) / sizeof(rv32_insts[0]));
+    decode_build(&cpu_decoder64, rv64_insts, sizeof(rv64_insts) / sizeof(rv64_insts[0]));
+}
 
 // ==================================================================== //
 //                            Func API: CPU
 // ==================================================================== //
 
 
- void cpu_init(CPU *cpu) {
-    dram_init(&cpu->bus.dram);              // Init memory
+ void cpu_init(CPU *cpu, BUS* bus, CLINT* clint, int hartid) {
+    cpu->bus     = bus;                     // Shared memory and devices
+    cpu->clint   = clint;                   // Shared timer
+    cpu->hartid  = hartid;
+    cpu->seg     = 0;                       // Bare metal: VA == GPA
+    cpu->proc    = NULL;                    // Set by the machine
     cpu->regs[0] = 0x00;                    // register x0 hardwired to 0
-    cpu->regs[2] = DRAM_BASE + DRAM_SIZE;   // Set stack pointer
+    cpu->regs[2] = DRAM_BASE + DRAM_SIZE - (u64)hartid * CPU_STACK_SIZE;   // Per-hart stack
+    cpu->regs[10] = hartid;                 // a0 = hartid
     cpu->pc      = DRAM_BASE;               // Set program counter to the base address
+    cpu->ilen    = 4;
+    csr_init(cpu);                          // Reset CSRs, privilege and counters
+    cpu->csr[CS_MHARTID] = hartid;
+    rvc_init();                             // Build RVC expansion table
+    fpu_init(cpu);                          // Init FP registers and fcsr
+    rvv_init();                             // Pick host SIMD kernels
+    rvv_reset(cpu);                         // Init vector registers and vtype
+    bitmanip_init();                        // Pick host bit-manipulation ops
+    crypto_init();                          // Build AES tables, detect AES-NI
+    pthread_once(&cpu_decoder_once, cpu_decoder_build);    // Build decode table
+    cpu_set_xlen(cpu, 64);                  // RV64 until the loader says otherwise
+    cpu->resv_addr = ~(u64)0;               // No LR reservation
  }
 
+void cpu_set_xlen(CPU* cpu, int xlen) {
+    cpu->xlen    = xlen;
+    cpu->decoder = xlen == 32 ? &cpu_decoder32 : &cpu_decoder64;
+    cpu->rvc     = rvc_table_of(xlen);
+    if (xlen == 32) {
+        // RV32 寄存器高 32 位恒为 0
+        for (int i = 0; i < 32; i++)
+            cpu->regs[i] = (u32)cpu->regs[i];
+        cpu->pc = (u32)cpu->pc;
+    }
+}
+
 u32 cpu_fetch(CPU *cpu) {
-    u32 inst = bus_load(&(cpu->bus), cpu->pc, 32);
+    u32 inst = bus_load(cpu->bus, cpu->pc + cpu->seg, 32);
     return inst;
 }
 
-/**
- * @note 操作码告诉我们要对给定的地址和寄存器进行什么操作。
- * 具体要进行什么操作取决于 3 个值：
- * 操作码 opcode，funct3 和 funct7。
- * 根据指令映射，
- * 我们用以下 cpu_execute 函数对这 3 个部分进行译码。
- */
 int cpu_execute(CPU *cpu, u32 inst) {
-    int opcode = inst & 0x7f;           // opcode in bits 6..0
-    int funct3 = (inst >> 12) & 0x7;    // funct3 in bits 14..12
-    int funct7 = (inst >> 25) & 0x7f;   // funct7 in bits 31..25
     cpu->regs[0] = 0;                   // x0 hardwired to 0 at each cycle
 
-    /*printf("%s\n%#.8lx -> Inst: %#.8x <OpCode: %#.2x, funct3:%#x, funct7:%#x> %s",*/
-            /*ANSI_YELLOW, cpu->pc-4, inst, opcode, funct3, funct7, ANSI_RESET); // DEBUG*/
-    printf(_yellow("\n%#.8lx -> "), cpu->pc-4); // DEBUG
-
-    switch (opcode) {
-        case LUI:   exec_LUI(cpu, inst); break;
-        case AUIPC: exec_AUIPC(cpu, inst); break;
-
-        case JAL:   exec_JAL(cpu, inst); break;
-        case JALR:  exec_JALR(cpu, inst); break;
-
-        case B_TYPE:
-            switch (funct3) {
-                case BEQ:   exec_BEQ(cpu, inst); break;
-                case BNE:   exec_BNE(cpu, inst); break;
-                case BLT:   exec_BLT(cpu, inst); break;
-                case BGE:   exec_BGE(cpu, inst); break;
-                case BLTU:  exec_BLTU(cpu, inst); break;
-                case BGEU:  exec_BGEU(cpu, inst); break;
-                default: ;
-            } break;
-
-        case LOAD:
-            switch (funct3) {
-                case LB  :  exec_LB(cpu, inst); break;  
-                case LH  :  exec_LH(cpu, inst); break;  
-                case LW  :  exec_LW(cpu, inst); break;  
-                case LD  :  exec_LD(cpu, inst); break;  
-                case LBU :  exec_LBU(cpu, inst); break; 
-                case LHU :  exec_LHU(cpu, inst); break; 
-                case LWU :  exec_LWU(cpu, inst); break; 
-                default: ;
-            } break;
-
-        case S_TYPE:
-            switch (funct3) {
-                case SB  :  exec_SB(cpu, inst); break;  
-                case SH  :  exec_SH(cpu, inst); break;  
-                case SW  :  exec_SW(cpu, inst); break;  
-                case SD  :  exec_SD(cpu, inst); break;  
-                default: ;
-            } break;
-
-        case I_TYPE:  
-            switch (funct3) {
-                case ADDI:  exec_ADDI(cpu, inst); break;
-                case SLLI:  exec_SLLI(cpu, inst); break;
-                case SLTI:  exec_SLTI(cpu, inst); break;
-                case SLTIU: exec_SLTIU(cpu, inst); break;
-                case XORI:  exec_XORI(cpu, inst); break;
-                case SRI:   
-                    switch (funct7) {
-                        case SRLI:  exec_SRLI(cpu, inst); break;
-                        case SRAI:  exec_SRAI(cpu, inst); break;
-                        default: ;
-                    } break;
-                case ORI:   exec_ORI(cpu, inst); break;
-                case ANDI:  exec_ANDI(cpu, inst); break;
-                default:
-                    fprintf(stderr, 
-                            "[-] ERROR-> opcode:0x%x, funct3:0x%x, funct7:0x%x\n"
-                            , opcode, funct3, funct7);
-                    return 0;
-            } break;
-
-        case R_TYPE:  
-            switch (funct3) {
-                case ADDSUB:
-                    switch (funct7) {
-                        case ADD: exec_ADD(cpu, inst);
-                        case SUB: exec_ADD(cpu, inst);
-                        default: ;
-                    } break;
-                case SLL:  exec_SLL(cpu, inst); break;
-                case SLT:  exec_SLT(cpu, inst); break;
-                case SLTU: exec_SLTU(cpu, inst); break;
-                case XOR:  exec_XOR(cpu, inst); break;
-                case SR:   
-                    switch (funct7) {
-                        case SRL:  exec_SRL(cpu, inst); break;
-                        case SRA:  exec_SRA(cpu, inst); break;
-                        default: ;
-                    }
-                case OR:   exec_OR(cpu, inst); break;
-                case AND:  exec_AND(cpu, inst); break;
-                default:
-                    fprintf(stderr, 
-                            "[-] ERROR-> opcode:0x%x, funct3:0x%x, funct7:0x%x\n"
-                            , opcode, funct3, funct7);
-                    return 0;
-            } break;
-
-        case FENCE: exec_FENCE(cpu, inst); break;
-
-        case I_TYPE_64:
-            switch (funct3) {
-                case ADDIW: exec_ADDIW(cpu, inst); break;
-                case SLLIW: exec_SLLIW(cpu, inst); break;
-                case SRIW : 
-                    switch (funct7) {
-                        case SRLIW: exec_SRLIW(cpu, inst); break;
-                        case SRAIW: exec_SRLIW(cpu, inst); break;
-                    } break;
-            } break;
-
-        case R_TYPE_64:
-            switch (funct3) {
-                case ADDSUB:
-                    switch (funct7) {
-                        case ADDW:  exec_ADDW(cpu, inst); break;
-                        case SUBW:  exec_SUBW(cpu, inst); break;
-                        case MULW:  exec_MULW(cpu, inst); break;
-                    } break;
-                case DIVW:  exec_DIVW(cpu, inst); break;
-                case SLLW:  exec_SLLW(cpu, inst); break;
-                case SRW:
-                    switch (funct7) {
-                        case SRLW:  exec_SRLW(cpu, inst); break;
-                        case SRAW:  exec_SRAW(cpu, inst); break;
-                        case DIVUW: exec_DIVUW(cpu, inst); break;
-                    } break;
-                case REMW:  exec_REMW(cpu, inst); break;
-                case REMUW: exec_REMUW(cpu, inst); break;
-                default: ;
-            } break;
-
-        case CSR:
-            switch (funct3) {
-                case ECALLBREAK:    exec_ECALLBREAK(cpu, inst); break;
-                case CSRRW  :  exec_CSRRW(cpu, inst); break;  
-                case CSRRS  :  exec_CSRRS(cpu, inst); break;  
-                case CSRRC  :  exec_CSRRC(cpu, inst); break;  
-                case CSRRWI :  exec_CSRRWI(cpu, inst); break; 
-                case CSRRSI :  exec_CSRRSI(cpu, inst); break; 
-                case CSRRCI :  exec_CSRRCI(cpu, inst); break; 
-                default:
-                    fprintf(stderr, 
-                            "[-] ERROR-> opcode:0x%x, funct3:0x%x, funct7:0x%x\n"
-                            , opcode, funct3, funct7);
-                    return 0;
-            } break;
-
-        case AMO_W:
-            switch (funct7 >> 2) { // since, funct[1:0] = aq, rl
-                case LR_W      :  exec_LR_W(cpu, inst); break;  
-                case SC_W      :  exec_SC_W(cpu, inst); break;  
-                case AMOSWAP_W :  exec_AMOSWAP_W(cpu, inst); break;  
-                case AMOADD_W  :  exec_AMOADD_W(cpu, inst); break; 
-                case AMOXOR_W  :  exec_AMOXOR_W(cpu, inst); break; 
-                case AMOAND_W  :  exec_AMOAND_W(cpu, inst); break; 
-                case AMOOR_W   :  exec_AMOOR_W(cpu, inst); break; 
-                case AMOMIN_W  :  exec_AMOMIN_W(cpu, inst); break; 
-                case AMOMAX_W  :  exec_AMOMAX_W(cpu, inst); break; 
-                case AMOMINU_W :  exec_AMOMINU_W(cpu, inst); break; 
-                case AMOMAXU_W :  exec_AMOMAXU_W(cpu, inst); break; 
-                default:
-                    fprintf(stderr, 
-                            "[-] ERROR-> opcode:0x%x, funct3:0x%x, funct7:0x%x\n"
-                            , opcode, funct3, funct7);
-                    return 0;
-            } break;
+    if (log_trace_on)
+        printf(_yellow("\n%#.8lx -> "), cpu->pc - cpu->ilen);
 
-        case 0x00:
-            return 0;
-
-        default:
+    const CPU_INST* in = decode_lookup(cpu->decoder, inst);
+    if (!in || !in->exec(cpu, inst)) {
+        if (inst != 0)
             fprintf(stderr, 
-                    "[-] ERROR-> opcode:0x%x, funct3:0x%x, funct3:0x%x\n"
-                    , opcode, funct3, funct7);
-            return 0;
-            /*exit(1);*/
+                    "[-] ERROR-> opcode:0x%x, funct3:0x%x, funct7:0x%x\n"
+                    , inst & 0x7f, (inst >> 12) & 0x7, inst >> 25);
+        return 0;
     }
     return 1;
 }
 
 int cpu_step(CPU* cpu, int step) {
     if(step < 0) {
-        while (1) {
+        for (u64 n = 1; ; n++) {
             if (!cpu_step_one(cpu))
                 return 0;
-            cpu_dump_regs(cpu);
+            if (n % BUS_POLL_INTERVAL == 0) {
+                // 设备描述符只由 0 号处理器轮询；其它处理器在此检查机器是否停止
+                if (cpu->hartid == 0)
+                    bus_poll(cpu->bus, 0);
+                if (__atomic_load_n(&cpu->bus->halt, __ATOMIC_RELAXED))
+                    return 0;
+            }
+            if (log_trace_on)
+                cpu_dump_regs(cpu);
             if(cpu->pc==0)
                 return 0;
         }
@@ -803,7 +374,8 @@ int cpu_step(CPU* cpu, int step) {
         for(i = 0; i < MIN(MAX_CPU_STEP, step); i++) {
             if (!cpu_step_one(cpu))
                 return 0;
-            cpu_dump_regs(cpu);
+            if (log_trace_on)
+                cpu_dump_regs(cpu);
             if(cpu->pc==0)
                 return 0;
         }
@@ -811,25 +383,21 @@ int cpu_step(CPU* cpu, int step) {
     return 1;
 }
 
-/**
- * @note 三级流水线CPU
- * - 第 1 级流水线由函数`cpu_fetch()`处理。
- * - 第 2、3 级流水线由定义在`cpu.h`中的函数`cpu_execute()`一并处理。
- * - 程序计数器`pc`在每次循环后增加 4 个字节（32 位，因为每个 RISC-V 指令长度都为 32 位），
- * 以获取下一条指令。因此 CPU 执行循环可以被写为下面这样：
- */
-int cpu_loop(CPU* cpu, char* filename) {
-    // 1. 初始化：cpu, 寄存器 regs 和程序计数器 pc
-    cpu_init(cpu);
-    // 2. load_file(&cpu, argv[1]);
-    load_elf(cpu, filename);
-    // 3. 执行 cpu 循环
-    cpu_step(cpu, -1);
-    return 0;
+long cpu_step_quantum(CPU* cpu, u64 quantum) {
+    cpu->idle = 0;
+    for (u64 n = 1; n <= quantum; n++) {
+        if (!cpu_step_one(cpu))
+            return -1;
+        if (log_trace_on)
+            cpu_dump_regs(cpu);
+        if (cpu->pc == 0)
+            return -1;
+        if (cpu->idle)
+            return n;
+    }
+    return quantum;
 }
 
-
-
 void cpu_dump_regs(CPU* cpu) {
     char* abi[] = { // Application Binary Interface registers
         "zero", "ra",  "sp",  "gp",
@@ -13,7 +13,10 @@
  * 1. 第 1 级流水线（取指）：cpu 从 DRAM 的特定地址（存放在程序计数器 pc 中）中取得指令；
  * 2. 第 2 级流水线（译码）：指令被译码为操作码，目标寄存器与源寄存器等；
  * 3. 第 3 级流水线（执行）：此时指令按照译码后的结果在 ALU 中执行。
- * 
+ *
+ * ## 处理器与机器
+ * `CPU`只保存一个处理器（hart）自己的状态：寄存器、pc、CSR 与 LR 保留；
+ * DRAM 与设备所在的总线、CLINT 属于整台机器（见`machine.h`），由各处理器以指针共享。
  */
 
 #ifndef CPU_H
@@ -23,7 +26,36 @@
 //                             Include
 // ==================================================================== //
 
-#include "bus.h"
+#include "clint.h"
+#include "proc.h"
+
+// ==================================================================== //
+//                              Defines
+// ==================================================================== //
+
+#define CPU_STACK_SIZE  0x4000  /** 每个处理器的初始栈大小，栈从 DRAM 末尾向下依次划分 */
+#define CPU_VLEN        256     /** 向量寄存器位宽 */
+#define CPU_VLENB       (CPU_VLEN / 8)
+
+#define PRIV_U          0       /** 用户态 */
+#define PRIV_S          1       /** 监管态 */
+#define PRIV_M          3       /** 机器态 */
+
+/**
+ * @brief CSR 存储槽：只有需要保存状态的 CSR 占用一个槽，
+ * 编号到槽的映射、读写处理函数与 WARL 掩码见`csr.c`中的 CSR 表。
+ */
+typedef enum {
+    CS_FFLAGS, CS_FRM,
+    CS_VSTART, CS_VXSAT, CS_VXRM, CS_VL, CS_VTYPE,
+    CS_STVEC, CS_SCOUNTEREN, CS_SSCRATCH, CS_SEPC, CS_SCAUSE, CS_STVAL, CS_SATP,
+    CS_MHARTID, CS_MSTATUS, CS_MEDELEG, CS_MIDELEG, CS_MIE, CS_MTVEC, CS_MCOUNTEREN,
+    CS_MCOUNTINHIBIT, CS_MSCRATCH, CS_MEPC, CS_MCAUSE, CS_MTVAL, CS_MIP,
+    CS_MCYCLE, CS_MINSTRET,             /** 计数器相对退休指令数的偏移 */
+    CS_PMPCFG0, CS_PMPCFG2,
+    CS_PMPADDR0, CS_PMPADDR15 = CS_PMPADDR0 + 15,
+    CS_NUM
+} CSR_SLOT;
 
 // ==================================================================== //
 //                             Data: CPU
@@ -33,10 +65,26 @@
  * @brief 中央处理器结构体
  */
 typedef struct CPU_t {
-    u64 regs[32];           /** 32/64-bit 寄存器（x0-x31） */
-    u64 pc;                 /** 64-bit 程序计数器 */
-    u64 csr[4069];          /** 存储 CSR 指令 */
-    BUS bus;                /** CPU连接总线 */
+    u64 regs[32];           /** 32/64-bit 寄存器（x0-x31），RV32 时高 32 位为 0 */
+    u64 pc;                 /** 64-bit 程序计数器（执行时已指向下一条指令） */
+    u64 ilen;               /** 当前指令长度：4，或压缩指令的 2 */
+    u64 fregs[32];          /** 64-bit 浮点寄存器（f0-f31） */
+    int fpu_rm;             /** 主机当前生效的舍入模式（frm 编码），-1 未知 */
+    u64 resv_addr;          /** LR 保留的地址，全 1 表示无保留 */
+    u64 resv_val;           /** LR 读到的值，SC 以它为 CAS 的期望值 */
+    u8 vregs[32 * CPU_VLENB] __attribute__((aligned(32)));  /** 向量寄存器（v0-v31） */
+    u64 csr[CS_NUM];        /** CSR 存储槽：CSR_SLOT */
+    u64 instret;            /** 已退休指令数，cycle/instret 由它按需换算 */
+    int priv;               /** 当前特权级：PRIV_U/PRIV_S/PRIV_M */
+    int idle;               /** 确定性模式下`WFI`没有可等待的中断时置 1，提前结束时间片 */
+    int xlen;               /** 整数寄存器宽度：32 或 64 */
+    const struct DECODER_t* decoder;    /** 当前 XLEN 的译码表 */
+    const u32* rvc;         /** 当前 XLEN 的压缩指令扩展表 */
+    int hartid;             /** 处理器编号（mhartid） */
+    BUS* bus;               /** CPU连接总线，所有处理器共享 */
+    CLINT* clint;           /** 定时器与软件中断，所有处理器共享 */
+    u64 seg;                /** 直接映射的段基址：来宾虚拟地址 + seg = 来宾物理地址，裸机为 0 */
+    PROC* proc;             /** 用户态进程，所有处理器共享 */
 } CPU;
 
 // ==================================================================== //
@@ -47,9 +95,21 @@ typedef struct CPU_t {
  * @brief 处理器初始化给定的`CPU`，
  * 将指针指向的`CPU`中的寄存器全部置 0，
  * 并将程序寄存器`pc`的值设为内存的起始地址。
+ * `a0`为处理器编号，`sp`指向该处理器自己的栈顶。
  * @param cpu 中央处理器
+ * @param bus 共享总线（已初始化）
+ * @param clint 共享 CLINT（已初始化）
+ * @param hartid 处理器编号
  */
-void cpu_init(CPU *cpu);
+void cpu_init(CPU *cpu, BUS* bus, CLINT* clint, int hartid);
+
+/**
+ * @brief 设置处理器的整数寄存器宽度，切换到对应 XLEN 的译码表与压缩指令表，
+ * 由加载器按 ELF 类别调用。
+ * @param cpu 中央处理器
+ * @param xlen 32 或 64
+ */
+void cpu_set_xlen(CPU* cpu, int xlen);
 
 /**
  * @brief 处理器从内存（DRAM）中读取指令用于执行，
@@ -71,18 +131,19 @@ int cpu_execute(CPU *cpu, u32 inst);
 /**
  * @brief 处理器步进执行
  * @param cpu 中央处理器
- * @param step 步数
+ * @param step 步数，-1 表示一直执行到出错、`pc`为 0 或机器停止
  * @return int 错误代码
  */
 int cpu_step(CPU* cpu, int step);
 
 /**
- * @brief 处理器循环执行
+ * @brief 处理器执行一个时间片：至多`quantum`条指令，
+ * 执行`WFI`进入空闲（`idle`置 1）时提前返回。确定性调度（见`machine.h`）使用。
  * @param cpu 中央处理器
- * @param filename 文件名
- * @return int 错误代码
+ * @param quantum 时间片长度（指令数）
+ * @return long 本时间片执行的指令数；出错或`pc`为 0 时返回 -1
  */
-int cpu_loop(CPU* cpu, char* filename);
+long cpu_step_quantum(CPU* cpu, u64 quantum);
 
 /**
  * @brief 处理器查看寄存器的值
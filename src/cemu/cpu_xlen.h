@@ -0,0 +1,545 @@
+/**
+ * @file cpu_xlen.h
+ * @author lancer (lancerstadium@163.com)
+ * @brief 按 XLEN 展开的整数指令执行函数与指令表
+ * @version 0.1
+ * @date 2024-01-30
+ * @copyright Copyright (c) 2024
+ *
+ * # XLEN 模板
+ * - 本文件没有包含保护，由`cpu.c`在定义`XLEN`为 32 与 64 后各包含一次，
+ * 生成`rv32_exec_*`/`rv64_exec_*`两套执行函数和`rv32_insts`/`rv64_insts`两张指令表。
+ * 执行函数内的寄存器宽度、移位量掩码、除法溢出值都是编译期常量，运行时不再判断 XLEN。
+ *
+ * - 寄存器统一存放在`u64 regs[32]`中：`X(i)`按 XLEN 截断读出，`SETX(i, v)`按 XLEN 截断写入，
+ * RV32 的寄存器高 32 位始终为 0。
+ *
+ * - RV32 指令表包含 RV32IMAC 与 Zicsr；只在 RV64 下存在的指令（`*W`、`LD`/`SD`/`LWU`、
+ * `.d` 原子指令）以及按 RV64 编写的 F/D、V、Zb、Zk 模块只登记在 RV64 指令表中。
+ */
+
+// ==================================================================== //
+//                          Defines: XLEN
+// ==================================================================== //
+
+#if XLEN == 32
+    #define UX          u32                     /** 无符号寄存器类型 */
+    #define SX          int32_t                 /** 有符号寄存器类型 */
+    #define UDX         u64                     /** 双倍宽度：乘法高位 */
+    #define SDX         int64_t
+    #define SX_MIN      INT32_MIN
+    #define MASK_SHIFT  MASK_FUNCT7             /** RV32 移位立即数 shamt[5] 必须为 0 */
+#elif XLEN == 64
+    #define UX          u64
+    #define SX          int64_t
+    #define UDX         unsigned __int128
+    #define SDX         __int128
+    #define SX_MIN      INT64_MIN
+    #define MASK_SHIFT  MASK_FUNCT6
+#else
+    #error "XLEN must be 32 or 64"
+#endif
+
+#define XCAT_(a, b, c)  a##b##c
+#define XCAT(a, b, c)   XCAT_(a, b, c)
+#define EXEC(name)      XCAT(rv, XLEN, _exec_##name)
+#define EXEC_FN(fn)     XCAT(rv, XLEN, fn)      /** 以`_exec_NAME`给出，避免 NAME 先被展开为编码常量 */
+#define INSTS           XCAT(rv, XLEN, _insts)
+
+#define X(i)            ((UX)cpu->regs[i])
+#define SETX(i, v)      (cpu->regs[i] = (u64)(UX)(v))
+#define SHAMT(inst)     (shamt(inst) & (XLEN - 1))
+#define JUMP(target)    (cpu->pc = (UX)(target))
+
+// ==================================================================== //
+//                       CPU Inst Exec: U/J/B-type
+// ==================================================================== //
+
+static int EXEC(LUI)(CPU* cpu, u32 inst) {
+    // LUI places upper 20 bits of U-immediate value to rd
+    SETX(rd(inst), imm_U(inst));
+    print_op("lui\n");
+    return 1;
+}
+
+static int EXEC(AUIPC)(CPU* cpu, u32 inst) {
+    // AUIPC forms a 32-bit offset from the 20 upper bits
+    // of the U-immediate
+    SETX(rd(inst), cpu->pc + imm_U(inst) - cpu->ilen);
+    print_op("auipc\n");
+    return 1;
+}
+
+static int EXEC(JAL)(CPU* cpu, u32 inst) {
+    SETX(rd(inst), cpu->pc);
+    JUMP(cpu->pc + imm_J(inst) - cpu->ilen);
+    print_op("jal\n");
+    if (ADDR_MISALIGNED(cpu->pc)) {
+        fprintf(stderr, "JAL pc address misalligned");
+        exit(0);
+    }
+    return 1;
+}
+
+static int EXEC(JALR)(CPU* cpu, u32 inst) {
+    UX tmp = cpu->pc;
+    JUMP((X(rs1(inst)) + imm_I(inst)) & ~(UX)1);
+    SETX(rd(inst), tmp);
+    print_op("jalr\n");
+    if (ADDR_MISALIGNED(cpu->pc)) {
+        fprintf(stderr, "JAL pc address misalligned");
+        exit(0);
+    }
+    return 1;
+}
+
+#define BRANCH_DEFINE(NAME, name, cond)                                             \
+static int EXEC_FN(_exec_##NAME)(CPU* cpu, u32 inst) {                              \
+    UX a = X(rs1(inst)), b = X(rs2(inst));                                          \
+    if (cond)                                                                       \
+        JUMP(cpu->pc + imm_B(inst) - cpu->ilen);                                    \
+    print_op(name "\n");                                                            \
+    return 1;                                                                       \
+}
+
+BRANCH_DEFINE(BEQ,  "beq",  a == b)
+BRANCH_DEFINE(BNE,  "bne",  a != b)
+BRANCH_DEFINE(BLT,  "blt",  (SX)a < (SX)b)
+BRANCH_DEFINE(BGE,  "bge",  (SX)a >= (SX)b)
+BRANCH_DEFINE(BLTU, "bltu", a < b)
+BRANCH_DEFINE(BGEU, "bgeu", a >= b)
+#undef BRANCH_DEFINE
+
+// ==================================================================== //
+//                       CPU Inst Exec: Load/Store
+// ==================================================================== //
+
+/** 加载：`T`为内存中的类型，符号/零扩展由它决定 */
+#define LOAD_DEFINE(NAME, name, T)                                                  \
+static int EXEC_FN(_exec_##NAME)(CPU* cpu, u32 inst) {                              \
+    UX addr = X(rs1(inst)) + imm_I(inst);                                           \
+    SETX(rd(inst), (SX)(T)cpu_load(cpu, addr, sizeof(T) * 8));                      \
+    print_op(name "\n");                                                            \
+    return 1;                                                                       \
+}
+
+#define STORE_DEFINE(NAME, name, bits)                                              \
+static int EXEC_FN(_exec_##NAME)(CPU* cpu, u32 inst) {                              \
+    UX addr = X(rs1(inst)) + imm_S(inst);                                           \
+    cpu_store(cpu, addr, bits, X(rs2(inst)));                                       \
+    print_op(name "\n");                                                            \
+    return 1;                                                                       \
+}
+
+LOAD_DEFINE(LB,  "lb",  int8_t)
+LOAD_DEFINE(LH,  "lh",  int16_t)
+LOAD_DEFINE(LW,  "lw",  int32_t)
+LOAD_DEFINE(LBU, "lbu", u8)
+LOAD_DEFINE(LHU, "lhu", u16)
+STORE_DEFINE(SB, "sb", 8)
+STORE_DEFINE(SH, "sh", 16)
+STORE_DEFINE(SW, "sw", 32)
+#if XLEN == 64
+LOAD_DEFINE(LD,  "ld",  int64_t)
+LOAD_DEFINE(LWU, "lwu", u32)
+STORE_DEFINE(SD, "sd", 64)
+#endif
+#undef LOAD_DEFINE
+#undef STORE_DEFINE
+
+// ==================================================================== //
+//                       CPU Inst Exec: I/R-type
+// ==================================================================== //
+
+/** 运算：`a`为 rs1，`b`为立即数或 rs2 */
+#define ALU_DEFINE(FN, name, B, expr)                                               \
+static int EXEC_FN(FN)(CPU* cpu, u32 inst) {                                        \
+    UX a = X(rs1(inst)), b = (B);                                                   \
+    SETX(rd(inst), expr);                                                           \
+    print_op(name "\n");                                                            \
+    return 1;                                                                       \
+}
+#define ALU_I(NAME, name, expr)     ALU_DEFINE(_exec_##NAME, name, imm_I(inst), expr)
+#define ALU_SH(NAME, name, expr)    ALU_DEFINE(_exec_##NAME, name, SHAMT(inst), expr)
+#define ALU_R(NAME, name, expr)     ALU_DEFINE(_exec_##NAME, name, X(rs2(inst)), expr)
+
+ALU_I(ADDI,   "addi",  a + b)
+ALU_I(SLTI,   "slti",  (SX)a < (SX)b)
+ALU_I(SLTIU,  "sltiu", a < b)
+ALU_I(XORI,   "xori",  a ^ b)
+ALU_I(ORI,    "ori",   a | b)
+ALU_I(ANDI,   "andi",  a & b)
+ALU_SH(SLLI,  "slli",  a << b)
+ALU_SH(SRLI,  "srli",  a >> b)
+ALU_SH(SRAI,  "srai",  (SX)a >> b)
+
+ALU_R(ADD,    "add",   a + b)
+ALU_R(SUB,    "sub",   a - b)
+ALU_R(SLL,    "sll",   a << (b & (XLEN - 1)))
+ALU_R(SLT,    "slt",   (SX)a < (SX)b)
+ALU_R(SLTU,   "sltu",  a < b)
+ALU_R(XOR,    "xor",   a ^ b)
+ALU_R(SRL,    "srl",   a >> (b & (XLEN - 1)))
+ALU_R(SRA,    "sra",   (SX)a >> (b & (XLEN - 1)))
+ALU_R(OR,     "or",    a | b)
+ALU_R(AND,    "and",   a & b)
+
+#if XLEN == 64
+// RV64I：32 位运算，结果符号扩展
+ALU_I(ADDIW,  "addiw", (int32_t)(a + b))
+ALU_SH(SLLIW, "slliw", (int32_t)((u32)a << (b & 0x1f)))
+ALU_SH(SRLIW, "srliw", (int32_t)((u32)a >> (b & 0x1f)))
+ALU_SH(SRAIW, "sraiw", (int32_t)a >> (b & 0x1f))
+ALU_R(ADDW,   "addw",  (int32_t)(a + b))
+ALU_R(SUBW,   "subw",  (int32_t)(a - b))
+ALU_R(SLLW,   "sllw",  (int32_t)((u32)a << (b & 0x1f)))
+ALU_R(SRLW,   "srlw",  (int32_t)((u32)a >> (b & 0x1f)))
+ALU_R(SRAW,   "sraw",  (int32_t)a >> (b & 0x1f))
+#endif
+
+// ==================================================================== //
+//                         CPU Inst Exec: M
+// ==================================================================== //
+
+/**
+ * @note 乘法高位结果借助双倍宽度整数计算；
+ * 除法不产生异常，除数为 0 与有符号溢出时按规范给出结果：
+ * - 除数为 0：商为全 1，余数为被除数；
+ * - 溢出（最小负数 / -1）：商为被除数，余数为 0。
+ */
+
+ALU_R(MUL,    "mul",    a * b)
+ALU_R(MULH,   "mulh",   ((SDX)(SX)a * (SDX)(SX)b) >> XLEN)
+ALU_R(MULHSU, "mulhsu", ((SDX)(SX)a * (SDX)b) >> XLEN)
+ALU_R(MULHU,  "mulhu",  ((UDX)a * (UDX)b) >> XLEN)
+ALU_R(DIV,    "div",    b == 0 ? ~(UX)0 : (SX)a == SX_MIN && (SX)b == -1 ? a : (UX)((SX)a / (SX)b))
+ALU_R(DIVU,   "divu",   b == 0 ? ~(UX)0 : a / b)
+ALU_R(REM,    "rem",    b == 0 ? a : (SX)a == SX_MIN && (SX)b == -1 ? 0 : (UX)((SX)a % (SX)b))
+ALU_R(REMU,   "remu",   b == 0 ? a : a % b)
+
+#if XLEN == 64
+ALU_R(MULW,   "mulw",   (int32_t)(a * b))
+ALU_R(DIVW,   "divw",   (int32_t)b == 0 ? ~(u64)0
+                      : (int32_t)a == INT32_MIN && (int32_t)b == -1 ? (u64)(int64_t)INT32_MIN
+                      : (u64)(int64_t)((int32_t)a / (int32_t)b))
+ALU_R(DIVUW,  "divuw",  (u32)b == 0 ? ~(u64)0 : (u64)(int64_t)(int32_t)((u32)a / (u32)b))
+ALU_R(REMW,   "remw",   (int32_t)b == 0 ? (u64)(int64_t)(int32_t)a
+                      : (int32_t)a == INT32_MIN && (int32_t)b == -1 ? 0
+                      : (u64)(int64_t)((int32_t)a % (int32_t)b))
+ALU_R(REMUW,  "remuw",  (int32_t)((u32)b == 0 ? (u32)a : (u32)a % (u32)b))
+#endif
+
+#undef ALU_DEFINE
+#undef ALU_I
+#undef ALU_SH
+#undef ALU_R
+
+// ==================================================================== //
+//                          CSR instructions
+// ==================================================================== //
+
+/**
+ * @note CSR 指令先检查访问权限，CSR 不存在或无权访问时为非法指令：
+ * - `CSRRW[I]`的`rd`为 x0 时不读 CSR（不触发读副作用）；
+ * - `CSRRS[I]`/`CSRRC[I]`的`rs1`/`uimm`为 0 时不写 CSR，因此可以读只读 CSR。
+ * `I`形式以`rs1`字段为 5 位零扩展立即数。
+ */
+#define CSR_DEFINE(NAME, name, V, swap, expr)                                       \
+static int EXEC_FN(_exec_##NAME)(CPU* cpu, u32 inst) {                              \
+    u64 c = csr(inst);                                                              \
+    UX v = (V), old = 0;                                                            \
+    if (!csr_access(cpu, c, (swap) || rs1(inst) != 0))                              \
+        return 0;                                                                   \
+    if (!(swap) || rd(inst) != 0)                                                   \
+        old = csr_read(cpu, c);                                                     \
+    if ((swap) || rs1(inst) != 0)                                                   \
+        csr_write(cpu, c, expr);                                                    \
+    SETX(rd(inst), old);                                                            \
+    print_op(name "\n");                                                            \
+    return 1;                                                                       \
+}
+
+CSR_DEFINE(CSRRW,  "csrrw",  X(rs1(inst)), 1, v)
+CSR_DEFINE(CSRRS,  "csrrs",  X(rs1(inst)), 0, old | v)
+CSR_DEFINE(CSRRC,  "csrrc",  X(rs1(inst)), 0, old & ~v)
+CSR_DEFINE(CSRRWI, "csrrwi", rs1(inst),    1, v)
+CSR_DEFINE(CSRRSI, "csrrsi", rs1(inst),    0, old | v)
+CSR_DEFINE(CSRRCI, "csrrci", rs1(inst),    0, old & ~v)
+#undef CSR_DEFINE
+
+// ==================================================================== //
+//                         CPU Inst Exec: A
+// ==================================================================== //
+
+static int EXEC(LR)(CPU* cpu, u32 inst) {
+    u64 bytes = ((inst >> 12) & 0x7) == AMO_W ? 4 : 8;
+    UX addr = X(rs1(inst));
+    void* p = amo_ptr(cpu, addr, bytes);
+    u64 v;
+    if (!p) {
+        cpu->resv_addr = ~(u64)0;
+        v = cpu_load(cpu, addr, bytes * 8);
+    } else {
+        v = bytes == 4 ? __atomic_load_n((u32*)p, amo_load_order(inst))
+                       : __atomic_load_n((u64*)p, amo_load_order(inst));
+        cpu->resv_addr = addr;
+        cpu->resv_val = v;
+    }
+    SETX(rd(inst), bytes == 4 ? (SX)(int32_t)v : (SX)v);
+    print_op(bytes == 4 ? "lr.w\n" : "lr.d\n");
+    return 1;
+}
+
+static int EXEC(SC)(CPU* cpu, u32 inst) {
+    u64 bytes = ((inst >> 12) & 0x7) == AMO_W ? 4 : 8;
+    UX addr = X(rs1(inst));
+    void* p = amo_ptr(cpu, addr, bytes);
+    int ok = 0;
+    if (p && cpu->resv_addr == addr) {
+        if (bytes == 4) {
+            u32 expect = (u32)cpu->resv_val;
+            ok = __atomic_compare_exchange_n((u32*)p, &expect, (u32)X(rs2(inst)),
+                                             0, amo_order(inst), __ATOMIC_RELAXED);
+        } else {
+            u64 expect = cpu->resv_val;
+            ok = __atomic_compare_exchange_n((u64*)p, &expect, (u64)X(rs2(inst)),
+                                             0, amo_order(inst), __ATOMIC_RELAXED);
+        }
+    }
+    // 无论成功与否，SC 都会清除保留
+    cpu->resv_addr = ~(u64)0;
+    SETX(rd(inst), !ok);
+    print_op(bytes == 4 ? "sc.w\n" : "sc.d\n");
+    return 1;
+}
+
+static int EXEC(AMO)(CPU* cpu, u32 inst) {
+    u64 bytes = ((inst >> 12) & 0x7) == AMO_W ? 4 : 8;
+    UX addr = X(rs1(inst));
+    UX val = X(rs2(inst));
+    u32 funct5 = inst >> 27;
+    void* p = amo_ptr(cpu, addr, bytes);
+    u64 old;
+    if (p) {
+        old = bytes == 4 ? amo_rmw_32(p, funct5, val, amo_order(inst))
+                         : amo_rmw_64(p, funct5, val, amo_order(inst));
+    } else if (bytes == 4) {
+        u32 tmp = cpu_load(cpu, addr, 32);
+        old = amo_rmw_32(&tmp, funct5, val, __ATOMIC_RELAXED);
+        cpu_store(cpu, addr, 32, tmp);
+    } else {
+        u64 tmp = cpu_load(cpu, addr, 64);
+        old = amo_rmw_64(&tmp, funct5, val, __ATOMIC_RELAXED);
+        cpu_store(cpu, addr, 64, tmp);
+    }
+    SETX(rd(inst), bytes == 4 ? (SX)(int32_t)old : (SX)old);
+    print_op(bytes == 4 ? "amo.w\n" : "amo.d\n");
+    return 1;
+}
+
+// ==================================================================== //
+//                           CPU Inst Table
+// ==================================================================== //
+
+/**
+ * @note 指令表：每条指令一项，`decode_build()`据此生成两级查找表。
+ * 同一编码被多项覆盖时，掩码位数多的优先（如`ecall`先于整个 SYSTEM 组）。
+ */
+#define INST(name, mask, match, exec, fmt)  { name, mask, match, exec, fmt }
+
+static const CPU_INST INSTS[] = {
+    // RV32I / RV64I
+    INST("lui",     MASK_OPCODE, MATCH_OP(LUI),   EXEC(LUI),   FMT_U),
+    INST("auipc",   MASK_OPCODE, MATCH_OP(AUIPC), EXEC(AUIPC), FMT_U),
+    INST("jal",     MASK_OPCODE, MATCH_OP(JAL),   EXEC(JAL),   FMT_J),
+    INST("jalr",    MASK_FUNCT3, MATCH_I(JALR, 0), EXEC(JALR), FMT_I),
+
+    INST("beq",     MASK_FUNCT3, MATCH_I(B_TYPE, BEQ),  EXEC(BEQ),  FMT_B),
+    INST("bne",     MASK_FUNCT3, MATCH_I(B_TYPE, BNE),  EXEC(BNE),  FMT_B),
+    INST("blt",     MASK_FUNCT3, MATCH_I(B_TYPE, BLT),  EXEC(BLT),  FMT_B),
+    INST("bge",     MASK_FUNCT3, MATCH_I(B_TYPE, BGE),  EXEC(BGE),  FMT_B),
+    INST("bltu",    MASK_FUNCT3, MATCH_I(B_TYPE, BLTU), EXEC(BLTU), FMT_B),
+    INST("bgeu",    MASK_FUNCT3, MATCH_I(B_TYPE, BGEU), EXEC(BGEU), FMT_B),
+
+    INST("lb",      MASK_FUNCT3, MATCH_I(LOAD, LB),  EXEC(LB),  FMT_I),
+    INST("lh",      MASK_FUNCT3, MATCH_I(LOAD, LH),  EXEC(LH),  FMT_I),
+    INST("lw",      MASK_FUNCT3, MATCH_I(LOAD, LW),  EXEC(LW),  FMT_I),
+    INST("lbu",     MASK_FUNCT3, MATCH_I(LOAD, LBU), EXEC(LBU), FMT_I),
+    INST("lhu",     MASK_FUNCT3, MATCH_I(LOAD, LHU), EXEC(LHU), FMT_I),
+    INST("sb",      MASK_FUNCT3, MATCH_I(S_TYPE, SB), EXEC(SB), FMT_S),
+    INST("sh",      MASK_FUNCT3, MATCH_I(S_TYPE, SH), EXEC(SH), FMT_S),
+    INST("sw",      MASK_FUNCT3, MATCH_I(S_TYPE, SW), EXEC(SW), FMT_S),
+
+    INST("addi",    MASK_FUNCT3, MATCH_I(I_TYPE, ADDI),  EXEC(ADDI),  FMT_I),
+    INST("slti",    MASK_FUNCT3, MATCH_I(I_TYPE, SLTI),  EXEC(SLTI),  FMT_I),
+    INST("sltiu",   MASK_FUNCT3, MATCH_I(I_TYPE, SLTIU), EXEC(SLTIU), FMT_I),
+    INST("xori",    MASK_FUNCT3, MATCH_I(I_TYPE, XORI),  EXEC(XORI),  FMT_I),
+    INST("ori",     MASK_FUNCT3, MATCH_I(I_TYPE, ORI),   EXEC(ORI),   FMT_I),
+    INST("andi",    MASK_FUNCT3, MATCH_I(I_TYPE, ANDI),  EXEC(ANDI),  FMT_I),
+    INST("slli",    MASK_SHIFT,  MATCH_R(I_TYPE, SLLI, 0),    EXEC(SLLI), FMT_I),
+    INST("srli",    MASK_SHIFT,  MATCH_R(I_TYPE, SRI, SRLI),  EXEC(SRLI), FMT_I),
+    INST("srai",    MASK_SHIFT,  MATCH_R(I_TYPE, SRI, SRAI),  EXEC(SRAI), FMT_I),
+
+    INST("add",     MASK_FUNCT7, MATCH_R(R_TYPE, ADDSUB, ADD), EXEC(ADD),  FMT_R),
+    INST("sub",     MASK_FUNCT7, MATCH_R(R_TYPE, ADDSUB, SUB), EXEC(SUB),  FMT_R),
+    INST("sll",     MASK_FUNCT7, MATCH_R(R_TYPE, SLL, 0),      EXEC(SLL),  FMT_R),
+    INST("slt",     MASK_FUNCT7, MATCH_R(R_TYPE, SLT, 0),      EXEC(SLT),  FMT_R),
+    INST("sltu",    MASK_FUNCT7, MATCH_R(R_TYPE, SLTU, 0),     EXEC(SLTU), FMT_R),
+    INST("xor",     MASK_FUNCT7, MATCH_R(R_TYPE, XOR, 0),      EXEC(XOR),  FMT_R),
+    INST("srl",     MASK_FUNCT7, MATCH_R(R_TYPE, SR, SRL),     EXEC(SRL),  FMT_R),
+    INST("sra",     MASK_FUNCT7, MATCH_R(R_TYPE, SR, SRA),     EXEC(SRA),  FMT_R),
+    INST("or",      MASK_FUNCT7, MATCH_R(R_TYPE, OR, 0),       EXEC(OR),   FMT_R),
+    INST("and",     MASK_FUNCT7, MATCH_R(R_TYPE, AND, 0),      EXEC(AND),  FMT_R),
+
+    INST("fence",   MASK_OPCODE, MATCH_OP(FENCE), exec_FENCE, FMT_I),
+    INST("ecall",   MASK_ALL, MATCH_IMM(CSR, ECALLBREAK, ECALL),  exec_ECALL,  FMT_I),
+    INST("ebreak",  MASK_ALL, MATCH_IMM(CSR, ECALLBREAK, EBREAK), exec_EBREAK, FMT_I),
+    INST("wfi",     MASK_ALL, MATCH_IMM(CSR, ECALLBREAK, WFI),    exec_WFI,    FMT_I),
+
+    INST("csrrw",   MASK_FUNCT3, MATCH_I(CSR, CSRRW),  EXEC(CSRRW),  FMT_I),
+    INST("csrrs",   MASK_FUNCT3, MATCH_I(CSR, CSRRS),  EXEC(CSRRS),  FMT_I),
+    INST("csrrc",   MASK_FUNCT3, MATCH_I(CSR, CSRRC),  EXEC(CSRRC),  FMT_I),
+    INST("csrrwi",  MASK_FUNCT3, MATCH_I(CSR, CSRRWI), EXEC(CSRRWI), FMT_I),
+    INST("csrrsi",  MASK_FUNCT3, MATCH_I(CSR, CSRRSI), EXEC(CSRRSI), FMT_I),
+    INST("csrrci",  MASK_FUNCT3, MATCH_I(CSR, CSRRCI), EXEC(CSRRCI), FMT_I),
+
+    // M
+    INST("mul",     MASK_FUNCT7, MATCH_R(R_TYPE, MUL, MULDIV),    EXEC(MUL),    FMT_R),
+    INST("mulh",    MASK_FUNCT7, MATCH_R(R_TYPE, MULH, MULDIV),   EXEC(MULH),   FMT_R),
+    INST("mulhsu",  MASK_FUNCT7, MATCH_R(R_TYPE, MULHSU, MULDIV), EXEC(MULHSU), FMT_R),
+    INST("mulhu",   MASK_FUNCT7, MATCH_R(R_TYPE, MULHU, MULDIV),  EXEC(MULHU),  FMT_R),
+    INST("div",     MASK_FUNCT7, MATCH_R(R_TYPE, DIV, MULDIV),    EXEC(DIV),    FMT_R),
+    INST("divu",    MASK_FUNCT7, MATCH_R(R_TYPE, DIVU, MULDIV),   EXEC(DIVU),   FMT_R),
+    INST("rem",     MASK_FUNCT7, MATCH_R(R_TYPE, REM, MULDIV),    EXEC(REM),    FMT_R),
+    INST("remu",    MASK_FUNCT7, MATCH_R(R_TYPE, REMU, MULDIV),   EXEC(REMU),   FMT_R),
+
+    // A
+#define AMO_INSTS(w, f3)                                                            \
+    INST("lr." w,       MASK_LR,     MATCH_AMO(f3, LR),      EXEC(LR),  FMT_R),     \
+    INST("sc." w,       MASK_FUNCT5, MATCH_AMO(f3, SC),      EXEC(SC),  FMT_R),     \
+    INST("amoswap." w,  MASK_FUNCT5, MATCH_AMO(f3, AMOSWAP), EXEC(AMO), FMT_R),     \
+    INST("amoadd." w,   MASK_FUNCT5, MATCH_AMO(f3, AMOADD),  EXEC(AMO), FMT_R),     \
+    INST("amoxor." w,   MASK_FUNCT5, MATCH_AMO(f3, AMOXOR),  EXEC(AMO), FMT_R),     \
+    INST("amoand." w,   MASK_FUNCT5, MATCH_AMO(f3, AMOAND),  EXEC(AMO), FMT_R),     \
+    INST("amoor." w,    MASK_FUNCT5, MATCH_AMO(f3, AMOOR),   EXEC(AMO), FMT_R),     \
+    INST("amomin." w,   MASK_FUNCT5, MATCH_AMO(f3, AMOMIN),  EXEC(AMO), FMT_R),     \
+    INST("amomax." w,   MASK_FUNCT5, MATCH_AMO(f3, AMOMAX),  EXEC(AMO), FMT_R),     \
+    INST("amominu." w,  MASK_FUNCT5, MATCH_AMO(f3, AMOMINU), EXEC(AMO), FMT_R),     \
+    INST("amomaxu." w,  MASK_FUNCT5, MATCH_AMO(f3, AMOMAXU), EXEC(AMO), FMT_R)
+    AMO_INSTS("w", AMO_W),
+
+#if XLEN == 64
+    AMO_INSTS("d", AMO_D),
+
+    // RV64I
+    INST("ld",      MASK_FUNCT3, MATCH_I(LOAD, LD),  EXEC(LD),  FMT_I),
+    INST("lwu",     MASK_FUNCT3, MATCH_I(LOAD, LWU), EXEC(LWU), FMT_I),
+    INST("sd",      MASK_FUNCT3, MATCH_I(S_TYPE, SD), EXEC(SD), FMT_S),
+    INST("addiw",   MASK_FUNCT3, MATCH_I(I_TYPE_64, ADDIW),          EXEC(ADDIW), FMT_I),
+    INST("slliw",   MASK_FUNCT7, MATCH_R(I_TYPE_64, SLLIW, 0),       EXEC(SLLIW), FMT_I),
+    INST("srliw",   MASK_FUNCT7, MATCH_R(I_TYPE_64, SRIW, SRLIW),    EXEC(SRLIW), FMT_I),
+    INST("sraiw",   MASK_FUNCT7, MATCH_R(I_TYPE_64, SRIW, SRAIW),    EXEC(SRAIW), FMT_I),
+    INST("addw",    MASK_FUNCT7, MATCH_R(R_TYPE_64, ADDSUB, ADDW),   EXEC(ADDW),  FMT_R),
+    INST("subw",    MASK_FUNCT7, MATCH_R(R_TYPE_64, ADDSUB, SUBW),   EXEC(SUBW),  FMT_R),
+    INST("sllw",    MASK_FUNCT7, MATCH_R(R_TYPE_64, SLLW, 0),        EXEC(SLLW),  FMT_R),
+    INST("srlw",    MASK_FUNCT7, MATCH_R(R_TYPE_64, SRW, SRLW),      EXEC(SRLW),  FMT_R),
+    INST("sraw",    MASK_FUNCT7, MATCH_R(R_TYPE_64, SRW, SRAW),      EXEC(SRAW),  FMT_R),
+
+    // RV64M
+    INST("mulw",    MASK_FUNCT7, MATCH_R(R_TYPE_64, MULW, MULDIV),  EXEC(MULW),  FMT_R),
+    INST("divw",    MASK_FUNCT7, MATCH_R(R_TYPE_64, DIVW, MULDIV),  EXEC(DIVW),  FMT_R),
+    INST("divuw",   MASK_FUNCT7, MATCH_R(R_TYPE_64, DIVUW, MULDIV), EXEC(DIVUW), FMT_R),
+    INST("remw",    MASK_FUNCT7, MATCH_R(R_TYPE_64, REMW, MULDIV),  EXEC(REMW),  FMT_R),
+    INST("remuw",   MASK_FUNCT7, MATCH_R(R_TYPE_64, REMUW, MULDIV), EXEC(REMUW), FMT_R),
+
+    // F/D：整组交给`fpu_execute()`细分
+    INST("flw",     MASK_FUNCT3, MATCH_I(LOAD_FP, FLW),  fpu_execute, FMT_I),
+    INST("fld",     MASK_FUNCT3, MATCH_I(LOAD_FP, FLD),  fpu_execute, FMT_I),
+    INST("fsw",     MASK_FUNCT3, MATCH_I(STORE_FP, FSW), fpu_execute, FMT_S),
+    INST("fsd",     MASK_FUNCT3, MATCH_I(STORE_FP, FSD), fpu_execute, FMT_S),
+    INST("fmadd",   MASK_OPCODE, MATCH_OP(FMADD),  fpu_execute, FMT_R4),
+    INST("fmsub",   MASK_OPCODE, MATCH_OP(FMSUB),  fpu_execute, FMT_R4),
+    INST("fnmsub",  MASK_OPCODE, MATCH_OP(FNMSUB), fpu_execute, FMT_R4),
+    INST("fnmadd",  MASK_OPCODE, MATCH_OP(FNMADD), fpu_execute, FMT_R4),
+    INST("op-fp",   MASK_OPCODE, MATCH_OP(OP_FP),  fpu_execute, FMT_R),
+
+    // V：访存复用 LOAD_FP/STORE_FP（width = 0/5/6/7），整组交给`rvv_execute()`细分
+    INST("vl8",     MASK_FUNCT3, MATCH_I(LOAD_FP, 0),  rvv_execute, FMT_I),
+    INST("vl16",    MASK_FUNCT3, MATCH_I(LOAD_FP, 5),  rvv_execute, FMT_I),
+    INST("vl32",    MASK_FUNCT3, MATCH_I(LOAD_FP, 6),  rvv_execute, FMT_I),
+    INST("vl64",    MASK_FUNCT3, MATCH_I(LOAD_FP, 7),  rvv_execute, FMT_I),
+    INST("vs8",     MASK_FUNCT3, MATCH_I(STORE_FP, 0), rvv_execute, FMT_S),
+    INST("vs16",    MASK_FUNCT3, MATCH_I(STORE_FP, 5), rvv_execute, FMT_S),
+    INST("vs32",    MASK_FUNCT3, MATCH_I(STORE_FP, 6), rvv_execute, FMT_S),
+    INST("vs64",    MASK_FUNCT3, MATCH_I(STORE_FP, 7), rvv_execute, FMT_S),
+    INST("op-v",    MASK_OPCODE, MATCH_OP(OP_V),       rvv_execute, FMT_R),
+
+    // Zba/Zbb/Zbc
+    INST("sh1add",  MASK_FUNCT7, MATCH_R(R_TYPE, 2, ZB_SHADD),  bitmanip_execute, FMT_R),
+    INST("sh2add",  MASK_FUNCT7, MATCH_R(R_TYPE, 4, ZB_SHADD),  bitmanip_execute, FMT_R),
+    INST("sh3add",  MASK_FUNCT7, MATCH_R(R_TYPE, 6, ZB_SHADD),  bitmanip_execute, FMT_R),
+    INST("xnor",    MASK_FUNCT7, MATCH_R(R_TYPE, 4, ZB_NOT),    bitmanip_execute, FMT_R),
+    INST("orn",     MASK_FUNCT7, MATCH_R(R_TYPE, 6, ZB_NOT),    bitmanip_execute, FMT_R),
+    INST("andn",    MASK_FUNCT7, MATCH_R(R_TYPE, 7, ZB_NOT),    bitmanip_execute, FMT_R),
+    INST("clmul",   MASK_FUNCT7, MATCH_R(R_TYPE, 1, ZB_MINMAX), bitmanip_execute, FMT_R),
+    INST("clmulr",  MASK_FUNCT7, MATCH_R(R_TYPE, 2, ZB_MINMAX), bitmanip_execute, FMT_R),
+    INST("clmulh",  MASK_FUNCT7, MATCH_R(R_TYPE, 3, ZB_MINMAX), bitmanip_execute, FMT_R),
+    INST("min",     MASK_FUNCT7, MATCH_R(R_TYPE, 4, ZB_MINMAX), bitmanip_execute, FMT_R),
+    INST("minu",    MASK_FUNCT7, MATCH_R(R_TYPE, 5, ZB_MINMAX), bitmanip_execute, FMT_R),
+    INST("max",     MASK_FUNCT7, MATCH_R(R_TYPE, 6, ZB_MINMAX), bitmanip_execute, FMT_R),
+    INST("maxu",    MASK_FUNCT7, MATCH_R(R_TYPE, 7, ZB_MINMAX), bitmanip_execute, FMT_R),
+    INST("rol",     MASK_FUNCT7, MATCH_R(R_TYPE, 1, ZB_ROT),    bitmanip_execute, FMT_R),
+    INST("ror",     MASK_FUNCT7, MATCH_R(R_TYPE, 5, ZB_ROT),    bitmanip_execute, FMT_R),
+    INST("add.uw",  MASK_FUNCT7, MATCH_R(R_TYPE_64, 0, ZB_ADDUW), bitmanip_execute, FMT_R),
+    INST("zext.h",  MASK_IMM,    MATCH_R(R_TYPE_64, 4, ZB_ADDUW), bitmanip_execute, FMT_R),
+    INST("sh1add.uw", MASK_FUNCT7, MATCH_R(R_TYPE_64, 2, ZB_SHADD), bitmanip_execute, FMT_R),
+    INST("sh2add.uw", MASK_FUNCT7, MATCH_R(R_TYPE_64, 4, ZB_SHADD), bitmanip_execute, FMT_R),
+    INST("sh3add.uw", MASK_FUNCT7, MATCH_R(R_TYPE_64, 6, ZB_SHADD), bitmanip_execute, FMT_R),
+    INST("rolw",    MASK_FUNCT7, MATCH_R(R_TYPE_64, 1, ZB_ROT), bitmanip_execute, FMT_R),
+    INST("rorw",    MASK_FUNCT7, MATCH_R(R_TYPE_64, 5, ZB_ROT), bitmanip_execute, FMT_R),
+    INST("clz",     MASK_IMM, MATCH_IMM(I_TYPE, 1, ZB_UNARY << 5 | 0), bitmanip_execute, FMT_I),
+    INST("ctz",     MASK_IMM, MATCH_IMM(I_TYPE, 1, ZB_UNARY << 5 | 1), bitmanip_execute, FMT_I),
+    INST("cpop",    MASK_IMM, MATCH_IMM(I_TYPE, 1, ZB_UNARY << 5 | 2), bitmanip_execute, FMT_I),
+    INST("sext.b",  MASK_IMM, MATCH_IMM(I_TYPE, 1, ZB_UNARY << 5 | 4), bitmanip_execute, FMT_I),
+    INST("sext.h",  MASK_IMM, MATCH_IMM(I_TYPE, 1, ZB_UNARY << 5 | 5), bitmanip_execute, FMT_I),
+    INST("rori",    MASK_FUNCT6, MATCH_IMM(I_TYPE, 5, ZB_RORI << 6),   bitmanip_execute, FMT_I),
+    INST("orc.b",   MASK_IMM, MATCH_IMM(I_TYPE, 5, ZB_ORCB),           bitmanip_execute, FMT_I),
+    INST("rev8",    MASK_IMM, MATCH_IMM(I_TYPE, 5, ZB_REV8),           bitmanip_execute, FMT_I),
+    INST("clzw",    MASK_IMM, MATCH_IMM(I_TYPE_64, 1, ZB_UNARY << 5 | 0), bitmanip_execute, FMT_I),
+    INST("ctzw",    MASK_IMM, MATCH_IMM(I_TYPE_64, 1, ZB_UNARY << 5 | 1), bitmanip_execute, FMT_I),
+    INST("cpopw",   MASK_IMM, MATCH_IMM(I_TYPE_64, 1, ZB_UNARY << 5 | 2), bitmanip_execute, FMT_I),
+    INST("slli.uw", MASK_FUNCT6, MATCH_IMM(I_TYPE_64, 1, ZB_SLLIUW << 6), bitmanip_execute, FMT_I),
+    INST("roriw",   MASK_FUNCT7, MATCH_R(I_TYPE_64, 5, ZB_ROT),           bitmanip_execute, FMT_I),
+
+    // Zkne/Zknd/Zknh
+    INST("aes64es",   MASK_FUNCT7, MATCH_R(R_TYPE, 0, ZK_AES64ES),  crypto_execute, FMT_R),
+    INST("aes64esm",  MASK_FUNCT7, MATCH_R(R_TYPE, 0, ZK_AES64ESM), crypto_execute, FMT_R),
+    INST("aes64ds",   MASK_FUNCT7, MATCH_R(R_TYPE, 0, ZK_AES64DS),  crypto_execute, FMT_R),
+    INST("aes64dsm",  MASK_FUNCT7, MATCH_R(R_TYPE, 0, ZK_AES64DSM), crypto_execute, FMT_R),
+    INST("aes64ks2",  MASK_FUNCT7, MATCH_R(R_TYPE, 0, ZK_AES64KS2), crypto_execute, FMT_R),
+    INST("aes64im",   MASK_IMM,    MATCH_IMM(I_TYPE, 1, ZK_AES64KS << 5),        crypto_execute, FMT_I),
+    INST("aes64ks1i", MASK_IMM & ~(0xf << 20), MATCH_IMM(I_TYPE, 1, ZK_AES64KS << 5 | 0x10), crypto_execute, FMT_I),
+    INST("sha2",      MASK_FUNCT7, MATCH_R(I_TYPE, 1, ZK_SHA),      crypto_execute, FMT_I),
+#endif
+#undef AMO_INSTS
+};
+
+#undef INST
+
+// ==================================================================== //
+//                          Undefine: XLEN
+// ==================================================================== //
+
+#undef UX
+#undef SX
+#undef UDX
+#undef SDX
+#undef SX_MIN
+#undef MASK_SHIFT
+#undef EXEC
+#undef EXEC_FN
+#undef INSTS
+#undef X
+#undef SETX
+#undef SHAMT
+#undef JUMP
@@ -0,0 +1,234 @@
+/**
+ * @file crypto.c
+ * @author lancer (lancerstadium@163.com)
+ * @brief 标量密码扩展（Zkne/Zknd/Zknh）实现
+ * @version 0.1
+ * @date 2024-01-28
+ * @copyright Copyright (c) 2024
+ * @note 128 位 AES 状态按字节小端存放：`rs1`为第 0、1 列，`rs2`为第 2、3 列，
+ * 第 i 个字节位于第 i / 4 列、第 i % 4 行，与 AES-NI 的 xmm 布局一致。
+ */
+
+// ==================================================================== //
+//                              Include
+// ==================================================================== //
+
+#include "crypto.h"
+#include "utils.h"
+#include <pthread.h>
+#include <string.h>
+#if defined(__x86_64__)
+#include <wmmintrin.h>
+#endif
+
+// ==================================================================== //
+//                              Defines
+// ==================================================================== //
+
+#define ZK_AES64IM  0x00            /** 内部记号：aes64im（不与 funct7 冲突） */
+
+// ==================================================================== //
+//                            Data: CRYPTO
+// ==================================================================== //
+
+static u8 aes_sbox[256];            /** AES S 盒 */
+static u8 aes_inv_sbox[256];        /** AES 逆 S 盒 */
+static int crypto_aesni;            /** 主机支持 AES-NI */
+static pthread_once_t crypto_once = PTHREAD_ONCE_INIT;
+
+/** aes64ks1i 的轮常数，rnum = 0xA 时为 0 */
+static const u8 aes_rcon[11] = {
+    0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36, 0x00
+};
+
+// ==================================================================== //
+//                         Private Func: CRYPTO
+// ==================================================================== //
+
+static void print_op(char* s) {
+    if (log_trace_on)
+        printf(_blue("%s"), s);
+}
+
+static inline u64 rd(u32 inst)  { return (inst >> 7) & 0x1f; }
+static inline u64 rs1(u32 inst) { return (inst >> 15) & 0x1f; }
+static inline u64 rs2(u32 inst) { return (inst >> 20) & 0x1f; }
+
+static inline u32 ror32(u32 x, u32 n) { return (x >> n) | (x << (32 - n)); }
+static inline u64 ror64(u64 x, u32 n) { return (x >> n) | (x << (64 - n)); }
+static inline u8  rol8(u8 x, u32 n)   { return (u8)((x << n) | (x >> (8 - n))); }
+
+/** GF(2^8) 乘 2 */
+static inline u8 xt(u8 x) {
+    return (u8)((x << 1) ^ ((x & 0x80) ? 0x1b : 0));
+}
+
+/** GF(2^8) 乘法 */
+static inline u8 gmul(u8 a, u8 b) {
+    u8 p = 0;
+    while (b) {
+        if (b & 1) p ^= a;
+        a = xt(a);
+        b >>= 1;
+    }
+    return p;
+}
+
+/** 由 GF(2^8) 乘法逆元与仿射变换生成 S 盒 */
+static void crypto_setup() {
+    u8 p = 1, q = 1;
+    do {
+        p = p ^ (u8)(p << 1) ^ ((p & 0x80) ? 0x1b : 0);     // p *= 3
+        q ^= q << 1;                                        // q /= 3
+        q ^= q << 2;
+        q ^= q << 4;
+        if (q & 0x80) q ^= 0x09;
+        aes_sbox[p] = q ^ rol8(q, 1) ^ rol8(q, 2) ^ rol8(q, 3) ^ rol8(q, 4) ^ 0x63;
+    } while (p != 1);
+    aes_sbox[0] = 0x63;
+    for (int i = 0; i < 256; i++)
+        aes_inv_sbox[aes_sbox[i]] = (u8)i;
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    crypto_aesni = __builtin_cpu_supports("aes");
+#endif
+}
+
+/** 一列 MixColumns / InvMixColumns */
+static inline void aes_mix(u8* a, int inv) {
+    u8 a0 = a[0], a1 = a[1], a2 = a[2], a3 = a[3];
+    if (!inv) {
+        a[0] = xt(a0) ^ xt(a1) ^ a1 ^ a2 ^ a3;
+        a[1] = a0 ^ xt(a1) ^ xt(a2) ^ a2 ^ a3;
+        a[2] = a0 ^ a1 ^ xt(a2) ^ xt(a3) ^ a3;
+        a[3] = xt(a0) ^ a0 ^ a1 ^ a2 ^ xt(a3);
+    } else {
+        a[0] = gmul(a0, 14) ^ gmul(a1, 11) ^ gmul(a2, 13) ^ gmul(a3, 9);
+        a[1] = gmul(a0, 9)  ^ gmul(a1, 14) ^ gmul(a2, 11) ^ gmul(a3, 13);
+        a[2] = gmul(a0, 13) ^ gmul(a1, 9)  ^ gmul(a2, 14) ^ gmul(a3, 11);
+        a[3] = gmul(a0, 11) ^ gmul(a1, 13) ^ gmul(a2, 9)  ^ gmul(a3, 14);
+    }
+}
+
+/**
+ * @brief AES 轮函数：可移植实现
+ * @param op funct7（ZK_AES64ES 等）或 ZK_AES64IM
+ */
+static u64 aes64_soft(u32 op, u64 a, u64 b) {
+    u8 s[16], t[8];
+    u64 r;
+    memcpy(s, &a, 8);
+    memcpy(s + 8, &b, 8);
+    if (op == ZK_AES64IM) {
+        memcpy(t, s, 8);
+    } else {
+        int enc = op == ZK_AES64ES || op == ZK_AES64ESM;
+        for (int i = 0; i < 8; i++) {
+            int c = i >> 2, row = i & 3;
+            int src = (enc ? (c + row) & 3 : (c - row) & 3) * 4 + row;     // (Inv)ShiftRows
+            t[i] = enc ? aes_sbox[s[src]] : aes_inv_sbox[s[src]];          // (Inv)SubBytes
+        }
+    }
+    if (op == ZK_AES64ESM || op == ZK_AES64DSM || op == ZK_AES64IM) {
+        aes_mix(t, op != ZK_AES64ESM);
+        aes_mix(t + 4, op != ZK_AES64ESM);
+    }
+    memcpy(&r, t, 8);
+    return r;
+}
+
+#if defined(__x86_64__)
+/**
+ * @brief AES 轮函数：AES-NI（轮密钥取 0）
+ */
+static __attribute__((target("aes"))) u64 aes64_host(u32 op, u64 a, u64 b) {
+    __m128i s = _mm_set_epi64x((long long)b, (long long)a);
+    __m128i z = _mm_setzero_si128();
+    switch (op) {
+        case ZK_AES64ES:  s = _mm_aesenclast_si128(s, z); break;
+        case ZK_AES64ESM: s = _mm_aesenc_si128(s, z);     break;
+        case ZK_AES64DS:  s = _mm_aesdeclast_si128(s, z); break;
+        case ZK_AES64DSM: s = _mm_aesdec_si128(s, z);     break;
+        default:          s = _mm_aesimc_si128(s);        break;
+    }
+    return (u64)_mm_cvtsi128_si64(s);
+}
+#endif
+
+static inline u64 aes64(u32 op, u64 a, u64 b) {
+#if defined(__x86_64__)
+    if (crypto_aesni)
+        return aes64_host(op, a, b);
+#endif
+    return aes64_soft(op, a, b);
+}
+
+// ==================================================================== //
+//                           Func API: CRYPTO
+// ==================================================================== //
+
+void crypto_init() {
+    pthread_once(&crypto_once, crypto_setup);
+}
+
+int crypto_execute(CPU* cpu, u32 inst) {
+    u32 opcode = inst & 0x7f;
+    u32 funct7 = inst >> 25;
+    u64 a = cpu->regs[rs1(inst)];
+    u64 b = cpu->regs[rs2(inst)];
+    u32 x = (u32)a;
+    u64 r;
+    char* name;
+
+    if (opcode == R_TYPE) {
+        switch (funct7) {
+            case ZK_AES64ES:  r = aes64(funct7, a, b); name = "aes64es\n";  break;
+            case ZK_AES64ESM: r = aes64(funct7, a, b); name = "aes64esm\n"; break;
+            case ZK_AES64DS:  r = aes64(funct7, a, b); name = "aes64ds\n";  break;
+            case ZK_AES64DSM: r = aes64(funct7, a, b); name = "aes64dsm\n"; break;
+            case ZK_AES64KS2: {
+                u32 w0 = (u32)(a >> 32) ^ (u32)b;
+                u32 w1 = w0 ^ (u32)(b >> 32);
+                r = (u64)w1 << 32 | w0;
+                name = "aes64ks2\n";
+                break;
+            }
+            default: return 0;
+        }
+    } else if (funct7 == ZK_AES64KS) {
+        u32 sel = rs2(inst);
+        if (sel == 0) {
+            r = aes64(ZK_AES64IM, a, 0);
+            name = "aes64im\n";
+        } else if ((sel & 0x10) && (sel & 0xf) <= 0xa) {
+            u32 rnum = sel & 0xf;
+            u32 w = (u32)(a >> 32);
+            if (rnum != 0xa)
+                w = ror32(w, 8);                                // RotWord
+            w = (u32)aes_sbox[w & 0xff]                         // SubWord
+              | (u32)aes_sbox[(w >> 8) & 0xff] << 8
+              | (u32)aes_sbox[(w >> 16) & 0xff] << 16
+              | (u32)aes_sbox[w >> 24] << 24;
+            w ^= aes_rcon[rnum];
+            r = (u64)w << 32 | w;
+            name = "aes64ks1i\n";
+        } else {
+            return 0;
+        }
+    } else {
+        switch (rs2(inst)) {
+            case 0: r = (int64_t)(int32_t)(ror32(x, 2) ^ ror32(x, 13) ^ ror32(x, 22)); name = "sha256sum0\n"; break;
+            case 1: r = (int64_t)(int32_t)(ror32(x, 6) ^ ror32(x, 11) ^ ror32(x, 25)); name = "sha256sum1\n"; break;
+            case 2: r = (int64_t)(int32_t)(ror32(x, 7) ^ ror32(x, 18) ^ (x >> 3));     name = "sha256sig0\n"; break;
+            case 3: r = (int64_t)(int32_t)(ror32(x, 17) ^ ror32(x, 19) ^ (x >> 10));   name = "sha256sig1\n"; break;
+            case 4: r = ror64(a, 28) ^ ror64(a, 34) ^ ror64(a, 39);                    name = "sha512sum0\n"; break;
+            case 5: r = ror64(a, 14) ^ ror64(a, 18) ^ ror64(a, 41);                    name = "sha512sum1\n"; break;
+            case 6: r = ror64(a, 1) ^ ror64(a, 8) ^ (a >> 7);                          name = "sha512sig0\n"; break;
+            case 7: r = ror64(a, 19) ^ ror64(a, 61) ^ (a >> 6);                        name = "sha512sig1\n"; break;
+            default: return 0;
+        }
+    }
+    cpu->regs[rd(inst)] = r;
+    print_op(name);
+    return 1;
+}
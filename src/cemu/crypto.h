@@ -0,0 +1,53 @@
+/**
+ * @file crypto.h
+ * @author lancer (lancerstadium@163.com)
+ * @brief 标量密码扩展（Zkne/Zknd/Zknh）头文件
+ * @version 0.1
+ * @date 2024-01-28
+ * @copyright Copyright (c) 2024
+ *
+ * # 标量密码扩展介绍
+ * - Zkne/Zknd：AES 轮函数辅助指令（RV64）。128 位状态拆成两个寄存器`{rs2, rs1}`，
+ * 一条指令算出结果的低 64 位（两列），交换操作数即得另外两列：
+ * 1. `aes64es`/`aes64esm`：加密末轮/中间轮（ShiftRows、SubBytes[、MixColumns]）；
+ * 2. `aes64ds`/`aes64dsm`：解密末轮/中间轮；
+ * 3. `aes64im`：InvMixColumns，`aes64ks1i`/`aes64ks2`：密钥扩展。
+ *
+ * - Zknh：SHA-256/SHA-512 的 sigma/sum 函数。
+ *
+ * - 主机支持 AES-NI 时，轮函数直接映射为`aesenc`/`aesenclast`/`aesdec`/`aesdeclast`/`aesimc`
+ * （轮密钥取 0，由来宾随后异或）；否则用查表的可移植实现。
+ * SHA-NI 以整轮为单位，与单个 sigma 函数对不上，sigma/sum 用移位异或实现，
+ * 编译后为几条主机循环移位指令。
+ */
+
+
+#ifndef CRYPTO_H
+#define CRYPTO_H
+
+// ==================================================================== //
+//                             Include
+// ==================================================================== //
+
+#include "cpu.h"
+#include "opcode.h"
+
+// ==================================================================== //
+//                          Declare API: CRYPTO
+// ==================================================================== //
+
+/**
+ * @brief 检测主机 AES-NI（可重复调用，只检测一次）
+ */
+void crypto_init();
+
+/**
+ * @brief 执行一条标量密码指令
+ * @param cpu 中央处理器
+ * @param inst 32-bit 指令数据
+ * @return int 1 成功，0 非法指令
+ */
+int crypto_execute(CPU* cpu, u32 inst);
+
+
+#endif // CRYPTO_H
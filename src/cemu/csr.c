@@ -1,12 +1,22 @@
 /**
  * @file csr.c
  * @author lancer (lancerstadium@163.com)
- * @brief CSR 
+ * @brief CSR
  * @version 0.1
  * @date 2024-01-08
- * 
+ *
  * @copyright Copyright (c) 2024
- * 
+ *
+ * @note CSR 由一张稀疏表描述：每项给出编号（或一段连续编号）、存储槽、可写位（WARL 掩码）
+ * 以及可选的读写处理函数。没有处理函数的 CSR 直接读写存储槽；
+ * 没有存储槽的 CSR（如 hpmcounter、misa）读出固定值，写入被忽略。
+ * 访问所需的特权级与只读属性由编号本身给出：`csr[9:8]`为最低特权级，`csr[11:10] = 3`为只读。
+ *
+ * `cycle`/`instret`不逐条指令更新，而是在读取时由已退休指令数`instret`加上偏移得到，
+ * 写`mcycle`/`minstret`只改偏移；`time`由`clint_mtime()`按主机时钟换算。
+ *
+ * RV32 与 RV64 共用一张表：`misa`/`mstatus`/`satp`与计数器的处理函数按`cpu->xlen`给出对应布局，
+ * 计数器高 32 位（`cycleh`等）与`mstatush`只在 RV32 下可访问。
  */
 
 // ==================================================================== //
@@ -14,16 +24,309 @@
 // ==================================================================== //
 
 #include "csr.h"
+#include "fpu.h"
+#include <pthread.h>
+#include <string.h>
 
+// ==================================================================== //
+//                              Defines
+// ==================================================================== //
+
+#define CS_NONE         CS_NUM      /** 无存储槽 */
+
+#define MIP_S_MASK      (MIP_SSIP | MIP_STIP | MIP_SEIP)
+#define MIE_MASK        (MIP_S_MASK | MIP_MSIP | MIP_MTIP | MIP_MEIP)
+
+/** mstatus 可写位 */
+#define MSTATUS_WMASK   (MSTATUS_SIE | MSTATUS_MIE | MSTATUS_SPIE | MSTATUS_MPIE | MSTATUS_SPP \
+                       | MSTATUS_MPP | MSTATUS_FS | MSTATUS_VS | MSTATUS_MPRV | MSTATUS_SUM \
+                       | MSTATUS_MXR | MSTATUS_TVM | MSTATUS_TW | MSTATUS_TSR)
+/** sstatus 可见位与可写位 */
+#define SSTATUS_WMASK   (MSTATUS_SIE | MSTATUS_SPIE | MSTATUS_SPP | MSTATUS_FS | MSTATUS_VS \
+                       | MSTATUS_SUM | MSTATUS_MXR)
+#define SSTATUS_RMASK   (SSTATUS_WMASK | MSTATUS_UXL | MSTATUS_SD)
+
+/** misa：RV64 ACDFIMSUV，RV32 ACIMSU */
+#define MISA_EXT(c)     ((u64)1 << ((c) - 'A'))
+#define MISA_VALUE      ((u64)2 << 62 | MISA_EXT('A') | MISA_EXT('C') | MISA_EXT('D') | MISA_EXT('F') \
+                       | MISA_EXT('I') | MISA_EXT('M') | MISA_EXT('S') | MISA_EXT('U') | MISA_EXT('V'))
+#define MISA32_VALUE    ((u64)1 << 30 | MISA_EXT('A') | MISA_EXT('C') | MISA_EXT('I') | MISA_EXT('M') \
+                       | MISA_EXT('S') | MISA_EXT('U'))
+
+/** RV32 专有 CSR：计数器高 32 位与 mstatush */
+#define CSR_RV32_ONLY(c)    (((c) >= CYCLEH && (c) <= HPMCOUNTER31H) \
+                           || ((c) >= MCYCLEH && (c) <= MHPMCOUNTER31H) || (c) == MSTATUSH)
+/** 计数器高 32 位：编号比低 32 位多 0x80 */
+#define CSR_HIGH(c)         ((c) & 0x80)
+
+typedef u64 (*CSR_READ)(CPU* cpu, u32 csr);
+typedef void (*CSR_WRITE)(CPU* cpu, u32 csr, u64 value);
+
+// ==================================================================== //
+//                              Data: CSR
+// ==================================================================== //
+
+/** CSR 表项 */
+typedef struct CSR_DESC_t {
+    u16 num;            /** 起始编号 */
+    u16 count;          /** 连续编号个数，占用同样多的存储槽 */
+    u8 slot;            /** 存储槽：CSR_SLOT，CS_NONE 无存储 */
+    u64 wmask;          /** 可写位 */
+    CSR_READ read;      /** 读处理函数，NULL 读存储槽 */
+    CSR_WRITE write;    /** 写处理函数，NULL 按掩码写存储槽 */
+} CSR_DESC;
+
+// ==================================================================== //
+//                            Private Func: CSR
+// ==================================================================== //
+
+static inline void csr_fs_dirty(CPU* cpu) {
+    cpu->csr[CS_MSTATUS] |= MSTATUS_FS;
+}
+
+static u64 csr_rd_fflags(CPU* cpu, u32 csr) {
+    return fpu_get_fflags(cpu);
+}
+static void csr_wr_fflags(CPU* cpu, u32 csr, u64 value) {
+    fpu_set_fflags(cpu, value);
+    csr_fs_dirty(cpu);
+}
+static void csr_wr_frm(CPU* cpu, u32 csr, u64 value) {
+    cpu->csr[CS_FRM] = value & 0x7;
+    fpu_sync_rm(cpu);                       // 立即切换主机舍入模式
+    csr_fs_dirty(cpu);
+}
+static u64 csr_rd_fcsr(CPU* cpu, u32 csr) {
+    return (cpu->csr[CS_FRM] & 0x7) << 5 | fpu_get_fflags(cpu);
+}
+static void csr_wr_fcsr(CPU* cpu, u32 csr, u64 value) {
+    csr_wr_frm(cpu, csr, value >> 5);
+    fpu_set_fflags(cpu, value);
+}
+
+static u64 csr_rd_vcsr(CPU* cpu, u32 csr) {
+    return (cpu->csr[CS_VXRM] & 0x3) << 1 | (cpu->csr[CS_VXSAT] & 0x1);
+}
+static void csr_wr_vcsr(CPU* cpu, u32 csr, u64 value) {
+    cpu->csr[CS_VXRM] = (value >> 1) & 0x3;
+    cpu->csr[CS_VXSAT] = value & 0x1;
+}
+static u64 csr_rd_vlenb(CPU* cpu, u32 csr) {
+    return CPU_VLENB;
+}
+
+// 计数器：每条指令一个周期，cycle 与 instret 同源；`*h`读高 32 位
+static u64 csr_rd_cycle(CPU* cpu, u32 csr) {
+    u64 v = cpu->instret + cpu->csr[CS_MCYCLE];
+    return CSR_HIGH(csr) ? v >> 32 : v;
+}
+static u64 csr_rd_instret(CPU* cpu, u32 csr) {
+    u64 v = cpu->instret + cpu->csr[CS_MINSTRET];
+    return CSR_HIGH(csr) ? v >> 32 : v;
+}
+static u64 csr_rd_time(CPU* cpu, u32 csr) {
+    u64 v = clint_mtime(cpu->clint);
+    return CSR_HIGH(csr) ? v >> 32 : v;
+}
+static void csr_wr_counter(CPU* cpu, u32 csr, u64 value) {
+    u32 slot = (csr & 0x2) ? CS_MINSTRET : CS_MCYCLE;
+    if (cpu->xlen == 32) {
+        // RV32 只写一半，另一半保持不变
+        u64 cur = cpu->instret + cpu->csr[slot];
+        value = CSR_HIGH(csr) ? (u32)cur | value << 32 : (cur & ~(u64)0xffffffff) | (u32)value;
+    }
+    // 写计数器的这条指令本身不计数：下一条指令读到的正好是`value`
+    cpu->csr[slot] = value - cpu->instret - 1;
+}
+
+static u64 csr_rd_misa(CPU* cpu, u32 csr) {
+    return cpu->xlen == 32 ? MISA32_VALUE : MISA_VALUE;
+}
+
+static u64 csr_rd_mstatus(CPU* cpu, u32 csr) {
+    u64 s = cpu->csr[CS_MSTATUS];
+    int dirty = (s & MSTATUS_FS) == MSTATUS_FS || (s & MSTATUS_VS) == MSTATUS_VS;
+    if (cpu->xlen == 32)                                            // 没有 UXL/SXL
+        return dirty ? s | MSTATUS32_SD : s;
+    s |= (u64)2 << 32 | (u64)2 << 34;                               // UXL = SXL = 64
+    return dirty ? s | MSTATUS_SD : s;
+}
+static void csr_wr_mstatus(CPU* cpu, u32 csr, u64 value) {
+    u64 old = cpu->csr[CS_MSTATUS];
+    if ((value & MSTATUS_MPP) == (u64)2 << 11)                      // MPP = 2 保留，保持原值
+        value = (value & ~MSTATUS_MPP) | (old & MSTATUS_MPP);
+    cpu->csr[CS_MSTATUS] = (old & ~MSTATUS_WMASK) | (value & MSTATUS_WMASK);
+}
+static u64 csr_rd_sstatus(CPU* cpu, u32 csr) {
+    return csr_rd_mstatus(cpu, csr) & (SSTATUS_RMASK | MSTATUS32_SD);
+}
+static void csr_wr_sstatus(CPU* cpu, u32 csr, u64 value) {
+    u64 old = cpu->csr[CS_MSTATUS];
+    csr_wr_mstatus(cpu, MSTATUS, (old & ~SSTATUS_WMASK) | (value & SSTATUS_WMASK));
+}
+
+static u64 csr_rd_sie(CPU* cpu, u32 csr) {
+    return cpu->csr[CS_MIE] & MIP_S_MASK;
+}
+static void csr_wr_sie(CPU* cpu, u32 csr, u64 value) {
+    cpu->csr[CS_MIE] = (cpu->csr[CS_MIE] & ~MIP_S_MASK) | (value & MIP_S_MASK);
+}
+static u64 csr_rd_sip(CPU* cpu, u32 csr) {
+    return cpu->csr[CS_MIP] & MIP_S_MASK;
+}
+static void csr_wr_sip(CPU* cpu, u32 csr, u64 value) {
+    cpu->csr[CS_MIP] = (cpu->csr[CS_MIP] & ~MIP_SSIP) | (value & MIP_SSIP);
+}
+
+static void csr_wr_satp(CPU* cpu, u32 csr, u64 value) {
+    if (cpu->xlen == 32) {
+        // Sv32：MODE[31] ASID[30:22] PPN[21:0]，两种模式都合法
+        cpu->csr[CS_SATP] = (u32)value;
+    } else {
+        u64 mode = value >> SATP_MODE_SHIFT;
+        if (mode != SATP_MODE_BARE && mode != SATP_MODE_SV39)
+            return;                         // 不支持的模式：整个写入无效
+        cpu->csr[CS_SATP] = value & ((u64)0xf << 60 | (u64)0xffff << 44 | (((u64)1 << 44) - 1));
+    }
+    cpu->resv_addr = ~(u64)0;               // 地址空间改变，清除 LR 保留
+}
+
+#define CSR_RW(num, slot, wmask)            { num, 1, slot, wmask, NULL, NULL }
+#define CSR_FN(num, slot, wmask, rd, wr)    { num, 1, slot, wmask, rd, wr }
+#define CSR_ZERO(num, count)                { num, count, CS_NONE, 0, NULL, NULL }
+
+static const CSR_DESC csr_table[] = {
+    // 浮点
+    CSR_FN(FFLAGS,  CS_FFLAGS, 0x1f, csr_rd_fflags, csr_wr_fflags),
+    CSR_FN(FRM,     CS_FRM,    0x7,  NULL,          csr_wr_frm),
+    CSR_FN(FCSR,    CS_NONE,   0xff, csr_rd_fcsr,   csr_wr_fcsr),
+    // 向量
+    CSR_RW(VSTART,  CS_VSTART, CPU_VLEN - 1),
+    CSR_RW(VXSAT,   CS_VXSAT,  0x1),
+    CSR_RW(VXRM,    CS_VXRM,   0x3),
+    CSR_FN(VCSR,    CS_NONE,   0x7,  csr_rd_vcsr,   csr_wr_vcsr),
+    CSR_RW(VL,      CS_VL,     0),
+    CSR_RW(VTYPE,   CS_VTYPE,  0),
+    CSR_FN(VLENB,   CS_NONE,   0,    csr_rd_vlenb,  NULL),
+    // 用户计数器
+    CSR_FN(CYCLE,   CS_NONE,   0,    csr_rd_cycle,   NULL),
+    CSR_FN(TIME,    CS_NONE,   0,    csr_rd_time,    NULL),
+    CSR_FN(INSTRET, CS_NONE,   0,    csr_rd_instret, NULL),
+    CSR_ZERO(HPMCOUNTER3, 29),
+    CSR_FN(CYCLEH,   CS_NONE,  0,    csr_rd_cycle,   NULL),
+    CSR_FN(TIMEH,    CS_NONE,  0,    csr_rd_time,    NULL),
+    CSR_FN(INSTRETH, CS_NONE,  0,    csr_rd_instret, NULL),
+    CSR_ZERO(HPMCOUNTER3H, 29),
+    // 监管态
+    CSR_FN(SSTATUS,    CS_NONE,       ~(u64)0, csr_rd_sstatus, csr_wr_sstatus),
+    CSR_FN(SIE,        CS_NONE,       ~(u64)0, csr_rd_sie,     csr_wr_sie),
+    CSR_RW(STVEC,      CS_STVEC,      ~(u64)0x2),             // mode 只支持 Direct/Vectored
+    CSR_RW(SCOUNTEREN, CS_SCOUNTEREN, 0x7),
+    CSR_RW(SSCRATCH,   CS_SSCRATCH,   ~(u64)0),
+    CSR_RW(SEPC,       CS_SEPC,       ~(u64)0x1),
+    CSR_RW(SCAUSE,     CS_SCAUSE,     ~(u64)0),
+    CSR_RW(STVAL,      CS_STVAL,      ~(u64)0),
+    CSR_FN(SIP,        CS_NONE,       ~(u64)0, csr_rd_sip,     csr_wr_sip),
+    CSR_FN(SATP,       CS_SATP,       ~(u64)0, NULL,           csr_wr_satp),
+    // 机器态信息
+    CSR_ZERO(MVENDORID, 3),                                 // mvendorid/marchid/mimpid
+    CSR_RW(MHARTID,    CS_MHARTID,    0),
+    // 机器态
+    CSR_FN(MSTATUS,    CS_MSTATUS,    ~(u64)0, csr_rd_mstatus, csr_wr_mstatus),
+    CSR_FN(MISA,       CS_NONE,       0,       csr_rd_misa,    NULL),
+    CSR_ZERO(MSTATUSH, 1),                                  // 小端，MBE/SBE = 0
+    CSR_RW(MEDELEG,    CS_MEDELEG,    0xf7ff),                // ecall from M 不可委托
+    CSR_RW(MIDELEG,    CS_MIDELEG,    MIP_S_MASK),
+    CSR_RW(MIE,        CS_MIE,        MIE_MASK),
+    CSR_RW(MTVEC,      CS_MTVEC,      ~(u64)0x2),
+    CSR_RW(MCOUNTEREN, CS_MCOUNTEREN, 0x7),
+    CSR_RW(MCOUNTINHIBIT, CS_MCOUNTINHIBIT, 0x5),           // 只保存，不停止计数
+    CSR_ZERO(MHPMEVENT3, 29),
+    CSR_RW(MSCRATCH,   CS_MSCRATCH,   ~(u64)0),
+    CSR_RW(MEPC,       CS_MEPC,       ~(u64)0x1),
+    CSR_RW(MCAUSE,     CS_MCAUSE,     ~(u64)0),
+    CSR_RW(MTVAL,      CS_MTVAL,      ~(u64)0),
+    CSR_RW(MIP,        CS_MIP,        MIP_S_MASK),            // M 级位由 CLINT/PLIC 置位
+    CSR_RW(PMPCFG0,    CS_PMPCFG0,    0x9f9f9f9f9f9f9f9full),
+    CSR_RW(PMPCFG2,    CS_PMPCFG2,    0x9f9f9f9f9f9f9f9full),
+    { PMPADDR0, 16, CS_PMPADDR0, ((u64)1 << 54) - 1, NULL, NULL },
+    CSR_FN(MCYCLE,     CS_NONE,       0, csr_rd_cycle,   csr_wr_counter),
+    CSR_FN(MINSTRET,   CS_NONE,       0, csr_rd_instret, csr_wr_counter),
+    CSR_ZERO(MHPMCOUNTER3, 29),
+    CSR_FN(MCYCLEH,    CS_NONE,       0, csr_rd_cycle,   csr_wr_counter),
+    CSR_FN(MINSTRETH,  CS_NONE,       0, csr_rd_instret, csr_wr_counter),
+    CSR_ZERO(MHPMCOUNTER3H, 29),
+    // 调试触发器：tdata1.type = 0，表示没有触发器
+    CSR_ZERO(TSELECT, 4),
+};
+
+#undef CSR_RW
+#undef CSR_FN
+#undef CSR_ZERO
+
+/** 编号到表项的索引：0 为不存在，否则为表项下标 + 1 */
+static u8 csr_index[4096];
+static pthread_once_t csr_once = PTHREAD_ONCE_INIT;
+
+static void csr_build_index() {
+    for (u32 i = 0; i < sizeof(csr_table) / sizeof(csr_table[0]); i++)
+        for (u32 j = 0; j < csr_table[i].count; j++)
+            csr_index[csr_table[i].num + j] = i + 1;
+}
+
+static inline const CSR_DESC* csr_find(u64 csr) {
+    u32 i = csr < 4096 ? csr_index[csr] : 0;
+    return i ? &csr_table[i - 1] : NULL;
+}
 
 // ==================================================================== //
 //                            Func API: CSR
 // ==================================================================== //
 
-uint64_t csr_read(CPU* cpu, uint64_t csr) {
-    return (uint64_t)(uint32_t)cpu->csr[csr];
+void csr_init(CPU* cpu) {
+    pthread_once(&csr_once, csr_build_index);
+    memset(cpu->csr, 0, sizeof(cpu->csr));
+    cpu->instret = 0;
+    cpu->priv = PRIV_M;
+    cpu->csr[CS_MSTATUS] = (u64)1 << 13 | (u64)1 << 9;     // FS = VS = Initial
+}
+
+int csr_access(CPU* cpu, u64 csr, int write) {
+    if (!csr_find(csr) || (cpu->xlen != 32 && CSR_RV32_ONLY(csr)))
+        return 0;
+    if (((csr >> 8) & 0x3) > (u64)cpu->priv)
+        return 0;
+    if (write && (csr >> 10) == 0x3)
+        return 0;
+    if ((csr >= CYCLE && csr <= HPMCOUNTER31) || (csr >= CYCLEH && csr <= HPMCOUNTER31H)) {
+        u64 bit = (u64)1 << (csr & 0x1f);
+        if (cpu->priv < PRIV_M && !(cpu->csr[CS_MCOUNTEREN] & bit))
+            return 0;
+        if (cpu->priv < PRIV_S && !(cpu->csr[CS_SCOUNTEREN] & bit))
+            return 0;
+    }
+    if (csr == SATP && cpu->priv == PRIV_S && (cpu->csr[CS_MSTATUS] & MSTATUS_TVM))
+        return 0;
+    return 1;
 }
 
-void csr_write(CPU* cpu, uint64_t csr, uint64_t value) {
-    cpu->csr[csr] = value;
-}
\ No newline at end of file
+u64 csr_read(CPU* cpu, u64 csr) {
+    const CSR_DESC* d = csr_find(csr);
+    if (!d)
+        return 0;
+    if (d->read)
+        return d->read(cpu, csr);
+    return d->slot == CS_NONE ? 0 : cpu->csr[d->slot + (csr - d->num)];
+}
+
+void csr_write(CPU* cpu, u64 csr, u64 value) {
+    const CSR_DESC* d = csr_find(csr);
+    if (!d)
+        return;
+    if (d->write) {
+        d->write(cpu, csr, value);
+    } else if (d->slot != CS_NONE) {
+        u64* p = &cpu->csr[d->slot + (csr - d->num)];
+        *p = (*p & ~d->wmask) | (value & d->wmask);
+    }
+}
@@ -44,6 +44,15 @@
 #define FRM         0x002 // URW Floating-Point Dynamic Rounding Mode.
 #define FCSR        0x003 // URW Floating-Point Control and Status Register (frm + fflags)
 
+//User Vector CSRs
+#define VSTART      0x008 // URW Vector start position.
+#define VXSAT       0x009 // URW Fixed-Point Saturate Flag.
+#define VXRM        0x00A // URW Fixed-Point Rounding Mode.
+#define VCSR        0x00F // URW Vector control and status register.
+#define VL          0xC20 // URO Vector length.
+#define VTYPE       0xC21 // URO Vector data type register.
+#define VLENB       0xC22 // URO VLEN/8 (vector register length in bytes).
+
 //User Counter/Timers
 #define CYCLE       0xC00 // URO Cycle counter for RDCYCLE instruction.
 #define TIME        0xC01 // URO Timer for RDTIME instruction.
@@ -58,7 +67,7 @@
 #define HPMCOUNTER3H 0xC83 // URO Upper 32 bits of hpmcounter3, RV32I only.
 #define HPMCOUNTER4H 0xC84 // URO Upper 32 bits of hpmcounter4, RV32I only.
 // ... hpm counter 4-31 (TODO)
-#define HPMCOUNTER31H 0xC9F URO 
+#define HPMCOUNTER31H 0xC9F // URO Upper 32 bits of hpmcounter31, RV32I only.
 
 
 //Supervisor Trap Setup
@@ -93,6 +102,7 @@
 #define MIE         0x304 // MRW Machine interrupt-enable register.
 #define MTVEC       0x305 // MRW Machine trap-handler base address.
 #define MCOUNTEREN  0x306 // MRW Machine counter enable.
+#define MSTATUSH    0x310 // MRW Additional machine status register, RV32 only.
 
 //Machine Trap Handling
 #define MSCRATCH    0x340 // MRW Scratch register for machine trap handlers.
@@ -144,12 +154,71 @@
 #define DSCRATCH0   0x7B2 // DRW Debug scratch register 0.
 #define DSCRATCH1   0x7B3 // DRW Debug scratch register 1.
 
+// mstatus bits
+#define MSTATUS_SIE     ((u64)1 << 1)
+#define MSTATUS_MIE     ((u64)1 << 3)
+#define MSTATUS_SPIE    ((u64)1 << 5)
+#define MSTATUS_UBE     ((u64)1 << 6)
+#define MSTATUS_MPIE    ((u64)1 << 7)
+#define MSTATUS_SPP     ((u64)1 << 8)
+#define MSTATUS_VS      ((u64)3 << 9)
+#define MSTATUS_MPP     ((u64)3 << 11)
+#define MSTATUS_FS      ((u64)3 << 13)
+#define MSTATUS_XS      ((u64)3 << 15)
+#define MSTATUS_MPRV    ((u64)1 << 17)
+#define MSTATUS_SUM     ((u64)1 << 18)
+#define MSTATUS_MXR     ((u64)1 << 19)
+#define MSTATUS_TVM     ((u64)1 << 20)
+#define MSTATUS_TW      ((u64)1 << 21)
+#define MSTATUS_TSR     ((u64)1 << 22)
+#define MSTATUS_UXL     ((u64)3 << 32)
+#define MSTATUS_SXL     ((u64)3 << 34)
+#define MSTATUS_SD      ((u64)1 << 63)
+#define MSTATUS32_SD    ((u64)1 << 31)  // RV32：SD 位于最高位
+
+// satp fields
+#define SATP_MODE_SHIFT 60
+#define SATP_MODE_BARE  0x0
+#define SATP_MODE_SV39  0x8
+#define SATP32_MODE_SHIFT 31    // RV32：MODE 只有 1 位
+#define SATP_MODE_SV32  0x1
+
+// mip/mie bits
+#define MIP_SSIP    ((u64)1 << 1)   // Supervisor software interrupt.
+#define MIP_MSIP    ((u64)1 << 3)   // Machine software interrupt.
+#define MIP_STIP    ((u64)1 << 5)   // Supervisor timer interrupt.
+#define MIP_MTIP    ((u64)1 << 7)   // Machine timer interrupt.
+#define MIP_SEIP    ((u64)1 << 9)   // Supervisor external interrupt.
+#define MIP_MEIP    ((u64)1 << 11)  // Machine external interrupt.
+
 
 // ==================================================================== //
 //                            Declare API: CSR
 // ==================================================================== //
 
+/**
+ * @brief 初始化 CSR：首次调用时构建编号到表项的索引，并复位处理器的 CSR 存储槽
+ * @param cpu 中央处理器
+ */
+void csr_init(CPU* cpu);
+
+/**
+ * @brief 检查当前特权级能否访问 CSR
+ * @param cpu 中央处理器
+ * @param csr CSR 编号
+ * @param write 是否写入
+ * @return int 1 可以访问，0 非法指令（CSR 不存在、特权级不足或写只读 CSR）
+ */
+int csr_access(CPU* cpu, u64 csr, int write);
+
+/**
+ * @brief 读 CSR（不检查权限，不存在的 CSR 读出 0）
+ */
 u64 csr_read(CPU* cpu, u64 csr);
+
+/**
+ * @brief 写 CSR：按 WARL 掩码合并，并执行副作用（不检查权限，不存在的 CSR 忽略）
+ */
 void csr_write(CPU* cpu, u64 csr, u64 value);
 
 #endif
\ No newline at end of file
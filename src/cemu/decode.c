@@ -0,0 +1,100 @@
+/**
+ * @file decode.c
+ * @author lancer (lancerstadium@163.com)
+ * @brief 指令译码表实现
+ * @version 0.1
+ * @date 2024-01-29
+ * @copyright Copyright (c) 2024
+ */
+
+// ==================================================================== //
+//                              Include
+// ==================================================================== //
+
+#include "decode.h"
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+// ==================================================================== //
+//                              Defines
+// ==================================================================== //
+
+#define F3_MASK     0x00007000
+#define F7_MASK     0xfe000000
+
+// ==================================================================== //
+//                         Private Func: DECODE
+// ==================================================================== //
+
+/** 表项是否属于第一级的某一组 */
+static inline int decode_in_group(const CPU_INST* in, u32 group) {
+    return (in->match & 0x3) == 0x3 && ((in->match >> 2) & 0x1f) == group;
+}
+
+/** 表项在第二级下标`key`处是否可能命中 */
+static inline int decode_in_slot(const CPU_INST* in, u32 key, int use_funct7) {
+    u32 bits = (key & 0x7) << 12 | (use_funct7 ? (key >> 3) << 25 : 0);
+    u32 mask = in->mask & (F3_MASK | (use_funct7 ? F7_MASK : 0));
+    return (bits & mask) == (in->match & mask);
+}
+
+/** 把以`NULL`结尾的候选列表加入`list`，与已有列表相同时复用 */
+static u16 decode_intern(DECODER* dec, const CPU_INST** cand, u32 n) {
+    if (n == 0)
+        return 0;
+    for (u32 i = 1; i + n < dec->list_len; i++)
+        if (!memcmp(dec->list + i, cand, (n + 1) * sizeof(*cand)) && (i == 1 || !dec->list[i - 1]))
+            return i;
+    dec->list = realloc(dec->list, (dec->list_len + n + 1) * sizeof(*cand));
+    if (!dec->list) {
+        fprintf(stderr, "[-] ERROR-> decode table: out of memory\n");
+        exit(1);
+    }
+    memcpy(dec->list + dec->list_len, cand, (n + 1) * sizeof(*cand));
+    dec->list_len += n + 1;
+    if (dec->list_len > 0xffff) {
+        fprintf(stderr, "[-] ERROR-> decode table: too many candidates\n");
+        exit(1);
+    }
+    return dec->list_len - n - 1;
+}
+
+// ==================================================================== //
+//                           Func API: DECODE
+// ==================================================================== //
+
+void decode_build(DECODER* dec, const CPU_INST* insts, u32 n) {
+    const CPU_INST** cand = malloc((n + 1) * sizeof(*cand));
+    memset(dec, 0, sizeof(*dec));
+    dec->list = calloc(1, sizeof(*cand));   // list[0] = NULL：空槽
+    dec->list_len = 1;
+
+    for (u32 g = 0; g < DECODE_GROUPS; g++) {
+        // 组内有表项比较 funct7 时，第二级下标才包含 funct7
+        for (u32 i = 0; i < n; i++)
+            if (decode_in_group(&insts[i], g) && (insts[i].mask & F7_MASK))
+                dec->use_funct7[g] = 1;
+        u32 slots = dec->use_funct7[g] ? DECODE_SLOTS : 8;
+
+        for (u32 key = 0; key < slots; key++) {
+            u32 m = 0;
+            for (u32 i = 0; i < n; i++)
+                if (decode_in_group(&insts[i], g) && decode_in_slot(&insts[i], key, dec->use_funct7[g]))
+                    cand[m++] = &insts[i];
+            // 掩码位数多（更具体）的表项优先，插入排序保持表内顺序
+            for (u32 i = 1; i < m; i++) {
+                const CPU_INST* t = cand[i];
+                u32 j = i;
+                while (j > 0 && __builtin_popcount(cand[j - 1]->mask) < __builtin_popcount(t->mask)) {
+                    cand[j] = cand[j - 1];
+                    j--;
+                }
+                cand[j] = t;
+            }
+            cand[m] = NULL;
+            dec->slot[g][key] = decode_intern(dec, cand, m);
+        }
+    }
+    free(cand);
+}
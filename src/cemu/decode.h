@@ -0,0 +1,100 @@
+/**
+ * @file decode.h
+ * @author lancer (lancerstadium@163.com)
+ * @brief 指令译码表头文件
+ * @version 0.1
+ * @date 2024-01-29
+ * @copyright Copyright (c) 2024
+ *
+ * # 译码表
+ * - 所有指令写在一张表里，每项给出`(mask, match)`、执行函数与指令格式，
+ * `(inst & mask) == match`即命中。新增指令只需在表中添加一项。
+ *
+ * - `decode_build()`由指令表生成两级直接查找表：
+ * 1. 第一级以`inst[6:2]`（opcode 去掉恒为`0b11`的低 2 位）为下标，共 32 组；
+ * 2. 第二级以压缩后的功能码为下标：组内有指令区分 funct7 时为`funct3 | funct7 << 3`，
+ *    否则只用`funct3`；槽中存放候选指令列表，按掩码位数从多到少排列。
+ *
+ * - 大多数槽只有一个候选；只有立即数编码的指令（如`ecall`/`ebreak`/`wfi`、
+ * Zbb 一元运算）才需要在槽内逐个比较掩码。
+ */
+
+
+#ifndef DECODE_H
+#define DECODE_H
+
+// ==================================================================== //
+//                             Include
+// ==================================================================== //
+
+#include "cpu.h"
+
+// ==================================================================== //
+//                              Defines
+// ==================================================================== //
+
+#define DECODE_GROUPS   32          /** 第一级：inst[6:2] */
+#define DECODE_SLOTS    1024        /** 第二级：funct3 | funct7 << 3 */
+
+// ==================================================================== //
+//                            Data: DECODE
+// ==================================================================== //
+
+/** 指令执行函数：返回 1 成功，0 非法指令 */
+typedef int (*CPU_EXEC)(CPU* cpu, u32 inst);
+
+/** 指令格式 */
+typedef enum {
+    FMT_R, FMT_I, FMT_S, FMT_B, FMT_U, FMT_J, FMT_R4
+} INST_FMT;
+
+/** 指令表项 */
+typedef struct CPU_INST_t {
+    const char* name;       /** 助记符 */
+    u32 mask;               /** 参与比较的位 */
+    u32 match;              /** 比较值 */
+    CPU_EXEC exec;          /** 执行函数 */
+    u8 fmt;                 /** 指令格式：INST_FMT */
+} CPU_INST;
+
+/** 两级查找表 */
+typedef struct DECODER_t {
+    u8 use_funct7[DECODE_GROUPS];               /** 该组第二级下标是否包含 funct7 */
+    u16 slot[DECODE_GROUPS][DECODE_SLOTS];      /** 候选列表在`list`中的起始下标，0 为空 */
+    const CPU_INST** list;                      /** 以`NULL`结尾的候选列表，依次存放 */
+    u32 list_len;
+} DECODER;
+
+// ==================================================================== //
+//                           Declare API: DECODE
+// ==================================================================== //
+
+/**
+ * @brief 由指令表生成查找表
+ * @param dec 查找表
+ * @param insts 指令表
+ * @param n 指令表项数
+ */
+void decode_build(DECODER* dec, const CPU_INST* insts, u32 n);
+
+/**
+ * @brief 查找指令对应的表项
+ * @param dec 查找表
+ * @param inst 32-bit 指令数据
+ * @return const CPU_INST* 表项，非法指令返回`NULL`
+ */
+static inline const CPU_INST* decode_lookup(const DECODER* dec, u32 inst) {
+    u32 group = (inst >> 2) & 0x1f;
+    u32 key = (inst >> 12) & 0x7;
+    if ((inst & 0x3) != 0x3)
+        return NULL;
+    if (dec->use_funct7[group])
+        key |= (inst >> 25) << 3;
+    for (const CPU_INST** p = dec->list + dec->slot[group][key]; *p; p++)
+        if ((inst & (*p)->mask) == (*p)->match)
+            return *p;
+    return NULL;
+}
+
+
+#endif // DECODE_H
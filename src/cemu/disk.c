@@ -0,0 +1,341 @@
+/**
+ * @file disk.c
+ * @author lancer (lancerstadium@163.com)
+ * @brief 稀疏写时复制磁盘镜像实现
+ * @version 0.1
+ * @date 2024-01-20
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+
+// ==================================================================== //
+//                             Include
+// ==================================================================== //
+
+#include "disk.h"
+#include "log.h"
+#include "macro.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+// ==================================================================== //
+//                         Private Func: DISK
+// ==================================================================== //
+
+#define DISK_CLUSTER(disk)  ((u64)1 << (disk)->cluster_bits)
+#define DISK_ALIGN(x, a)    (((x) + (a) - 1) & ~((u64)(a) - 1))
+
+/**
+ * @brief 计算给定参数下覆盖镜像的最大可能长度（用于一次性映射）
+ */
+static u64 disk_max_file_size(u64 size, u32 cluster_bits, u32 l1_entries) {
+    u64 cluster = (u64)1 << cluster_bits;
+    u64 l1_bytes = DISK_ALIGN((u64)l1_entries * sizeof(u64), cluster);
+    return cluster + l1_bytes                           // 文件头 + L1 表
+        + (u64)l1_entries * cluster                     // 全部 L2 表
+        + DISK_ALIGN(size, cluster);                    // 全部数据簇
+}
+
+/** 表项是否指向覆盖镜像内、L1 表之后的一个完整簇 */
+static inline int disk_valid_cluster(DISK* disk, u64 off, u64 meta_end) {
+    return (off & (DISK_CLUSTER(disk) - 1)) == 0 && off >= meta_end
+        && off <= disk->file_size - DISK_CLUSTER(disk);
+}
+
+/**
+ * @brief 校验 L1/L2 表：每个非 0 表项都必须是有效的簇偏移
+ * @return int 0 有效，-1 损坏
+ */
+static int disk_check_tables(DISK* disk, u64 meta_end) {
+    u64 n = (u64)1 << disk->l2_bits;
+    for (u32 i = 0; i < disk->l1_entries; i++) {
+        u64 l2_off = disk->l1[i];
+        if (!l2_off)
+            continue;
+        if (!disk_valid_cluster(disk, l2_off, meta_end))
+            return -1;
+        u64* l2 = (u64*)(disk->map + l2_off);
+        for (u64 j = 0; j < n; j++)
+            if (l2[j] && !disk_valid_cluster(disk, l2[j], meta_end))
+                return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief 在覆盖镜像末尾追加一个清零的簇
+ * @return u64 新簇的文件偏移，0 表示失败
+ */
+static u64 disk_alloc_cluster(DISK* disk) {
+    u64 offset = disk->file_size;
+    if (offset + DISK_CLUSTER(disk) > disk->map_size) {
+        log_error("Disk overlay full");
+        return 0;
+    }
+    // 扩展文件：新增部分由文件系统保证为 0，且保持稀疏
+    if (ftruncate(disk->fd, offset + DISK_CLUSTER(disk)) < 0) {
+        log_error("Disk overlay grow failed");
+        return 0;
+    }
+    disk->file_size = offset + DISK_CLUSTER(disk);
+    return offset;
+}
+
+/**
+ * @brief 查找簇在覆盖镜像中的偏移
+ * @param disk 磁盘
+ * @param offset 磁盘偏移
+ * @param alloc 未分配时是否分配（同时完成写时复制）
+ * @return u64 数据簇文件偏移，0 表示未分配
+ */
+static u64 disk_lookup(DISK* disk, u64 offset, int alloc) {
+    u64 cidx = offset >> disk->cluster_bits;
+    u64 l1_idx = cidx >> disk->l2_bits;
+    u64 l2_idx = cidx & (((u64)1 << disk->l2_bits) - 1);
+
+    u64 l2_off = disk->l1[l1_idx];
+    if (!l2_off) {
+        if (!alloc)
+            return 0;
+        if (!(l2_off = disk_alloc_cluster(disk)))
+            return 0;
+        disk->l1[l1_idx] = l2_off;
+    }
+    u64* l2 = (u64*)(disk->map + l2_off);
+    u64 data_off = l2[l2_idx];
+    if (!data_off && alloc) {
+        if (!(data_off = disk_alloc_cluster(disk)))
+            return 0;
+        // 写时复制：将基础镜像中该簇的原内容复制到覆盖镜像
+        u64 base_off = cidx << disk->cluster_bits;
+        if (disk->base_map && base_off < disk->base_size) {
+            u64 n = MIN(DISK_CLUSTER(disk), disk->base_size - base_off);
+            memcpy(disk->map + data_off, disk->base_map + base_off, n);
+        }
+        l2[l2_idx] = data_off;
+    }
+    return data_off;
+}
+
+
+// ==================================================================== //
+//                            Func API: DISK
+// ==================================================================== //
+
+int disk_create(char* path, char* base_path, u64 size, u32 cluster_bits) {
+    if (!cluster_bits)
+        cluster_bits = DISK_CLUSTER_BITS;
+    if (cluster_bits < DISK_MIN_CLUSTER_BITS || cluster_bits > DISK_MAX_CLUSTER_BITS) {
+        log_error("Disk cluster bits out of range: %u", cluster_bits);
+        return -1;
+    }
+    u64 cluster = (u64)1 << cluster_bits;
+    u32 base_len = base_path ? strlen(base_path) : 0;
+    if (sizeof(DISK_HDR) + base_len > cluster) {
+        log_error("Disk base path too long: %s", base_path);
+        return -1;
+    }
+    if (!size && base_path) {
+        struct stat st;
+        if (stat(base_path, &st) < 0) {
+            log_error("Unable to stat base image %s", base_path);
+            return -1;
+        }
+        size = st.st_size;
+    }
+    if (!size || size > DISK_MAX_SIZE) {
+        log_error("Disk size out of range: %lu", size);
+        return -1;
+    }
+    size = DISK_ALIGN(size, DISK_SECTOR_SIZE);
+
+    DISK_HDR hdr = {0};
+    memcpy(hdr.magic, DISK_MAGIC, sizeof(hdr.magic));
+    hdr.version = DISK_VERSION;
+    hdr.cluster_bits = cluster_bits;
+    hdr.size = size;
+    hdr.l1_offset = cluster;
+    u64 l1_span = (u64)1 << (cluster_bits + cluster_bits - 3);
+    hdr.l1_entries = (size + l1_span - 1) / l1_span;
+    hdr.base_len = base_len;
+
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        log_error("Unable to create disk %s", path);
+        return -1;
+    }
+    u64 file_size = cluster + DISK_ALIGN((u64)hdr.l1_entries * sizeof(u64), cluster);
+    int ok = ftruncate(fd, file_size) == 0
+        && pwrite(fd, &hdr, sizeof(hdr), 0) == sizeof(hdr)
+        && (!base_len || pwrite(fd, base_path, base_len, sizeof(hdr)) == base_len);
+    close(fd);
+    if (!ok) {
+        log_error("Unable to write disk header %s", path);
+        return -1;
+    }
+    return 0;
+}
+
+int disk_open(DISK* disk, char* path) {
+    memset(disk, 0, sizeof(DISK));
+    disk->fd = disk->base_fd = -1;
+
+    DISK_HDR hdr;
+    if ((disk->fd = open(path, O_RDWR)) < 0) {
+        log_error("Unable to open disk %s", path);
+        return -1;
+    }
+    if (pread(disk->fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)
+        || memcmp(hdr.magic, DISK_MAGIC, sizeof(hdr.magic)) != 0
+        || hdr.version != DISK_VERSION
+        || hdr.cluster_bits < DISK_MIN_CLUSTER_BITS
+        || hdr.cluster_bits > DISK_MAX_CLUSTER_BITS) {
+        log_error("Invalid disk image %s", path);
+        goto fail;
+    }
+    disk->size = hdr.size;
+    disk->cluster_bits = hdr.cluster_bits;
+    disk->l2_bits = hdr.cluster_bits - 3;
+    disk->l1_entries = hdr.l1_entries;
+
+    struct stat st;
+    fstat(disk->fd, &st);
+    disk->file_size = st.st_size;
+
+    // L1 表必须恰好覆盖虚拟磁盘，且整体位于文件头之后、文件之内
+    u64 cluster = DISK_CLUSTER(disk);
+    u64 l1_span = (u64)1 << (disk->cluster_bits + disk->l2_bits);
+    u64 l1_end = hdr.l1_offset + DISK_ALIGN((u64)hdr.l1_entries * sizeof(u64), cluster);
+    if (!hdr.size || hdr.size > DISK_MAX_SIZE
+        || hdr.l1_entries != (hdr.size + l1_span - 1) / l1_span
+        || hdr.l1_offset < cluster || (hdr.l1_offset & (cluster - 1))
+        || hdr.l1_offset >= disk->file_size || l1_end > disk->file_size
+        || (disk->file_size & (cluster - 1))
+        || sizeof(hdr) + hdr.base_len > cluster) {
+        log_error("Invalid disk layout %s", path);
+        goto fail;
+    }
+
+    // 基础镜像：只读私有映射
+    if (hdr.base_len) {
+        char* base_path = malloc(hdr.base_len + 1);
+        if (pread(disk->fd, base_path, hdr.base_len, sizeof(hdr)) != hdr.base_len) {
+            log_error("Invalid disk base path");
+            free(base_path);
+            goto fail;
+        }
+        base_path[hdr.base_len] = '\0';
+        disk->base_fd = open(base_path, O_RDONLY);
+        free(base_path);
+        if (disk->base_fd < 0) {
+            log_error("Unable to open base image");
+            goto fail;
+        }
+        fstat(disk->base_fd, &st);
+        disk->base_size = st.st_size;
+        if (disk->base_size) {
+            disk->base_map = mmap(NULL, disk->base_size, PROT_READ, MAP_PRIVATE, disk->base_fd, 0);
+            if (disk->base_map == MAP_FAILED) {
+                disk->base_map = NULL;
+                log_error("Unable to map base image");
+                goto fail;
+            }
+        }
+    }
+
+    // 覆盖镜像：按最大可能长度一次性映射，文件增长时映射无需改变
+    disk->map_size = disk_max_file_size(disk->size, disk->cluster_bits, disk->l1_entries);
+    disk->map = mmap(NULL, disk->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, disk->fd, 0);
+    if (disk->map == MAP_FAILED) {
+        disk->map = NULL;
+        log_error("Unable to map disk %s", path);
+        goto fail;
+    }
+    disk->l1 = (u64*)(disk->map + hdr.l1_offset);
+    if (disk->file_size > disk->map_size || disk_check_tables(disk, l1_end) < 0) {
+        log_error("Invalid disk tables %s", path);
+        goto fail;
+    }
+    log_info("Disk open: %s (%lu bytes, cluster %lu)", path, disk->size, DISK_CLUSTER(disk));
+    return 0;
+
+fail:
+    disk_close(disk);
+    return -1;
+}
+
+u64 disk_read(DISK* disk, u64 offset, void* buf, u64 len) {
+    if (offset >= disk->size)
+        return 0;
+    len = MIN(len, disk->size - offset);
+    u64 done = 0;
+    while (done < len) {
+        u64 n = len - done;
+        u8* src = disk_map(disk, offset + done, &n);
+        if (src)
+            memcpy((u8*)buf + done, src, n);
+        else
+            memset((u8*)buf + done, 0, n);
+        done += n;
+    }
+    return done;
+}
+
+u64 disk_write(DISK* disk, u64 offset, void* buf, u64 len) {
+    if (offset >= disk->size)
+        return 0;
+    len = MIN(len, disk->size - offset);
+    u64 done = 0;
+    while (done < len) {
+        u64 pos = offset + done;
+        u64 in = pos & (DISK_CLUSTER(disk) - 1);
+        u64 n = MIN(len - done, DISK_CLUSTER(disk) - in);
+        u64 data_off = disk_lookup(disk, pos, 1);
+        if (!data_off)
+            break;
+        memcpy(disk->map + data_off + in, (u8*)buf + done, n);
+        done += n;
+    }
+    return done;
+}
+
+u8* disk_map(DISK* disk, u64 offset, u64* len) {
+    if (offset >= disk->size) {
+        *len = 0;
+        return NULL;
+    }
+    u64 in = offset & (DISK_CLUSTER(disk) - 1);
+    *len = MIN(MIN(*len, DISK_CLUSTER(disk) - in), disk->size - offset);
+    u64 data_off = disk_lookup(disk, offset, 0);
+    if (data_off)
+        return disk->map + data_off + in;
+    if (disk->base_map && offset < disk->base_size) {
+        *len = MIN(*len, disk->base_size - offset);
+        return disk->base_map + offset;
+    }
+    // 未分配且超出基础镜像的部分读为 0
+    return NULL;
+}
+
+void disk_flush(DISK* disk) {
+    if (disk->map)
+        msync(disk->map, disk->file_size, MS_SYNC);
+}
+
+void disk_close(DISK* disk) {
+    if (disk->map)
+        munmap(disk->map, disk->map_size);
+    if (disk->base_map)
+        munmap(disk->base_map, disk->base_size);
+    if (disk->fd >= 0)
+        close(disk->fd);
+    if (disk->base_fd >= 0)
+        close(disk->base_fd);
+    memset(disk, 0, sizeof(DISK));
+    disk->fd = disk->base_fd = -1;
+}
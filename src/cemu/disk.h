@@ -0,0 +1,167 @@
+/**
+ * @file disk.h
+ * @author lancer (lancerstadium@163.com)
+ * @brief 稀疏写时复制磁盘镜像头文件
+ * @version 0.1
+ * @date 2024-01-20
+ * @copyright Copyright (c) 2024
+ *
+ * # 磁盘镜像介绍
+ * - 块设备使用 cemu 自有的覆盖镜像格式（overlay），
+ * 它以簇（cluster）为单位稀疏存储，底层指向一个只读的基础镜像（base）。
+ * 多个来宾可以共用同一个基础镜像，各自只在覆盖镜像中保存被写过的簇。
+ *
+ * - 簇地址通过两级表查找：L1 表项指向 L2 表，L2 表项指向数据簇。
+ * 表项为 0 表示该簇尚未分配：读取时回落到基础镜像（没有基础镜像则读 0），
+ * 写入时在覆盖镜像末尾分配新簇，并先复制基础镜像中的原内容（写时复制）。
+ * ```
+ *
+ *   offset:  |      L1 index      |   L2 index   |  cluster offset  |
+ *
+ *   +--------+    +--------+    +---------+
+ *   |  L1[i] |--->|  L2[j] |--->| cluster |  overlay
+ *   +--------+    +--------+    +---------+
+ *                      | 0
+ *                      +------->+---------+
+ *                               | cluster |  base (read-only)
+ *                               +---------+
+ *
+ * ```
+ *
+ * - 覆盖镜像文件布局（均按簇对齐）：
+ * 1. 簇 0：文件头`DISK_HDR`，其后紧跟基础镜像路径；
+ * 2. 簇 1 ~ n：L1 表；
+ * 3. 其余：按分配顺序排列的 L2 表与数据簇。
+ *
+ * - 打开时校验文件头与全部 L1/L2 表项：表项必须按簇对齐且指向文件内，
+ * 之后的查找无需再检查，损坏的镜像不会让访问越出映射。
+ *
+ * - 覆盖镜像与基础镜像在打开时整体`mmap`，
+ * 覆盖镜像按最大可能长度一次性映射，增长文件时无需重新映射，
+ * 读取可以直接通过`disk_map()`拿到主机指针。
+ */
+
+
+#ifndef DISK_H
+#define DISK_H
+
+// ==================================================================== //
+//                             Include
+// ==================================================================== //
+
+#include "typedef.h"
+
+// ==================================================================== //
+//                              Defines
+// ==================================================================== //
+
+#define DISK_MAGIC          "CEMUCOW"   /** 镜像魔数（含结尾 0 共 8 字节） */
+#define DISK_VERSION        1           /** 镜像格式版本 */
+#define DISK_CLUSTER_BITS   16          /** 默认簇大小：64KB */
+#define DISK_MIN_CLUSTER_BITS 12        /** 最小簇大小：4KB */
+#define DISK_MAX_CLUSTER_BITS 21        /** 最大簇大小：2MB */
+#define DISK_SECTOR_SIZE    512         /** 扇区大小 */
+#define DISK_MAX_SIZE       ((u64)1 << 40)  /** 虚拟磁盘大小上限：1TB */
+
+
+// ==================================================================== //
+//                             Data: DISK
+// ==================================================================== //
+
+/**
+ * @brief 覆盖镜像文件头（小端存储，位于簇 0）
+ */
+typedef struct DISK_HDR_t {
+    char magic[8];          /** 魔数`DISK_MAGIC` */
+    u32 version;            /** 格式版本 */
+    u32 cluster_bits;       /** 簇大小 = 1 << cluster_bits */
+    u64 size;               /** 虚拟磁盘大小（字节） */
+    u64 l1_offset;          /** L1 表在文件中的偏移 */
+    u32 l1_entries;         /** L1 表项个数 */
+    u32 base_len;           /** 基础镜像路径长度（0 表示无基础镜像） */
+} DISK_HDR;
+
+/**
+ * @brief 稀疏写时复制磁盘结构体
+ */
+typedef struct DISK_t {
+    int fd;                 /** 覆盖镜像文件描述符 */
+    int base_fd;            /** 基础镜像文件描述符（-1 表示无） */
+    u8* map;                /** 覆盖镜像映射地址 */
+    size_t map_size;        /** 覆盖镜像映射长度（最大可能文件长度） */
+    u8* base_map;           /** 基础镜像映射地址 */
+    size_t base_size;       /** 基础镜像文件大小 */
+    u64 file_size;          /** 覆盖镜像当前文件长度 */
+    u64 size;               /** 虚拟磁盘大小 */
+    u32 cluster_bits;       /** 簇大小位数 */
+    u32 l2_bits;            /** 每个 L2 表项数位数 */
+    u32 l1_entries;         /** L1 表项个数 */
+    u64* l1;                /** L1 表（指向映射内） */
+} DISK;
+
+
+// ==================================================================== //
+//                            Declare API: DISK
+// ==================================================================== //
+
+/**
+ * @brief 创建覆盖镜像文件
+ * @param path 覆盖镜像路径
+ * @param base_path 基础镜像路径，可为`NULL`
+ * @param size 虚拟磁盘大小，为 0 时取基础镜像大小
+ * @param cluster_bits 簇大小位数，为 0 时取`DISK_CLUSTER_BITS`
+ * @return int 0 成功，-1 失败
+ */
+int disk_create(char* path, char* base_path, u64 size, u32 cluster_bits);
+
+/**
+ * @brief 打开覆盖镜像并映射覆盖镜像与基础镜像
+ * @param disk 磁盘
+ * @param path 覆盖镜像路径
+ * @return int 0 成功，-1 失败
+ */
+int disk_open(DISK* disk, char* path);
+
+/**
+ * @brief 从磁盘读取数据
+ * @param disk 磁盘
+ * @param offset 磁盘偏移
+ * @param buf 目标缓冲区
+ * @param len 长度
+ * @return u64 实际读取字节数
+ */
+u64 disk_read(DISK* disk, u64 offset, void* buf, u64 len);
+
+/**
+ * @brief 向磁盘写入数据，首次写入的簇会在覆盖镜像中分配
+ * @param disk 磁盘
+ * @param offset 磁盘偏移
+ * @param buf 源缓冲区
+ * @param len 长度
+ * @return u64 实际写入字节数
+ */
+u64 disk_write(DISK* disk, u64 offset, void* buf, u64 len);
+
+/**
+ * @brief 获取磁盘偏移处只读数据的主机指针（零拷贝读）
+ * @param disk 磁盘
+ * @param offset 磁盘偏移
+ * @param len 输入期望长度，输出在同一簇内连续可读的长度（偏移越过磁盘末尾时为 0）
+ * @return u8* 主机指针，簇未分配且无基础镜像或越界时返回`NULL`（内容全 0）
+ */
+u8* disk_map(DISK* disk, u64 offset, u64* len);
+
+/**
+ * @brief 将覆盖镜像同步到文件
+ * @param disk 磁盘
+ */
+void disk_flush(DISK* disk);
+
+/**
+ * @brief 关闭磁盘并解除映射
+ * @param disk 磁盘
+ */
+void disk_close(DISK* disk);
+
+
+#endif // DISK_H
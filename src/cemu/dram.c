@@ -14,8 +14,14 @@
 // ==================================================================== //
 
 
+#define _GNU_SOURCE
 #include "dram.h"
 #include "log.h"
+#include "macro.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 
 // ==================================================================== //
@@ -23,62 +29,35 @@
 // ==================================================================== //
 
 
-static inline u64 dram_load_8(DRAM* dram, u64 addr) {
-    return (u64) dram->mem_addr[addr-DRAM_BASE];
-}
-
 /**
- * @note 小端法是将最小端（权值最低位）最先存储。
- * 当读取数据时，我们先读取最低的地址中存放的值通过返回值输送给总线，
- * 随后左移 8 位（1 字节）并与 0xff（8 个 1）进行与操作来得到最低字节的数据，
- * 并清空高字节以便用于或操作。
+ * @note 来宾内存由多个处理器线程共享：自然对齐的访问以`__ATOMIC_RELAXED`原子读写，
+ * 满足 RVWMO 对对齐访问“单次拷贝原子性”的要求，不会读到撕裂的值；
+ * 未对齐访问按字节拷贝，规范不保证其原子性。
+ * 主机与来宾都是小端序，直接按主机整数读写即可。
  */
-static inline u64 dram_load_16(DRAM* dram, u64 addr) {
-    return (u64) dram->mem_addr[addr-DRAM_BASE]
-        | (u64) dram->mem_addr[addr-DRAM_BASE + 1] << 8;
-}
-
-static inline u64 dram_load_32(DRAM* dram, u64 addr) {
-    return (u64) dram->mem_addr[addr-DRAM_BASE]
-        | (u64) dram->mem_addr[addr-DRAM_BASE + 1] << 8
-        | (u64) dram->mem_addr[addr-DRAM_BASE + 1] << 16
-        | (u64) dram->mem_addr[addr-DRAM_BASE + 1] << 24;
+#define DRAM_ACCESS_DEFINE(bits, T)                                                 \
+static inline u64 dram_load_##bits(DRAM* dram, u64 addr) {                          \
+    T* p = (T*)(dram->mem_addr + (addr - DRAM_BASE));                               \
+    T v;                                                                            \
+    if (((uintptr_t)p & (sizeof(T) - 1)) == 0)                                      \
+        return __atomic_load_n(p, __ATOMIC_RELAXED);                                \
+    memcpy(&v, p, sizeof(T));                                                       \
+    return v;                                                                       \
+}                                                                                   \
+static inline void dram_store_##bits(DRAM* dram, u64 addr, u64 value) {             \
+    T* p = (T*)(dram->mem_addr + (addr - DRAM_BASE));                               \
+    T v = (T)value;                                                                 \
+    if (((uintptr_t)p & (sizeof(T) - 1)) == 0)                                      \
+        __atomic_store_n(p, v, __ATOMIC_RELAXED);                                   \
+    else                                                                            \
+        memcpy(p, &v, sizeof(T));                                                   \
 }
 
-static inline u64 dram_load_64(DRAM* dram, u64 addr) {
-    return (u64) dram->mem_addr[addr-DRAM_BASE]
-        | (u64) dram->mem_addr[addr-DRAM_BASE + 1] << 8
-        | (u64) dram->mem_addr[addr-DRAM_BASE + 1] << 16
-        | (u64) dram->mem_addr[addr-DRAM_BASE + 1] << 24
-        | (u64) dram->mem_addr[addr-DRAM_BASE + 1] << 32
-        | (u64) dram->mem_addr[addr-DRAM_BASE + 1] << 40
-        | (u64) dram->mem_addr[addr-DRAM_BASE + 1] << 48
-        | (u64) dram->mem_addr[addr-DRAM_BASE + 1] << 56;
-}
-
-static inline void dram_store_8(DRAM* dram, u64 addr, u64 value) {
-    dram->mem_addr[addr-DRAM_BASE]       = (u8) (value & 0xff);
-}
-static inline void dram_store_16(DRAM* dram, u64 addr, u64 value) {
-    dram->mem_addr[addr-DRAM_BASE]       = (u8) (value & 0xff);
-    dram->mem_addr[addr-DRAM_BASE + 1]   = (u8) ((value >> 8) & 0xff);
-}
-static inline void dram_store_32(DRAM* dram, u64 addr, u64 value) {
-    dram->mem_addr[addr-DRAM_BASE]       = (u8) (value & 0xff);
-    dram->mem_addr[addr-DRAM_BASE + 1]   = (u8) ((value >> 8) & 0xff);
-    dram->mem_addr[addr-DRAM_BASE + 2]   = (u8) ((value >> 16) & 0xff);
-    dram->mem_addr[addr-DRAM_BASE + 3]   = (u8) ((value >> 24) & 0xff);
-}
-static inline void dram_store_64(DRAM* dram, u64 addr, u64 value) {
-    dram->mem_addr[addr-DRAM_BASE]       = (u8) (value & 0xff);
-    dram->mem_addr[addr-DRAM_BASE + 1]   = (u8) ((value >> 8) & 0xff);
-    dram->mem_addr[addr-DRAM_BASE + 2]   = (u8) ((value >> 16) & 0xff);
-    dram->mem_addr[addr-DRAM_BASE + 3]   = (u8) ((value >> 24) & 0xff);
-    dram->mem_addr[addr-DRAM_BASE + 4]   = (u8) ((value >> 32) & 0xff);
-    dram->mem_addr[addr-DRAM_BASE + 5]   = (u8) ((value >> 40) & 0xff);
-    dram->mem_addr[addr-DRAM_BASE + 6]   = (u8) ((value >> 48) & 0xff);
-    dram->mem_addr[addr-DRAM_BASE + 7]   = (u8) ((value >> 56) & 0xff);
-}
+DRAM_ACCESS_DEFINE(8,  u8)
+DRAM_ACCESS_DEFINE(16, u16)
+DRAM_ACCESS_DEFINE(32, u32)
+DRAM_ACCESS_DEFINE(64, u64)
+#undef DRAM_ACCESS_DEFINE
 
 
 // ==================================================================== //
@@ -87,12 +66,54 @@ static inline void dram_store_64(DRAM* dram, u64 addr, u64 value) {
 
 
 void dram_init(DRAM* dram) {
-    dram->mem_addr = (uint8_t*)malloc(DRAM_SIZE);  // 分配DRAM的内存空间
+    // 分配DRAM的内存空间：匿名映射，物理页按需分配
+    dram->fd = -1;
+    dram->mem_addr = mmap(NULL, DRAM_SIZE, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (dram->mem_addr == MAP_FAILED) {
+        log_error("DRAM alloc failed");
+        exit(1);
+    }
     dram->alloc_size = 0;
     dram->alloc_addr = dram->mem_addr;  // 初始时，待分配地址指向DRAM的起始位置
+    dram->exported = 0;
+    dram->mapped = 0;
     log_info("DRAM mem addr: %p", dram->mem_addr);
 }
 
+int dram_export_fd(DRAM* dram) {
+    if (dram->fd >= 0)
+        return dram->fd;
+    int fd = memfd_create("cemu-dram", MFD_CLOEXEC);
+    if (fd < 0 || ftruncate(fd, DRAM_SIZE) < 0) {
+        log_error("DRAM memfd failed");
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    u8* shm = mmap(NULL, DRAM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (shm == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+    // 只拷贝已加载的映像与已驻留的页，未访问过的匿名页在 memfd 中同样为 0
+    u64 page = sysconf(_SC_PAGESIZE);
+    u8 vec[DRAM_SIZE / 4096 + 1];
+    int resident = !dram->mapped && mincore(dram->mem_addr, DRAM_SIZE, vec) == 0;
+    for (u64 i = 0; i < DRAM_SIZE / page; i++)
+        if (!resident || (vec[i] & 1) || i * page < dram->alloc_size)
+            memcpy(shm + i * page, dram->mem_addr + i * page, page);
+    munmap(shm, DRAM_SIZE);
+    if (mmap(dram->mem_addr, DRAM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        log_error("DRAM remap failed");
+        close(fd);
+        return -1;
+    }
+    dram->fd = fd;
+    dram->exported = 1;
+    return fd;
+}
+
 
 void dram_alloc_data(DRAM* dram, size_t size, void* data) {
     if (dram->alloc_addr + size > dram->mem_addr + DRAM_SIZE) {
@@ -110,11 +131,60 @@ void dram_alloc_data(DRAM* dram, size_t size, void* data) {
     log_info("DRAM alloced: %d now at (0x%.8x)", size, DRAM_BASE + dram->alloc_size);
 }
 
+size_t dram_alloc_file(DRAM* dram, int fd, size_t size, void* data, u64 ro[][2], int nro) {
+    if (dram->alloc_addr + size > dram->mem_addr + DRAM_SIZE) {
+        log_error("Out of memory range");
+        return 0;
+    }
+    // 文件页只能映射到 DRAM 中页对齐的位置
+    u64 page = sysconf(_SC_PAGESIZE);
+    if (dram->exported || (dram->alloc_addr - dram->mem_addr) % page != 0)
+        nro = 0;
+    size_t pos = 0, shared = 0;             // pos: 已放置的映像字节
+    for (int i = 0; i < nro; i++) {
+        u64 start = (MAX(ro[i][0], pos) + page - 1) & ~(page - 1);
+        u64 end = MIN(ro[i][1], size) & ~(page - 1);
+        if (start >= end)
+            continue;
+        memcpy(dram->alloc_addr + pos, (u8*)data + pos, start - pos);
+        pos = start;
+        void* p = mmap(dram->alloc_addr + start, end - start, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_FIXED, fd, start);
+        if (p == MAP_FAILED) {
+            log_warn("DRAM share file pages failed, copy instead");
+            continue;
+        }
+        pos = end;
+        shared += end - start;
+    }
+    memcpy(dram->alloc_addr + pos, (u8*)data + pos, size - pos);
+    dram->alloc_size += size;
+    dram->alloc_addr += size;
+    log_info("DRAM alloced: %d (%d shared) now at (0x%.8x)", size, shared, DRAM_BASE + dram->alloc_size);
+    return shared;
+}
+
+int dram_map_file(DRAM* dram, int fd, u64 offset, size_t alloc_size) {
+    // 已导出的 DRAM 必须留在 memfd 中，对方才能看到
+    if (dram->exported || alloc_size > DRAM_SIZE) {
+        log_error("DRAM map file: exported or image too large");
+        return -1;
+    }
+    if (mmap(dram->mem_addr, DRAM_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, offset) == MAP_FAILED) {
+        log_error("DRAM map file failed");
+        return -1;
+    }
+    dram->alloc_size = alloc_size;
+    dram->alloc_addr = dram->mem_addr + alloc_size;
+    dram->mapped = 1;
+    return 0;
+}
+
 void dram_write_data(DRAM* dram, size_t offset, size_t size, u64 value) {
-    if (offset + size > dram->alloc_size) {
-        // 如果写入的偏移量和大小超出了已分配的范围
-        // 处理错误，这里简单地打印错误信息
-        log_error("Writing out of allocated range");
+    if (offset > DRAM_SIZE - size / 8) {
+        // 整个 DRAM 都可写（栈、堆不在已加载的映像内），只检查是否越过 DRAM 末尾；
+        // size 以位计
+        log_error("Writing out of DRAM range");
         return;
     }
     // 写入数据到DRAM
@@ -127,16 +197,14 @@ void dram_write_data(DRAM* dram, size_t offset, size_t size, u64 value) {
         case 64:    dram_store_64(dram, addr, value); break;
         default:;
     }
-    log_info("DRAM write: %d to (0x%.8x)", size, addr);
+    log_trace("DRAM write: %d to (0x%.8x)", size, addr);
 }
 
 
 u64 dram_load_data(DRAM* dram, size_t offset, size_t size) {
-    if (offset + size > dram->alloc_size) {
-        // 如果取出的偏移量和大小超出了已分配的范围
-        // 处理错误，这里简单地打印错误信息
-        log_error("Loading out of allocated range");
-        return;
+    if (offset > DRAM_SIZE - size / 8) {
+        log_error("Loading out of DRAM range");
+        return 0;
     }
     // 从DRAM中取出数据
     // memcpy(data_addr, dram->mem_addr + offset, size);
@@ -149,7 +217,7 @@ u64 dram_load_data(DRAM* dram, size_t offset, size_t size) {
         case 64:    data_addr = dram_load_64(dram, addr);break;
         default:;
     }
-    log_info("DRAM load: %d from (0x%.8x)", size, addr);
+    log_trace("DRAM load: %d from (0x%.8x)", size, addr);
     return data_addr;
 }
 
@@ -169,7 +237,10 @@ void dram_release_data(DRAM* dram, size_t size) {
 
 
 void dram_free(DRAM* dram) {
-    free(dram->mem_addr);
+    munmap(dram->mem_addr, DRAM_SIZE);
+    if (dram->fd >= 0)
+        close(dram->fd);
+    dram->fd = -1;
     size_t total_size = dram->alloc_size;
     dram->alloc_size = 0;
     dram->alloc_addr = NULL;
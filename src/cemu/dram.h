@@ -47,6 +47,25 @@
  * 
  * - 定义函数`dram_load()`用于读取内存，
  * 以及`dram_store()`用于写入内存。
+ *
+ * ## DRAM 后备存储
+ * - DRAM 默认是`MAP_NORESERVE`的匿名私有映射：只占虚拟地址空间，
+ * 物理页在来宾第一次访问时才由内核分配，未访问的页不占内存，也不占用描述符，
+ * 一个进程中因此可以容纳上万个空闲实例。
+ * - 需要把来宾内存交给其它进程（如进程外设备）时调用`dram_export_fd()`：
+ * 此时才创建`memfd`，把已驻留的页拷入后以`MAP_SHARED`重新映射到原地址，
+ * 对方映射同一描述符后直接访问来宾内存，无需拷贝。未导出时`fd`为 -1。
+ *
+ * ## 共享代码页
+ * - 加载 ELF 时，只读段（代码、只读数据）所在的整页不拷贝，
+ * 而是以`MAP_PRIVATE | MAP_FIXED`把文件页直接映射到 DRAM 中对应位置（见`dram_alloc_file()`）。
+ * 同一进程（乃至不同进程）中运行同一 ELF 的多个机器因此共用页缓存中的同一批物理页，
+ * 来宾写入这些页时才由内核写时复制出私有副本，语义与拷贝相同。
+ * 每个实例的内存开销只剩可写数据、栈与被写过的页。
+ * - 这些页不在`memfd`中：DRAM 描述符导出给其它进程（`exported`）后，
+ * 对方看不到映射的文件页，此时退回整段拷贝；导出前已映射的文件页在导出时拷入`memfd`。
+ * - 恢复快照时整段 DRAM 同样私有映射自快照文件（见`dram_map_file()`、`snapshot.h`），
+ * 多个从同一快照恢复的机器共用未被写过的页。
  */
 
 
@@ -83,6 +102,9 @@ typedef struct DRAM_t {
     u8* mem_addr;  // 指向内存的地址指针
     size_t alloc_size;    // 已分配大小
     u8* alloc_addr; // 指向待分配地址的指针
+    int fd;         // 导出的 memfd，-1 表示尚未导出（匿名映射）
+    int exported;   // memfd 已交给其它进程，映像必须拷贝进 memfd
+    int mapped;     // 整段 DRAM 私有映射自快照文件，页是否驻留无法判断
 } DRAM;
 
 
@@ -106,6 +128,29 @@ void dram_init(DRAM* dram);
  */
 void dram_alloc_data(DRAM* dram, size_t size, void* data);
 
+/**
+ * @brief DRAM追加文件映像：`ro`中的只读区间按整页映射文件（写时复制），其余部分拷贝
+ * @param dram 动态随机存取存储器
+ * @param fd 文件描述符
+ * @param size 映像大小
+ * @param data 映像内容（文件的只读映射）
+ * @param ro 只读区间 [起始, 结束) 的文件偏移，按起始偏移升序
+ * @param nro 区间个数
+ * @return size_t 以共享页映射的字节数
+ */
+size_t dram_alloc_file(DRAM* dram, int fd, size_t size, void* data, u64 ro[][2], int nro);
+
+/**
+ * @brief 以`MAP_PRIVATE | MAP_FIXED`把文件中整段 DRAM 映像映射到 DRAM（写时复制），
+ * 用于恢复快照：耗时与 DRAM 大小无关，页在来宾访问时才从页缓存读入
+ * @param dram 动态随机存取存储器（已初始化）
+ * @param fd 文件描述符
+ * @param offset 映像在文件中的偏移，按主机页对齐
+ * @param alloc_size 映像中已分配（加载）的大小
+ * @return int 0 成功，-1 失败
+ */
+int dram_map_file(DRAM* dram, int fd, u64 offset, size_t alloc_size);
+
 /**
  * @brief DRAM向指定地址写入数据
  * @param dram 动态随机存取存储器
@@ -131,6 +176,13 @@ u64 dram_load_data(DRAM* dram, size_t offset, size_t size);
  */
 void dram_release_data(DRAM* dram, size_t size);
 
+/**
+ * @brief 取得可交给其它进程映射的 DRAM 描述符，首次调用时把 DRAM 迁移到 memfd
+ * @param dram 动态随机存取存储器
+ * @return int memfd，失败返回 -1
+ */
+int dram_export_fd(DRAM* dram);
+
 /**
  * @brief 释放DRAM
  * @param dram 动态随机存取存储器
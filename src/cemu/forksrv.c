@@ -0,0 +1,350 @@
+/**
+ * @file forksrv.c
+ * @author lancer (lancerstadium@163.com)
+ * @brief 预启动服务实现
+ * @version 0.1
+ * @date 2024-02-03
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+// ==================================================================== //
+//                              Include
+// ==================================================================== //
+
+#define _GNU_SOURCE
+#include "forksrv.h"
+#include "chan.h"
+#include "log.h"
+#include "macro.h"
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+
+// ==================================================================== //
+//                         Private Func: FORKSRV
+// ==================================================================== //
+
+/** 子进程中把 g2h 环转发到连接的线程参数 */
+typedef struct FORKSRV_DRAIN_t {
+    CHAN* chan;
+    int conn;
+    int stop;                       /** 来宾已结束：转发完剩余数据后退出 */
+} FORKSRV_DRAIN;
+
+/** 服务进程记录的子进程 */
+typedef struct FORKSRV_CHILD_t {
+    pid_t pid;
+    int id;                         /** 请求序号 */
+    int killed;                     /** 已因超时被终止 */
+    u64 start;                      /** fork 时刻（微秒） */
+} FORKSRV_CHILD;
+
+static inline u64 forksrv_now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int forksrv_send(int conn, u8* buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(conn, buf, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/** 读完客户端发送的全部输入（直到对端关闭写端） */
+static u8* forksrv_recv_all(int conn, size_t* len) {
+    size_t cap = 4096, n = 0;
+    u8* buf = malloc(cap);
+    for (;;) {
+        if (!buf)
+            return NULL;
+        ssize_t r = recv(conn, buf + n, cap - n, 0);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r < 0) {
+            free(buf);
+            return NULL;
+        }
+        if (r == 0)
+            break;
+        n += r;
+        if (n == cap)
+            buf = realloc(buf, cap *= 2);
+    }
+    *len = n;
+    return buf;
+}
+
+/**
+ * @brief g2h 环 -> 连接；读出数据后敲门铃，使等待空间的来宾继续写
+ */
+static void* forksrv_drain(void* arg) {
+    FORKSRV_DRAIN* d = arg;
+    static u8 buf[65536];
+    u64 one = 1, cnt;
+    for (;;) {
+        int stop = __atomic_load_n(&d->stop, __ATOMIC_ACQUIRE);
+        size_t n = chan_ring_read(d->chan->shm, CHAN_RING_G2H, buf, sizeof(buf));
+        if (n > 0) {
+            if (forksrv_send(d->conn, buf, n) < 0)
+                break;
+            if (write(d->chan->kick_fd, &one, sizeof(one)) < 0)
+                break;
+            continue;
+        }
+        if (stop || chan_ring_eof(d->chan->shm, CHAN_RING_G2H))
+            break;
+        struct pollfd pfd = { .fd = d->chan->call_fd, .events = POLLIN };
+        if (poll(&pfd, 1, 10) > 0 && read(d->chan->call_fd, &cnt, sizeof(cnt)) < 0)
+            break;
+    }
+    return NULL;
+}
+
+/**
+ * @brief 裸机程序：输入写入数据通道的 h2g 环，g2h 环转发到连接
+ * @return int 0 已执行，-1 失败
+ */
+static int forksrv_run_chan(MACHINE* m, int conn, int id) {
+    CHAN chan = { .listen_fd = -1 };
+    size_t len = 0;
+    u8* input = forksrv_recv_all(conn, &len);
+    u64 ring = CHAN_PAGE_SIZE * 16;
+    while (ring < len)
+        ring <<= 1;
+    if (!input) {
+        log_error("Request %d: receive failed", id);
+        return -1;
+    }
+    if (chan_init(&chan, &m->bus, CHAN_PAGE_SIZE + 2 * ring) < 0) {
+        log_error("Request %d: data channel failed", id);
+        free(input);
+        return -1;
+    }
+    chan_ring_write(chan.shm, CHAN_RING_H2G, input, len);
+    chan_ring_close(chan.shm, CHAN_RING_H2G);
+    free(input);
+    FORKSRV_DRAIN drain = { .chan = &chan, .conn = conn };
+    pthread_t thread;
+    int started = pthread_create(&thread, NULL, forksrv_drain, &drain) == 0;
+    if (!started)
+        log_warn("Request %d: output thread create failed", id);
+    machine_run(m);
+    if (started) {
+        __atomic_store_n(&drain.stop, 1, __ATOMIC_RELEASE);
+        pthread_join(thread, NULL);
+    }
+    return 0;
+}
+
+/**
+ * @brief 用户态程序不能访问数据通道 MMIO：把标准输入输出接到连接上，
+ * 客户端关闭写端后来宾读到 EOF；JSON 结果仍写到原来的标准输出
+ * @return int 0 已执行，-1 失败
+ */
+static int forksrv_run_stdio(MACHINE* m, int conn, int id) {
+    // 客户端提前断开时来宾的 write 返回 -EPIPE，而不是终止子进程
+    signal(SIGPIPE, SIG_IGN);
+    int saved = dup(STDOUT_FILENO);
+    int ret = -1;
+    if (saved < 0 || dup2(conn, STDIN_FILENO) < 0 || dup2(conn, STDOUT_FILENO) < 0) {
+        log_error("Request %d: redirect stdio failed", id);
+    } else {
+        machine_run(m);
+        ret = 0;
+    }
+    if (saved >= 0) {
+        dup2(saved, STDOUT_FILENO);
+        close(saved);
+    }
+    close(STDIN_FILENO);
+    return ret;
+}
+
+/**
+ * @brief 子进程：从快照继续执行一个请求，输出一行 JSON 结果
+ */
+static void forksrv_child(FORKSRV* srv, int conn, int id) {
+    MACHINE* m = &srv->m;
+    u64 start = forksrv_now_us();
+    const char* status = "error";
+    u64 insns = 0, pc = 0;
+    int64_t code = 0;
+
+    // 快照中已创建的唤醒描述符与服务进程、其它子进程共用，需要重新创建
+    for (int i = 0; i < BUS_MAX_HART; i++) {
+        if (m->bus.wake_fd[i] >= 0)
+            close(m->bus.wake_fd[i]);
+        m->bus.wake_fd[i] = -1;
+    }
+
+    int ret = m->proc.user ? forksrv_run_stdio(m, conn, id) : forksrv_run_chan(m, conn, id);
+    if (ret == 0) {
+        CPU* boot = m->harts[0];
+        status = boot->pc == 0 ? "exit" : "fault";
+        code = (int64_t)boot->regs[10];
+        pc = boot->pc - boot->ilen;
+        insns = boot->instret - srv->instret;
+        for (int i = 1; i < m->nhart; i++)
+            insns += m->harts[i]->instret;
+    }
+    shutdown(conn, SHUT_RDWR);
+    close(conn);
+    u64 wall = forksrv_now_us() - start;
+
+    fprintf(srv->out, "{\"id\":%d,\"status\":\"%s\"", id, status);
+    if (strcmp(status, "exit") == 0)
+        fprintf(srv->out, ",\"code\":%ld", code);
+    else if (strcmp(status, "fault") == 0)
+        fprintf(srv->out, ",\"pc\":%lu", pc);
+    fprintf(srv->out, ",\"insns\":%lu,\"wall_us\":%lu}\n", insns, wall);
+    fflush(srv->out);
+}
+
+/**
+ * @brief 回收已结束的子进程，终止超时的子进程并为其输出一行 JSON
+ * @return int 仍在运行的子进程个数
+ */
+static int forksrv_reap(FORKSRV* srv, FORKSRV_CHILD* kids, int n, u64 timeout_ms) {
+    u64 now = forksrv_now_us();
+    for (int i = 0; i < n;) {
+        FORKSRV_CHILD* k = &kids[i];
+        if (timeout_ms > 0 && !k->killed && now - k->start > timeout_ms * 1000) {
+            kill(k->pid, SIGKILL);
+            k->killed = 1;
+        }
+        pid_t r = waitpid(k->pid, NULL, WNOHANG);
+        if (r == 0 || (r < 0 && errno == EINTR)) {
+            i++;
+            continue;
+        }
+        if (k->killed) {
+            log_warn("Request %d: killed after %lu ms", k->id, timeout_ms);
+            fprintf(srv->out, "{\"id\":%d,\"status\":\"timeout\",\"wall_us\":%lu}\n",
+                    k->id, forksrv_now_us() - k->start);
+            fflush(srv->out);
+        }
+        kids[i] = kids[--n];
+    }
+    return n;
+}
+
+
+// ==================================================================== //
+//                           Func API: FORKSRV
+// ==================================================================== //
+
+int forksrv_init(FORKSRV* srv, char* elf, int nhart, u64 quantum, int at) {
+    memset(srv, 0, sizeof(FORKSRV));
+    srv->listen_fd = -1;
+    machine_init(&srv->m, nhart);
+    machine_set_quantum(&srv->m, quantum);
+    if (machine_load_elf(&srv->m, elf) < 0)
+        return -1;
+    CPU* boot = srv->m.harts[0];
+    if (at == FORKSRV_AT_MARKER && machine_run_to_marker(&srv->m) < 0)
+        return -1;
+    srv->instret = boot->instret;
+    log_info("Fork point at %#lx after %lu insts", boot->pc, srv->instret);
+    return 0;
+}
+
+int forksrv_serve(FORKSRV* srv, char* path, int count, int jobs, u64 timeout_ms, FILE* out) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        log_error("Socket path too long");
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    srv->out = out;
+    srv->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (srv->listen_fd < 0
+        || bind(srv->listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0
+        || listen(srv->listen_fd, 128) < 0) {
+        log_error("Listen %s failed", path);
+        return -1;
+    }
+    log_info("Serving %s", path);
+
+    if (jobs <= 0)
+        jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (jobs <= 0)
+        jobs = 1;
+    FORKSRV_CHILD* kids = calloc(jobs, sizeof(FORKSRV_CHILD));
+    if (!kids) {
+        log_error("Out of memory");
+        return -1;
+    }
+    int id = 0, nkid = 0;
+    while (count <= 0 || id < count || nkid > 0) {
+        nkid = forksrv_reap(srv, kids, nkid, timeout_ms);
+        // 达到请求数或子进程上限时不再接受连接，只等待子进程结束或超时
+        if ((count > 0 && id >= count) || nkid >= jobs) {
+            if (nkid > 0)
+                poll(NULL, 0, 10);
+            continue;
+        }
+        struct pollfd pfd = { .fd = srv->listen_fd, .events = POLLIN };
+        int r = poll(&pfd, 1, nkid > 0 ? 10 : -1);
+        if (r < 0 && errno != EINTR) {
+            log_error("Poll failed");
+            break;
+        }
+        if (r <= 0)
+            continue;
+        int conn = accept(srv->listen_fd, NULL, NULL);
+        if (conn < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            log_error("Accept failed");
+            break;
+        }
+        // 缓冲区中尚未写出的内容会被子进程再写一次
+        fflush(NULL);
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(srv->listen_fd);
+            forksrv_child(srv, conn, id);
+            _exit(0);
+        }
+        if (pid < 0)
+            log_error("Request %d: fork failed", id);
+        else
+            kids[nkid++] = (FORKSRV_CHILD){ .pid = pid, .id = id, .start = forksrv_now_us() };
+        close(conn);
+        id++;
+    }
+    // 出错退出循环时仍要回收已启动的子进程
+    while (nkid > 0) {
+        nkid = forksrv_reap(srv, kids, nkid, timeout_ms);
+        if (nkid > 0)
+            poll(NULL, 0, 10);
+    }
+    free(kids);
+    log_info("Served %d requests", id);
+    return 0;
+}
+
+void forksrv_free(FORKSRV* srv) {
+    if (srv->listen_fd >= 0)
+        close(srv->listen_fd);
+    srv->listen_fd = -1;
+    machine_free(&srv->m);
+}
@@ -0,0 +1,118 @@
+/**
+ * @file forksrv.h
+ * @author lancer (lancerstadium@163.com)
+ * @brief 预启动服务头文件
+ * @version 0.1
+ * @date 2024-02-03
+ * @copyright Copyright (c) 2024
+ *
+ * # 预启动服务介绍
+ * - 短任务的开销主要在启动、解析 ELF 与来宾运行库初始化。`cemu serve`只做一次这些工作：
+ * 加载 ELF，让 0 号处理器执行到启动点，然后在 Unix socket 上等待请求，
+ * 每个请求`fork()`一个子进程，从写时复制的快照继续执行：
+ * ```
+ *
+ *   加载 ELF -> 执行到启动点 -> listen
+ *                                 |
+ *                      accept ----+----> fork() -> 子进程：建立数据通道 -> 继续执行 -> 回写结果
+ *
+ * ```
+ *
+ * - 启动点为入口（`FORKSRV_AT_ENTRY`），或来宾代码中第一条标记指令
+ * `MACHINE_MARKER`（`FORKSRV_AT_MARKER`，见`machine_run_to_marker()`）。标记指令是`slti x0, x0, 1`，
+ * 属于 RISC-V 的 HINT 编码，在真实硬件与普通运行时都是空操作；
+ * 子进程从标记的下一条指令继续执行。其它处理器不参与预执行，在子进程中从入口开始执行。
+ *
+ * - 请求协议：客户端连接后发送输入并关闭写端（`shutdown(SHUT_WR)`），
+ * 子进程把输入写入数据通道（见`chan.h`）的 h2g 环并关闭该环，
+ * 来宾写入 g2h 环的数据原样回写到连接上，来宾结束后关闭连接。例如：
+ * ```
+ *
+ *   cemu serve -i job.elf -l /tmp/job.sock -a marker &
+ *   socat - UNIX-CONNECT:/tmp/job.sock < input > output
+ *
+ * ```
+ * 每个请求结束后向输出写一行 JSON，字段与`cemu batch`相同（见`batch.h`），
+ * `insns`只计启动点之后执行的指令。
+ *
+ * - 静态链接的 Linux 用户态程序不能访问数据通道：子进程把来宾的标准输入、标准输出
+ * （描述符 0、1）接到连接上，来宾读到客户端发送的输入，写出的数据直接回到客户端。
+ *
+ * - 同时运行的子进程数有上限，达到上限时服务进程暂停接受连接；
+ * 设置超时后，运行超时的子进程被`SIGKILL`终止，服务进程代为输出
+ * `{"id":N,"status":"timeout","wall_us":...}`，死循环的来宾不会一直占用子进程。
+ *
+ * - 子进程之间、子进程与服务进程之间不共享可写状态：DRAM 是私有匿名映射，
+ * 只读段是私有文件映射（见`dram.h`），`fork()`后都按页写时复制；
+ * 数据通道与唤醒描述符在子进程中重新创建。来宾在启动点之前不能访问数据通道。
+ */
+
+
+#ifndef FORKSRV_H
+#define FORKSRV_H
+
+// ==================================================================== //
+//                             Include
+// ==================================================================== //
+
+#include "machine.h"
+#include <stdio.h>
+
+// ==================================================================== //
+//                              Defines
+// ==================================================================== //
+
+#define FORKSRV_AT_ENTRY    0           /** 从入口开始服务 */
+#define FORKSRV_AT_MARKER   1           /** 执行到标记指令后开始服务 */
+
+
+// ==================================================================== //
+//                            Data: FORKSRV
+// ==================================================================== //
+
+/**
+ * @brief 预启动服务
+ */
+typedef struct FORKSRV_t {
+    MACHINE m;                      /** 执行到启动点的机器（快照） */
+    u64 instret;                    /** 快照时 0 号处理器已退休的指令数 */
+    int listen_fd;                  /** 请求 socket，-1 表示未监听 */
+    FILE* out;                      /** JSON 行输出 */
+} FORKSRV;
+
+
+// ==================================================================== //
+//                          Declare API: FORKSRV
+// ==================================================================== //
+
+/**
+ * @brief 加载 ELF，并让 0 号处理器执行到启动点
+ * @param srv 预启动服务
+ * @param elf ELF 文件
+ * @param nhart 处理器个数
+ * @param quantum 确定性时间片，0 表示自由并行
+ * @param at 启动点：`FORKSRV_AT_ENTRY`或`FORKSRV_AT_MARKER`
+ * @return int 0 成功，-1 失败（ELF 无法加载，见`load_elf()`；或到达标记前来宾已结束）
+ */
+int forksrv_init(FORKSRV* srv, char* elf, int nhart, u64 quantum, int at);
+
+/**
+ * @brief 在`path`上监听，每个连接`fork()`一个子进程处理
+ * @param srv 预启动服务
+ * @param path Unix socket 路径
+ * @param count 处理的请求数，0 表示不限；达到后等待所有子进程结束再返回
+ * @param jobs 同时运行的子进程上限，0 表示主机处理器个数
+ * @param timeout_ms 单个请求的超时（毫秒），0 表示不限
+ * @param out 输出
+ * @return int 0 成功，-1 失败
+ */
+int forksrv_serve(FORKSRV* srv, char* path, int count, int jobs, u64 timeout_ms, FILE* out);
+
+/**
+ * @brief 关闭 socket 并释放机器
+ * @param srv 预启动服务
+ */
+void forksrv_free(FORKSRV* srv);
+
+
+#endif // FORKSRV_H
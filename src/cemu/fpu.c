@@ -0,0 +1,536 @@
+/**
+ * @file fpu.c
+ * @author lancer (lancerstadium@163.com)
+ * @brief 浮点单元（RV64F/D）实现
+ * @version 0.1
+ * @date 2024-01-26
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+
+// ==================================================================== //
+//                             Include
+// ==================================================================== //
+
+#include "fpu.h"
+#include "csr.h"
+#include "opcode.h"
+#include "utils.h"
+#include <fenv.h>
+#include <math.h>
+#include <string.h>
+
+
+// ==================================================================== //
+//                              Defines
+// ==================================================================== //
+
+#define CANON_NAN_S     0x7fc00000u                 /** 单精度规范 NaN */
+#define CANON_NAN_D     0x7ff8000000000000ull       /** 双精度规范 NaN */
+#define NAN_BOX         0xffffffff00000000ull       /** 单精度 NaN-boxing 高位 */
+
+/** frm 编码 -> 主机舍入模式（RMM 近似为 RNE；5~7 保留，只在来宾写入 frm 时出现） */
+static const int fpu_host_rm[8] = {
+    FE_TONEAREST, FE_TOWARDZERO, FE_DOWNWARD, FE_UPWARD,
+    FE_TONEAREST, FE_TONEAREST, FE_TONEAREST, FE_TONEAREST,
+};
+
+
+// ==================================================================== //
+//                          Private Func: FPU
+// ==================================================================== //
+
+static void print_op(char* s) {
+    if (log_trace_on)
+        printf(_blue("%s"), s);
+}
+
+static inline u64 rd(u32 inst)  { return (inst >> 7) & 0x1f; }
+static inline u64 rs1(u32 inst) { return (inst >> 15) & 0x1f; }
+static inline u64 rs2(u32 inst) { return (inst >> 20) & 0x1f; }
+static inline u64 rs3(u32 inst) { return (inst >> 27) & 0x1f; }
+
+/** 浮点状态已改变：`mstatus.FS`置为 Dirty（SD 在读`mstatus`时汇总） */
+static inline void fpu_dirty(CPU* cpu) {
+    cpu->csr[CS_MSTATUS] |= MSTATUS_FS;
+}
+
+/** 读/写单精度寄存器（NaN-boxing） */
+static inline u32 fget_s_bits(CPU* cpu, int r) {
+    u64 v = cpu->fregs[r];
+    return (v & NAN_BOX) == NAN_BOX ? (u32)v : CANON_NAN_S;
+}
+static inline float fget_s(CPU* cpu, int r) {
+    u32 b = fget_s_bits(cpu, r);
+    float f;
+    memcpy(&f, &b, sizeof(f));
+    return f;
+}
+static inline void fset_s_bits(CPU* cpu, int r, u32 b) {
+    cpu->fregs[r] = NAN_BOX | b;
+    fpu_dirty(cpu);
+}
+static inline void fset_s(CPU* cpu, int r, float f) {
+    u32 b;
+    memcpy(&b, &f, sizeof(b));
+    fset_s_bits(cpu, r, f != f ? CANON_NAN_S : b);
+}
+
+/** 读/写双精度寄存器 */
+static inline double fget_d(CPU* cpu, int r) {
+    double d;
+    memcpy(&d, &cpu->fregs[r], sizeof(d));
+    return d;
+}
+static inline void fset_d_bits(CPU* cpu, int r, u64 b) {
+    cpu->fregs[r] = b;
+    fpu_dirty(cpu);
+}
+static inline void fset_d(CPU* cpu, int r, double d) {
+    u64 b;
+    memcpy(&b, &d, sizeof(b));
+    fset_d_bits(cpu, r, d != d ? CANON_NAN_D : b);
+}
+
+static inline int is_snan_s(u32 b) {
+    return (b & 0x7f800000) == 0x7f800000 && (b & 0x007fffff) && !(b & 0x00400000);
+}
+static inline int is_snan_d(u64 b) {
+    return (b & 0x7ff0000000000000ull) == 0x7ff0000000000000ull
+        && (b & 0x000fffffffffffffull) && !(b & 0x0008000000000000ull);
+}
+
+/** 额外的异常标志（主机行为与 RISC-V 不一致处）直接记入 fflags */
+static inline void fpu_raise(CPU* cpu, u64 flags) {
+    cpu->csr[CS_FFLAGS] |= flags;
+    fpu_dirty(cpu);
+}
+
+/** 取得指令实际使用的舍入模式：静态 5、6 保留，DYN 时取`frm`（可能为保留值 5~7） */
+static inline u32 fpu_rm_of(CPU* cpu, u32 inst) {
+    u32 rm = (inst >> 12) & 0x7;
+    return rm == FRM_DYN ? cpu->csr[CS_FRM] & 0x7 : rm;
+}
+
+/** 带舍入模式字段的 OP-FP 指令：算术、开方与类型转换 */
+static inline int fpu_has_rm(u32 funct5) {
+    return funct5 == FADD_S || funct5 == FSUB_S || funct5 == FMUL_S || funct5 == FDIV_S
+        || funct5 == FSQRT_S || funct5 == FCVT_S_D || funct5 == FCVT_W_S || funct5 == FCVT_S_W;
+}
+
+/** 设置主机舍入模式：只在实际变化时调用 fesetround */
+static inline void fpu_set_rm(CPU* cpu, u32 rm) {
+    if ((int)rm != cpu->fpu_rm) {
+        fesetround(fpu_host_rm[rm]);
+        cpu->fpu_rm = rm;
+    }
+}
+
+/**
+ * @brief 浮点数分类（`FCLASS`），按位模式判断
+ * @param sign 符号位
+ * @param exp 阶码
+ * @param exp_max 阶码全 1 的值
+ * @param frac 尾数
+ * @param quiet 尾数最高位（quiet 位）
+ */
+static u64 fpu_classify(int sign, u64 exp, u64 exp_max, u64 frac, int quiet) {
+    if (exp == exp_max) {
+        if (frac == 0)
+            return sign ? 1 << 0 : 1 << 7;              // ±inf
+        return quiet ? 1 << 9 : 1 << 8;                 // qNaN / sNaN
+    }
+    if (exp == 0)
+        return frac == 0 ? (sign ? 1 << 3 : 1 << 4)     // ±0
+                         : (sign ? 1 << 2 : 1 << 5);    // ±subnormal
+    return sign ? 1 << 1 : 1 << 6;                      // ±normal
+}
+
+/**
+ * @brief 按 RISC-V 规则舍入到整数值（RMM 单独实现，其余使用主机舍入模式）
+ */
+static inline double fpu_round(CPU* cpu, double x, u32 rm) {
+    switch (rm) {
+        case FRM_RTZ: return trunc(x);
+        case FRM_RMM: return round(x);
+        default:
+            fpu_set_rm(cpu, rm);
+            return nearbyint(x);
+    }
+}
+
+/**
+ * @brief 浮点转整数（`FCVT.{W,WU,L,LU}.{S,D}`）：NaN 与越界饱和并置 NV
+ * @param x 源值（单精度先无损转为双精度）
+ * @param type 0 W，1 WU，2 L，3 LU
+ * @return u64 写入整数寄存器的值（32 位结果符号扩展）
+ */
+static u64 fpu_cvt_to_int(CPU* cpu, double x, u32 rm, u32 type) {
+    static const double lo[4] = { -2147483648.0, 0.0, -9223372036854775808.0, 0.0 };
+    static const double hi[4] = { 2147483648.0, 4294967296.0, 9223372036854775808.0, 18446744073709551616.0 };
+    static const u64 min[4] = { (u64)(int64_t)INT32_MIN, 0, (u64)INT64_MIN, 0 };
+    static const u64 max[4] = { INT32_MAX, ~(u64)0, INT64_MAX, ~(u64)0 };
+    if (x != x) {
+        fpu_raise(cpu, FFLAGS_NV);
+        return max[type];
+    }
+    double r = fpu_round(cpu, x, rm);
+    if (r < lo[type]) {
+        fpu_raise(cpu, FFLAGS_NV);
+        return min[type];
+    }
+    if (r >= hi[type]) {
+        fpu_raise(cpu, FFLAGS_NV);
+        return max[type];
+    }
+    if (r != x)
+        fpu_raise(cpu, FFLAGS_NX);
+    switch (type) {
+        case 0:  return (u64)(int64_t)(int32_t)r;
+        case 1:  return (u64)(int64_t)(int32_t)(u32)r;
+        case 2:  return (u64)(int64_t)r;
+        default: return (u64)r;
+    }
+}
+
+/**
+ * @brief 浮点比较（`FEQ`/`FLT`/`FLE`）：有 NaN 时结果为 0；
+ * `FLT`/`FLE`对任意 NaN 置 NV，`FEQ`仅对 sNaN 置 NV
+ * @param op 0 LE，1 LT，2 EQ
+ */
+static inline u64 fpu_compare(CPU* cpu, double a, double b, u32 op, int nan, int snan) {
+    if (nan) {
+        if (snan || op != 2)
+            fpu_raise(cpu, FFLAGS_NV);
+        return 0;
+    }
+    switch (op) {
+        case 0:  return a <= b;
+        case 1:  return a < b;
+        default: return a == b;
+    }
+}
+
+static float fpu_minmax_s(CPU* cpu, u32 ab, u32 bb, int max) {
+    float a, b;
+    memcpy(&a, &ab, sizeof(a));
+    memcpy(&b, &bb, sizeof(b));
+    if (is_snan_s(ab) || is_snan_s(bb))
+        fpu_raise(cpu, FFLAGS_NV);
+    if (a != a)
+        return b;
+    if (b != b)
+        return a;
+    if (a == b)     // ±0：-0 < +0
+        return (signbit(a) != 0) == !max ? a : b;
+    return max ? (a > b ? a : b) : (a < b ? a : b);
+}
+
+static double fpu_minmax_d(CPU* cpu, u64 ab, u64 bb, int max) {
+    double a, b;
+    memcpy(&a, &ab, sizeof(a));
+    memcpy(&b, &bb, sizeof(b));
+    if (is_snan_d(ab) || is_snan_d(bb))
+        fpu_raise(cpu, FFLAGS_NV);
+    if (a != a)
+        return b;
+    if (b != b)
+        return a;
+    if (a == b)
+        return (signbit(a) != 0) == !max ? a : b;
+    return max ? (a > b ? a : b) : (a < b ? a : b);
+}
+
+/** 单精度 OP-FP */
+static int fpu_op_s(CPU* cpu, u32 inst, u32 funct5, u32 funct3) {
+    int d = rd(inst), s1 = rs1(inst), s2 = rs2(inst);
+    u32 ab = fget_s_bits(cpu, s1), bb = fget_s_bits(cpu, s2);
+    float a = fget_s(cpu, s1), b = fget_s(cpu, s2);
+    switch (funct5) {
+        case FADD_S:
+            fpu_set_rm(cpu, fpu_rm_of(cpu, inst));
+            fset_s(cpu, d, a + b); print_op("fadd.s\n"); return 1;
+        case FSUB_S:
+            fpu_set_rm(cpu, fpu_rm_of(cpu, inst));
+            fset_s(cpu, d, a - b); print_op("fsub.s\n"); return 1;
+        case FMUL_S:
+            fpu_set_rm(cpu, fpu_rm_of(cpu, inst));
+            fset_s(cpu, d, a * b); print_op("fmul.s\n"); return 1;
+        case FDIV_S:
+            fpu_set_rm(cpu, fpu_rm_of(cpu, inst));
+            fset_s(cpu, d, a / b); print_op("fdiv.s\n"); return 1;
+        case FSQRT_S:
+            fpu_set_rm(cpu, fpu_rm_of(cpu, inst));
+            fset_s(cpu, d, sqrtf(a)); print_op("fsqrt.s\n"); return 1;
+        case FSGNJ_S: {
+            u32 sign;
+            switch (funct3) {
+                case 0: sign = bb & 0x80000000; break;
+                case 1: sign = ~bb & 0x80000000; break;
+                case 2: sign = (ab ^ bb) & 0x80000000; break;
+                default: return 0;
+            }
+            fset_s_bits(cpu, d, (ab & 0x7fffffff) | sign);
+            print_op("fsgnj.s\n");
+            return 1;
+        }
+        case FMINMAX_S:
+            if (funct3 > 1)
+                return 0;
+            fset_s(cpu, d, fpu_minmax_s(cpu, ab, bb, funct3));
+            print_op(funct3 ? "fmax.s\n" : "fmin.s\n");
+            return 1;
+        case FCVT_S_D:  // FCVT.S.D
+            if (s2 != 1)
+                return 0;
+            fpu_set_rm(cpu, fpu_rm_of(cpu, inst));
+            fset_s(cpu, d, (float)fget_d(cpu, s1));
+            print_op("fcvt.s.d\n");
+            return 1;
+        case FCMP_S:
+            if (funct3 > 2)
+                return 0;
+            cpu->regs[d] = fpu_compare(cpu, a, b, funct3, a != a || b != b, is_snan_s(ab) || is_snan_s(bb));
+            print_op("fcmp.s\n");
+            return 1;
+        case FCVT_W_S:
+            if (s2 > 3)
+                return 0;
+            cpu->regs[d] = fpu_cvt_to_int(cpu, a, fpu_rm_of(cpu, inst), s2);
+            print_op("fcvt.w.s\n");
+            return 1;
+        case FCVT_S_W: {
+            u64 x = cpu->regs[s1];
+            fpu_set_rm(cpu, fpu_rm_of(cpu, inst));
+            switch (s2) {
+                case 0: fset_s(cpu, d, (float)(int32_t)x); break;
+                case 1: fset_s(cpu, d, (float)(u32)x); break;
+                case 2: fset_s(cpu, d, (float)(int64_t)x); break;
+                case 3: fset_s(cpu, d, (float)x); break;
+                default: return 0;
+            }
+            print_op("fcvt.s.w\n");
+            return 1;
+        }
+        case FMV_X_W:
+            if (funct3 == 0)    // FMV.X.W：原样搬运低 32 位并符号扩展
+                cpu->regs[d] = (u64)(int64_t)(int32_t)(u32)cpu->fregs[s1];
+            else if (funct3 == 1)
+                cpu->regs[d] = fpu_classify(ab >> 31, (ab >> 23) & 0xff, 0xff,
+                                            ab & 0x7fffff, (ab >> 22) & 1);
+            else
+                return 0;
+            print_op(funct3 ? "fclass.s\n" : "fmv.x.w\n");
+            return 1;
+        case FMV_W_X:
+            fset_s_bits(cpu, d, (u32)cpu->regs[s1]);
+            print_op("fmv.w.x\n");
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/** 双精度 OP-FP（funct5 使用 fmt = S 的编码） */
+static int fpu_op_d(CPU* cpu, u32 inst, u32 funct5, u32 funct3) {
+    int d = rd(inst), s1 = rs1(inst), s2 = rs2(inst);
+    u64 ab = cpu->fregs[s1], bb = cpu->fregs[s2];
+    double a = fget_d(cpu, s1), b = fget_d(cpu, s2);
+    switch (funct5) {
+        case FADD_S:
+            fpu_set_rm(cpu, fpu_rm_of(cpu, inst));
+            fset_d(cpu, d, a + b); print_op("fadd.d\n"); return 1;
+        case FSUB_S:
+            fpu_set_rm(cpu, fpu_rm_of(cpu, inst));
+            fset_d(cpu, d, a - b); print_op("fsub.d\n"); return 1;
+        case FMUL_S:
+            fpu_set_rm(cpu, fpu_rm_of(cpu, inst));
+            fset_d(cpu, d, a * b); print_op("fmul.d\n"); return 1;
+        case FDIV_S:
+            fpu_set_rm(cpu, fpu_rm_of(cpu, inst));
+            fset_d(cpu, d, a / b); print_op("fdiv.d\n"); return 1;
+        case FSQRT_S:
+            fpu_set_rm(cpu, fpu_rm_of(cpu, inst));
+            fset_d(cpu, d, sqrt(a)); print_op("fsqrt.d\n"); return 1;
+        case FSGNJ_S: {
+            u64 sign, m = (u64)1 << 63;
+            switch (funct3) {
+                case 0: sign = bb & m; break;
+                case 1: sign = ~bb & m; break;
+                case 2: sign = (ab ^ bb) & m; break;
+                default: return 0;
+            }
+            fset_d_bits(cpu, d, (ab & ~m) | sign);
+            print_op("fsgnj.d\n");
+            return 1;
+        }
+        case FMINMAX_S:
+            if (funct3 > 1)
+                return 0;
+            fset_d(cpu, d, fpu_minmax_d(cpu, ab, bb, funct3));
+            print_op(funct3 ? "fmax.d\n" : "fmin.d\n");
+            return 1;
+        case FCVT_S_D:  // FCVT.D.S：精确，无需舍入
+            if (s2 != 0)
+                return 0;
+            fset_d(cpu, d, (double)fget_s(cpu, s1));
+            print_op("fcvt.d.s\n");
+            return 1;
+        case FCMP_S:
+            if (funct3 > 2)
+                return 0;
+            cpu->regs[d] = fpu_compare(cpu, a, b, funct3, a != a || b != b, is_snan_d(ab) || is_snan_d(bb));
+            print_op("fcmp.d\n");
+            return 1;
+        case FCVT_W_S:
+            if (s2 > 3)
+                return 0;
+            cpu->regs[d] = fpu_cvt_to_int(cpu, a, fpu_rm_of(cpu, inst), s2);
+            print_op("fcvt.w.d\n");
+            return 1;
+        case FCVT_S_W: {
+            u64 x = cpu->regs[s1];
+            fpu_set_rm(cpu, fpu_rm_of(cpu, inst));
+            switch (s2) {
+                case 0: fset_d(cpu, d, (double)(int32_t)x); break;
+                case 1: fset_d(cpu, d, (double)(u32)x); break;
+                case 2: fset_d(cpu, d, (double)(int64_t)x); break;
+                case 3: fset_d(cpu, d, (double)x); break;
+                default: return 0;
+            }
+            print_op("fcvt.d.w\n");
+            return 1;
+        }
+        case FMV_X_W:
+            if (funct3 == 0)
+                cpu->regs[d] = ab;
+            else if (funct3 == 1)
+                cpu->regs[d] = fpu_classify(ab >> 63, (ab >> 52) & 0x7ff, 0x7ff,
+                                            ab & 0xfffffffffffffull, (ab >> 51) & 1);
+            else
+                return 0;
+            print_op(funct3 ? "fclass.d\n" : "fmv.x.d\n");
+            return 1;
+        case FMV_W_X:
+            fset_d_bits(cpu, d, cpu->regs[s1]);
+            print_op("fmv.d.x\n");
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/** 融合乘加：FMADD / FMSUB / FNMSUB / FNMADD */
+static int fpu_fma(CPU* cpu, u32 inst, u32 opcode) {
+    int neg_prod = opcode == FNMSUB || opcode == FNMADD;
+    int neg_add = opcode == FMSUB || opcode == FNMADD;
+    fpu_set_rm(cpu, fpu_rm_of(cpu, inst));
+    switch ((inst >> 25) & 0x3) {
+        case 0: {
+            float a = fget_s(cpu, rs1(inst)), b = fget_s(cpu, rs2(inst)), c = fget_s(cpu, rs3(inst));
+            fset_s(cpu, rd(inst), fmaf(neg_prod ? -a : a, b, neg_add ? -c : c));
+            print_op("fmadd.s\n");
+            return 1;
+        }
+        case 1: {
+            double a = fget_d(cpu, rs1(inst)), b = fget_d(cpu, rs2(inst)), c = fget_d(cpu, rs3(inst));
+            fset_d(cpu, rd(inst), fma(neg_prod ? -a : a, b, neg_add ? -c : c));
+            print_op("fmadd.d\n");
+            return 1;
+        }
+        default:
+            return 0;
+    }
+}
+
+
+// ==================================================================== //
+//                            Func API: FPU
+// ==================================================================== //
+
+void fpu_init(CPU* cpu) {
+    memset(cpu->fregs, 0, sizeof(cpu->fregs));
+    cpu->csr[CS_FFLAGS] = 0;
+    cpu->csr[CS_FRM] = FRM_RNE;
+    cpu->fpu_rm = -1;
+    feclearexcept(FE_ALL_EXCEPT);
+}
+
+int fpu_execute(CPU* cpu, u32 inst) {
+    u32 opcode = inst & 0x7f;
+    u32 funct3 = (inst >> 12) & 0x7;
+    u64 addr = cpu->regs[rs1(inst)];
+    switch (opcode) {
+        case LOAD_FP: {
+            addr += ((int64_t)(int32_t)inst >> 20) + cpu->seg;
+            if (funct3 == FLW)
+                fset_s_bits(cpu, rd(inst), bus_load(cpu->bus, addr, 32));
+            else if (funct3 == FLD)
+                fset_d_bits(cpu, rd(inst), bus_load(cpu->bus, addr, 64));
+            else
+                return 0;
+            print_op(funct3 == FLW ? "flw\n" : "fld\n");
+            return 1;
+        }
+        case STORE_FP: {
+            addr += (((int64_t)(int32_t)(inst & 0xfe000000) >> 20) | ((inst >> 7) & 0x1f)) + cpu->seg;
+            if (funct3 == FSW)
+                bus_store(cpu->bus, addr, 32, (u32)cpu->fregs[rs2(inst)]);
+            else if (funct3 == FSD)
+                bus_store(cpu->bus, addr, 64, cpu->fregs[rs2(inst)]);
+            else
+                return 0;
+            print_op(funct3 == FSW ? "fsw\n" : "fsd\n");
+            return 1;
+        }
+        case FMADD:
+        case FMSUB:
+        case FNMSUB:
+        case FNMADD:
+            // 舍入模式为保留值（静态 5、6 或 frm 为 5~7）时是非法指令
+            if (fpu_rm_of(cpu, inst) > FRM_RMM)
+                return 0;
+            return fpu_fma(cpu, inst, opcode);
+        case OP_FP: {
+            u32 funct7 = inst >> 25;
+            u32 funct5 = funct7 & ~0x3;
+            if (fpu_has_rm(funct5) && fpu_rm_of(cpu, inst) > FRM_RMM)
+                return 0;
+            switch (funct7 & 0x3) {
+                case 0: return fpu_op_s(cpu, inst, funct5, funct3);
+                case 1: return fpu_op_d(cpu, inst, funct5, funct3);
+                default: return 0;
+            }
+        }
+        default:
+            return 0;
+    }
+}
+
+void fpu_sync_rm(CPU* cpu) {
+    fpu_set_rm(cpu, cpu->csr[CS_FRM] & 0x7);
+}
+
+u64 fpu_get_fflags(CPU* cpu) {
+    int ex = fetestexcept(FE_ALL_EXCEPT);
+    if (ex) {
+        cpu->csr[CS_FFLAGS] |= ((ex & FE_INEXACT)   ? FFLAGS_NX : 0)
+                          | ((ex & FE_UNDERFLOW) ? FFLAGS_UF : 0)
+                          | ((ex & FE_OVERFLOW)  ? FFLAGS_OF : 0)
+                          | ((ex & FE_DIVBYZERO) ? FFLAGS_DZ : 0)
+                          | ((ex & FE_INVALID)   ? FFLAGS_NV : 0);
+        feclearexcept(FE_ALL_EXCEPT);
+    }
+    return cpu->csr[CS_FFLAGS] & 0x1f;
+}
+
+void fpu_set_fflags(CPU* cpu, u64 value) {
+    feclearexcept(FE_ALL_EXCEPT);
+    cpu->csr[CS_FFLAGS] = value & 0x1f;
+}
+
+void fpu_yield(CPU* cpu) {
+    fpu_get_fflags(cpu);
+    cpu->fpu_rm = -1;
+}
@@ -0,0 +1,110 @@
+/**
+ * @file fpu.h
+ * @author lancer (lancerstadium@163.com)
+ * @brief 浮点单元（RV64F/D）头文件
+ * @version 0.1
+ * @date 2024-01-26
+ * @copyright Copyright (c) 2024
+ *
+ * # 浮点单元介绍
+ * - F/D 扩展提供 32 个 64 位浮点寄存器`f0 ~ f31`。单精度值按 NaN-boxing 存放：
+ * 高 32 位全为 1，读出时高位不全为 1 的值视为规范 NaN。
+ *
+ * - 运算直接使用主机 SSE2 浮点指令，IEEE 754 语义与 RISC-V 一致，
+ * 仅对以下差异单独处理：
+ * 1. 结果为 NaN 时统一写回规范 NaN（主机会传播输入 NaN 的负载）；
+ * 2. `FMIN`/`FMAX`的 NaN 与 ±0 规则、浮点转整数的饱和规则；
+ * 3. 舍入模式 RMM（最近舍入、远离零）主机不支持，算术运算按 RNE 近似，
+ * 浮点转整数则精确实现。
+ *
+ * - 舍入模式：指令的`rm`字段为 DYN 时取`frm`。`rm`为保留值 5、6，或 DYN 时`frm`为 5~7，
+ * 该指令是非法指令。主机舍入模式缓存在`fpu_rm`中，
+ * 只有实际生效的模式发生变化时才调用`fesetround()`。
+ *
+ * - 写浮点寄存器或置位`fflags`的指令把`mstatus.FS`置为 Dirty，读`mstatus`时据此置 SD。
+ *
+ * - 异常标志惰性计算：运算期间不逐条检查，异常标志在主机 MXCSR 中自然累积，
+ * 只有来宾读`fflags`/`fcsr`时才由`fetestexcept()`取出并入`fflags`；
+ * 来宾写`fflags`时清除主机标志。
+ *
+ * - 确定性模式下所有处理器共用调用线程的主机浮点环境：每个时间片结束时由
+ * `fpu_yield()`把累积的主机标志并入该处理器的`fflags`，并使舍入模式缓存失效，
+ * 下一个处理器的浮点指令会重新设置自己的舍入模式。
+ */
+
+
+#ifndef FPU_H
+#define FPU_H
+
+// ==================================================================== //
+//                             Include
+// ==================================================================== //
+
+#include "cpu.h"
+
+// ==================================================================== //
+//                              Defines
+// ==================================================================== //
+
+// fflags
+#define FFLAGS_NX   0x01    /** 不精确 */
+#define FFLAGS_UF   0x02    /** 下溢 */
+#define FFLAGS_OF   0x04    /** 上溢 */
+#define FFLAGS_DZ   0x08    /** 除零 */
+#define FFLAGS_NV   0x10    /** 无效操作 */
+
+// frm
+#define FRM_RNE     0       /** 最近舍入，偶数优先 */
+#define FRM_RTZ     1       /** 向零舍入 */
+#define FRM_RDN     2       /** 向下舍入 */
+#define FRM_RUP     3       /** 向上舍入 */
+#define FRM_RMM     4       /** 最近舍入，远离零 */
+#define FRM_DYN     7       /** 使用 frm */
+
+
+// ==================================================================== //
+//                            Declare API: FPU
+// ==================================================================== //
+
+/**
+ * @brief 初始化浮点单元：清空浮点寄存器、`fcsr`与主机异常标志
+ * @param cpu 中央处理器
+ */
+void fpu_init(CPU* cpu);
+
+/**
+ * @brief 执行一条浮点指令（LOAD-FP、STORE-FP、FMADD 系列与 OP-FP）
+ * @param cpu 中央处理器
+ * @param inst 32-bit 指令数据
+ * @return int 1 成功，0 非法指令（含保留的舍入模式）
+ */
+int fpu_execute(CPU* cpu, u32 inst);
+
+/**
+ * @brief 将主机舍入模式同步为`frm`（供向量浮点运算使用）
+ * @param cpu 中央处理器
+ */
+void fpu_sync_rm(CPU* cpu);
+
+/**
+ * @brief 读取`fflags`：并入累积的主机异常标志
+ * @param cpu 中央处理器
+ * @return u64 fflags
+ */
+u64 fpu_get_fflags(CPU* cpu);
+
+/**
+ * @brief 写入`fflags`
+ * @param cpu 中央处理器
+ * @param value fflags
+ */
+void fpu_set_fflags(CPU* cpu, u64 value);
+
+/**
+ * @brief 处理器让出主机线程：主机异常标志并入其`fflags`，舍入模式缓存置为未知
+ * @param cpu 中央处理器
+ */
+void fpu_yield(CPU* cpu);
+
+
+#endif // FPU_H
@@ -14,9 +14,19 @@
 
 #include "loader.h"
 #include "celf.h"
+#include "macro.h"
 #include <errno.h>
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+// ==================================================================== //
+//                              Defines
+// ==================================================================== //
+
+#define LOADER_MAX_PHDR     16      /** 参与共享的只读段个数上限 */
 
 
 // ==================================================================== //
@@ -103,59 +113,204 @@ static void mmap_to_addr(char* filename, void* addr) {
 
 
 
+/**
+ * @brief 收集只读 PT_LOAD 段的文件区间 [p_offset, p_offset + p_filesz)，按偏移升序
+ * @param image 文件映像
+ * @param len 文件大小
+ * @param ro 输出区间
+ * @return int 区间个数
+ */
+static int elf_ro_ranges(u8* image, size_t len, u64 ro[][2]) {
+    Elf64_Ehdr* eh = (Elf64_Ehdr*)image;
+    if (len < sizeof(Elf64_Ehdr) || memcmp(eh->e_ident, ELFMAG, SELFMAG) != 0)
+        return 0;
+    int is32 = eh->e_ident[EI_CLASS] == ELFCLASS32;
+    u64 phoff   = is32 ? ((Elf32_Ehdr*)image)->e_phoff     : eh->e_phoff;
+    u64 phnum   = is32 ? ((Elf32_Ehdr*)image)->e_phnum     : eh->e_phnum;
+    u64 phentsz = is32 ? ((Elf32_Ehdr*)image)->e_phentsize : eh->e_phentsize;
+    int n = 0;
+    for (u64 i = 0; i < phnum && n < LOADER_MAX_PHDR; i++) {
+        u64 off = phoff + i * phentsz;
+        if (off + (is32 ? sizeof(Elf32_Phdr) : sizeof(Elf64_Phdr)) > len)
+            break;
+        u64 type, flags, start, size;
+        if (is32) {
+            Elf32_Phdr* ph = (Elf32_Phdr*)(image + off);
+            type = ph->p_type, flags = ph->p_flags, start = ph->p_offset, size = ph->p_filesz;
+        } else {
+            Elf64_Phdr* ph = (Elf64_Phdr*)(image + off);
+            type = ph->p_type, flags = ph->p_flags, start = ph->p_offset, size = ph->p_filesz;
+        }
+        if (type != PT_LOAD || (flags & PF_W) || size == 0)
+            continue;
+        // 插入排序：程序头通常已按地址排好
+        int j = n++;
+        for (; j > 0 && ro[j - 1][0] > start; j--) {
+            ro[j][0] = ro[j - 1][0];
+            ro[j][1] = ro[j - 1][1];
+        }
+        ro[j][0] = start;
+        ro[j][1] = start + size;
+    }
+    return n;
+}
+
+/**
+ * @brief 按用户态进程加载静态链接的 riscv64 Linux 程序（见`proc.h`）：
+ * 64 位、有 PT_LOAD 段、最低段地址低于`DRAM_BASE`且段地址不等于文件偏移的 ELF，各段放到自己的虚拟地址；
+ * 各段地址都等于文件偏移的映像与裸机映像的布局相同，仍整体拷贝（并共享只读页）
+ * @param cpu 中央处理器
+ * @param filename 文件名
+ * @param image 文件映像
+ * @param len 文件大小
+ * @return int 1 已按用户态加载，0 不是用户态程序（按裸机映像加载），-1 无法加载
+ */
+static int elf_load_user(CPU* cpu, char* filename, u8* image, size_t len) {
+    Elf64_Ehdr* eh = (Elf64_Ehdr*)image;
+    if (!cpu->proc || len < sizeof(Elf64_Ehdr) || memcmp(eh->e_ident, ELFMAG, SELFMAG) != 0
+        || eh->e_ident[EI_CLASS] != ELFCLASS64 || eh->e_phnum == 0
+        || eh->e_phoff + eh->e_phnum * sizeof(Elf64_Phdr) > len)
+        return 0;
+    Elf64_Phdr* ph = (Elf64_Phdr*)(image + eh->e_phoff);
+    u64 lo = ~(u64)0, end = 0, phdr = 0;
+    u64 phend = eh->e_phoff + eh->e_phnum * sizeof(Elf64_Phdr);
+    int interp = 0, moved = 0;
+    for (int i = 0; i < eh->e_phnum; i++) {
+        if (ph[i].p_type == PT_INTERP)
+            interp = 1;
+        if (ph[i].p_type == PT_PHDR)
+            phdr = ph[i].p_vaddr;
+        if (ph[i].p_type == PT_LOAD) {
+            lo = MIN(lo, ph[i].p_vaddr);
+            end = MAX(end, ph[i].p_vaddr + ph[i].p_memsz);
+            moved |= ph[i].p_vaddr != ph[i].p_offset;
+            // 没有 PT_PHDR 时，程序头位于覆盖其文件区间的段中
+            if (!phdr && ph[i].p_offset <= eh->e_phoff && phend <= ph[i].p_offset + ph[i].p_filesz)
+                phdr = ph[i].p_vaddr + eh->e_phoff - ph[i].p_offset;
+        }
+    }
+    if (lo >= DRAM_BASE || !moved)
+        return 0;
+    if (interp) {
+        log_error("%s is dynamically linked, only static executables are supported", filename);
+        return -1;
+    }
+    // 位置无关程序从 0 开始链接，整体平移到 PROC_PIE_BASE
+    u64 bias = eh->e_type == ET_DYN ? PROC_PIE_BASE : 0;
+    if (end + bias > PROC_STACK_TOP - PROC_STACK_SIZE) {
+        log_error("%s needs %#lx bytes, exceeds DRAM", filename, end + bias);
+        return -1;
+    }
+    // 先检查所有段，出错时不留下装了一半的映像
+    for (int i = 0; i < eh->e_phnum; i++) {
+        if (ph[i].p_type == PT_LOAD
+            && (ph[i].p_offset > len || ph[i].p_filesz > len - ph[i].p_offset || ph[i].p_filesz > ph[i].p_memsz)) {
+            log_error("%s: segment %d out of file", filename, i);
+            return -1;
+        }
+    }
+    cpu->seg = DRAM_BASE;
+    for (int i = 0; i < eh->e_phnum; i++) {
+        if (ph[i].p_type != PT_LOAD)
+            continue;
+        u8* dst = proc_ptr(cpu, ph[i].p_vaddr + bias, ph[i].p_memsz);
+        memcpy(dst, image + ph[i].p_offset, ph[i].p_filesz);
+        memset(dst + ph[i].p_filesz, 0, ph[i].p_memsz - ph[i].p_filesz);     // .bss
+    }
+    DRAM* dram = &cpu->bus->dram;
+    dram->alloc_size = (end + bias + PROC_PAGE_SIZE - 1) & ~(u64)(PROC_PAGE_SIZE - 1);
+    dram->alloc_addr = dram->mem_addr + dram->alloc_size;
+    cpu_set_xlen(cpu, 64);
+    if (proc_start(cpu->proc, cpu, filename, end + bias, eh->e_entry + bias, phdr ? phdr + bias : 0, eh->e_phnum) < 0)
+        return -1;
+
+    printf("File Name    : %s\n", filename);
+    printf("File Size    : %lu (user process)\n", len);
+    printf("Architecture : %s (RV%d)\n", elf_arch(eh->e_machine), cpu->xlen);
+    printf("Entry Point  : 0x%.8lx\n", eh->e_entry + bias);
+    printf("Brk          : 0x%.8lx\n", cpu->proc->brk);
+    printf("Stack        : 0x%.8lx\n", cpu->regs[2]);
+    return 1;
+}
+
+
 // ==================================================================== //
 //                           Func API: loader
 // ==================================================================== //
 
 void load_file(CPU* cpu, char* filename) {
-    copy_to_addr(filename, cpu->bus.dram.mem_addr);
+    copy_to_addr(filename, cpu->bus->dram.mem_addr);
 }
 
 
-void load_elf(CPU* cpu, char* filename) {
-    int fsize;
+int load_elf(CPU* cpu, char* filename) {
     setbuf(stdout, NULL);
-    void *mmaped_elf = cpu->bus.dram.mem_addr;
+    void *mmaped_elf = cpu->bus->dram.mem_addr;
     // copy_to_addr(filename, mmaped_elf);
     // mmap_to_addr(filename, mmaped_elf);
 
-    FILE *file;
-    u8 *buffer;
-    unsigned long filelen;
-    // 1. 打开文件
-    file = fopen(filename, "rb");
-    if (!file) {
+    // 1. 打开文件并只读映射，用于解析与拷贝（不再整体读入堆缓冲区）
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
         log_error("Unable to open file %s", filename);
-        exit(1);
+        if (fd >= 0)
+            close(fd);
+        return -1;
     }
-    // 2. 获取文件大小
-    fseek(file, 0, SEEK_END);
-    filelen=ftell(file);
-    fseek(file, 0, SEEK_SET);
-    // 3. 申请内存
-    buffer=(u8 *)malloc(filelen+1);
-    if (!buffer) {
-        log_error("Memory error!");
-        fclose(file);
+    unsigned long filelen = st.st_size;
+    if (filelen < sizeof(Elf64_Ehdr)) {
+        log_error("%s is not an ELF file", filename);
+        close(fd);
+        return -1;
     }
-    // 4. 将文件内容读取到缓冲区
-    fread(buffer, filelen, 1, file);
-    fclose(file);
-    // 6. 将可执行文件加载到DRAM
-    dram_alloc_data(&cpu->bus.dram, filelen * sizeof(u8), buffer);
-    // memcpy(mmaped_elf, buffer, filelen * sizeof(u8));
+    u8* image = mmap(NULL, filelen, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (image == MAP_FAILED) {
+        log_error("Unable to map file %s", filename);
+        close(fd);
+        return -1;
+    }
+    int user = memcmp(image, ELFMAG, SELFMAG) == 0 ? elf_load_user(cpu, filename, image, filelen) : -1;
+    if (user != 0 || filelen > DRAM_SIZE - cpu->bus->dram.alloc_size) {
+        if (user == 0)
+            log_error("%s needs %#lx bytes, exceeds DRAM", filename, filelen);
+        else if (memcmp(image, ELFMAG, SELFMAG) != 0)
+            log_error("%s is not an ELF file", filename);
+        munmap(image, filelen);
+        close(fd);
+        return user > 0 ? 0 : -1;
+    }
+    cpu->seg = 0;
+    if (cpu->proc)
+        cpu->proc->user = 0;
+    // 2. 将可执行文件加载到DRAM：只读段以共享页映射，其余拷贝
+    u64 ro[LOADER_MAX_PHDR][2];
+    int nro = elf_ro_ranges(image, filelen, ro);
+    size_t shared = dram_alloc_file(&cpu->bus->dram, fd, filelen, image, ro, nro);
+    munmap(image, filelen);
+    close(fd);
 
 
     Elf64_Ehdr *elf_hdr = (Elf64_Ehdr *)mmaped_elf;
     Elf64_Phdr *elf_pdr = (Elf64_Phdr *)mmaped_elf;
     uint16_t oldEntryPoint = elf_pdr->p_paddr;
-    cpu->pc += elf_hdr->e_entry;
+    // 7. 按 ELF 类别选择 RV32/RV64，两者的 e_ident/e_machine 位置相同
+    u64 entry;
+    if (elf_hdr->e_ident[EI_CLASS] == ELFCLASS32) {
+        entry = ((Elf32_Ehdr *)mmaped_elf)->e_entry;
+        cpu->pc += entry;
+        cpu_set_xlen(cpu, 32);
+    } else {
+        entry = elf_hdr->e_entry;
+        cpu->pc += entry;
+        cpu_set_xlen(cpu, 64);
+    }
 
     printf("File Name    : %s\n", filename);
-    printf("File Size    : %d\n", filelen);
+    printf("File Size    : %d (%d shared)\n", filelen, shared);
     printf("File Ident   : %s\n", elf_hdr->e_ident);
-    printf("Architecture : %s\n", elf_arch(elf_hdr->e_machine));
-    printf("Entry Point  : 0x%.8lx\n", elf_hdr->e_entry);
+    printf("Architecture : %s (RV%d)\n", elf_arch(elf_hdr->e_machine), cpu->xlen);
+    printf("Entry Point  : 0x%.8lx\n", entry);
     printf("DRAM Memory  : %p\n", mmaped_elf);
     printf("PC           : 0x%.8lx\n", cpu->pc);
     // printf("TARGET E_IDENT :: %x\n", elf_hdr->e_ident[EI_CLASS]);
@@ -164,4 +319,5 @@ void load_elf(CPU* cpu, char* filename) {
     // uint16_t textSegment = find_segment(mmaped_elf, &fsize);
 
     // elf_pdr->p_paddr = 0x540;
+    return 0;
 }
\ No newline at end of file
@@ -31,6 +31,12 @@
  */
 void load_file(CPU* cpu, char* filename);
 
-void load_elf(CPU* cpu, char* filename);
+/**
+ * @brief 加载 ELF 到处理器：静态链接的 Linux 程序按用户态进程加载，其余按裸机映像整体拷贝
+ * @param cpu 中央处理器
+ * @param filename 文件名
+ * @return int 0 成功，-1 失败（无法打开、不是 ELF、动态链接、段越界或超出 DRAM）
+ */
+int load_elf(CPU* cpu, char* filename);
 
 #endif // LOADER_H
\ No newline at end of file
@@ -0,0 +1,212 @@
+/**
+ * @file machine.c
+ * @author lancer (lancerstadium@163.com)
+ * @brief 多处理器机器实现
+ * @version 0.1
+ * @date 2024-01-31
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+// ==================================================================== //
+//                              Include
+// ==================================================================== //
+
+#include "machine.h"
+#include "loader.h"
+#include "fpu.h"
+#include "log.h"
+#include "macro.h"
+#include <stdlib.h>
+#include <string.h>
+
+// ==================================================================== //
+//                         Private Func: MACHINE
+// ==================================================================== //
+
+/** 从处理器线程：执行到出错、`pc`为 0 或机器停止 */
+static void* machine_hart_thread(void* arg) {
+    CPU* cpu = arg;
+    cpu_step(cpu, -1);
+    return NULL;
+}
+
+/** 是否有处理器存在挂起的中断：外部中断、软件中断或定时器中断 */
+static int machine_pending(MACHINE* m) {
+    if (m->bus.irq_pending)
+        return 1;
+    for (int i = 0; i < m->nhart; i++)
+        if (clint_pending(&m->clint, i))
+            return 1;
+    return 0;
+}
+
+/** 所有处理器中最近的定时器截止时间，没有则为全 1 */
+static u64 machine_next_deadline(MACHINE* m) {
+    u64 cmp = ~(u64)0;
+    for (int i = 0; i < m->nhart; i++)
+        cmp = MIN(cmp, m->clint.mtimecmp[i]);
+    return cmp;
+}
+
+/**
+ * @brief 确定性调度：在调用线程上按编号轮转执行处理器，每轮每个处理器至多一个时间片，
+ * 设备只在轮次之间轮询，虚拟时钟按轮次推进。
+ */
+static int machine_run_quantum(MACHINE* m) {
+    CLINT* clint = &m->clint;
+    int done[BUS_MAX_HART] = { 0 };
+    for (;;) {
+        // 其它线程的 exit_group 等会停止总线：此时 0 号处理器可能在 futex 上反复返回 -EINTR
+        if (__atomic_load_n(&m->bus.halt, __ATOMIC_RELAXED))
+            return 0;
+        int idle = 1;
+        for (int i = 0; i < m->nhart; i++) {
+            // 主线程挂起在 futex 上时跳过，直到其它线程唤醒它
+            if (done[i] || (m->proc.user && m->proc.waiter[i]))
+                continue;
+            long n = cpu_step_quantum(m->harts[i], m->quantum);
+            // 各处理器共用本线程的主机浮点环境：切换前结算异常标志与舍入模式
+            fpu_yield(m->harts[i]);
+            if (n < 0) {
+                if (i == 0)
+                    return 0;
+                done[i] = 1;
+                continue;
+            }
+            idle &= m->harts[i]->idle;
+        }
+        // 用户态进程的其它线程接在处理器之后轮转
+        if (m->proc.user && proc_run_quantum(&m->proc, m->quantum))
+            idle = 0;
+        bus_poll(&m->bus, 0);
+        m->vinsn += m->quantum;
+        clint->vtime += m->vinsn / CLINT_INSN_PER_TICK;
+        m->vinsn %= CLINT_INSN_PER_TICK;
+        if (!idle || machine_pending(m))
+            continue;
+        if (m->proc.user) {
+            // 所有线程都挂起在 futex 上：先让带超时的等待超时，否则没有谁能再唤醒它们
+            if (proc_expire(&m->proc))
+                continue;
+            log_error("All threads wait on futex, none left to wake them");
+            return 0;
+        }
+        // 全部空闲：跳过空转，直接推进到下一个事件
+        u64 cmp = machine_next_deadline(m);
+        if (cmp != ~(u64)0) {
+            clint->vtime = MAX(clint->vtime, cmp);
+        } else if (m->bus.npoll > 0) {
+            bus_poll(&m->bus, -1);
+        } else {
+            log_error("All harts wait for interrupt, but no timer or device is armed");
+            return 0;
+        }
+    }
+}
+
+// ==================================================================== //
+//                           Func API: MACHINE
+// ==================================================================== //
+
+void machine_init(MACHINE* m, int nhart) {
+    m->nhart = MAX(1, MIN(nhart, BUS_MAX_HART));
+    m->quantum = 0;
+    m->vinsn = 0;
+    bus_init(&m->bus, m->nhart);            // Init memory and devices
+    clint_init(&m->clint, &m->bus);         // Init timer
+    proc_init(&m->proc, &m->bus);           // No user process until loaded
+    for (int i = 0; i < m->nhart; i++) {
+        // CPU 含 32 字节对齐的向量寄存器
+        m->harts[i] = aligned_alloc(32, sizeof(CPU));
+        if (!m->harts[i]) {
+            log_error("Hart %d alloc failed", i);
+            exit(1);
+        }
+        memset(m->harts[i], 0, sizeof(CPU));
+        cpu_init(m->harts[i], &m->bus, &m->clint, i);
+        m->harts[i]->proc = &m->proc;
+    }
+}
+
+int machine_load_elf(MACHINE* m, char* filename) {
+    CPU* boot = m->harts[0];
+    if (load_elf(boot, filename) < 0)
+        return -1;
+    // 用户态进程只有一个初始线程
+    if (m->proc.user && m->nhart > 1) {
+        log_warn("User process runs on hart 0 only, %d harts dropped", m->nhart - 1);
+        for (int i = 1; i < m->nhart; i++) {
+            free(m->harts[i]);
+            m->harts[i] = NULL;
+        }
+        m->nhart = 1;
+    }
+    for (int i = 1; i < m->nhart; i++) {
+        m->harts[i]->pc = boot->pc;
+        cpu_set_xlen(m->harts[i], boot->xlen);
+    }
+    return 0;
+}
+
+int machine_run_to_marker(MACHINE* m) {
+    CPU* boot = m->harts[0];
+    while (cpu_fetch(boot) != MACHINE_MARKER) {
+        if (!cpu_step(boot, 1)) {
+            log_error("Guest stopped at %#lx before reaching the marker", boot->pc);
+            return -1;
+        }
+    }
+    boot->pc += 4;
+    return 0;
+}
+
+void machine_set_quantum(MACHINE* m, u64 quantum) {
+    m->quantum = quantum;
+    m->clint.virt = quantum > 0;
+    m->proc.det = quantum > 0;
+    m->clint.vtime = 0;
+}
+
+/**
+ * @note 三级流水线CPU
+ * - 第 1 级流水线由函数`cpu_fetch()`处理。
+ * - 第 2、3 级流水线由定义在`cpu.h`中的函数`cpu_execute()`一并处理。
+ * - 程序计数器`pc`在每次循环后增加指令长度`ilen`个字节（普通指令 4 字节，
+ * C 扩展的压缩指令 2 字节，后者在取指后被扩展为 32 位指令），以获取下一条指令。
+ * - 每个处理器在自己的主机线程上循环执行`cpu_step(cpu, -1)`；
+ * 确定性模式下改为轮转执行`cpu_step_quantum()`。
+ */
+int machine_run(MACHINE* m) {
+    if (m->quantum > 0) {
+        int ret = machine_run_quantum(m);
+        proc_join(&m->proc, m->harts[0]);
+        return ret;
+    }
+    pthread_t threads[BUS_MAX_HART];
+    int started[BUS_MAX_HART] = { 0 };
+    for (int i = 1; i < m->nhart; i++) {
+        if (pthread_create(&threads[i], NULL, machine_hart_thread, m->harts[i]) != 0)
+            log_error("Hart %d thread create failed", i);
+        else
+            started[i] = 1;
+    }
+    int ret = cpu_step(m->harts[0], -1);
+    bus_halt(&m->bus);
+    for (int i = 1; i < m->nhart; i++)
+        if (started[i])
+            pthread_join(threads[i], NULL);
+    // 用户态进程的线程不在 harts 中，由进程回收
+    proc_join(&m->proc, m->harts[0]);
+    return ret;
+}
+
+void machine_free(MACHINE* m) {
+    for (int i = 0; i < m->nhart; i++) {
+        free(m->harts[i]);
+        m->harts[i] = NULL;
+    }
+    proc_free(&m->proc);
+    bus_free(&m->bus);
+    m->nhart = 0;
+}
@@ -0,0 +1,135 @@
+/**
+ * @file machine.h
+ * @author lancer (lancerstadium@163.com)
+ * @brief 多处理器机器头文件
+ * @version 0.1
+ * @date 2024-01-31
+ * @copyright Copyright (c) 2024
+ *
+ * # 机器介绍
+ * - 机器由共享部分与每个处理器（hart）私有的部分组成：
+ * ```
+ *
+ *   MACHINE
+ *   +-- BUS    DRAM、MMIO 设备、中断位图       共享
+ *   +-- CLINT  mtime，每个 hart 的 msip/mtimecmp 共享
+ *   +-- PROC   用户态程序的描述符表、堆与 mmap 区   共享
+ *   +-- CPU[0 .. nhart-1]                     私有：寄存器、pc、CSR、LR 保留
+ *
+ * ```
+ * - `machine_run()`让每个处理器在各自的主机线程上执行，共用同一块来宾内存。
+ * 0 号处理器在调用线程上运行，并负责轮询设备描述符；
+ * 0 号处理器停止时整台机器停止，其它处理器在下一个轮询间隔退出。
+ *
+ * ## 内存模型
+ * - 来宾内存的普通访存：自然对齐的访问是主机上的 relaxed 原子读写，
+ * 保证单次拷贝原子性与同一地址上的一致顺序；不同地址之间的顺序由主机决定
+ * （x86 为 TSO，强于 RVWMO；AArch64 等弱序主机与 RVWMO 同样允许重排）。
+ * - `FENCE`映射为主机的顺序一致栅栏`__atomic_thread_fence(__ATOMIC_SEQ_CST)`。
+ * - AMO 直接在来宾内存上执行主机原子操作，aq/rl 映射为 acquire/release/seq_cst；
+ * LR/SC 以 LR 读到的值为期望值做 CAS（见`cpu.c`）：其它处理器改变了保留的字则 SC 失败，
+ * 写同一缓存行的其它字或 A→B→A 的改写不会使 SC 失败。
+ * - 设备回调在总线锁下串行执行，MMIO 访问之间天然有序。
+ *
+ * ## 确定性模式
+ * - `machine_set_quantum()`设置时间片后，`machine_run()`改为在调用线程上按编号轮转执行：
+ * ```
+ *
+ *   round k:  hart0 [≤ quantum] → hart1 [≤ quantum] → ... → 轮询设备 → mtime += quantum / CLINT_INSN_PER_TICK
+ *
+ * ```
+ * - 处理器之间的交错只取决于时间片长度与已执行的指令，`mtime`由虚拟时钟按轮次推进，
+ * `WFI`不阻塞而是结束该处理器的时间片；所有处理器都空闲且没有挂起的中断时，
+ * 虚拟时钟直接跳到最近的`mtimecmp`，没有定时器时阻塞等待设备输入。
+ * 因此在相同输入下（设备输入在启动前就绪，如重定向的文件）重复运行的结果逐位相同。
+ * - 用户态进程的线程（`clone`）同样不占主机线程：接在处理器之后按槽位轮转，
+ * 在 futex 上等待时让出时间片并挂起到被唤醒（见`proc.h`），多线程程序的交错也逐位可复现。
+ * - 不采用多线程锁步：同一轮内并行执行的处理器通过共享内存交互时，
+ * 交错顺序仍由主机决定，无法逐位复现。
+ */
+
+
+#ifndef MACHINE_H
+#define MACHINE_H
+
+// ==================================================================== //
+//                             Include
+// ==================================================================== //
+
+#include "cpu.h"
+
+// ==================================================================== //
+//                              Defines
+// ==================================================================== //
+
+#define MACHINE_MARKER      0x00102013  /** 标记指令`slti x0, x0, 1`（HINT，空操作） */
+
+// ==================================================================== //
+//                            Data: MACHINE
+// ==================================================================== //
+
+/**
+ * @brief 机器：共享总线与 CLINT，以及若干处理器
+ */
+typedef struct MACHINE_t {
+    BUS bus;                        /** 共享总线：DRAM 与设备 */
+    CLINT clint;                    /** 共享 CLINT */
+    PROC proc;                      /** 用户态进程：描述符表与内存布局 */
+    int nhart;                      /** 处理器个数 */
+    CPU* harts[BUS_MAX_HART];       /** 处理器 */
+    u64 quantum;                    /** 确定性模式的时间片（指令数），0 表示各处理器自由并行 */
+    u64 vinsn;                      /** 虚拟时钟中不足一个节拍的指令数 */
+} MACHINE;
+
+
+// ==================================================================== //
+//                          Declare API: MACHINE
+// ==================================================================== //
+
+/**
+ * @brief 初始化机器：总线、CLINT 与`nhart`个处理器
+ * @param m 机器
+ * @param nhart 处理器个数，超出 1 ~ BUS_MAX_HART 时截断
+ */
+void machine_init(MACHINE* m, int nhart);
+
+/**
+ * @brief 加载 ELF 文件，所有处理器从同一入口开始执行；
+ * 静态链接的 Linux 程序按用户态进程加载（见`proc.h`），只保留 0 号处理器
+ * @param m 机器
+ * @param filename 文件名
+ * @return int 0 成功，-1 失败（见`load_elf()`）
+ */
+int machine_load_elf(MACHINE* m, char* filename);
+
+/**
+ * @brief 0 号处理器单独执行到第一条标记指令`MACHINE_MARKER`，停在标记的下一条指令，
+ * 用于在来宾初始化完成后取快照或预启动（见`snapshot.h`、`forksrv.h`）
+ * @param m 机器（已加载 ELF）
+ * @return int 0 成功，-1 到达标记前来宾已结束或出错
+ */
+int machine_run_to_marker(MACHINE* m);
+
+/**
+ * @brief 设置确定性模式的时间片，并把 CLINT 切换到虚拟时钟
+ * @param m 机器
+ * @param quantum 时间片长度（指令数），0 表示自由并行
+ */
+void machine_set_quantum(MACHINE* m, u64 quantum);
+
+/**
+ * @brief 运行所有处理器，直到 0 号处理器停止：
+ * 自由并行时每个处理器在各自的主机线程上运行，确定性模式下在调用线程上轮转执行
+ * @param m 机器
+ * @return int 0 号处理器停止时的返回值
+ */
+int machine_run(MACHINE* m);
+
+/**
+ * @brief 释放处理器与总线（DRAM、唤醒描述符）
+ * @param m 机器
+ */
+void machine_free(MACHINE* m);
+
+
+#endif // MACHINE_H
@@ -55,11 +55,30 @@
  * 7. `imm`：表示立即数。
  * 8. `shamt`：shamt 位于`imm`的低位，存有移位指令的移位量。
  * 
+ * - 每条指令由一对`(mask, match)`描述：`(inst & mask) == match`即为该指令。
+ * `cpu.c`中的指令表用下面的`MASK_*`/`MATCH_*`宏书写，`decode.c`据此生成查找表。
  */
 
 #ifndef OPCODE_H
 #define OPCODE_H
 
+// 指令编码掩码：参与比较的位
+#define MASK_OPCODE     0x0000007f  /** opcode */
+#define MASK_FUNCT3     0x0000707f  /** opcode + funct3 */
+#define MASK_FUNCT7     0xfe00707f  /** opcode + funct3 + funct7 */
+#define MASK_FUNCT6     0xfc00707f  /** opcode + funct3 + imm[11:6]（RV64 移位立即数） */
+#define MASK_FUNCT5     0xf800707f  /** opcode + funct3 + funct5（AMO，忽略 aq/rl） */
+#define MASK_LR         0xf9f0707f  /** opcode + funct3 + funct5 + rs2（LR，忽略 aq/rl） */
+#define MASK_IMM        0xfff0707f  /** opcode + funct3 + imm[11:0] */
+#define MASK_ALL        0xffffffff  /** 全部 32 位 */
+
+// 指令编码匹配值
+#define MATCH_OP(op)                ((u32)(op))
+#define MATCH_I(op, f3)             ((u32)(op) | (u32)(f3) << 12)
+#define MATCH_R(op, f3, f7)         (MATCH_I(op, f3) | (u32)(f7) << 25)
+#define MATCH_IMM(op, f3, imm)      (MATCH_I(op, f3) | (u32)(imm) << 20)
+#define MATCH_AMO(f3, f5)           (MATCH_I(AMO, f3) | (u32)(f5) << 27)
+
 #define LUI     0x37 
 #define AUIPC   0x17 
 
@@ -114,9 +133,68 @@
         #define SRA     0x20
     #define OR      0x6
     #define AND     0x7
+    // RV64M：funct7 = MULDIV
+    #define MUL     0x0
+    #define MULH    0x1
+    #define MULHSU  0x2
+    #define MULHU   0x3
+    #define DIV     0x4
+    #define DIVU    0x5
+    #define REM     0x6
+    #define REMU    0x7
+
+#define MULDIV  0x01                /** funct7：RV64M 乘除法 0000001 */
+
+// Zba/Zbb/Zbc：位操作，与基础指令共用 I_TYPE/R_TYPE/I_TYPE_64/R_TYPE_64
+#define ZB_SHADD    0x10            /** funct7：sh1add 2，sh2add 4，sh3add 6（R_TYPE_64 为 .uw） */
+#define ZB_NOT      0x20            /** funct7：xnor 4，orn 6，andn 7 */
+#define ZB_MINMAX   0x05            /** funct7：clmul 1，clmulr 2，clmulh 3，min 4，minu 5，max 6，maxu 7 */
+#define ZB_ROT      0x30            /** funct7：rol(w) 1，ror(w) 5 */
+#define ZB_ADDUW    0x04            /** funct7（R_TYPE_64）：add.uw 0，zext.h 4 */
+#define ZB_UNARY    0x30            /** imm[11:5]（funct3 = 1）：clz(w) 0，ctz(w) 1，cpop(w) 2，sext.b 4，sext.h 5 */
+#define ZB_RORI     0x18            /** imm[11:6]（funct3 = 5）：rori */
+#define ZB_SLLIUW   0x02            /** imm[11:6]（I_TYPE_64，funct3 = 1）：slli.uw */
+#define ZB_ORCB     0x287           /** imm[11:0]（funct3 = 5）：orc.b */
+#define ZB_REV8     0x6b8           /** imm[11:0]（funct3 = 5）：rev8（RV64） */
+
+// Zkne/Zknd/Zknh：标量密码（RV64）
+#define ZK_AES64ES  0x19            /** funct7（R_TYPE，funct3 = 0） */
+#define ZK_AES64ESM 0x1b
+#define ZK_AES64DS  0x1d
+#define ZK_AES64DSM 0x1f
+#define ZK_AES64KS2 0x3f
+#define ZK_SHA      0x08            /** imm[11:5]（I_TYPE，funct3 = 1）：rs2 为 sha256sum0/sum1/sig0/sig1、sha512sum0/sum1/sig0/sig1 */
+#define ZK_AES64KS  0x18            /** imm[11:5]（I_TYPE，funct3 = 1）：rs2 = 0 为 aes64im，0x10 | rnum 为 aes64ks1i */
 
 #define FENCE   0x0f
 
+// RV64F/D：浮点
+#define LOAD_FP     0x07
+    #define FLW     0x2
+    #define FLD     0x3
+#define STORE_FP    0x27
+    #define FSW     0x2
+    #define FSD     0x3
+#define FMADD       0x43
+#define FMSUB       0x47
+#define FNMSUB      0x4b
+#define FNMADD      0x4f
+#define OP_FP       0x53
+    // funct7 = funct5 << 2 | fmt，下面为 fmt = S 的取值，D 为其 + 1
+    #define FADD_S      0x00
+    #define FSUB_S      0x04
+    #define FMUL_S      0x08
+    #define FDIV_S      0x0c
+    #define FSGNJ_S     0x10    /** funct3：0 J，1 JN，2 JX */
+    #define FMINMAX_S   0x14    /** funct3：0 MIN，1 MAX */
+    #define FCVT_S_D    0x20    /** rs2 = 1：D -> S；fmt = D 时 rs2 = 0：S -> D */
+    #define FSQRT_S     0x2c
+    #define FCMP_S      0x50    /** funct3：0 LE，1 LT，2 EQ */
+    #define FCVT_W_S    0x60    /** rs2：0 W，1 WU，2 L，3 LU */
+    #define FCVT_S_W    0x68    /** rs2：0 W，1 WU，2 L，3 LU */
+    #define FMV_X_W     0x70    /** funct3：0 FMV，1 FCLASS */
+    #define FMV_W_X     0x78
+
 #define I_TYPE_64 0x1b
     #define ADDIW   0x0
     #define SLLIW   0x1
@@ -127,19 +205,23 @@
 #define R_TYPE_64 0x3b
     #define ADDSUB   0x0
         #define ADDW    0x00
-        #define MULW    0x01
         #define SUBW    0x20
-    #define DIVW    0x4
     #define SLLW    0x1
     #define SRW     0x5
         #define SRLW   0x00
-        #define DIVUW   0x01
         #define SRAW   0x20
+    // RV64M：funct7 = MULDIV
+    #define MULW    0x0
+    #define DIVW    0x4
+    #define DIVUW   0x5
     #define REMW    0x6
     #define REMUW   0x7
 
 #define CSR 0x73
     #define ECALLBREAK    0x00     // contains both ECALL and EBREAK
+        #define ECALL   0x000       /** imm[11:0]：ECALL */
+        #define EBREAK  0x001       /** imm[11:0]：EBREAK */
+        #define WFI     0x105       /** imm[11:0]：WFI */
     #define CSRRW   0x01
     #define CSRRS   0x02
     #define CSRRC   0x03
@@ -147,18 +229,32 @@
     #define CSRRSI  0x06
     #define CSRRCI  0x07
 
-#define AMO_W 0x2f
-    #define LR_W        0x02
-    #define SC_W        0x03
-    #define AMOSWAP_W   0x01
-    #define AMOADD_W    0x00
-    #define AMOXOR_W    0x04
-    #define AMOAND_W    0x0c
-    #define AMOOR_W     0x08
-    #define AMOMIN_W    0x10
-    #define AMOMAX_W    0x14
-    #define AMOMINU_W   0x18
-    #define AMOMAXU_W   0x1c
+// RVV：向量（加载/存储复用 LOAD_FP/STORE_FP，width = 0/5/6/7）
+#define OP_V    0x57
+    #define OPIVV   0x0
+    #define OPFVV   0x1
+    #define OPMVV   0x2
+    #define OPIVI   0x3
+    #define OPIVX   0x4
+    #define OPFVF   0x5
+    #define OPMVX   0x6
+    #define OPCFG   0x7             /** vsetvli / vsetivli / vsetvl */
+
+#define AMO     0x2f
+    #define AMO_W   0x2             /** funct3：32 位 */
+    #define AMO_D   0x3             /** funct3：64 位 */
+        // funct5 = funct7 >> 2（funct7[1:0] = aq, rl）
+        #define LR          0x02
+        #define SC          0x03
+        #define AMOSWAP     0x01
+        #define AMOADD      0x00
+        #define AMOXOR      0x04
+        #define AMOAND      0x0c
+        #define AMOOR       0x08
+        #define AMOMIN      0x10
+        #define AMOMAX      0x14
+        #define AMOMINU     0x18
+        #define AMOMAXU     0x1c
 
 
 
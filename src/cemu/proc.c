@@ -0,0 +1,942 @@
+/**
+ * @file proc.c
+ * @author lancer (lancerstadium@163.com)
+ * @brief 用户态进程（Linux ABI）实现
+ * @version 0.1
+ * @date 2024-02-05
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+// ==================================================================== //
+//                              Include
+// ==================================================================== //
+
+#define _GNU_SOURCE
+#include "proc.h"
+#include "cpu.h"
+#include "fpu.h"
+#include "mmu.h"
+#include "log.h"
+#include "macro.h"
+#include <elf.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sched.h>
+#include <sys/random.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/utsname.h>
+
+
+// ==================================================================== //
+//                              Defines
+// ==================================================================== //
+
+// riscv64 系统调用号（asm-generic）
+#define SYS_IOCTL           29
+#define SYS_OPENAT          56
+#define SYS_CLOSE           57
+#define SYS_LSEEK           62
+#define SYS_READ            63
+#define SYS_WRITE           64
+#define SYS_WRITEV          66
+#define SYS_NEWFSTATAT      79
+#define SYS_FSTAT           80
+#define SYS_EXIT            93
+#define SYS_EXIT_GROUP      94
+#define SYS_SET_TID_ADDRESS 96
+#define SYS_FUTEX           98
+#define SYS_SET_ROBUST_LIST 99
+#define SYS_CLOCK_GETTIME   113
+#define SYS_SCHED_YIELD     124
+#define SYS_RT_SIGACTION    134
+#define SYS_RT_SIGPROCMASK  135
+#define SYS_UNAME           160
+#define SYS_GETPID          172
+#define SYS_GETUID          174
+#define SYS_GETEUID         175
+#define SYS_GETGID          176
+#define SYS_GETEGID         177
+#define SYS_GETTID          178
+#define SYS_BRK             214
+#define SYS_MUNMAP          215
+#define SYS_MMAP            222
+#define SYS_CLONE           220
+#define SYS_MPROTECT        226
+#define SYS_PRLIMIT64       261
+#define SYS_GETRANDOM       278
+#define SYS_CLONE3          435
+
+// 来宾（asm-generic）标志位，与主机不一定相同，逐位换算
+#define G_O_CREAT           00000100
+#define G_O_EXCL            00000200
+#define G_O_NOCTTY          00000400
+#define G_O_TRUNC           00001000
+#define G_O_APPEND          00002000
+#define G_O_NONBLOCK        00004000
+#define G_O_DIRECTORY       00200000
+#define G_O_NOFOLLOW        00400000
+#define G_O_CLOEXEC         02000000
+#define G_AT_FDCWD          -100
+#define G_AT_SYMLINK_NOFOLLOW 0x100
+#define G_AT_EMPTY_PATH     0x1000
+#define G_MAP_FIXED         0x10
+#define G_MAP_ANONYMOUS     0x20
+#define G_IOV_MAX           64          /** 一次 writev 换算的 iovec 个数上限 */
+#define G_UIO_MAXIOV        1024        /** Linux 的 iovec 个数上限，超过返回 -EINVAL */
+
+#define PROC_CLONE_THREAD   (CLONE_VM | CLONE_THREAD)  /** 线程：clone 标志位与主机相同 */
+#define PROC_PLATFORM       "riscv64"
+#define PROC_HWCAP_EXT(c)   (1UL << ((c) - 'A'))
+/** 不含 V：rvv.c 只实现了部分向量指令，运行库按 HWCAP 选择向量化的 mem/str 函数会触发非法指令 */
+#define PROC_HWCAP          (PROC_HWCAP_EXT('I') | PROC_HWCAP_EXT('M') | PROC_HWCAP_EXT('A') \
+                           | PROC_HWCAP_EXT('F') | PROC_HWCAP_EXT('D') | PROC_HWCAP_EXT('C'))
+#define PROC_NAUXV          18          /** auxv 项数（含 AT_NULL） */
+
+
+// ==================================================================== //
+//                          Private Func: PROC
+// ==================================================================== //
+
+/**
+ * @brief riscv64 内核的`struct stat`（asm-generic 布局）
+ */
+typedef struct PROC_STAT_t {
+    u64 st_dev;
+    u64 st_ino;
+    u32 st_mode;
+    u32 st_nlink;
+    u32 st_uid;
+    u32 st_gid;
+    u64 st_rdev;
+    u64 pad1;
+    int64_t st_size;
+    int32_t st_blksize;
+    int32_t pad2;
+    int64_t st_blocks;
+    int64_t st_atime_sec;
+    u64 st_atime_nsec;
+    int64_t st_mtime_sec;
+    u64 st_mtime_nsec;
+    int64_t st_ctime_sec;
+    u64 st_ctime_nsec;
+    u32 unused[2];
+} PROC_STAT;
+
+static inline u64 proc_page_up(u64 x) {
+    return (x + PROC_PAGE_SIZE - 1) & ~(u64)(PROC_PAGE_SIZE - 1);
+}
+
+/** 主机调用结果 -> 来宾返回值：失败为负的 errno */
+static inline u64 proc_ret(long ret) {
+    return ret < 0 ? (u64)-errno : (u64)ret;
+}
+
+/** 来宾描述符 -> 主机描述符，无效时返回 -1 */
+static int proc_fd(PROC* proc, u64 gfd) {
+    if (gfd >= PROC_MAX_FD)
+        return -1;
+    pthread_mutex_lock(&proc->lock);
+    int fd = proc->fds[gfd];
+    pthread_mutex_unlock(&proc->lock);
+    return fd;
+}
+
+/** 以 NUL 结尾的来宾字符串 -> 主机指针，越过 DRAM 末尾时返回`NULL` */
+static char* proc_str(CPU* cpu, u64 addr) {
+    char* p = proc_ptr(cpu, addr, 1);
+    if (!p)
+        return NULL;
+    u64 room = (u64)(cpu->bus->dram.mem_addr + DRAM_SIZE) - (u64)p;
+    return memchr(p, 0, room) ? p : NULL;
+}
+
+static int proc_open_flags(u64 g) {
+    static const int map[][2] = {
+        { G_O_CREAT, O_CREAT }, { G_O_EXCL, O_EXCL }, { G_O_NOCTTY, O_NOCTTY },
+        { G_O_TRUNC, O_TRUNC }, { G_O_APPEND, O_APPEND }, { G_O_NONBLOCK, O_NONBLOCK },
+        { G_O_DIRECTORY, O_DIRECTORY }, { G_O_NOFOLLOW, O_NOFOLLOW },
+    };
+    int flags = (g & O_ACCMODE) | O_CLOEXEC;
+    for (u64 i = 0; i < sizeof(map) / sizeof(map[0]); i++)
+        if (g & map[i][0])
+            flags |= map[i][1];
+    return flags;
+}
+
+/** 目录描述符：AT_FDCWD 原样传递，其它换算为主机描述符 */
+static int proc_dirfd(PROC* proc, u64 gfd) {
+    return (int)gfd == G_AT_FDCWD ? AT_FDCWD : proc_fd(proc, gfd);
+}
+
+static void proc_fill_stat(PROC_STAT* g, struct stat* st) {
+    memset(g, 0, sizeof(PROC_STAT));
+    g->st_dev = st->st_dev;
+    g->st_ino = st->st_ino;
+    g->st_mode = st->st_mode;
+    g->st_nlink = st->st_nlink;
+    g->st_uid = st->st_uid;
+    g->st_gid = st->st_gid;
+    g->st_rdev = st->st_rdev;
+    g->st_size = st->st_size;
+    g->st_blksize = st->st_blksize;
+    g->st_blocks = st->st_blocks;
+    g->st_atime_sec = st->st_atim.tv_sec;
+    g->st_atime_nsec = st->st_atim.tv_nsec;
+    g->st_mtime_sec = st->st_mtim.tv_sec;
+    g->st_mtime_nsec = st->st_mtim.tv_nsec;
+    g->st_ctime_sec = st->st_ctim.tv_sec;
+    g->st_ctime_nsec = st->st_ctim.tv_nsec;
+}
+
+static u64 proc_openat(CPU* cpu, u64 dirfd, u64 path, u64 flags, u64 mode) {
+    PROC* proc = cpu->proc;
+    char* p = proc_str(cpu, path);
+    int dfd = proc_dirfd(proc, dirfd);
+    if (!p)
+        return -EFAULT;
+    if (dfd == -1)
+        return -EBADF;
+    int fd = openat(dfd, p, proc_open_flags(flags), (mode_t)mode);
+    if (fd < 0)
+        return -errno;
+    pthread_mutex_lock(&proc->lock);
+    int gfd = 0;
+    while (gfd < PROC_MAX_FD && proc->fds[gfd] >= 0)
+        gfd++;
+    if (gfd < PROC_MAX_FD)
+        proc->fds[gfd] = fd;
+    pthread_mutex_unlock(&proc->lock);
+    if (gfd == PROC_MAX_FD) {
+        close(fd);
+        return -EMFILE;
+    }
+    return gfd;
+}
+
+static u64 proc_close(PROC* proc, u64 gfd) {
+    if (gfd >= PROC_MAX_FD)
+        return -EBADF;
+    pthread_mutex_lock(&proc->lock);
+    int fd = proc->fds[gfd];
+    proc->fds[gfd] = -1;
+    pthread_mutex_unlock(&proc->lock);
+    if (fd < 0)
+        return -EBADF;
+    // 标准输入输出属于模拟器本身
+    if (fd > STDERR_FILENO && close(fd) < 0)
+        return -errno;
+    return 0;
+}
+
+static u64 proc_stat(CPU* cpu, int fd, char* path, int flags, u64 buf) {
+    PROC_STAT* g = proc_ptr(cpu, buf, sizeof(PROC_STAT));
+    if (!g)
+        return -EFAULT;
+    struct stat st;
+    int ret = path ? fstatat(fd, path, &st, flags) : fstat(fd, &st);
+    if (ret < 0)
+        return -errno;
+    proc_fill_stat(g, &st);
+    return 0;
+}
+
+static u64 proc_writev(CPU* cpu, int fd, u64 iov, u64 cnt) {
+    // 先按 UIO_MAXIOV 拒绝、再截断，之后才换算长度，cnt * 16 不会溢出
+    if (cnt > G_UIO_MAXIOV)
+        return -EINVAL;
+    cnt = MIN(cnt, G_IOV_MAX);
+    u64* giov = proc_ptr(cpu, iov, cnt * 16);
+    if (!giov)
+        return -EFAULT;
+    struct iovec hiov[G_IOV_MAX];
+    for (u64 i = 0; i < cnt; i++) {
+        hiov[i].iov_len = giov[2 * i + 1];
+        hiov[i].iov_base = proc_ptr(cpu, giov[2 * i], hiov[i].iov_len);
+        if (!hiov[i].iov_base && hiov[i].iov_len)
+            return -EFAULT;
+    }
+    return proc_ret(writev(fd, hiov, cnt));
+}
+
+/** brk：在 [brk_start, mmap_cur) 内移动堆顶，新增部分清零；失败时返回原堆顶 */
+static u64 proc_brk(PROC* proc, CPU* cpu, u64 addr) {
+    pthread_mutex_lock(&proc->lock);
+    if (addr >= proc->brk_start && addr <= proc->mmap_cur) {
+        if (addr > proc->brk)
+            memset(proc_ptr(cpu, proc->brk, addr - proc->brk), 0, addr - proc->brk);
+        proc->brk = addr;
+    }
+    u64 brk = proc->brk;
+    pthread_mutex_unlock(&proc->lock);
+    return brk;
+}
+
+/**
+ * @brief mmap：匿名或文件私有映射，在 mmap 区向下分配并清零（文件映射读入内容）；
+ * `MAP_FIXED`只接受已在地址空间内的区间
+ */
+static u64 proc_mmap(PROC* proc, CPU* cpu, u64 addr, u64 len, u64 flags, u64 gfd, u64 off) {
+    len = proc_page_up(len);
+    int fd = (flags & G_MAP_ANONYMOUS) ? -1 : proc_fd(proc, gfd);
+    if (len == 0)
+        return -EINVAL;
+    if (!(flags & G_MAP_ANONYMOUS) && fd < 0)
+        return -EBADF;
+    pthread_mutex_lock(&proc->lock);
+    if (!(flags & G_MAP_FIXED)) {
+        addr = proc->mmap_cur - len;
+        if (len > proc->mmap_cur || addr < proc->brk) {
+            pthread_mutex_unlock(&proc->lock);
+            return -ENOMEM;
+        }
+        proc->mmap_cur = addr;
+    }
+    pthread_mutex_unlock(&proc->lock);
+    u8* p = proc_ptr(cpu, addr, len);
+    if (!p)
+        return -ENOMEM;
+    memset(p, 0, len);
+    if (fd >= 0 && pread(fd, p, len, off) < 0)
+        return -errno;
+    return addr;
+}
+
+/** munmap：只回收 mmap 区最下面的一段，其它区间保留 */
+static u64 proc_munmap(PROC* proc, u64 addr, u64 len) {
+    pthread_mutex_lock(&proc->lock);
+    if (addr == proc->mmap_cur)
+        proc->mmap_cur = MIN(proc->mmap_top, addr + proc_page_up(len));
+    pthread_mutex_unlock(&proc->lock);
+    return 0;
+}
+
+/** 把一段数据压入栈顶的字符串区，返回其来宾地址 */
+static u64 proc_push(CPU* cpu, u64* sp, const void* data, u64 len) {
+    *sp -= len;
+    memcpy(proc_ptr(cpu, *sp, len), data, len);
+    return *sp;
+}
+
+static int proc_count(char** v) {
+    int n = 0;
+    while (v && v[n])
+        n++;
+    return n;
+}
+
+/**
+ * @brief 构造初始栈：先压入字符串与随机数，再自下而上写 argc、argv、envp 与 auxv，`sp`按 16 字节对齐
+ */
+static int proc_stack(PROC* proc, CPU* cpu, char* filename, u64 entry, u64 phdr, u64 phnum) {
+    int nargv = proc_count(proc->argv), nenv = proc_count(proc->envp);
+    int argc = 1 + nargv;
+    u64 words = 1 + (argc + 1) + (nenv + 1) + 2 * PROC_NAUXV;
+    u64 need = words * 8 + strlen(filename) + 1 + sizeof(PROC_PLATFORM) + 16 + 16;
+    for (int i = 0; i < nargv; i++)
+        need += strlen(proc->argv[i]) + 1;
+    for (int i = 0; i < nenv; i++)
+        need += strlen(proc->envp[i]) + 1;
+    if (need > PROC_MAX_ARGS) {
+        log_error("Arguments and environment need %lu bytes, exceed %d", need, PROC_MAX_ARGS);
+        return -1;
+    }
+
+    u64 sp = PROC_STACK_TOP;
+    u64* str = malloc(sizeof(u64) * (argc + nenv));
+    if (!str) {
+        log_error("Process stack alloc failed");
+        return -1;
+    }
+    str[0] = proc_push(cpu, &sp, filename, strlen(filename) + 1);
+    for (int i = 0; i < nargv; i++)
+        str[1 + i] = proc_push(cpu, &sp, proc->argv[i], strlen(proc->argv[i]) + 1);
+    for (int i = 0; i < nenv; i++)
+        str[argc + i] = proc_push(cpu, &sp, proc->envp[i], strlen(proc->envp[i]) + 1);
+    u64 platform = proc_push(cpu, &sp, PROC_PLATFORM, sizeof(PROC_PLATFORM));
+    u8 rnd[16] = { 0 };
+    if (getrandom(rnd, sizeof(rnd), 0) != sizeof(rnd))
+        log_warn("AT_RANDOM: host getrandom failed");
+    u64 random = proc_push(cpu, &sp, rnd, sizeof(rnd));
+
+    const u64 auxv[PROC_NAUXV][2] = {
+        { AT_PHDR, phdr },          { AT_PHENT, sizeof(Elf64_Phdr) }, { AT_PHNUM, phnum },
+        { AT_PAGESZ, PROC_PAGE_SIZE }, { AT_BASE, 0 },            { AT_FLAGS, 0 },
+        { AT_ENTRY, entry },        { AT_UID, getuid() },         { AT_EUID, geteuid() },
+        { AT_GID, getgid() },       { AT_EGID, getegid() },       { AT_SECURE, 0 },
+        { AT_HWCAP, PROC_HWCAP },   { AT_CLKTCK, sysconf(_SC_CLK_TCK) },
+        { AT_PLATFORM, platform },  { AT_RANDOM, random },        { AT_EXECFN, str[0] },
+        { AT_NULL, 0 },
+    };
+    sp = (sp - words * 8) & ~(u64)15;
+    u64* f = proc_ptr(cpu, sp, words * 8);
+    *f++ = argc;
+    for (int i = 0; i < argc; i++)
+        *f++ = str[i];
+    *f++ = 0;
+    for (int i = 0; i < nenv; i++)
+        *f++ = str[argc + i];
+    *f++ = 0;
+    memcpy(f, auxv, sizeof(auxv));
+    free(str);
+    cpu->regs[2] = sp;
+    return 0;
+}
+
+/** 线程号：主机进程号加线程槽位，主线程即进程号 */
+static inline u64 proc_tid(CPU* cpu) {
+    return getpid() + cpu->hartid;
+}
+
+static inline int proc_halted(PROC* proc) {
+    return __atomic_load_n(&proc->bus->halt, __ATOMIC_RELAXED);
+}
+
+/** 确定性模式：等待`uaddr`且位掩码相交的线程中最先开始等待的槽位，没有则为 -1 */
+static int proc_first_waiter(PROC* proc, u64 uaddr, u32 mask) {
+    int k = -1;
+    for (int i = 0; i < PROC_MAX_THREAD; i++) {
+        if (!proc->waiter[i] || proc->wait_addr[i] != uaddr || !(proc->wait_mask[i] & mask))
+            continue;
+        if (k < 0 || proc->wait_seq[i] < proc->wait_seq[k])
+            k = i;
+    }
+    return k;
+}
+
+/** 确定性模式：按开始等待的先后唤醒至多`n`个等待者，返回唤醒数 */
+static u64 proc_wake(PROC* proc, u64 uaddr, u32 n, u32 mask) {
+    u64 woken = 0;
+    int k;
+    while (woken < n && (k = proc_first_waiter(proc, uaddr, mask)) >= 0) {
+        proc->waiter[k] = NULL;
+        woken++;
+    }
+    return woken;
+}
+
+/** 线程结束：出错时停止机器，按 CLONE_CHILD_CLEARTID 清零并唤醒等待者，槽位可回收 */
+static void proc_thread_end(CPU* cpu) {
+    PROC* proc = cpu->proc;
+    if (cpu->pc != 0 && !proc_halted(proc)) {
+        // 线程出错：与信号终止整个进程一样停止机器
+        log_error("Thread %lu stopped at %#lx", proc_tid(cpu), cpu->pc - cpu->ilen);
+        bus_halt(proc->bus);
+    }
+    u64 addr = proc->clear_tid[cpu->hartid];
+    u32* ctid = addr ? proc_ptr(cpu, addr, 4) : NULL;
+    if (ctid) {
+        __atomic_store_n(ctid, 0, __ATOMIC_SEQ_CST);
+        if (proc->det)
+            proc_wake(proc, addr, 1, FUTEX_BITSET_MATCH_ANY);
+        else
+            syscall(SYS_futex, ctid, FUTEX_WAKE, 1, NULL, NULL, 0);
+    }
+    pthread_mutex_lock(&proc->lock);
+    proc->done[cpu->hartid] = 1;
+    pthread_mutex_unlock(&proc->lock);
+}
+
+/** 线程的主机线程：执行到线程退出或机器停止 */
+static void* proc_thread(void* arg) {
+    CPU* cpu = arg;
+    cpu_step(cpu, -1);
+    proc_thread_end(cpu);
+    return NULL;
+}
+
+/**
+ * @brief 创建线程：复制调用者的处理器状态到空闲槽位（回收已结束的线程），子线程`a0`为 0，
+ * 从`clone`的下一条指令开始执行：自由模式下在新的主机线程上，确定性模式下由`proc_run_quantum()`轮转
+ */
+static u64 proc_clone(CPU* cpu, u64 flags, u64 sp, u64 ptid, u64 tls, u64 ctid) {
+    PROC* proc = cpu->proc;
+    if ((flags & PROC_CLONE_THREAD) != PROC_CLONE_THREAD) {
+        log_warn("clone without CLONE_VM | CLONE_THREAD is not supported");
+        return -ENOSYS;
+    }
+    u32* pp = (flags & CLONE_PARENT_SETTID) ? proc_ptr(cpu, ptid, 4) : NULL;
+    u32* cp = (flags & CLONE_CHILD_SETTID) ? proc_ptr(cpu, ctid, 4) : NULL;
+    if (((flags & CLONE_PARENT_SETTID) && !pp) || ((flags & CLONE_CHILD_SETTID) && !cp))
+        return -EFAULT;
+    pthread_mutex_lock(&proc->lock);
+    int slot = 1;
+    while (slot < PROC_MAX_THREAD && proc->threads[slot] && !proc->done[slot])
+        slot++;
+    // 机器停止后不再创建线程，`proc_join()`因此能回收全部线程
+    if (slot == PROC_MAX_THREAD || proc_halted(proc)) {
+        pthread_mutex_unlock(&proc->lock);
+        return -EAGAIN;
+    }
+    if (proc->threads[slot]) {
+        if (!proc->det)
+            pthread_join(proc->host[slot], NULL);
+        free(proc->threads[slot]);
+        proc->threads[slot] = NULL;
+    }
+    CPU* t = aligned_alloc(32, sizeof(CPU));
+    if (!t) {
+        pthread_mutex_unlock(&proc->lock);
+        return -ENOMEM;
+    }
+    memcpy(t, cpu, sizeof(CPU));
+    t->hartid = slot;
+    t->csr[CS_MHARTID] = slot;
+    t->regs[10] = 0;
+    t->instret = 0;
+    t->idle = 0;
+    t->fpu_rm = -1;
+    t->resv_addr = ~(u64)0;
+    if (sp)
+        t->regs[2] = sp;
+    if (flags & CLONE_SETTLS)
+        t->regs[4] = tls;
+    u64 tid = proc_tid(t);
+    if (pp)
+        __atomic_store_n(pp, (u32)tid, __ATOMIC_SEQ_CST);
+    if (cp)
+        __atomic_store_n(cp, (u32)tid, __ATOMIC_SEQ_CST);
+    proc->clear_tid[slot] = (flags & CLONE_CHILD_CLEARTID) ? ctid : 0;
+    proc->done[slot] = 0;
+    proc->waiter[slot] = NULL;
+    proc->threads[slot] = t;
+    if (!proc->det && pthread_create(&proc->host[slot], NULL, proc_thread, t) != 0) {
+        proc->threads[slot] = NULL;
+        pthread_mutex_unlock(&proc->lock);
+        free(t);
+        return -EAGAIN;
+    }
+    pthread_mutex_unlock(&proc->lock);
+    return tid;
+}
+
+/** clone3：参数在来宾内存中的`struct clone_args`，栈由起点与大小给出 */
+static u64 proc_clone3(CPU* cpu, u64 args, u64 size) {
+    // flags, pidfd, child_tid, parent_tid, exit_signal, stack, stack_size, tls
+    u64* ca = proc_ptr(cpu, args, 8 * 8);
+    if (size < 8 * 8)
+        return -EINVAL;
+    if (!ca)
+        return -EFAULT;
+    u64 sp = ca[5] ? ca[5] + ca[6] : 0;
+    return proc_clone(cpu, ca[0], sp, ca[3], ca[7], ca[2]);
+}
+
+/** FUTEX_WAKE_OP：按`code`编码的运算改写`*p`，返回旧值与参数的比较结果，-1 表示编码无效 */
+static int proc_futex_op(u32* p, u32 code) {
+    int op = (code >> 28) & 7, cmp = (code >> 24) & 15;
+    int32_t oparg = (int32_t)(code << 8) >> 20, cmparg = (int32_t)(code << 20) >> 20;
+    if (code & ((u32)FUTEX_OP_OPARG_SHIFT << 28))
+        oparg = 1u << (oparg & 31);
+    if (op > FUTEX_OP_XOR || cmp > FUTEX_OP_CMP_GE)
+        return -1;
+    u32 old = __atomic_load_n(p, __ATOMIC_SEQ_CST);
+    u32 val = op == FUTEX_OP_SET  ? (u32)oparg
+            : op == FUTEX_OP_ADD  ? old + oparg
+            : op == FUTEX_OP_OR   ? old | oparg
+            : op == FUTEX_OP_ANDN ? old & ~oparg
+            :                       old ^ oparg;
+    __atomic_store_n(p, val, __ATOMIC_SEQ_CST);
+    switch (cmp) {
+        case FUTEX_OP_CMP_EQ: return (int32_t)old == cmparg;
+        case FUTEX_OP_CMP_NE: return (int32_t)old != cmparg;
+        case FUTEX_OP_CMP_LT: return (int32_t)old <  cmparg;
+        case FUTEX_OP_CMP_LE: return (int32_t)old <= cmparg;
+        case FUTEX_OP_CMP_GT: return (int32_t)old >  cmparg;
+        default:              return (int32_t)old >= cmparg;
+    }
+}
+
+/**
+ * @brief 确定性模式的 futex：不调用主机，等待者挂起在进程的等待表上，
+ * 让出时间片直到被唤醒（返回 0）或由`proc_expire()`超时
+ */
+static u64 proc_futex_det(CPU* cpu, int cmd, u64 uaddr, u32* p, u64 val, u64 arg4, u64 uaddr2, u64 val3) {
+    PROC* proc = cpu->proc;
+    int bitset = cmd == FUTEX_WAIT_BITSET || cmd == FUTEX_WAKE_BITSET;
+    u32 mask = bitset ? (u32)val3 : FUTEX_BITSET_MATCH_ANY;
+    u32* p2 = NULL;
+    if (!mask)
+        return -EINVAL;
+    if (cmd == FUTEX_REQUEUE || cmd == FUTEX_CMP_REQUEUE || cmd == FUTEX_WAKE_OP) {
+        p2 = proc_ptr(cpu, uaddr2, 4);
+        if (!p2)
+            return -EFAULT;
+    }
+    switch (cmd) {
+        case FUTEX_WAIT:
+        case FUTEX_WAIT_BITSET: {
+            int h = cpu->hartid;
+            if (arg4 && !proc_ptr(cpu, arg4, sizeof(struct timespec)))
+                return -EFAULT;
+            if (__atomic_load_n(p, __ATOMIC_SEQ_CST) != (u32)val)
+                return -EAGAIN;
+            proc->waiter[h] = cpu;
+            proc->wait_addr[h] = uaddr;
+            proc->wait_mask[h] = mask;
+            proc->wait_seq[h] = proc->wait_next++;
+            proc->wait_timed[h] = arg4 != 0;
+            cpu->idle = 1;
+            return 0;
+        }
+        case FUTEX_WAKE:
+        case FUTEX_WAKE_BITSET:
+            return proc_wake(proc, uaddr, val, mask);
+        case FUTEX_CMP_REQUEUE:
+            if (__atomic_load_n(p, __ATOMIC_SEQ_CST) != (u32)val3)
+                return -EAGAIN;
+            // fall through
+        case FUTEX_REQUEUE: {
+            u64 n = proc_wake(proc, uaddr, val, mask);
+            int k;
+            for (u64 moved = 0; moved < (u32)arg4 && (k = proc_first_waiter(proc, uaddr, mask)) >= 0; moved++) {
+                proc->wait_addr[k] = uaddr2;
+                n++;
+            }
+            return n;
+        }
+        case FUTEX_WAKE_OP: {
+            int r = proc_futex_op(p2, val3);
+            if (r < 0)
+                return -ENOSYS;
+            u64 n = proc_wake(proc, uaddr, val, mask);
+            return r ? n + proc_wake(proc, uaddr2, arg4, mask) : n;
+        }
+        default:
+            return -ENOSYS;
+    }
+}
+
+/**
+ * @brief futex：在换算后的主机地址上调用主机 futex；无超时的等待分段进行，
+ * 机器停止后返回`EINTR`，线程在下一个轮询间隔退出
+ */
+static u64 proc_futex(CPU* cpu, u64 uaddr, u64 op, u64 val, u64 arg4, u64 uaddr2, u64 val3) {
+    int cmd = op & FUTEX_CMD_MASK;
+    u32* p = proc_ptr(cpu, uaddr, 4);
+    if (!p)
+        return -EFAULT;
+    if (cpu->proc->det)
+        return proc_futex_det(cpu, cmd, uaddr, p, val, arg4, uaddr2, val3);
+    switch (cmd) {
+        case FUTEX_WAIT:
+        case FUTEX_WAIT_BITSET: {
+            if (arg4) {
+                struct timespec* ts = proc_ptr(cpu, arg4, sizeof(struct timespec));
+                return !ts ? (u64)-EFAULT : proc_ret(syscall(SYS_futex, p, op, val, ts, NULL, val3));
+            }
+            while (!proc_halted(cpu->proc)) {
+                // FUTEX_WAIT 的超时为相对时间，FUTEX_WAIT_BITSET 为绝对时间
+                struct timespec ts = { 0, 0 };
+                if (cmd == FUTEX_WAIT_BITSET)
+                    clock_gettime((op & FUTEX_CLOCK_REALTIME) ? CLOCK_REALTIME : CLOCK_MONOTONIC, &ts);
+                ts.tv_nsec += PROC_FUTEX_SLICE_MS * 1000000L;
+                ts.tv_sec += ts.tv_nsec / 1000000000L;
+                ts.tv_nsec %= 1000000000L;
+                long r = syscall(SYS_futex, p, op, val, &ts, NULL, val3);
+                if (r >= 0 || errno != ETIMEDOUT)
+                    return proc_ret(r);
+            }
+            return -EINTR;
+        }
+        case FUTEX_WAKE:
+        case FUTEX_WAKE_BITSET:
+            return proc_ret(syscall(SYS_futex, p, op, val, NULL, NULL, val3));
+        case FUTEX_REQUEUE:
+        case FUTEX_CMP_REQUEUE:
+        case FUTEX_WAKE_OP: {
+            // 第 4 个参数为个数 val2，不是指针
+            u32* p2 = proc_ptr(cpu, uaddr2, 4);
+            return !p2 ? (u64)-EFAULT : proc_ret(syscall(SYS_futex, p, op, val, (void*)arg4, p2, val3));
+        }
+        default:
+            // PI futex 以线程号标记持有者，主机内核不认识来宾线程号
+            return -ENOSYS;
+    }
+}
+
+/** prlimit64：只读；栈上限报告为`PROC_STACK_SIZE`，描述符上限为`PROC_MAX_FD` */
+static u64 proc_prlimit(CPU* cpu, u64 resource, u64 old) {
+    u64* r = old ? proc_ptr(cpu, old, 16) : NULL;
+    if (old && !r)
+        return -EFAULT;
+    if (!r)
+        return 0;
+    struct rlimit host;
+    if (resource == RLIMIT_STACK) {
+        r[0] = r[1] = PROC_STACK_SIZE;
+    } else if (resource == RLIMIT_NOFILE) {
+        r[0] = r[1] = PROC_MAX_FD;
+    } else if (getrlimit(resource, &host) == 0) {
+        r[0] = host.rlim_cur;
+        r[1] = host.rlim_max;
+    } else {
+        return -errno;
+    }
+    return 0;
+}
+
+/** 停止机器并回收所有线程 */
+static void proc_reap(PROC* proc) {
+    int any = 0;
+    pthread_mutex_lock(&proc->lock);
+    for (int i = 1; i < PROC_MAX_THREAD; i++)
+        any |= proc->threads[i] != NULL;
+    if (any)
+        bus_halt(proc->bus);
+    pthread_mutex_unlock(&proc->lock);
+    for (int i = 1; i < PROC_MAX_THREAD; i++) {
+        if (!proc->threads[i])
+            continue;
+        if (!proc->det)
+            pthread_join(proc->host[i], NULL);
+        free(proc->threads[i]);
+        proc->threads[i] = NULL;
+        proc->done[i] = 0;
+    }
+    memset(proc->waiter, 0, sizeof(proc->waiter));
+}
+
+static u64 proc_uname(CPU* cpu, u64 buf) {
+    struct utsname* u = proc_ptr(cpu, buf, sizeof(struct utsname));
+    if (!u)
+        return -EFAULT;
+    if (uname(u) < 0)
+        return -errno;
+    strcpy(u->machine, "riscv64");
+    return 0;
+}
+
+
+// ==================================================================== //
+//                            Func API: PROC
+// ==================================================================== //
+
+void proc_init(PROC* proc, BUS* bus) {
+    proc->bus = bus;
+    proc->user = 0;
+    proc->brk_start = proc->brk = 0;
+    proc->mmap_top = proc->mmap_cur = 0;
+    for (int i = 0; i < PROC_MAX_FD; i++)
+        proc->fds[i] = i <= STDERR_FILENO ? i : -1;
+    proc->argv = proc->envp = NULL;
+    memset(proc->threads, 0, sizeof(proc->threads));
+    memset(proc->clear_tid, 0, sizeof(proc->clear_tid));
+    memset(proc->done, 0, sizeof(proc->done));
+    memset(proc->waiter, 0, sizeof(proc->waiter));
+    proc->det = 0;
+    proc->wait_next = 0;
+    proc->exited = 0;
+    proc->code = 0;
+    pthread_mutex_init(&proc->lock, NULL);
+}
+
+void proc_set_args(PROC* proc, char** argv, char** envp) {
+    proc->argv = argv;
+    proc->envp = envp;
+}
+
+int proc_start(PROC* proc, CPU* cpu, char* filename, u64 image_end, u64 entry, u64 phdr, u64 phnum) {
+    proc->user = 1;
+    proc->brk_start = proc->brk = proc_page_up(image_end);
+    proc->mmap_top = proc->mmap_cur = PROC_STACK_TOP - PROC_STACK_SIZE;
+    cpu->seg = DRAM_BASE;
+    cpu->pc = entry;
+    // 参数只在启动时读取
+    int ret = proc_stack(proc, cpu, filename, entry, phdr, phnum);
+    proc->argv = proc->envp = NULL;
+    return ret;
+}
+
+void* proc_ptr(CPU* cpu, u64 addr, u64 len) {
+    u64 gpa = addr + cpu->seg;
+    if (gpa < DRAM_BASE || gpa - DRAM_BASE > DRAM_SIZE || len > DRAM_SIZE - (gpa - DRAM_BASE))
+        return NULL;
+    return (void*)mmu_GPA_to_HVA((u64)cpu->bus->dram.mem_addr, gpa);
+}
+
+int proc_syscall(CPU* cpu) {
+    PROC* proc = cpu->proc;
+    u64* a = &cpu->regs[10];            // a0 ~ a5
+    u64 nr = cpu->regs[17];             // a7
+    u64 ret;
+    int fd;
+    void* p;
+    switch (nr) {
+        case SYS_READ:
+        case SYS_WRITE:
+            fd = proc_fd(proc, a[0]);
+            p = proc_ptr(cpu, a[1], a[2]);
+            if (fd < 0)
+                ret = -EBADF;
+            else if (!p && a[2])
+                ret = -EFAULT;
+            else
+                ret = proc_ret(nr == SYS_READ ? read(fd, p, a[2]) : write(fd, p, a[2]));
+            break;
+        case SYS_WRITEV:
+            fd = proc_fd(proc, a[0]);
+            ret = fd < 0 ? (u64)-EBADF : proc_writev(cpu, fd, a[1], a[2]);
+            break;
+        case SYS_OPENAT:
+            ret = proc_openat(cpu, a[0], a[1], a[2], a[3]);
+            break;
+        case SYS_CLOSE:
+            ret = proc_close(proc, a[0]);
+            break;
+        case SYS_LSEEK:
+            fd = proc_fd(proc, a[0]);
+            ret = fd < 0 ? (u64)-EBADF : proc_ret(lseek(fd, (off_t)a[1], (int)a[2]));
+            break;
+        case SYS_FSTAT:
+            fd = proc_fd(proc, a[0]);
+            ret = fd < 0 ? (u64)-EBADF : proc_stat(cpu, fd, NULL, 0, a[1]);
+            break;
+        case SYS_NEWFSTATAT: {
+            char* path = proc_str(cpu, a[1]);
+            int flags = ((a[3] & G_AT_EMPTY_PATH) ? AT_EMPTY_PATH : 0)
+                      | ((a[3] & G_AT_SYMLINK_NOFOLLOW) ? AT_SYMLINK_NOFOLLOW : 0);
+            fd = proc_dirfd(proc, a[0]);
+            ret = !path ? (u64)-EFAULT : fd == -1 ? (u64)-EBADF : proc_stat(cpu, fd, path, flags, a[2]);
+            break;
+        }
+        case SYS_EXIT:
+        case SYS_EXIT_GROUP:
+            // pc 为 0 时执行循环停止，a0 即退出码；其它线程的 exit_group 停止整台机器，
+            // 退出码由`proc_join()`交给主线程
+            if (nr == SYS_EXIT_GROUP && cpu->hartid != 0) {
+                proc->code = a[0];
+                proc->exited = 1;
+                bus_halt(cpu->bus);
+            }
+            cpu->pc = 0;
+            return 1;
+        case SYS_CLONE:
+            // riscv 的参数顺序：flags, newsp, parent_tid, tls, child_tid
+            ret = proc_clone(cpu, a[0], a[1], a[2], a[3], a[4]);
+            break;
+        case SYS_CLONE3:
+            ret = proc_clone3(cpu, a[0], a[1]);
+            break;
+        case SYS_FUTEX:
+            ret = proc_futex(cpu, a[0], a[1], a[2], a[3], a[4], a[5]);
+            break;
+        case SYS_PRLIMIT64:
+            ret = proc_prlimit(cpu, a[1], a[3]);
+            break;
+        case SYS_SCHED_YIELD:
+            // 确定性模式：结束时间片，轮到下一个线程
+            if (proc->det)
+                cpu->idle = 1;
+            ret = proc->det ? 0 : proc_ret(sched_yield());
+            break;
+        case SYS_CLOCK_GETTIME:
+            p = proc_ptr(cpu, a[1], sizeof(struct timespec));
+            ret = !p ? (u64)-EFAULT : proc_ret(clock_gettime((clockid_t)a[0], p));
+            break;
+        case SYS_UNAME:
+            ret = proc_uname(cpu, a[0]);
+            break;
+        case SYS_BRK:
+            ret = proc_brk(proc, cpu, a[0]);
+            break;
+        case SYS_MMAP:
+            ret = proc_mmap(proc, cpu, a[0], a[1], a[3], a[4], a[5]);
+            break;
+        case SYS_MUNMAP:
+            ret = proc_munmap(proc, a[0], a[1]);
+            break;
+        case SYS_GETRANDOM:
+            p = proc_ptr(cpu, a[0], a[1]);
+            ret = !p ? (u64)-EFAULT : proc_ret(getrandom(p, a[1], a[2] & (GRND_NONBLOCK | GRND_RANDOM)));
+            break;
+        case SYS_SET_TID_ADDRESS:
+            proc->clear_tid[cpu->hartid] = a[0];
+            ret = proc_tid(cpu);
+            break;
+        case SYS_GETTID:
+            ret = proc_tid(cpu);
+            break;
+        case SYS_GETPID:
+            ret = getpid();
+            break;
+        case SYS_GETUID:  ret = getuid();  break;
+        case SYS_GETEUID: ret = geteuid(); break;
+        case SYS_GETGID:  ret = getgid();  break;
+        case SYS_GETEGID: ret = getegid(); break;
+        // 没有信号与内存保护：接受但不生效
+        case SYS_SET_ROBUST_LIST:
+        case SYS_RT_SIGACTION:
+        case SYS_RT_SIGPROCMASK:
+        case SYS_MPROTECT:
+            ret = 0;
+            break;
+        // 终端控制：标准输出按非终端处理（全缓冲）
+        case SYS_IOCTL:
+            ret = -ENOTTY;
+            break;
+        default:
+            log_warn("Unimplemented syscall %lu at %#lx", nr, cpu->pc - cpu->ilen);
+            ret = -ENOSYS;
+    }
+    a[0] = ret;
+    return 1;
+}
+
+int proc_run_quantum(PROC* proc, u64 quantum) {
+    for (int i = 1; i < PROC_MAX_THREAD; i++) {
+        CPU* t = proc->threads[i];
+        if (!t || proc->done[i] || proc->waiter[i])
+            continue;
+        long n = cpu_step_quantum(t, quantum);
+        fpu_yield(t);
+        if (n < 0)
+            proc_thread_end(t);
+        if (proc_halted(proc))
+            return 1;
+    }
+    int run = !proc->waiter[0];
+    for (int i = 1; i < PROC_MAX_THREAD; i++)
+        run |= proc->threads[i] && !proc->done[i] && !proc->waiter[i];
+    return run;
+}
+
+int proc_expire(PROC* proc) {
+    int n = 0;
+    for (int i = 0; i < PROC_MAX_THREAD; i++) {
+        if (!proc->waiter[i] || !proc->wait_timed[i])
+            continue;
+        proc->waiter[i]->regs[10] = -ETIMEDOUT;
+        proc->waiter[i] = NULL;
+        n++;
+    }
+    return n;
+}
+
+void proc_join(PROC* proc, CPU* main) {
+    proc_reap(proc);
+    if (proc->exited) {
+        main->regs[10] = proc->code;
+        main->pc = 0;
+        proc->exited = 0;
+    }
+}
+
+void proc_free(PROC* proc) {
+    proc_reap(proc);
+    for (int i = 0; i < PROC_MAX_FD; i++) {
+        if (proc->fds[i] > STDERR_FILENO)
+            close(proc->fds[i]);
+        proc->fds[i] = -1;
+    }
+    pthread_mutex_destroy(&proc->lock);
+    proc->user = 0;
+}
@@ -0,0 +1,206 @@
+/**
+ * @file proc.h
+ * @author lancer (lancerstadium@163.com)
+ * @brief 用户态进程（Linux ABI）头文件
+ * @version 0.1
+ * @date 2024-02-05
+ * @copyright Copyright (c) 2024
+ *
+ * # 用户态进程介绍
+ * - 不启动内核，直接运行静态链接的 riscv64 Linux 程序：加载器把 PT_LOAD 段放到
+ * 各自的虚拟地址，来宾执行`ECALL`时按`a7`中的系统调用号分派给主机实现，
+ * 返回值（失败时为负的 errno）写回`a0`。
+ *
+ * - 地址空间采用直接映射（见`mmu.h`）：来宾虚拟地址加上处理器的段基址`seg`
+ * 即为来宾物理地址，用户态进程的`seg`为`DRAM_BASE`，虚拟地址 [0, DRAM_SIZE) 对应整段 DRAM：
+ * ```
+ *
+ *   0                                                           DRAM_SIZE
+ *   +--------+-----------+--------> <--------+------------+--------+
+ *   | 未使用 | ELF 段    |  堆(brk)    mmap  |            |   栈   |
+ *   +--------+-----------+--------> <--------+------------+--------+
+ *            ^ 最低段    ^ brk_start         ^ mmap_top   ^ PROC_STACK_TOP - PROC_STACK_SIZE
+ *
+ * ```
+ * 堆从映像末尾向上增长，`mmap`从栈下方向下分配，两者相遇时返回`ENOMEM`。
+ *
+ * - 初始栈与 Linux 内核构造的相同，`sp`指向`argc`，字符串与 AT_RANDOM 的 16 个随机字节在栈顶：
+ * ```
+ *
+ *   sp -> argc | argv[0..argc-1] | NULL | envp[..] | NULL | auxv (type, value)... | AT_NULL | ... 字符串 | PROC_STACK_TOP
+ *
+ * ```
+ * `argv[0]`为 ELF 文件名，其余参数与环境变量由`proc_set_args()`给出；auxv 含
+ * AT_PHDR/AT_PHENT/AT_PHNUM/AT_PAGESZ/AT_ENTRY/AT_RANDOM 等，运行库据此找到程序头（TLS 段）
+ * 与栈保护的随机数，不必走回退路径。
+ *
+ * - 系统调用的缓冲区不拷贝：来宾指针经`proc_ptr()`检查范围后，
+ * 由`mmu_GPA_to_HVA()`换算成主机指针直接交给主机系统调用。
+ *
+ * - 来宾描述符经描述符表映射到主机描述符，0、1、2 对应主机的标准输入输出，
+ * 来宾关闭它们只解除映射，不关闭主机描述符。
+ *
+ * - 线程：`clone`/`clone3`带`CLONE_VM | CLONE_THREAD`时复制调用者的处理器状态，
+ * 作为新的处理器（编号即线程槽位）在新的主机线程上运行，与其它线程共享来宾内存，
+ * 线程号为主机进程号加槽位。`futex`在换算后的主机地址上调用主机 futex，
+ * 来宾线程之间的等待与唤醒就是主机线程之间的等待与唤醒：
+ * ```
+ *
+ *   来宾 futex(uaddr) -> proc_ptr(uaddr) -> 主机 futex(HVA)
+ *
+ * ```
+ * 无超时的等待按`PROC_FUTEX_SLICE_MS`分段，每段醒来检查机器是否已停止，
+ * 因此`exit_group`后阻塞的线程也能退出。不支持优先级继承（PI）futex 与不共享内存的`fork`。
+ * 主线程的`exit`按`exit_group`处理。
+ *
+ * - 确定性模式（见`machine.h`）：线程不占主机线程，由`proc_run_quantum()`在主线程之后按槽位轮转，
+ * 每个线程至多一个时间片；futex 不调用主机，等待的线程让出时间片并挂起，
+ * 唤醒按开始等待的先后进行，因此线程之间的交错同样逐位可复现。
+ * 带超时的等待在所有线程都挂起时才超时（返回`ETIMEDOUT`），全部是无超时的等待则视为死锁，机器停止。
+ *
+ * - 已实现：read/write/writev/openat/close/fstat/newfstatat/lseek、brk/mmap/munmap/mprotect、
+ * exit/exit_group、clone/clone3/futex、clock_gettime、uname、prlimit64，以及运行库初始化常用的
+ * set_tid_address/set_robust_list/getpid/gettid/getrandom 等；其它调用返回`ENOSYS`。
+ * `prlimit64`报告的栈上限为`PROC_STACK_SIZE`，运行库据此为新线程分配较小的栈。
+ */
+
+
+#ifndef PROC_H
+#define PROC_H
+
+// ==================================================================== //
+//                             Include
+// ==================================================================== //
+
+#include "bus.h"
+
+// ==================================================================== //
+//                              Defines
+// ==================================================================== //
+
+#define PROC_MAX_FD         64          /** 来宾描述符表大小 */
+#define PROC_STACK_SIZE     0x10000     /** 主线程栈大小 */
+#define PROC_STACK_TOP      DRAM_SIZE   /** 栈顶（来宾虚拟地址） */
+#define PROC_PIE_BASE       0x10000     /** 位置无关程序的加载基址 */
+#define PROC_PAGE_SIZE      4096        /** 来宾页大小 */
+#define PROC_MAX_ARGS       (PROC_STACK_SIZE / 2)   /** 参数与环境变量（含指针）占用栈的上限 */
+#define PROC_MAX_THREAD     BUS_MAX_HART    /** 同时存在的线程数上限（含主线程） */
+#define PROC_FUTEX_SLICE_MS 100         /** 无超时 futex 等待的分段长度 */
+
+
+// ==================================================================== //
+//                             Data: PROC
+// ==================================================================== //
+
+struct CPU_t;
+
+/**
+ * @brief 用户态进程：机器上所有处理器共享一个
+ */
+typedef struct PROC_t {
+    BUS* bus;                       /** 所在总线 */
+    int user;                       /** 1：运行 Linux 用户态程序，`ECALL`为系统调用 */
+    u64 brk_start;                  /** 堆起点（映像末尾） */
+    u64 brk;                        /** 当前堆顶 */
+    u64 mmap_top;                   /** mmap 区上界（栈底） */
+    u64 mmap_cur;                   /** mmap 区当前下界，向下分配 */
+    int fds[PROC_MAX_FD];           /** 来宾描述符 -> 主机描述符，-1 表示空闲 */
+    char** argv;                    /** 程序名之后的参数（以`NULL`结尾），`NULL`表示无 */
+    char** envp;                    /** 环境变量（以`NULL`结尾），`NULL`表示空环境 */
+    struct CPU_t* threads[PROC_MAX_THREAD]; /** 线程的处理器，0 号槽位留给主线程（机器的 0 号处理器） */
+    pthread_t host[PROC_MAX_THREAD];    /** 运行线程的主机线程 */
+    u64 clear_tid[PROC_MAX_THREAD];     /** 线程退出时清零并唤醒的地址（CLONE_CHILD_CLEARTID） */
+    int done[PROC_MAX_THREAD];      /** 线程已结束，可回收 */
+    int det;                        /** 1：确定性模式，线程由`proc_run_quantum()`轮转执行 */
+    struct CPU_t* waiter[PROC_MAX_THREAD];  /** 确定性模式：在 futex 上挂起的线程，`NULL`表示可运行 */
+    u64 wait_addr[PROC_MAX_THREAD]; /** 挂起线程等待的 futex（来宾地址） */
+    u32 wait_mask[PROC_MAX_THREAD]; /** 挂起线程等待的位掩码（FUTEX_WAIT_BITSET） */
+    u64 wait_seq[PROC_MAX_THREAD];  /** 开始等待的序号，先等待的先唤醒 */
+    int wait_timed[PROC_MAX_THREAD];    /** 挂起的等待带超时 */
+    u64 wait_next;                  /** 下一个等待序号 */
+    int exited;                     /** 已调用`exit_group` */
+    u64 code;                       /** `exit_group`的退出码 */
+    pthread_mutex_t lock;           /** 保护描述符表与内存布局 */
+} PROC;
+
+
+// ==================================================================== //
+//                          Declare API: PROC
+// ==================================================================== //
+
+/**
+ * @brief 初始化进程：描述符 0~2 映射到主机标准输入输出，尚未进入用户态
+ * @param proc 进程
+ * @param bus 总线
+ */
+void proc_init(PROC* proc, BUS* bus);
+
+/**
+ * @brief 设置来宾程序的参数与环境变量，在加载 ELF 之前调用；不拷贝，须保持有效到加载完成
+ * @param proc 进程
+ * @param argv 程序名之后的参数，以`NULL`结尾，可为`NULL`
+ * @param envp 环境变量，以`NULL`结尾，可为`NULL`
+ */
+void proc_set_args(PROC* proc, char** argv, char** envp);
+
+/**
+ * @brief 进入用户态：设置堆与 mmap 区，构造初始栈，处理器使用直接映射并从`entry`开始执行
+ * @param proc 进程
+ * @param cpu 主处理器
+ * @param filename ELF 文件名（`argv[0]`与 AT_EXECFN）
+ * @param image_end 映像末尾（来宾虚拟地址）
+ * @param entry 入口（来宾虚拟地址）
+ * @param phdr 程序头地址（来宾虚拟地址），不在映像中时为 0
+ * @param phnum 程序头个数
+ * @return int 0 成功，-1 参数与环境变量超出`PROC_MAX_ARGS`
+ */
+int proc_start(PROC* proc, struct CPU_t* cpu, char* filename, u64 image_end, u64 entry, u64 phdr, u64 phnum);
+
+/**
+ * @brief 来宾虚拟地址区间 -> 主机指针
+ * @param cpu 处理器
+ * @param addr 来宾虚拟地址
+ * @param len 长度
+ * @return void* 主机指针，区间不完全在 DRAM 内时返回`NULL`
+ */
+void* proc_ptr(struct CPU_t* cpu, u64 addr, u64 len);
+
+/**
+ * @brief 执行一次系统调用：调用号在`a7`，参数在`a0`~`a5`，结果写回`a0`
+ * @param cpu 处理器
+ * @return int 1 继续执行，0 出错
+ */
+int proc_syscall(struct CPU_t* cpu);
+
+/**
+ * @brief 确定性模式：按槽位轮转执行来宾线程（不含主线程）各一个时间片，回收结束的线程；
+ * 有线程调用`exit_group`停止机器时立即返回
+ * @param proc 进程
+ * @param quantum 时间片长度（指令数）
+ * @return int 1 仍有可运行的线程（含主线程），0 所有线程都挂起在 futex 上
+ */
+int proc_run_quantum(PROC* proc, u64 quantum);
+
+/**
+ * @brief 确定性模式：所有线程都挂起时，让带超时的等待超时返回`ETIMEDOUT`
+ * @param proc 进程
+ * @return int 超时唤醒的线程数，0 表示剩下的都是无超时的等待（死锁）
+ */
+int proc_expire(PROC* proc);
+
+/**
+ * @brief 停止并回收所有来宾线程：机器停止后调用；
+ * 若其它线程调用过`exit_group`，把退出码写回主线程（`a0`，`pc`置 0）
+ * @param proc 进程
+ * @param main 主线程的处理器
+ */
+void proc_join(PROC* proc, struct CPU_t* main);
+
+/**
+ * @brief 关闭来宾打开的主机描述符
+ * @param proc 进程
+ */
+void proc_free(PROC* proc);
+
+
+#endif // PROC_H
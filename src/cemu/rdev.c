@@ -0,0 +1,346 @@
+/**
+ * @file rdev.c
+ * @author lancer (lancerstadium@163.com)
+ * @brief 进程外设备后端协议实现
+ * @version 0.1
+ * @date 2024-01-23
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+
+// ==================================================================== //
+//                             Include
+// ==================================================================== //
+
+#define _GNU_SOURCE
+#include "rdev.h"
+#include "log.h"
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <sys/un.h>
+
+
+// ==================================================================== //
+//                          Private Func: RDEV
+// ==================================================================== //
+
+/** 关闭收到的描述符 */
+static void rdev_close_fds(int* fds, u32 n) {
+    for (u32 i = 0; i < n; i++)
+        close(fds[i]);
+}
+
+static int rdev_sockaddr(struct sockaddr_un* addr, char* path) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        log_error("rdev: socket path too long");
+        return -1;
+    }
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+/**
+ * @brief 模拟器侧：发送请求并等待回复；回复不应附带描述符，收到的一律关闭
+ * @return int 0 成功，-1 连接断开
+ */
+static int rdev_call(RDEV* rdev, RDEV_MSG* msg, int* fds) {
+    u32 type = msg->type;
+    int rfds[RDEV_MAX_FDS];
+    if (rdev_send(rdev->sock, msg, fds) < 0 || rdev_recv(rdev->sock, msg, rfds) < 0) {
+        log_error("rdev: device disconnected");
+        return -1;
+    }
+    rdev_close_fds(rfds, msg->nfds);
+    if (msg->type != (type | RDEV_REPLY)) {
+        log_error("rdev: device disconnected");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief 根据回复中的中断电平更新中断位图
+ */
+static inline void rdev_sync_irq(RDEV* rdev, u64 level) {
+    if (level)
+        bus_raise_irq(rdev->bus, rdev->irq);
+    else
+        bus_lower_irq(rdev->bus, rdev->irq);
+}
+
+static u64 rdev_load(void* opaque, u64 offset, u64 size) {
+    RDEV* rdev = opaque;
+    if (offset == rdev->doorbell)
+        return 0;
+    RDEV_MSG msg = { .type = RDEV_MMIO_READ, .args = { offset, size } };
+    if (rdev_call(rdev, &msg, NULL) < 0)
+        return 0;
+    rdev_sync_irq(rdev, msg.args[1]);
+    return msg.args[0];
+}
+
+static void rdev_store(void* opaque, u64 offset, u64 size, u64 value) {
+    RDEV* rdev = opaque;
+    if (offset == rdev->doorbell) {
+        // 门铃：只写 eventfd，不等待设备进程
+        u64 one = 1;
+        if (write(rdev->kick_fd, &one, sizeof(one)) < 0)
+            log_warn("rdev: kick failed");
+        return;
+    }
+    RDEV_MSG msg = { .type = RDEV_MMIO_WRITE, .args = { offset, size, value } };
+    if (rdev_call(rdev, &msg, NULL) < 0)
+        return;
+    rdev_sync_irq(rdev, msg.args[0]);
+}
+
+static void rdev_irq_poll(void* opaque) {
+    RDEV* rdev = opaque;
+    u64 cnt;
+    if (read(rdev->irq_fd, &cnt, sizeof(cnt)) == sizeof(cnt))
+        bus_raise_irq(rdev->bus, rdev->irq);
+}
+
+/**
+ * @brief 设备进程侧：处理一条来自模拟器的消息
+ * @return int 0 继续，-1 连接断开
+ */
+static int rdev_backend_handle(RDEV_BACKEND* be) {
+    RDEV_MSG msg;
+    int fds[RDEV_MAX_FDS];
+    if (rdev_recv(be->sock, &msg, fds) < 0)
+        return -1;
+    // 只有 SET_MEM/SET_KICK/SET_IRQ 各带 1 个描述符，其它消息附带的描述符直接关闭
+    u32 want = msg.type == RDEV_SET_MEM || msg.type == RDEV_SET_KICK || msg.type == RDEV_SET_IRQ;
+    if (msg.nfds != want) {
+        rdev_close_fds(fds, msg.nfds);
+        if (want)
+            return -1;
+    }
+    RDEV_MSG reply = { .type = msg.type | RDEV_REPLY };
+    switch (msg.type) {
+        case RDEV_HELLO:
+            reply.args[0] = RDEV_VERSION;
+            reply.args[1] = be->mmio_size;
+            reply.args[2] = be->doorbell;
+            return rdev_send(be->sock, &reply, NULL);
+        case RDEV_SET_MEM: {
+            if (be->nmem >= RDEV_MAX_MEM) {
+                close(fds[0]);
+                return -1;
+            }
+            void* p = mmap(NULL, msg.args[1], PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], msg.args[2]);
+            close(fds[0]);
+            if (p == MAP_FAILED)
+                return -1;
+            be->mem[be->nmem++] = (RDEV_MEM){ .gpa = msg.args[0], .size = msg.args[1], .hva = p };
+            return 0;
+        }
+        case RDEV_SET_KICK:
+            if (be->kick_fd >= 0)
+                close(be->kick_fd);
+            be->kick_fd = fds[0];
+            return 0;
+        case RDEV_SET_IRQ:
+            if (be->irq_fd >= 0)
+                close(be->irq_fd);
+            be->irq_fd = fds[0];
+            return 0;
+        case RDEV_MMIO_READ:
+            reply.args[0] = be->mmio_read ? be->mmio_read(be, msg.args[0], msg.args[1]) : 0;
+            reply.args[1] = be->irq_level;
+            return rdev_send(be->sock, &reply, NULL);
+        case RDEV_MMIO_WRITE:
+            if (be->mmio_write)
+                be->mmio_write(be, msg.args[0], msg.args[1], msg.args[2]);
+            reply.args[0] = be->irq_level;
+            return rdev_send(be->sock, &reply, NULL);
+        case RDEV_RESET:
+            if (be->reset)
+                be->reset(be);
+            be->irq_level = 0;
+            return rdev_send(be->sock, &reply, NULL);
+        default:
+            log_warn("rdev: unknown message %u", msg.type);
+            return 0;
+    }
+}
+
+
+// ==================================================================== //
+//                            Func API: RDEV
+// ==================================================================== //
+
+int rdev_send(int sock, RDEV_MSG* msg, int* fds) {
+    struct iovec iov = { .iov_base = msg, .iov_len = sizeof(RDEV_MSG) };
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * RDEV_MAX_FDS)];
+        struct cmsghdr align;
+    } u;
+    struct msghdr mh = { .msg_iov = &iov, .msg_iovlen = 1 };
+    if (msg->nfds > RDEV_MAX_FDS)
+        return -1;
+    if (msg->nfds) {
+        mh.msg_control = u.buf;
+        mh.msg_controllen = CMSG_SPACE(sizeof(int) * msg->nfds);
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&mh);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * msg->nfds);
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * msg->nfds);
+    }
+    return sendmsg(sock, &mh, MSG_NOSIGNAL) == sizeof(RDEV_MSG) ? 0 : -1;
+}
+
+int rdev_recv(int sock, RDEV_MSG* msg, int* fds) {
+    struct iovec iov = { .iov_base = msg, .iov_len = sizeof(RDEV_MSG) };
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * RDEV_MAX_FDS)];
+        struct cmsghdr align;
+    } u;
+    struct msghdr mh = {
+        .msg_iov = &iov, .msg_iovlen = 1,
+        .msg_control = u.buf, .msg_controllen = sizeof(u.buf),
+    };
+    ssize_t n = recvmsg(sock, &mh, MSG_CMSG_CLOEXEC);
+    if (n < 0)
+        return -1;
+    // 按 cmsg_len 取描述符个数，超出`RDEV_MAX_FDS`的部分关闭，不写入`fds`
+    u32 nfds = 0, extra = 0;
+    for (struct cmsghdr* c = CMSG_FIRSTHDR(&mh); c; c = CMSG_NXTHDR(&mh, c)) {
+        if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS || c->cmsg_len < CMSG_LEN(0))
+            continue;
+        u32 cnt = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (u32 i = 0; i < cnt; i++) {
+            int fd;
+            memcpy(&fd, CMSG_DATA(c) + sizeof(int) * i, sizeof(int));
+            if (nfds < RDEV_MAX_FDS) {
+                fds[nfds++] = fd;
+            } else {
+                close(fd);
+                extra++;
+            }
+        }
+    }
+    if (n != sizeof(RDEV_MSG) || extra || (mh.msg_flags & MSG_CTRUNC)) {
+        rdev_close_fds(fds, nfds);
+        return -1;
+    }
+    msg->nfds = nfds;
+    return 0;
+}
+
+int rdev_connect(RDEV* rdev, BUS* bus, char* path, u64 base, u32 irq) {
+    struct sockaddr_un addr;
+    memset(rdev, 0, sizeof(RDEV));
+    rdev->bus = bus;
+    rdev->irq = irq;
+    rdev->kick_fd = rdev->irq_fd = -1;
+    int dram_fd = dram_export_fd(&bus->dram);
+    if (dram_fd < 0) {
+        log_error("rdev: DRAM is not shareable");
+        return -1;
+    }
+    if (rdev_sockaddr(&addr, path) < 0)
+        return -1;
+    rdev->sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (rdev->sock < 0 || connect(rdev->sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        log_error("rdev: connect %s failed", path);
+        return -1;
+    }
+
+    RDEV_MSG msg = { .type = RDEV_HELLO, .args = { RDEV_VERSION } };
+    if (rdev_call(rdev, &msg, NULL) < 0 || msg.args[0] != RDEV_VERSION) {
+        log_error("rdev: handshake failed");
+        return -1;
+    }
+    rdev->mmio_size = msg.args[1];
+    rdev->doorbell = msg.args[2];
+
+    rdev->kick_fd = eventfd(0, EFD_CLOEXEC);
+    rdev->irq_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (rdev->kick_fd < 0 || rdev->irq_fd < 0)
+        return -1;
+    RDEV_MSG mem = { .type = RDEV_SET_MEM, .nfds = 1, .args = { DRAM_BASE, DRAM_SIZE, 0 } };
+    RDEV_MSG kick = { .type = RDEV_SET_KICK, .nfds = 1 };
+    RDEV_MSG irqm = { .type = RDEV_SET_IRQ, .nfds = 1 };
+    if (rdev_send(rdev->sock, &mem, &dram_fd) < 0
+        || rdev_send(rdev->sock, &kick, &rdev->kick_fd) < 0
+        || rdev_send(rdev->sock, &irqm, &rdev->irq_fd) < 0) {
+        log_error("rdev: setup failed");
+        return -1;
+    }
+    log_info("rdev: connected %s (mmio 0x%lx)", path, rdev->mmio_size);
+    if (bus_add_device(bus, (DEV){
+            .name = "rdev", .base = base, .size = rdev->mmio_size,
+            .opaque = rdev, .load = rdev_load, .store = rdev_store }) < 0)
+        return -1;
+    return bus_add_poll(bus, rdev->irq_fd, rdev_irq_poll, rdev);
+}
+
+int rdev_backend_serve(RDEV_BACKEND* be, char* path) {
+    struct sockaddr_un addr;
+    be->sock = be->kick_fd = be->irq_fd = -1;
+    be->nmem = 0;
+    be->irq_level = 0;
+    if (rdev_sockaddr(&addr, path) < 0)
+        return -1;
+    unlink(path);
+    int lfd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (lfd < 0 || bind(lfd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(lfd, 1) < 0) {
+        log_error("rdev: listen %s failed", path);
+        return -1;
+    }
+    be->sock = accept(lfd, NULL, NULL);
+    close(lfd);
+    if (be->sock < 0)
+        return -1;
+
+    for (;;) {
+        struct pollfd pfds[2] = {
+            { .fd = be->sock, .events = POLLIN },
+            { .fd = be->kick_fd, .events = POLLIN },
+        };
+        if (poll(pfds, 2, -1) < 0)
+            break;
+        if (pfds[1].revents & POLLIN) {
+            u64 cnt;
+            if (read(be->kick_fd, &cnt, sizeof(cnt)) == sizeof(cnt) && be->kick)
+                be->kick(be);
+        }
+        if (pfds[0].revents & (POLLIN | POLLHUP)) {
+            if (rdev_backend_handle(be) < 0)
+                break;
+        }
+    }
+    close(be->sock);
+    for (int i = 0; i < be->nmem; i++)
+        munmap(be->mem[i].hva, be->mem[i].size);
+    if (be->kick_fd >= 0)
+        close(be->kick_fd);
+    if (be->irq_fd >= 0)
+        close(be->irq_fd);
+    return 0;
+}
+
+void* rdev_backend_gpa(RDEV_BACKEND* be, u64 gpa, u64 len) {
+    for (int i = 0; i < be->nmem; i++) {
+        RDEV_MEM* m = &be->mem[i];
+        if (gpa >= m->gpa && gpa - m->gpa <= m->size && len <= m->size - (gpa - m->gpa))
+            return m->hva + (gpa - m->gpa);
+    }
+    return NULL;
+}
+
+void rdev_backend_irq(RDEV_BACKEND* be, int level) {
+    be->irq_level = level;
+    u64 one = 1;
+    if (level && be->irq_fd >= 0 && write(be->irq_fd, &one, sizeof(one)) < 0)
+        log_warn("rdev: irq failed");
+}
@@ -0,0 +1,190 @@
+/**
+ * @file rdev.h
+ * @author lancer (lancerstadium@163.com)
+ * @brief 进程外设备后端协议头文件
+ * @version 0.1
+ * @date 2024-01-23
+ * @copyright Copyright (c) 2024
+ *
+ * # 进程外设备介绍
+ * - 较重的设备模型（如带压缩的存储）可以运行在独立的进程中，
+ * 占用其它核心，且崩溃不会拖垮模拟器。模拟器与设备进程之间通过
+ * 本地 Unix socket（`SOCK_SEQPACKET`）交换定长消息`RDEV_MSG`，
+ * 文件描述符随消息以`SCM_RIGHTS`传递。
+ *
+ * - 来宾内存通过描述符共享：模拟器把 DRAM 的 memfd（见`dram_export_fd()`）发给设备进程，
+ * 设备进程`mmap`后可以直接读写来宾内存（如 virtqueue 与数据缓冲区），零拷贝。
+ *
+ * - 通知走`eventfd`，不占用 socket：
+ * 1. kick：来宾写设备声明的门铃寄存器时，模拟器只写`kick_fd`，不等待回复；
+ * 2. irq：设备写`irq_fd`，模拟器轮询到后置起中断。
+ *
+ * - 握手流程（模拟器 -> 设备）：
+ * ```
+ *
+ *   RDEV_HELLO           -> 回复 { version, mmio_size, doorbell }
+ *   RDEV_SET_MEM  + fd   :  来宾内存 { gpa, size, offset }
+ *   RDEV_SET_KICK + fd   :  门铃 eventfd
+ *   RDEV_SET_IRQ  + fd   :  中断 eventfd
+ *
+ * ```
+ * 之后其余寄存器的访问以`RDEV_MMIO_READ`/`RDEV_MMIO_WRITE`同步往返，
+ * 回复中携带设备当前的中断电平，模拟器据此更新中断位图。
+ */
+
+
+#ifndef RDEV_H
+#define RDEV_H
+
+// ==================================================================== //
+//                             Include
+// ==================================================================== //
+
+#include "bus.h"
+
+// ==================================================================== //
+//                              Defines
+// ==================================================================== //
+
+#define RDEV_MMIO_BASE      0x10010000  /** 第一个进程外设备基址 */
+#define RDEV_IRQ            16          /** 第一个进程外设备中断号 */
+#define RDEV_VERSION        1           /** 协议版本 */
+#define RDEV_NO_DOORBELL    (~(u64)0)   /** 设备未声明门铃寄存器 */
+#define RDEV_MAX_MEM        4           /** 设备进程最多映射的内存区域数 */
+#define RDEV_MAX_FDS        4           /** 一条消息最多附带的描述符数 */
+
+/**
+ * @brief 消息类型
+ */
+typedef enum {
+    RDEV_HELLO = 1,     /** 握手：args[0] = 版本 */
+    RDEV_SET_MEM,       /** 来宾内存：args = { gpa, size, offset }，带 memfd */
+    RDEV_SET_KICK,      /** 门铃 eventfd，带 fd */
+    RDEV_SET_IRQ,       /** 中断 eventfd，带 fd */
+    RDEV_MMIO_READ,     /** 读寄存器：args = { offset, size } */
+    RDEV_MMIO_WRITE,    /** 写寄存器：args = { offset, size, value } */
+    RDEV_RESET,         /** 复位设备 */
+    RDEV_REPLY = 0x80,  /** 回复标志 */
+} RDEV_TYPE;
+
+
+// ==================================================================== //
+//                             Data: RDEV
+// ==================================================================== //
+
+/**
+ * @brief 协议消息（定长）
+ */
+typedef struct RDEV_MSG_t {
+    u32 type;           /** 消息类型`RDEV_TYPE` */
+    u32 nfds;           /** 随消息传递的描述符个数 */
+    u64 args[4];        /** 参数 */
+} RDEV_MSG;
+
+/**
+ * @brief 模拟器侧的进程外设备代理
+ */
+typedef struct RDEV_t {
+    BUS* bus;           /** 所在总线 */
+    int sock;           /** 与设备进程的连接 */
+    int kick_fd;        /** 门铃 eventfd */
+    int irq_fd;         /** 中断 eventfd */
+    u32 irq;            /** 中断号 */
+    u64 mmio_size;      /** 寄存器地址空间大小 */
+    u64 doorbell;       /** 门铃寄存器偏移 */
+} RDEV;
+
+/**
+ * @brief 设备进程侧映射的来宾内存区域
+ */
+typedef struct RDEV_MEM_t {
+    u64 gpa;            /** 来宾物理地址 */
+    u64 size;           /** 大小 */
+    u8* hva;            /** 设备进程中的映射地址 */
+} RDEV_MEM;
+
+typedef struct RDEV_BACKEND_t RDEV_BACKEND;
+
+/**
+ * @brief 设备进程侧的后端
+ */
+struct RDEV_BACKEND_t {
+    int sock;                       /** 与模拟器的连接 */
+    int kick_fd;                    /** 门铃 eventfd */
+    int irq_fd;                     /** 中断 eventfd */
+    int nmem;                       /** 来宾内存区域数 */
+    RDEV_MEM mem[RDEV_MAX_MEM];     /** 来宾内存区域 */
+    u64 mmio_size;                  /** 寄存器地址空间大小 */
+    u64 doorbell;                   /** 门铃寄存器偏移 */
+    int irq_level;                  /** 当前中断电平 */
+    void* opaque;                   /** 设备模型私有数据 */
+    /** 读寄存器 */
+    u64 (*mmio_read)(RDEV_BACKEND* be, u64 offset, u64 size);
+    /** 写寄存器 */
+    void (*mmio_write)(RDEV_BACKEND* be, u64 offset, u64 size, u64 value);
+    /** 来宾敲门铃 */
+    void (*kick)(RDEV_BACKEND* be);
+    /** 复位 */
+    void (*reset)(RDEV_BACKEND* be);
+};
+
+
+// ==================================================================== //
+//                            Declare API: RDEV
+// ==================================================================== //
+
+/**
+ * @brief 发送一条消息，可附带描述符
+ * @param sock 连接
+ * @param msg 消息
+ * @param fds 描述符数组，`msg->nfds`个
+ * @return int 0 成功，-1 失败
+ */
+int rdev_send(int sock, RDEV_MSG* msg, int* fds);
+
+/**
+ * @brief 接收一条消息，可附带描述符
+ * @param sock 连接
+ * @param msg 消息
+ * @param fds 描述符数组，`RDEV_MAX_FDS`个，收到的个数写入`msg->nfds`，由调用方关闭
+ * @return int 0 成功，-1 失败、连接关闭或描述符超出`RDEV_MAX_FDS`（已收到的全部关闭）
+ */
+int rdev_recv(int sock, RDEV_MSG* msg, int* fds);
+
+/**
+ * @brief 模拟器连接进程外设备，完成握手并挂载到总线
+ * @param rdev 设备代理
+ * @param bus 总线
+ * @param path 设备进程的 socket 路径
+ * @param base 来宾物理基址
+ * @param irq 中断号
+ * @return int 0 成功，-1 失败
+ */
+int rdev_connect(RDEV* rdev, BUS* bus, char* path, u64 base, u32 irq);
+
+/**
+ * @brief 设备进程监听 socket 并为一个模拟器连接提供服务，直到连接关闭
+ * @param be 后端（调用方预先填好回调、`mmio_size`与`doorbell`）
+ * @param path socket 路径
+ * @return int 0 正常结束，-1 失败
+ */
+int rdev_backend_serve(RDEV_BACKEND* be, char* path);
+
+/**
+ * @brief 设备进程将来宾物理地址区间转换为本进程指针
+ * @param be 后端
+ * @param gpa 来宾物理地址
+ * @param len 长度
+ * @return void* 指针，不在已映射区域内时返回`NULL`
+ */
+void* rdev_backend_gpa(RDEV_BACKEND* be, u64 gpa, u64 len);
+
+/**
+ * @brief 设备进程设置中断电平，置起时通过`irq_fd`通知模拟器
+ * @param be 后端
+ * @param level 中断电平
+ */
+void rdev_backend_irq(RDEV_BACKEND* be, int level);
+
+
+#endif // RDEV_H
@@ -0,0 +1,226 @@
+/**
+ * @file rvc.c
+ * @author lancer (lancerstadium@163.com)
+ * @brief RVC 压缩指令扩展实现
+ * @version 0.1
+ * @date 2024-01-25
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+
+// ==================================================================== //
+//                             Include
+// ==================================================================== //
+
+#include "rvc.h"
+#include "opcode.h"
+#include <pthread.h>
+
+
+// ==================================================================== //
+//                             Data: RVC
+// ==================================================================== //
+
+u32 rvc_table[1 << 16];
+u32 rvc_table32[1 << 16];
+
+static pthread_once_t rvc_once = PTHREAD_ONCE_INIT;
+
+
+// ==================================================================== //
+//                          Private Func: RVC
+// ==================================================================== //
+
+/** 取出 inst[hi:lo] */
+#define BITS(inst, hi, lo)  (((inst) >> (lo)) & ((1u << ((hi) - (lo) + 1)) - 1))
+/** 取出 inst[pos] 并放到第 to 位 */
+#define BIT(inst, pos, to)  ((((inst) >> (pos)) & 1u) << (to))
+
+/** 压缩寄存器编号 rd'/rs1'/rs2' 对应 x8 ~ x15 */
+static inline u32 creg(u32 r) {
+    return r + 8;
+}
+
+/** 符号扩展 bits 位立即数 */
+static inline int32_t sext(u32 imm, int bits) {
+    return (int32_t)(imm << (32 - bits)) >> (32 - bits);
+}
+
+static inline u32 enc_R(u32 op, u32 rd, u32 f3, u32 rs1, u32 rs2, u32 f7) {
+    return (f7 << 25) | (rs2 << 20) | (rs1 << 15) | (f3 << 12) | (rd << 7) | op;
+}
+static inline u32 enc_I(u32 op, u32 rd, u32 f3, u32 rs1, int32_t imm) {
+    return ((u32)imm << 20) | (rs1 << 15) | (f3 << 12) | (rd << 7) | op;
+}
+static inline u32 enc_S(u32 op, u32 f3, u32 rs1, u32 rs2, int32_t imm) {
+    return (BITS((u32)imm, 11, 5) << 25) | (rs2 << 20) | (rs1 << 15) | (f3 << 12)
+        | (BITS((u32)imm, 4, 0) << 7) | op;
+}
+static inline u32 enc_B(u32 f3, u32 rs1, u32 rs2, int32_t imm) {
+    u32 i = imm;
+    return (BIT(i, 12, 31) | (BITS(i, 10, 5) << 25)) | (rs2 << 20) | (rs1 << 15) | (f3 << 12)
+        | (BITS(i, 4, 1) << 8) | BIT(i, 11, 7) | B_TYPE;
+}
+static inline u32 enc_U(u32 op, u32 rd, int32_t imm) {
+    return ((u32)imm & 0xfffff000) | (rd << 7) | op;
+}
+static inline u32 enc_J(u32 rd, int32_t imm) {
+    u32 i = imm;
+    return BIT(i, 20, 31) | (BITS(i, 10, 1) << 21) | BIT(i, 11, 20) | (BITS(i, 19, 12) << 12)
+        | (rd << 7) | JAL;
+}
+
+/** 象限 0：栈指针相关加法与基于 rs1' 的加载/存储 */
+static u32 rvc_expand_q0(u32 c, int xlen) {
+    u32 rd = creg(BITS(c, 4, 2));       // rd' / rs2'
+    u32 rs1 = creg(BITS(c, 9, 7));      // rs1'
+    // uimm[5:3|7:6]：C.LD / C.SD / C.FLD / C.FSD
+    u32 uimm_d = (BITS(c, 12, 10) << 3) | (BITS(c, 6, 5) << 6);
+    // uimm[5:3|2|6]：C.LW / C.SW
+    u32 uimm_w = (BITS(c, 12, 10) << 3) | BIT(c, 6, 2) | BIT(c, 5, 6);
+    switch (BITS(c, 15, 13)) {
+        case 0: {   // C.ADDI4SPN
+            u32 nzuimm = (BITS(c, 12, 11) << 4) | (BITS(c, 10, 7) << 6) | BIT(c, 6, 2) | BIT(c, 5, 3);
+            return nzuimm ? enc_I(I_TYPE, rd, ADDI, 2, nzuimm) : 0;
+        }
+        case 1: return enc_I(LOAD_FP, rd, FLD, rs1, uimm_d);    // C.FLD
+        case 2: return enc_I(LOAD, rd, LW, rs1, uimm_w);        // C.LW
+        case 3:
+            if (xlen == 32)
+                return enc_I(LOAD_FP, rd, FLW, rs1, uimm_w);    // C.FLW
+            return enc_I(LOAD, rd, LD, rs1, uimm_d);            // C.LD
+        case 5: return enc_S(STORE_FP, FSD, rs1, rd, uimm_d);   // C.FSD
+        case 6: return enc_S(S_TYPE, SW, rs1, rd, uimm_w);      // C.SW
+        case 7:
+            if (xlen == 32)
+                return enc_S(STORE_FP, FSW, rs1, rd, uimm_w);   // C.FSW
+            return enc_S(S_TYPE, SD, rs1, rd, uimm_d);          // C.SD
+        default: return 0;
+    }
+}
+
+/** 象限 1：立即数运算、寄存器运算与控制转移 */
+static u32 rvc_expand_q1(u32 c, int xlen) {
+    u32 rd = BITS(c, 11, 7);
+    u32 rd_c = creg(BITS(c, 9, 7));     // rd' / rs1'
+    u32 rs2_c = creg(BITS(c, 4, 2));    // rs2'
+    int32_t imm = sext(BIT(c, 12, 5) | BITS(c, 6, 2), 6);
+    // C.J / C.JAL 的跳转偏移
+    int32_t off_j = sext(BIT(c, 12, 11) | BIT(c, 11, 4) | (BITS(c, 10, 9) << 8) | BIT(c, 8, 10)
+            | BIT(c, 7, 6) | BIT(c, 6, 7) | (BITS(c, 5, 3) << 1) | BIT(c, 2, 5), 12);
+    switch (BITS(c, 15, 13)) {
+        case 0: return enc_I(I_TYPE, rd, ADDI, rd, imm);        // C.ADDI / C.NOP
+        case 1:
+            if (xlen == 32)
+                return enc_J(1, off_j);                         // C.JAL
+            return rd ? enc_I(I_TYPE_64, rd, ADDIW, rd, imm) : 0;   // C.ADDIW
+        case 2: return enc_I(I_TYPE, rd, ADDI, 0, imm);         // C.LI
+        case 3:
+            if (rd == 2) {  // C.ADDI16SP
+                int32_t nzimm = sext(BIT(c, 12, 9) | BIT(c, 6, 4) | BIT(c, 5, 6)
+                        | (BITS(c, 4, 3) << 7) | BIT(c, 2, 5), 10);
+                return nzimm ? enc_I(I_TYPE, 2, ADDI, 2, nzimm) : 0;
+            }
+            // C.LUI
+            return imm ? enc_U(LUI, rd, imm << 12) : 0;
+        case 4: {
+            u32 shamt = BIT(c, 12, 5) | BITS(c, 6, 2);
+            switch (BITS(c, 11, 10)) {
+                case 0: return enc_I(I_TYPE, rd_c, SRI, rd_c, shamt);               // C.SRLI
+                case 1: return enc_I(I_TYPE, rd_c, SRI, rd_c, shamt | 0x400);       // C.SRAI
+                case 2: return enc_I(I_TYPE, rd_c, ANDI, rd_c, imm);                // C.ANDI
+                default: ;
+            }
+            if (!BIT(c, 12, 0)) {
+                switch (BITS(c, 6, 5)) {
+                    case 0: return enc_R(R_TYPE, rd_c, ADDSUB, rd_c, rs2_c, SUB);   // C.SUB
+                    case 1: return enc_R(R_TYPE, rd_c, XOR, rd_c, rs2_c, 0);        // C.XOR
+                    case 2: return enc_R(R_TYPE, rd_c, OR, rd_c, rs2_c, 0);         // C.OR
+                    case 3: return enc_R(R_TYPE, rd_c, AND, rd_c, rs2_c, 0);        // C.AND
+                }
+            }
+            switch (BITS(c, 6, 5)) {
+                case 0: return enc_R(R_TYPE_64, rd_c, ADDSUB, rd_c, rs2_c, SUBW);   // C.SUBW
+                case 1: return enc_R(R_TYPE_64, rd_c, ADDSUB, rd_c, rs2_c, ADDW);   // C.ADDW
+                default: return 0;
+            }
+        }
+        case 5: return enc_J(0, off_j);                         // C.J
+        case 6:     // C.BEQZ
+        case 7: {   // C.BNEZ
+            int32_t off = sext(BIT(c, 12, 8) | (BITS(c, 11, 10) << 3) | (BITS(c, 6, 5) << 6)
+                    | (BITS(c, 4, 3) << 1) | BIT(c, 2, 5), 9);
+            return enc_B(BITS(c, 15, 13) == 6 ? BEQ : BNE, rd_c, 0, off);
+        }
+        default: return 0;
+    }
+}
+
+/** 象限 2：基于栈指针的加载/存储、跳转与寄存器传送 */
+static u32 rvc_expand_q2(u32 c, int xlen) {
+    u32 rd = BITS(c, 11, 7);
+    u32 rs2 = BITS(c, 6, 2);
+    // uimm[5|4:3|8:6]：C.LDSP / C.FLDSP
+    u32 uimm_ld = BIT(c, 12, 5) | (BITS(c, 6, 5) << 3) | (BITS(c, 4, 2) << 6);
+    // uimm[5:3|8:6]：C.SDSP / C.FSDSP
+    u32 uimm_sd = (BITS(c, 12, 10) << 3) | (BITS(c, 9, 7) << 6);
+    // uimm[5|4:2|7:6]：C.LWSP / C.FLWSP
+    u32 uimm_lw = BIT(c, 12, 5) | (BITS(c, 6, 4) << 2) | (BITS(c, 3, 2) << 6);
+    // uimm[5:2|7:6]：C.SWSP / C.FSWSP
+    u32 uimm_sw = (BITS(c, 12, 9) << 2) | (BITS(c, 8, 7) << 6);
+    switch (BITS(c, 15, 13)) {
+        case 0: return enc_I(I_TYPE, rd, SLLI, rd, BIT(c, 12, 5) | rs2);     // C.SLLI
+        case 1: return enc_I(LOAD_FP, rd, FLD, 2, uimm_ld);                  // C.FLDSP
+        case 2: return rd ? enc_I(LOAD, rd, LW, 2, uimm_lw) : 0;             // C.LWSP
+        case 3:
+            if (xlen == 32)
+                return enc_I(LOAD_FP, rd, FLW, 2, uimm_lw);                  // C.FLWSP
+            return rd ? enc_I(LOAD, rd, LD, 2, uimm_ld) : 0;                 // C.LDSP
+        case 4:
+            if (!BIT(c, 12, 0)) {
+                if (rs2 == 0)   // C.JR
+                    return rd ? enc_I(JALR, 0, 0, rd, 0) : 0;
+                return enc_R(R_TYPE, rd, ADDSUB, 0, rs2, ADD);              // C.MV
+            }
+            if (rs2 == 0) {
+                if (rd == 0)    // C.EBREAK
+                    return enc_I(CSR, 0, ECALLBREAK, 0, 1);
+                return enc_I(JALR, 1, 0, rd, 0);                            // C.JALR
+            }
+            return enc_R(R_TYPE, rd, ADDSUB, rd, rs2, ADD);                 // C.ADD
+        case 5: return enc_S(STORE_FP, FSD, 2, rs2, uimm_sd);               // C.FSDSP
+        case 6: return enc_S(S_TYPE, SW, 2, rs2, uimm_sw);                  // C.SWSP
+        case 7:
+            if (xlen == 32)
+                return enc_S(STORE_FP, FSW, 2, rs2, uimm_sw);               // C.FSWSP
+            return enc_S(S_TYPE, SD, 2, rs2, uimm_sd);                      // C.SDSP
+        default: return 0;
+    }
+}
+
+static void rvc_build_table() {
+    for (u32 c = 0; c < (1 << 16); c++) {
+        rvc_table[c] = rvc_expand(c, 64);
+        rvc_table32[c] = rvc_expand(c, 32);
+    }
+}
+
+
+// ==================================================================== //
+//                            Func API: RVC
+// ==================================================================== //
+
+void rvc_init() {
+    pthread_once(&rvc_once, rvc_build_table);
+}
+
+u32 rvc_expand(u16 inst, int xlen) {
+    u32 c = inst;
+    switch (c & 0x3) {
+        case 0: return c ? rvc_expand_q0(c, xlen) : 0;  // 全 0 为非法指令
+        case 1: return rvc_expand_q1(c, xlen);
+        case 2: return rvc_expand_q2(c, xlen);
+        default: return 0;                          // 非压缩指令
+    }
+}
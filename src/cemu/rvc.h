@@ -0,0 +1,68 @@
+/**
+ * @file rvc.h
+ * @author lancer (lancerstadium@163.com)
+ * @brief RVC 压缩指令扩展头文件
+ * @version 0.1
+ * @date 2024-01-25
+ * @copyright Copyright (c) 2024
+ *
+ * # RVC 介绍
+ * - C 扩展把常用指令编码为 16 位，低 2 位不为`0b11`的半字即为压缩指令。
+ * 每条压缩指令都等价于一条 32 位指令，因此这里不为它们单独编写执行函数，
+ * 而是在取指后把它扩展为对应的 32 位指令，交给原有的`cpu_execute()`执行。
+ *
+ * - 16 位编码空间只有 65536 种取值，扩展结果与指令所在地址无关，
+ * 所以在初始化时一次性把全部编码扩展进查找表`rvc_table`，
+ * 取指时只需一次查表；查找表为只读数据，所有处理器共享，
+ * 来宾改写代码也不需要任何失效处理。非法编码扩展为 0。
+ *
+ * - RV32C 与 RV64C 有几处编码含义不同（`C.JAL`/`C.ADDIW`、`C.FLW`/`C.LD`等），
+ * 因此按 XLEN 各建一张表，处理器在选定 XLEN 时取用对应的表。
+ */
+
+
+#ifndef RVC_H
+#define RVC_H
+
+// ==================================================================== //
+//                             Include
+// ==================================================================== //
+
+#include "typedef.h"
+
+// ==================================================================== //
+//                             Data: RVC
+// ==================================================================== //
+
+/** 压缩指令扩展查找表：下标为 16 位编码，值为 32 位指令 */
+extern u32 rvc_table[1 << 16];      /** RV64C */
+extern u32 rvc_table32[1 << 16];    /** RV32C */
+
+// ==================================================================== //
+//                            Declare API: RVC
+// ==================================================================== //
+
+/**
+ * @brief 构建压缩指令扩展查找表（可重复调用，只构建一次）
+ */
+void rvc_init();
+
+/**
+ * @brief 将一条 16 位压缩指令扩展为等价的 32 位指令
+ * @param inst 16 位压缩指令
+ * @param xlen 32 或 64
+ * @return u32 32 位指令，非法编码返回 0
+ */
+u32 rvc_expand(u16 inst, int xlen);
+
+/**
+ * @brief 取得对应 XLEN 的扩展查找表（需先调用`rvc_init()`）
+ * @param xlen 32 或 64
+ * @return const u32* 查找表，下标为 16 位压缩指令
+ */
+static inline const u32* rvc_table_of(int xlen) {
+    return xlen == 32 ? rvc_table32 : rvc_table;
+}
+
+
+#endif // RVC_H
@@ -0,0 +1,889 @@
+/**
+ * @file rvv.c
+ * @author lancer (lancerstadium@163.com)
+ * @brief RVV 1.0 向量扩展实现
+ * @version 0.1
+ * @date 2024-01-27
+ * @copyright Copyright (c) 2024
+ * @note 向量寄存器组按字节连续存放，元素按主机小端序直接`memcpy`读写；
+ * 所有运算都只处理`[0, vl)`内的元素，`vstart`视为 0。
+ */
+
+// ==================================================================== //
+//                              Include
+// ==================================================================== //
+
+#include "rvv.h"
+#include "csr.h"
+#include "opcode.h"
+#include "fpu.h"
+#include "utils.h"
+#include <math.h>
+#include <pthread.h>
+#include <string.h>
+
+// ==================================================================== //
+//                              Defines
+// ==================================================================== //
+
+#define VTYPE_VILL      (1ull << 63)    /** vtype 非法标志 */
+#define VGROUP_MAX      (8 * CPU_VLENB) /** 寄存器组最大字节数（LMUL = 8） */
+
+#define CANON_NAN_S     0x7fc00000u
+#define CANON_NAN_D     0x7ff8000000000000ull
+#define NAN_BOX         0xffffffff00000000ull
+
+/** 核函数：d[i] = a[i] op b[i]，i < n */
+typedef void (*RVV_KERN)(u8* d, const u8* a, const u8* b, u64 n);
+
+/** 整数核函数（每种运算按 SEW = 8/16/32/64 各一个） */
+enum {
+    VK_ADD, VK_SUB, VK_AND, VK_OR, VK_XOR,
+    VK_MINU, VK_MAXU, VK_MIN, VK_MAX,
+    VK_MUL, VK_SLL, VK_SRL, VK_SRA,
+    VK_NINT
+};
+
+/** 浮点核函数（每种运算按 SEW = 32/64 各一个） */
+enum {
+    VK_FADD, VK_FSUB, VK_FMUL, VK_FDIV,
+    VK_NFP
+};
+
+// ==================================================================== //
+//                            Data: RVV
+// ==================================================================== //
+
+/**
+ * @brief 一组核函数实现
+ */
+typedef struct RVV_KERNELS_t {
+    const char* name;               /** 实现名称 */
+    RVV_KERN iop[VK_NINT][4];       /** 整数核函数：[运算][log2(SEW/8)] */
+    RVV_KERN fop[VK_NFP][2];        /** 浮点核函数：[运算][SEW = 32 ? 0 : 1] */
+} RVV_KERNELS;
+
+/**
+ * @brief 整数运算（OPIVV/OPIVX/OPIVI）的 funct6 译码表
+ */
+typedef struct RVV_IOP_t {
+    const char* name;               /** 助记符，NULL 为未实现 */
+    int op;                         /** 核函数 */
+    int rev;                        /** 1 表示交换操作数（vrsub） */
+    int uimm;                       /** 1 表示 .vi 形式的立即数零扩展（移位） */
+} RVV_IOP;
+
+static const RVV_IOP rvv_iops[64] = {
+    [0x00] = { "vadd",  VK_ADD,  0, 0 },
+    [0x02] = { "vsub",  VK_SUB,  0, 0 },
+    [0x03] = { "vrsub", VK_SUB,  1, 0 },
+    [0x04] = { "vminu", VK_MINU, 0, 0 },
+    [0x05] = { "vmin",  VK_MIN,  0, 0 },
+    [0x06] = { "vmaxu", VK_MAXU, 0, 0 },
+    [0x07] = { "vmax",  VK_MAX,  0, 0 },
+    [0x09] = { "vand",  VK_AND,  0, 0 },
+    [0x0a] = { "vor",   VK_OR,   0, 0 },
+    [0x0b] = { "vxor",  VK_XOR,  0, 0 },
+    [0x25] = { "vsll",  VK_SLL,  0, 1 },
+    [0x28] = { "vsrl",  VK_SRL,  0, 1 },
+    [0x29] = { "vsra",  VK_SRA,  0, 1 },
+};
+
+// ==================================================================== //
+//                        Private Func: RVV Kernels
+// ==================================================================== //
+
+/**
+ * 核函数用 GCC 向量扩展编写，主循环每次处理`VW`字节，余下元素走标量尾循环；
+ * 同一份表达式在主循环中作用于向量`vec_t`，在尾循环中作用于标量`T`。
+ * 操作数一律`memcpy`读写，因此允许`d`与`a`/`b`完全重叠（同一寄存器组）。
+ */
+
+#define VK_T_u(n)   uint##n##_t
+#define VK_T_s(n)   int##n##_t
+
+/** 按比较掩码选择：m 全 1 取 x，否则取 y */
+#define VSEL(m, x, y)   ((((vec_t)(m)) & (x)) | (~((vec_t)(m)) & (y)))
+
+/** 整数运算：X(名字, 向量表达式, 标量表达式, 符号) */
+#define VK_INT_OPS(X)                                                       \
+    X(add,  a + b,                      a + b,              u)              \
+    X(sub,  a - b,                      a - b,              u)              \
+    X(and,  a & b,                      a & b,              u)              \
+    X(or,   a | b,                      a | b,              u)              \
+    X(xor,  a ^ b,                      a ^ b,              u)              \
+    X(minu, VSEL(a < b, a, b),          a < b ? a : b,      u)              \
+    X(maxu, VSEL(a > b, a, b),          a > b ? a : b,      u)              \
+    X(min,  VSEL(a < b, a, b),          a < b ? a : b,      s)              \
+    X(max,  VSEL(a > b, a, b),          a > b ? a : b,      s)              \
+    X(mul,  a * b,                      a * b,              u)              \
+    X(sll,  a << (b & M),               a << (b & M),       u)              \
+    X(srl,  a >> (b & M),               a >> (b & M),       u)              \
+    X(sra,  a >> (b & M),               a >> (b & M),       s)
+
+/** 浮点运算：X(名字, 运算符) */
+#define VK_FP_OPS(X)                                                        \
+    X(fadd, +)                                                              \
+    X(fsub, -)                                                              \
+    X(fmul, *)                                                              \
+    X(fdiv, /)
+
+/** 标量尾循环 */
+#define VK_TAIL(T, SEXPR)                                                   \
+    for (; i < n; i++) {                                                    \
+        T a, b, r;                                                          \
+        memcpy(&a, pa + i * sizeof(T), sizeof(T));                          \
+        memcpy(&b, pb + i * sizeof(T), sizeof(T));                          \
+        r = SEXPR;                                                          \
+        memcpy(pd + i * sizeof(T), &r, sizeof(T));                          \
+    }
+
+/** 整数核函数：VW = 0 时只有标量循环 */
+#define VK_INT_FN(ATTR, IMPL, VW, NAME, T, VEXPR, SEXPR)                    \
+static ATTR void vk_##IMPL##_##NAME(u8* pd, const u8* pa, const u8* pb, u64 n) { \
+    const T M = sizeof(T) * 8 - 1;                                          \
+    u64 i = 0;                                                              \
+    VK_INT_BODY_##VW(T, VEXPR)                                              \
+    VK_TAIL(T, SEXPR)                                                       \
+    (void)M;                                                                \
+}
+
+#define VK_INT_BODY_0(T, VEXPR)
+#define VK_INT_BODY_16(T, VEXPR)    VK_INT_BODY(16, T, VEXPR)
+#define VK_INT_BODY_32(T, VEXPR)    VK_INT_BODY(32, T, VEXPR)
+#define VK_INT_BODY(VW, T, VEXPR)                                           \
+    typedef T vec_t __attribute__((vector_size(VW)));                       \
+    for (; i + VW / sizeof(T) <= n; i += VW / sizeof(T)) {                  \
+        vec_t a, b, r;                                                      \
+        memcpy(&a, pa + i * sizeof(T), VW);                                 \
+        memcpy(&b, pb + i * sizeof(T), VW);                                 \
+        r = VEXPR;                                                          \
+        memcpy(pd + i * sizeof(T), &r, VW);                                 \
+    }
+
+/** 浮点核函数：结果为 NaN 时写回规范 NaN */
+#define VK_FP_FN(ATTR, IMPL, VW, NAME, T, I, CANON, OP)                     \
+static ATTR void vk_##IMPL##_##NAME(u8* pd, const u8* pa, const u8* pb, u64 n) { \
+    u64 i = 0;                                                              \
+    VK_FP_BODY_##VW(T, I, CANON, OP)                                        \
+    for (; i < n; i++) {                                                    \
+        T a, b, r;                                                          \
+        memcpy(&a, pa + i * sizeof(T), sizeof(T));                          \
+        memcpy(&b, pb + i * sizeof(T), sizeof(T));                          \
+        r = a OP b;                                                         \
+        if (r != r) { I c = CANON; memcpy(&r, &c, sizeof(T)); }             \
+        memcpy(pd + i * sizeof(T), &r, sizeof(T));                          \
+    }                                                                       \
+}
+
+#define VK_FP_BODY_0(T, I, CANON, OP)
+#define VK_FP_BODY_16(T, I, CANON, OP)  VK_FP_BODY(16, T, I, CANON, OP)
+#define VK_FP_BODY_32(T, I, CANON, OP)  VK_FP_BODY(32, T, I, CANON, OP)
+#define VK_FP_BODY(VW, T, I, CANON, OP)                                     \
+    typedef T vec_t __attribute__((vector_size(VW)));                       \
+    typedef I ivec_t __attribute__((vector_size(VW)));                      \
+    for (; i + VW / sizeof(T) <= n; i += VW / sizeof(T)) {                  \
+        vec_t a, b, r;                                                      \
+        memcpy(&a, pa + i * sizeof(T), VW);                                 \
+        memcpy(&b, pb + i * sizeof(T), VW);                                 \
+        r = a OP b;                                                         \
+        ivec_t m = (ivec_t)(r != r);                                        \
+        ivec_t ri = ((ivec_t)r & ~m) | ((I)CANON & m);                      \
+        memcpy(pd + i * sizeof(T), &ri, VW);                                \
+    }
+
+/** 生成一组实现的全部核函数 */
+#define VK_INT_TYPES(ATTR, IMPL, VW, NAME, VEXPR, SEXPR, SG)                \
+    VK_INT_FN(ATTR, IMPL, VW, NAME##_8,  VK_T_##SG(8),  VEXPR, SEXPR)       \
+    VK_INT_FN(ATTR, IMPL, VW, NAME##_16, VK_T_##SG(16), VEXPR, SEXPR)       \
+    VK_INT_FN(ATTR, IMPL, VW, NAME##_32, VK_T_##SG(32), VEXPR, SEXPR)       \
+    VK_INT_FN(ATTR, IMPL, VW, NAME##_64, VK_T_##SG(64), VEXPR, SEXPR)
+
+#define VK_FP_TYPES(ATTR, IMPL, VW, NAME, OP)                               \
+    VK_FP_FN(ATTR, IMPL, VW, NAME##_32, float,  int32_t, CANON_NAN_S, OP)   \
+    VK_FP_FN(ATTR, IMPL, VW, NAME##_64, double, int64_t, CANON_NAN_D, OP)
+
+#define VK_DEFINE(IMPL)                                                     \
+    VK_INT_OPS(VK_INT_DEFINE_##IMPL)                                        \
+    VK_FP_OPS(VK_FP_DEFINE_##IMPL)
+
+/** 生成核函数表 */
+#define VK_INT_ENTRY(IMPL, NAME)                                            \
+    { vk_##IMPL##_##NAME##_8, vk_##IMPL##_##NAME##_16,                      \
+      vk_##IMPL##_##NAME##_32, vk_##IMPL##_##NAME##_64 },
+#define VK_FP_ENTRY(IMPL, NAME)                                             \
+    { vk_##IMPL##_##NAME##_32, vk_##IMPL##_##NAME##_64 },
+
+// 标量实现（任意主机）
+#define VK_INT_DEFINE_scalar(N, V, S, SG)  VK_INT_TYPES(, scalar, 0, N, V, S, SG)
+#define VK_FP_DEFINE_scalar(N, OP)         VK_FP_TYPES(, scalar, 0, N, OP)
+#define VK_INT_ENTRY_scalar(N, V, S, SG)   VK_INT_ENTRY(scalar, N)
+#define VK_FP_ENTRY_scalar(N, OP)          VK_FP_ENTRY(scalar, N)
+VK_DEFINE(scalar)
+
+static const RVV_KERNELS vk_scalar = {
+    "scalar",
+    { VK_INT_OPS(VK_INT_ENTRY_scalar) },
+    { VK_FP_OPS(VK_FP_ENTRY_scalar) },
+};
+
+#if defined(__x86_64__) || defined(__i386__)
+
+// SSE4.1：128 位
+#define VK_INT_DEFINE_sse4(N, V, S, SG)    VK_INT_TYPES(__attribute__((target("sse4.1"))), sse4, 16, N, V, S, SG)
+#define VK_FP_DEFINE_sse4(N, OP)           VK_FP_TYPES(__attribute__((target("sse4.1"))), sse4, 16, N, OP)
+#define VK_INT_ENTRY_sse4(N, V, S, SG)     VK_INT_ENTRY(sse4, N)
+#define VK_FP_ENTRY_sse4(N, OP)            VK_FP_ENTRY(sse4, N)
+VK_DEFINE(sse4)
+
+static const RVV_KERNELS vk_sse4 = {
+    "sse4.1",
+    { VK_INT_OPS(VK_INT_ENTRY_sse4) },
+    { VK_FP_OPS(VK_FP_ENTRY_sse4) },
+};
+
+// AVX2：256 位，一次处理一整个向量寄存器
+#define VK_INT_DEFINE_avx2(N, V, S, SG)    VK_INT_TYPES(__attribute__((target("avx2"))), avx2, 32, N, V, S, SG)
+#define VK_FP_DEFINE_avx2(N, OP)           VK_FP_TYPES(__attribute__((target("avx2"))), avx2, 32, N, OP)
+#define VK_INT_ENTRY_avx2(N, V, S, SG)     VK_INT_ENTRY(avx2, N)
+#define VK_FP_ENTRY_avx2(N, OP)            VK_FP_ENTRY(avx2, N)
+VK_DEFINE(avx2)
+
+static const RVV_KERNELS vk_avx2 = {
+    "avx2",
+    { VK_INT_OPS(VK_INT_ENTRY_avx2) },
+    { VK_FP_OPS(VK_FP_ENTRY_avx2) },
+};
+
+#endif
+
+/** 当前选用的核函数 */
+static const RVV_KERNELS* vk = &vk_scalar;
+static pthread_once_t vk_once = PTHREAD_ONCE_INIT;
+
+static void rvv_select_kernels() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        vk = &vk_avx2;
+    else if (__builtin_cpu_supports("sse4.1"))
+        vk = &vk_sse4;
+#endif
+}
+
+// ==================================================================== //
+//                          Private Func: RVV
+// ==================================================================== //
+
+static void print_op(const char* s) {
+    if (log_trace_on)
+        printf(_blue("%s\n"), s);
+}
+
+static inline u64 rd(u32 inst)  { return (inst >> 7) & 0x1f; }
+static inline u64 rs1(u32 inst) { return (inst >> 15) & 0x1f; }
+static inline u64 rs2(u32 inst) { return (inst >> 20) & 0x1f; }
+
+/** 向量寄存器`r`（寄存器组首地址） */
+static inline u8* vreg(CPU* cpu, u64 r) {
+    return cpu->vregs + r * CPU_VLENB;
+}
+
+/** v0 中第 i 个掩码位 */
+static inline int vmask(CPU* cpu, u64 i) {
+    return (cpu->vregs[i >> 3] >> (i & 7)) & 1;
+}
+
+/** 读/写第 i 个元素（元素宽度 eb 字节），读出零扩展 */
+static inline u64 vget(const u8* p, u64 i, u64 eb) {
+    u64 v = 0;
+    memcpy(&v, p + i * eb, eb);
+    return v;
+}
+static inline void vset(u8* p, u64 i, u64 eb, u64 v) {
+    memcpy(p + i * eb, &v, eb);
+}
+
+/** eb 字节元素符号扩展 */
+static inline int64_t vsext(u64 v, u64 eb) {
+    int s = 64 - eb * 8;
+    return (int64_t)(v << s) >> s;
+}
+
+/** 将标量广播为 n 个元素 */
+static inline void vsplat(u8* p, u64 n, u64 eb, u64 v) {
+    for (u64 i = 0; i < n; i++)
+        vset(p, i, eb, v);
+}
+
+/** 按 v0 把`src`中的活跃元素合并到`vd` */
+static inline void vmerge_mask(CPU* cpu, u8* vd, const u8* src, u64 vl, u64 eb) {
+    for (u64 i = 0; i < vl; i++)
+        if (vmask(cpu, i))
+            memcpy(vd + i * eb, src + i * eb, eb);
+}
+
+/** vtype 字段 */
+static inline u64 vsew_bytes(u64 vtype) { return 1ull << ((vtype >> 3) & 0x7); }
+static inline int vsew_log2(u64 vtype)  { return (vtype >> 3) & 0x7; }
+static inline int vlmul_log2(u64 vtype) {
+    int l = vtype & 0x7;
+    return l >= 4 ? l - 8 : l;
+}
+
+/** 寄存器组对齐检查：EMUL > 1 时寄存器号须是 EMUL 的倍数 */
+static inline int vgroup_ok(u64 r, int emul_log2) {
+    return emul_log2 <= 0 || (r & ((1u << emul_log2) - 1)) == 0;
+}
+
+/** 由 vtype 计算 VLMAX，vtype 非法时返回 0 */
+static u64 rvv_vlmax(u64 vtype) {
+    int sew = vsew_log2(vtype);     // log2(SEW/8)
+    int lmul = vlmul_log2(vtype);
+    if ((vtype & 0x7) == 4 || sew > 3 || (vtype >> 8))
+        return 0;
+    // 分数 LMUL 要求 SEW <= LMUL * ELEN
+    if (lmul < 0 && sew + 3 > 6 + lmul)
+        return 0;
+    return lmul >= 0 ? (u64)(CPU_VLENB << lmul) >> sew
+                     : (u64)CPU_VLENB >> (sew - lmul);
+}
+
+/** 来宾物理地址区间 -> DRAM 主机指针，不完全在 DRAM 内时返回 NULL */
+static inline u8* rvv_ptr(CPU* cpu, u64 addr, u64 len) {
+    if (addr < DRAM_BASE || addr - DRAM_BASE > DRAM_SIZE || len > DRAM_SIZE - (addr - DRAM_BASE))
+        return NULL;
+    return (u8*)mmu_GPA_to_HVA((u64)cpu->bus->dram.mem_addr, addr);
+}
+
+/** 读/写一段来宾内存：DRAM 内直接拷贝，否则逐次走总线 */
+static void rvv_access(CPU* cpu, u64 addr, u8* buf, u64 len, int store) {
+    addr += cpu->seg;
+    u8* p = rvv_ptr(cpu, addr, len);
+    if (p) {
+        if (store) memcpy(p, buf, len);
+        else       memcpy(buf, p, len);
+        return;
+    }
+    u64 step = (len == 8 || len == 4 || len == 2) ? len : 1;
+    for (u64 off = 0; off < len; off += step) {
+        if (store) {
+            bus_store(cpu->bus, addr + off, step * 8, vget(buf + off, 0, step));
+        } else {
+            vset(buf + off, 0, step, bus_load(cpu->bus, addr + off, step * 8));
+        }
+    }
+}
+
+/**
+ * @brief vsetvli / vsetivli / vsetvl
+ */
+static int rvv_setvl(CPU* cpu, u32 inst) {
+    u64 vtype, avl;
+    if ((inst >> 31) == 0) {                    // vsetvli
+        vtype = (inst >> 20) & 0x7ff;
+    } else if ((inst >> 30) == 0x3) {           // vsetivli
+        vtype = (inst >> 20) & 0x3ff;
+    } else if ((inst >> 25) == 0x40) {          // vsetvl
+        vtype = cpu->regs[rs2(inst)];
+    } else {
+        return 0;
+    }
+
+    u64 vlmax = rvv_vlmax(vtype);
+    if ((inst >> 30) == 0x3) {
+        avl = rs1(inst);
+    } else if (rs1(inst) != 0) {
+        avl = cpu->regs[rs1(inst)];
+    } else if (rd(inst) != 0) {
+        avl = ~(u64)0;
+    } else {
+        avl = cpu->csr[CS_VL];                  // 只改 vtype，保持 vl
+    }
+
+    if (vlmax == 0) {
+        cpu->csr[CS_VTYPE] = VTYPE_VILL;
+        cpu->csr[CS_VL] = 0;
+    } else {
+        cpu->csr[CS_VTYPE] = vtype;
+        cpu->csr[CS_VL] = avl < vlmax ? avl : vlmax;
+    }
+    cpu->regs[rd(inst)] = cpu->csr[CS_VL];
+    print_op((inst >> 31) == 0 ? "vsetvli" : (inst >> 30) == 0x3 ? "vsetivli" : "vsetvl");
+    return 1;
+}
+
+/**
+ * @brief 向量加载/存储（LOAD-FP/STORE-FP，width = 0/5/6/7）
+ */
+static int rvv_mem(CPU* cpu, u32 inst, int store) {
+    u32 width = (inst >> 12) & 0x7;
+    u32 nf    = inst >> 29;
+    u32 mew   = (inst >> 28) & 0x1;
+    u32 mop   = (inst >> 26) & 0x3;
+    u32 vm    = (inst >> 25) & 0x1;
+    u32 lumop = rs2(inst);
+    u64 vd    = rd(inst);
+    u64 base  = cpu->regs[rs1(inst)];
+    u64 eew   = width == 0 ? 1 : 1ull << (width - 4);
+    u64 vtype = cpu->csr[CS_VTYPE];
+    u64 vl    = cpu->csr[CS_VL];
+
+    if (mew)
+        return 0;
+
+    // 整寄存器加载/存储：与 vtype 无关，搬运 nf + 1 个寄存器
+    if (mop == 0 && lumop == 0x08) {
+        u64 nreg = nf + 1;
+        if (!vm || (nreg & (nreg - 1)) || vd % nreg)
+            return 0;
+        rvv_access(cpu, base, vreg(cpu, vd), nreg * CPU_VLENB, store);
+        print_op(store ? "vsr.v" : "vlr.v");
+        return 1;
+    }
+    // 暂不支持分段（segment）访存
+    if (nf || (vtype & VTYPE_VILL))
+        return 0;
+
+    // 掩码加载/存储：EEW = 8，有效长度 ceil(vl / 8)
+    if (mop == 0 && lumop == 0x0b) {
+        if (!vm || width != 0)
+            return 0;
+        rvv_access(cpu, base, vreg(cpu, vd), (vl + 7) / 8, store);
+        print_op(store ? "vsm.v" : "vlm.v");
+        return 1;
+    }
+    // 单位步长只支持普通与 fault-only-first（仅加载）
+    if (mop == 0 && lumop != 0x00 && !(lumop == 0x10 && !store))
+        return 0;
+
+    // 索引访存：数据宽度为 SEW，索引宽度为 EEW；否则数据宽度为 EEW
+    int indexed = mop & 0x1;
+    u64 eb = indexed ? vsew_bytes(vtype) : eew;
+    int emul = indexed ? vlmul_log2(vtype)
+                       : (int)__builtin_ctzll(eew) - vsew_log2(vtype) + vlmul_log2(vtype);
+    if (emul < -3 || emul > 3 || !vgroup_ok(vd, emul))
+        return 0;
+    if (!vm && vd == 0 && !store)
+        return 0;
+
+    u8* data = vreg(cpu, vd);
+    if (mop == 0 && vm) {
+        rvv_access(cpu, base, data, vl * eb, store);
+    } else {
+        u64 stride = cpu->regs[rs2(inst)];
+        u8* index = vreg(cpu, rs2(inst));
+        for (u64 i = 0; i < vl; i++) {
+            if (!vm && !vmask(cpu, i))
+                continue;
+            u64 addr = mop == 0 ? base + i * eb
+                     : mop == 2 ? base + i * stride
+                     : base + vget(index, i, eew);
+            rvv_access(cpu, addr, data + i * eb, eb, store);
+        }
+    }
+    static const char* names[2][4] = {
+        { "vle.v", "vluxei.v", "vlse.v", "vloxei.v" },
+        { "vse.v", "vsuxei.v", "vsse.v", "vsoxei.v" },
+    };
+    print_op(names[store][mop]);
+    return 1;
+}
+
+/**
+ * @brief vmerge / vmv.v（vm = 1 时为 vmv.v.*，vs2 须为 0）
+ */
+static int rvv_merge(CPU* cpu, u32 inst, const u8* b, u64 vl, u64 eb) {
+    u32 vm = (inst >> 25) & 0x1;
+    u8* vd = vreg(cpu, rd(inst));
+    if (vm) {
+        if (rs2(inst) != 0)
+            return 0;
+        memmove(vd, b, vl * eb);
+        print_op("vmv.v");
+    } else {
+        if (rd(inst) == 0)
+            return 0;
+        const u8* a = vreg(cpu, rs2(inst));
+        for (u64 i = 0; i < vl; i++)
+            memmove(vd + i * eb, vmask(cpu, i) ? b + i * eb : a + i * eb, eb);
+        print_op("vmerge");
+    }
+    return 1;
+}
+
+/**
+ * @brief 整数运算（OPIVV / OPIVX / OPIVI）
+ */
+static int rvv_op_int(CPU* cpu, u32 inst, u32 funct3) {
+    u32 funct6 = inst >> 26;
+    u32 vm = (inst >> 25) & 0x1;
+    u64 vd = rd(inst), vs1 = rs1(inst), vs2 = rs2(inst);
+
+    // vmv<nr>r.v：与 vtype 无关，整寄存器拷贝
+    if (funct3 == OPIVI && funct6 == 0x27) {
+        u64 nreg = vs1 + 1;
+        if (!vm || (nreg & (nreg - 1)) || vd % nreg || vs2 % nreg)
+            return 0;
+        memmove(vreg(cpu, vd), vreg(cpu, vs2), nreg * CPU_VLENB);
+        print_op("vmvr.v");
+        return 1;
+    }
+
+    u64 vtype = cpu->csr[CS_VTYPE], vl = cpu->csr[CS_VL];
+    if (vtype & VTYPE_VILL)
+        return 0;
+    u64 eb = vsew_bytes(vtype);
+    int lmul = vlmul_log2(vtype);
+    if (!vgroup_ok(vd, lmul) || !vgroup_ok(vs2, lmul))
+        return 0;
+
+    u8 sb[VGROUP_MAX] __attribute__((aligned(32)));
+    u8 tmp[VGROUP_MAX] __attribute__((aligned(32)));
+    const RVV_IOP* op = &rvv_iops[funct6];
+    const u8* b;
+    if (funct3 == OPIVV) {
+        if (!vgroup_ok(vs1, lmul))
+            return 0;
+        b = vreg(cpu, vs1);
+    } else {
+        u64 x = funct3 == OPIVX ? cpu->regs[vs1]
+              : op->uimm        ? vs1
+              : (u64)((int64_t)(vs1 << 59) >> 59);
+        vsplat(sb, vl, eb, x);
+        b = sb;
+    }
+
+    if (funct6 == 0x17)
+        return rvv_merge(cpu, inst, b, vl, eb);
+    if (!op->name || (!vm && vd == 0))
+        return 0;
+
+    const u8* a = vreg(cpu, vs2);
+    u8* dst = vm ? vreg(cpu, vd) : tmp;
+    RVV_KERN k = vk->iop[op->op][vsew_log2(vtype)];
+    if (op->rev) k(dst, b, a, vl);
+    else         k(dst, a, b, vl);
+    if (!vm)
+        vmerge_mask(cpu, vreg(cpu, vd), tmp, vl, eb);
+    print_op(op->name);
+    return 1;
+}
+
+/**
+ * @brief 整数乘除、乘加、归约与标量传送（OPMVV / OPMVX）
+ */
+static int rvv_op_mul(CPU* cpu, u32 inst, u32 funct3) {
+    u32 funct6 = inst >> 26;
+    u32 vm = (inst >> 25) & 0x1;
+    u64 vd = rd(inst), vs1 = rs1(inst), vs2 = rs2(inst);
+    u64 vtype = cpu->csr[CS_VTYPE], vl = cpu->csr[CS_VL];
+    if (vtype & VTYPE_VILL)
+        return 0;
+    u64 eb = vsew_bytes(vtype);
+    int lg = vsew_log2(vtype);
+    int lmul = vlmul_log2(vtype);
+    u64 ones = eb == 8 ? ~(u64)0 : (1ull << (eb * 8)) - 1;
+
+    // vmv.x.s / vmv.s.x
+    if (funct6 == 0x10) {
+        if (funct3 == OPMVV && vs1 == 0) {
+            cpu->regs[vd] = vsext(vget(vreg(cpu, vs2), 0, eb), eb);
+            print_op("vmv.x.s");
+            return 1;
+        }
+        if (funct3 == OPMVX && vs2 == 0 && vm) {
+            if (vl)
+                vset(vreg(cpu, vd), 0, eb, cpu->regs[vs1]);
+            print_op("vmv.s.x");
+            return 1;
+        }
+        return 0;
+    }
+
+    // 归约：vd[0] = vs1[0] op vs2[活跃元素]
+    if (funct3 == OPMVV && funct6 <= 0x07) {
+        static const char* names[8] = {
+            "vredsum", "vredand", "vredor", "vredxor",
+            "vredminu", "vredmin", "vredmaxu", "vredmax",
+        };
+        if (!vgroup_ok(vs2, lmul))
+            return 0;
+        if (vl == 0) {
+            print_op(names[funct6]);
+            return 1;
+        }
+        const u8* a = vreg(cpu, vs2);
+        u64 acc = vget(vreg(cpu, vs1), 0, eb);
+        for (u64 i = 0; i < vl; i++) {
+            if (!vm && !vmask(cpu, i))
+                continue;
+            u64 x = vget(a, i, eb);
+            switch (funct6) {
+                case 0x00: acc += x; break;
+                case 0x01: acc &= x; break;
+                case 0x02: acc |= x; break;
+                case 0x03: acc ^= x; break;
+                case 0x04: acc = x < acc ? x : acc; break;
+                case 0x05: acc = vsext(x, eb) < vsext(acc, eb) ? x : acc; break;
+                case 0x06: acc = x > acc ? x : acc; break;
+                case 0x07: acc = vsext(x, eb) > vsext(acc, eb) ? x : acc; break;
+            }
+        }
+        vset(vreg(cpu, vd), 0, eb, acc);
+        print_op(names[funct6]);
+        return 1;
+    }
+
+    if (!vgroup_ok(vd, lmul) || !vgroup_ok(vs2, lmul) || (!vm && vd == 0))
+        return 0;
+
+    u8 sb[VGROUP_MAX] __attribute__((aligned(32)));
+    u8 tmp[VGROUP_MAX] __attribute__((aligned(32)));
+    u8 prod[VGROUP_MAX] __attribute__((aligned(32)));
+    const u8* b;
+    if (funct3 == OPMVV) {
+        if (!vgroup_ok(vs1, lmul))
+            return 0;
+        b = vreg(cpu, vs1);
+    } else {
+        vsplat(sb, vl, eb, cpu->regs[vs1]);
+        b = sb;
+    }
+    const u8* a = vreg(cpu, vs2);
+    u8* dst = vm ? vreg(cpu, vd) : tmp;
+    const char* name;
+
+    switch (funct6) {
+        case 0x25:                                  // vmul
+            vk->iop[VK_MUL][lg](dst, a, b, vl);
+            name = "vmul";
+            break;
+        case 0x2d:                                  // vmacc：vd = vs1 * vs2 + vd
+        case 0x2f:                                  // vnmsac：vd = -(vs1 * vs2) + vd
+            vk->iop[VK_MUL][lg](prod, a, b, vl);
+            vk->iop[funct6 == 0x2d ? VK_ADD : VK_SUB][lg](dst, vreg(cpu, vd), prod, vl);
+            name = funct6 == 0x2d ? "vmacc" : "vnmsac";
+            break;
+        case 0x20:                                  // vdivu
+        case 0x21:                                  // vdiv
+        case 0x22:                                  // vremu
+        case 0x23:                                  // vrem
+            for (u64 i = 0; i < vl; i++) {
+                u64 x = vget(a, i, eb), y = vget(b, i, eb), r;
+                int64_t sx = vsext(x, eb), sy = vsext(y, eb);
+                switch (funct6) {
+                    case 0x20: r = y == 0 ? ones : x / y; break;
+                    case 0x21: r = sy == 0 ? ones
+                                 : (sy == -1 && sx == INT64_MIN) ? x : (u64)(sx / sy); break;
+                    case 0x22: r = y == 0 ? x : x % y; break;
+                    default:   r = sy == 0 ? x
+                                 : (sy == -1 && sx == INT64_MIN) ? 0 : (u64)(sx % sy); break;
+                }
+                vset(dst, i, eb, r);
+            }
+            name = (const char*[]){ "vdivu", "vdiv", "vremu", "vrem" }[funct6 - 0x20];
+            break;
+        default:
+            return 0;
+    }
+    if (!vm)
+        vmerge_mask(cpu, vreg(cpu, vd), tmp, vl, eb);
+    print_op(name);
+    return 1;
+}
+
+/**
+ * 浮点逐元素与归约运算（最值、乘加、归约）按元素类型各生成一份；
+ * NaN 结果统一写回规范 NaN，最值遵循 IEEE 754-2019 minimumNumber/maximumNumber。
+ */
+#define RVV_FP_DEFINE(S, T, I, CANON, FMA)                                  \
+static inline T rvv_f##S##_get(const u8* p, u64 i) {                        \
+    T v;                                                                    \
+    memcpy(&v, p + i * sizeof(T), sizeof(T));                               \
+    return v;                                                               \
+}                                                                           \
+static inline void rvv_f##S##_set(u8* p, u64 i, T v) {                      \
+    if (v != v) { I c = CANON; memcpy(&v, &c, sizeof(T)); }                 \
+    memcpy(p + i * sizeof(T), &v, sizeof(T));                               \
+}                                                                           \
+static inline T rvv_f##S##_minmax(T a, T b, int max) {                      \
+    if (a != a) return b;                                                   \
+    if (b != b) return a;                                                   \
+    if (a == b) return (signbit(a) != 0) == !max ? a : b;                   \
+    return (a < b) == !max ? a : b;                                         \
+}                                                                           \
+static int rvv_f##S##_op(CPU* cpu, u32 funct6, u32 vm, u64 vl,              \
+                         u8* vd, const u8* a, const u8* b, u8* dst) {       \
+    switch (funct6) {                                                       \
+        case 0x04:                                                          \
+        case 0x06:                                                          \
+            for (u64 i = 0; i < vl; i++)                                    \
+                rvv_f##S##_set(dst, i, rvv_f##S##_minmax(rvv_f##S##_get(a, i), \
+                               rvv_f##S##_get(b, i), funct6 == 0x06));      \
+            return 1;                                                       \
+        case 0x2c:                                                          \
+            for (u64 i = 0; i < vl; i++)                                    \
+                rvv_f##S##_set(dst, i, FMA(rvv_f##S##_get(b, i),            \
+                               rvv_f##S##_get(a, i), rvv_f##S##_get(vd, i))); \
+            return 1;                                                       \
+        default:                                                            \
+            return 0;                                                       \
+    }                                                                       \
+}                                                                           \
+static void rvv_f##S##_red(CPU* cpu, u32 funct6, u32 vm, u64 vl,            \
+                           u8* vd, const u8* a, const u8* b) {              \
+    T acc = rvv_f##S##_get(b, 0);                                           \
+    for (u64 i = 0; i < vl; i++) {                                          \
+        if (!vm && !vmask(cpu, i))                                          \
+            continue;                                                       \
+        T x = rvv_f##S##_get(a, i);                                         \
+        acc = funct6 <= 0x03 ? acc + x                                      \
+            : rvv_f##S##_minmax(acc, x, funct6 == 0x07);                    \
+    }                                                                       \
+    rvv_f##S##_set(vd, 0, acc);                                             \
+}
+
+RVV_FP_DEFINE(32, float,  u32, CANON_NAN_S, fmaf)
+RVV_FP_DEFINE(64, double, u64, CANON_NAN_D, fma)
+
+/**
+ * @brief 浮点运算（OPFVV / OPFVF），SEW = 32/64
+ */
+static int rvv_op_fp(CPU* cpu, u32 inst, u32 funct3) {
+    u32 funct6 = inst >> 26;
+    u32 vm = (inst >> 25) & 0x1;
+    u64 vd = rd(inst), vs1 = rs1(inst), vs2 = rs2(inst);
+    u64 vtype = cpu->csr[CS_VTYPE], vl = cpu->csr[CS_VL];
+    if (vtype & VTYPE_VILL)
+        return 0;
+    u64 eb = vsew_bytes(vtype);
+    int lmul = vlmul_log2(vtype);
+    if (eb != 4 && eb != 8)
+        return 0;
+    fpu_sync_rm(cpu);
+
+    // 标量浮点操作数：单精度须为合法 NaN-boxing，否则视为规范 NaN
+    u64 f = cpu->fregs[vs1];
+    if (eb == 4)
+        f = (f & NAN_BOX) == NAN_BOX ? (u32)f : CANON_NAN_S;
+
+    // vfmv.f.s / vfmv.s.f
+    if (funct6 == 0x10) {
+        if (funct3 == OPFVV && vs1 == 0) {
+            u64 v = vget(vreg(cpu, vs2), 0, eb);
+            cpu->fregs[vd] = eb == 4 ? NAN_BOX | v : v;
+            print_op("vfmv.f.s");
+            return 1;
+        }
+        if (funct3 == OPFVF && vs2 == 0 && vm) {
+            if (vl)
+                vset(vreg(cpu, vd), 0, eb, f);
+            print_op("vfmv.s.f");
+            return 1;
+        }
+        return 0;
+    }
+
+    // 归约：vfredusum 与 vfredosum 都按顺序累加（无序求和的合法实现）
+    if (funct3 == OPFVV && (funct6 == 0x01 || funct6 == 0x03 || funct6 == 0x05 || funct6 == 0x07)) {
+        if (!vgroup_ok(vs2, lmul))
+            return 0;
+        if (vl) {
+            if (eb == 4) rvv_f32_red(cpu, funct6, vm, vl, vreg(cpu, vd), vreg(cpu, vs2), vreg(cpu, vs1));
+            else         rvv_f64_red(cpu, funct6, vm, vl, vreg(cpu, vd), vreg(cpu, vs2), vreg(cpu, vs1));
+        }
+        print_op((const char*[]){ "vfredusum", "vfredosum", "vfredmin", "vfredmax" }[funct6 >> 1]);
+        return 1;
+    }
+
+    if (!vgroup_ok(vd, lmul) || !vgroup_ok(vs2, lmul))
+        return 0;
+
+    u8 sb[VGROUP_MAX] __attribute__((aligned(32)));
+    u8 tmp[VGROUP_MAX] __attribute__((aligned(32)));
+    const u8* b;
+    if (funct3 == OPFVV) {
+        if (!vgroup_ok(vs1, lmul))
+            return 0;
+        b = vreg(cpu, vs1);
+    } else {
+        vsplat(sb, vl, eb, f);
+        b = sb;
+    }
+
+    // vfmerge.vfm / vfmv.v.f
+    if (funct6 == 0x17) {
+        if (funct3 != OPFVF)
+            return 0;
+        return rvv_merge(cpu, inst, b, vl, eb);
+    }
+    if (!vm && vd == 0)
+        return 0;
+
+    const u8* a = vreg(cpu, vs2);
+    u8* dst = vm ? vreg(cpu, vd) : tmp;
+    int w = eb == 8;
+    const char* name;
+    switch (funct6) {
+        case 0x00: vk->fop[VK_FADD][w](dst, a, b, vl); name = "vfadd";  break;
+        case 0x02: vk->fop[VK_FSUB][w](dst, a, b, vl); name = "vfsub";  break;
+        case 0x24: vk->fop[VK_FMUL][w](dst, a, b, vl); name = "vfmul";  break;
+        case 0x20: vk->fop[VK_FDIV][w](dst, a, b, vl); name = "vfdiv";  break;
+        case 0x27:
+            if (funct3 != OPFVF) return 0;
+            vk->fop[VK_FSUB][w](dst, b, a, vl); name = "vfrsub"; break;
+        case 0x21:
+            if (funct3 != OPFVF) return 0;
+            vk->fop[VK_FDIV][w](dst, b, a, vl); name = "vfrdiv"; break;
+        default:
+            if (!(w ? rvv_f64_op : rvv_f32_op)(cpu, funct6, vm, vl, vreg(cpu, vd), a, b, dst))
+                return 0;
+            name = funct6 == 0x04 ? "vfmin" : funct6 == 0x06 ? "vfmax" : "vfmacc";
+            break;
+    }
+    if (!vm)
+        vmerge_mask(cpu, vreg(cpu, vd), tmp, vl, eb);
+    print_op(name);
+    return 1;
+}
+
+// ==================================================================== //
+//                            Func API: RVV
+// ==================================================================== //
+
+void rvv_init() {
+    pthread_once(&vk_once, rvv_select_kernels);
+}
+
+void rvv_reset(CPU* cpu) {
+    memset(cpu->vregs, 0, sizeof(cpu->vregs));
+    cpu->csr[CS_VSTART] = 0;
+    cpu->csr[CS_VL]     = 0;
+    cpu->csr[CS_VTYPE]  = VTYPE_VILL;
+}
+
+int rvv_execute(CPU* cpu, u32 inst) {
+    u32 opcode = inst & 0x7f;
+    u32 funct3 = (inst >> 12) & 0x7;
+    int ok = 0;
+    switch (opcode) {
+        case LOAD_FP:   ok = rvv_mem(cpu, inst, 0); break;
+        case STORE_FP:  ok = rvv_mem(cpu, inst, 1); break;
+        case OP_V:
+            switch (funct3) {
+                case OPCFG: ok = rvv_setvl(cpu, inst); break;
+                case OPIVV:
+                case OPIVX:
+                case OPIVI: ok = rvv_op_int(cpu, inst, funct3); break;
+                case OPMVV:
+                case OPMVX: ok = rvv_op_mul(cpu, inst, funct3); break;
+                case OPFVV:
+                case OPFVF: ok = rvv_op_fp(cpu, inst, funct3); break;
+            }
+            break;
+    }
+    if (ok)
+        cpu->csr[CS_VSTART] = 0;
+    return ok;
+}
@@ -0,0 +1,64 @@
+/**
+ * @file rvv.h
+ * @author lancer (lancerstadium@163.com)
+ * @brief RVV 1.0 向量扩展头文件
+ * @version 0.1
+ * @date 2024-01-27
+ * @copyright Copyright (c) 2024
+ *
+ * # 向量扩展介绍
+ * - 32 个向量寄存器`v0 ~ v31`，每个`CPU_VLEN`位，在`CPU`中连续存放，
+ * 因此 LMUL > 1 的寄存器组就是一段连续内存，第 i 个元素位于`vd * VLENB + i * SEW/8`。
+ *
+ * - 支持的指令：
+ * 1. 配置：`vsetvli`、`vsetivli`、`vsetvl`；
+ * 2. 访存：单位步长（含整寄存器、掩码）、跨步与索引加载/存储，EEW = 8/16/32/64；
+ * 3. 整数：加减、逻辑、移位、最值、乘除、乘加、合并与传送，`.vv`/`.vx`/`.vi`；
+ * 4. 浮点：加减乘除、最值、乘加、合并与传送，`.vv`/`.vf`，SEW = 32/64；
+ * 5. 归约：整数与浮点归约，以及`vmv.x.s`/`vmv.s.x`/`vfmv.f.s`/`vfmv.s.f`。
+ *
+ * - 逐元素运算交给按主机 CPU 特性选择的核函数：同一份核函数用 GCC 向量扩展编写，
+ * 分别以`target("avx2")`、`target("sse4.1")`编译，另有标量版本兜底，
+ * 在`rvv_init()`中用`__builtin_cpu_supports()`选择一次。
+ * `.vx`/`.vi`形式先把标量广播到临时缓冲区，再复用`.vv`核函数；
+ * 带掩码（vm = 0）时先算到临时缓冲区，再按 v0 合并。
+ *
+ * - 尾部与被屏蔽元素一律保持不变（undisturbed），对 agnostic 策略同样合法；
+ * `vstart`始终为 0。
+ */
+
+
+#ifndef RVV_H
+#define RVV_H
+
+// ==================================================================== //
+//                             Include
+// ==================================================================== //
+
+#include "cpu.h"
+
+// ==================================================================== //
+//                            Declare API: RVV
+// ==================================================================== //
+
+/**
+ * @brief 按主机 CPU 特性选择向量核函数（可重复调用，只选择一次）
+ */
+void rvv_init();
+
+/**
+ * @brief 复位向量状态：vl = 0，vtype = vill，清空向量寄存器
+ * @param cpu 中央处理器
+ */
+void rvv_reset(CPU* cpu);
+
+/**
+ * @brief 执行一条向量指令（OP-V，以及 width = 0/5/6/7 的 LOAD-FP/STORE-FP）
+ * @param cpu 中央处理器
+ * @param inst 32-bit 指令数据
+ * @return int 1 成功，0 非法指令
+ */
+int rvv_execute(CPU* cpu, u32 inst);
+
+
+#endif // RVV_H
@@ -0,0 +1,206 @@
+/**
+ * @file snapshot.c
+ * @author lancer (lancerstadium@163.com)
+ * @brief 机器快照实现
+ * @version 0.1
+ * @date 2024-02-04
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+// ==================================================================== //
+//                              Include
+// ==================================================================== //
+
+#include "snapshot.h"
+#include "log.h"
+#include "macro.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+
+// ==================================================================== //
+//                         Private Func: SNAPSHOT
+// ==================================================================== //
+
+#define SNAPSHOT_PAGE   4096        /** 判断全 0 页（文件空洞）的粒度 */
+
+static inline u64 snapshot_align(u64 off) {
+    return (off + SNAPSHOT_ALIGN - 1) & ~(u64)(SNAPSHOT_ALIGN - 1);
+}
+
+static int snapshot_pwrite(int fd, void* buf, size_t len, u64 off) {
+    while (len > 0) {
+        ssize_t n = pwrite(fd, buf, len, off);
+        if (n <= 0)
+            return -1;
+        buf = (u8*)buf + n;
+        len -= n;
+        off += n;
+    }
+    return 0;
+}
+
+static int snapshot_pread(int fd, void* buf, size_t len, u64 off) {
+    while (len > 0) {
+        ssize_t n = pread(fd, buf, len, off);
+        if (n <= 0)
+            return -1;
+        buf = (u8*)buf + n;
+        len -= n;
+        off += n;
+    }
+    return 0;
+}
+
+/** 写入处理器段与 DRAM 段（全 0 的页跳过，留作空洞） */
+static int snapshot_write_body(MACHINE* m, int fd, SNAPSHOT_HDR* hdr) {
+    static const u8 zero[SNAPSHOT_PAGE];
+    for (int i = 0; i < m->nhart; i++) {
+        CPU* cpu = m->harts[i];
+        SNAPSHOT_HART h = { .pc = cpu->pc, .instret = cpu->instret, .seg = cpu->seg, .priv = cpu->priv, .xlen = cpu->xlen };
+        memcpy(h.regs, cpu->regs, sizeof(h.regs));
+        memcpy(h.fregs, cpu->fregs, sizeof(h.fregs));
+        memcpy(h.vregs, cpu->vregs, sizeof(h.vregs));
+        memcpy(h.csr, cpu->csr, sizeof(h.csr));
+        if (snapshot_pwrite(fd, &h, sizeof(h), hdr->hart_off + i * hdr->hart_size) < 0)
+            return -1;
+    }
+    u8* mem = m->bus.dram.mem_addr;
+    for (u64 off = 0; off < DRAM_SIZE; off += SNAPSHOT_PAGE) {
+        if (memcmp(mem + off, zero, SNAPSHOT_PAGE) == 0)
+            continue;
+        if (snapshot_pwrite(fd, mem + off, SNAPSHOT_PAGE, hdr->dram_off + off) < 0)
+            return -1;
+    }
+    // 末尾的全 0 页同样是空洞
+    return ftruncate(fd, hdr->dram_off + DRAM_SIZE);
+}
+
+
+// ==================================================================== //
+//                           Func API: SNAPSHOT
+// ==================================================================== //
+
+int snapshot_save(MACHINE* m, char* path) {
+    if (sysconf(_SC_PAGESIZE) > SNAPSHOT_ALIGN) {
+        log_error("Snapshot: host page larger than %d", SNAPSHOT_ALIGN);
+        return -1;
+    }
+    if (m->bus.ndev > 1)
+        log_warn("Snapshot: %d host-backed devices are not saved", m->bus.ndev - 1);
+    SNAPSHOT_HDR hdr = {
+        .magic = SNAPSHOT_MAGIC,
+        .version = SNAPSHOT_VERSION,
+        .nhart = m->nhart,
+        .hart_off = snapshot_align(sizeof(SNAPSHOT_HDR)),
+        .hart_size = sizeof(SNAPSHOT_HART),
+        .dram_size = DRAM_SIZE,
+        .alloc_size = m->bus.dram.alloc_size,
+        .quantum = m->quantum,
+        .vinsn = m->vinsn,
+        .irq_pending = __atomic_load_n(&m->bus.irq_pending, __ATOMIC_ACQUIRE),
+        .mtime = clint_mtime(&m->clint),
+        .proc_user = m->proc.user,
+        .brk_start = m->proc.brk_start,
+        .brk = m->proc.brk,
+        .mmap_top = m->proc.mmap_top,
+        .mmap_cur = m->proc.mmap_cur,
+    };
+    hdr.dram_off = snapshot_align(hdr.hart_off + m->nhart * hdr.hart_size);
+    memcpy(hdr.mtimecmp, m->clint.mtimecmp, sizeof(hdr.mtimecmp));
+    memcpy(hdr.msip, m->clint.msip, sizeof(hdr.msip));
+
+    // 先写临时文件：正在从旧快照运行的机器仍映射着旧文件
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        log_error("Snapshot: unable to create %s", tmp);
+        return -1;
+    }
+    int ret = snapshot_pwrite(fd, &hdr, sizeof(hdr), 0) == 0 && snapshot_write_body(m, fd, &hdr) == 0 ? 0 : -1;
+    if (close(fd) < 0)
+        ret = -1;
+    if (ret == 0 && rename(tmp, path) < 0)
+        ret = -1;
+    if (ret < 0) {
+        log_error("Snapshot: write %s failed", path);
+        unlink(tmp);
+        return -1;
+    }
+    log_info("Snapshot saved: %s (%d harts, pc %#lx)", path, m->nhart, m->harts[0]->pc);
+    return 0;
+}
+
+int snapshot_load(MACHINE* m, char* path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        log_error("Snapshot: unable to open %s", path);
+        return -1;
+    }
+    SNAPSHOT_HDR hdr;
+    SNAPSHOT_HART harts[BUS_MAX_HART];
+    if (snapshot_pread(fd, &hdr, sizeof(hdr), 0) < 0 || hdr.magic != SNAPSHOT_MAGIC
+        || hdr.version != SNAPSHOT_VERSION || hdr.nhart < 1 || hdr.nhart > BUS_MAX_HART
+        || hdr.hart_size != sizeof(SNAPSHOT_HART) || hdr.dram_size != DRAM_SIZE
+        || hdr.dram_off % sysconf(_SC_PAGESIZE) != 0) {
+        log_error("Snapshot: %s is not a compatible snapshot", path);
+        close(fd);
+        return -1;
+    }
+    // DRAM 段按 MAP_PRIVATE 映射，文件短于 dram_off + dram_size 时访问末尾会触发 SIGBUS
+    struct stat st;
+    u64 harts_end = hdr.hart_off + hdr.nhart * sizeof(SNAPSHOT_HART);
+    if (fstat(fd, &st) < 0 || hdr.hart_off < sizeof(hdr) || hdr.hart_off > hdr.dram_off
+        || harts_end > hdr.dram_off || hdr.alloc_size > hdr.dram_size
+        || (u64)st.st_size < hdr.dram_off || (u64)st.st_size - hdr.dram_off < hdr.dram_size) {
+        log_error("Snapshot: %s is truncated", path);
+        close(fd);
+        return -1;
+    }
+    if (snapshot_pread(fd, harts, hdr.nhart * sizeof(SNAPSHOT_HART), hdr.hart_off) < 0) {
+        log_error("Snapshot: %s is truncated", path);
+        close(fd);
+        return -1;
+    }
+
+    machine_init(m, hdr.nhart);
+    machine_set_quantum(m, hdr.quantum);
+    m->vinsn = hdr.vinsn;
+    // 映射建立后即可关闭文件
+    int ret = dram_map_file(&m->bus.dram, fd, hdr.dram_off, hdr.alloc_size);
+    close(fd);
+    if (ret < 0) {
+        machine_free(m);
+        return -1;
+    }
+    for (int i = 0; i < m->nhart; i++) {
+        CPU* cpu = m->harts[i];
+        SNAPSHOT_HART* h = &harts[i];
+        memcpy(cpu->regs, h->regs, sizeof(h->regs));
+        memcpy(cpu->fregs, h->fregs, sizeof(h->fregs));
+        memcpy(cpu->vregs, h->vregs, sizeof(h->vregs));
+        memcpy(cpu->csr, h->csr, sizeof(h->csr));
+        cpu->pc = h->pc;
+        cpu->instret = h->instret;
+        cpu->seg = h->seg;
+        cpu->priv = h->priv;
+        cpu_set_xlen(cpu, h->xlen);
+    }
+    memcpy(m->clint.mtimecmp, hdr.mtimecmp, sizeof(hdr.mtimecmp));
+    memcpy(m->clint.msip, hdr.msip, sizeof(hdr.msip));
+    clint_set_mtime(&m->clint, hdr.mtime);
+    m->bus.irq_pending = hdr.irq_pending;
+    m->proc.user = hdr.proc_user;
+    m->proc.brk_start = hdr.brk_start;
+    m->proc.brk = hdr.brk;
+    m->proc.mmap_top = hdr.mmap_top;
+    m->proc.mmap_cur = hdr.mmap_cur;
+    log_info("Snapshot loaded: %s (%d harts, pc %#lx)", path, m->nhart, m->harts[0]->pc);
+    return 0;
+}
@@ -0,0 +1,126 @@
+/**
+ * @file snapshot.h
+ * @author lancer (lancerstadium@163.com)
+ * @brief 机器快照头文件
+ * @version 0.1
+ * @date 2024-02-04
+ * @copyright Copyright (c) 2024
+ *
+ * # 快照介绍
+ * - 快照保存整台机器的状态：每个处理器的寄存器、浮点与向量寄存器、pc、CSR、特权级，
+ * CLINT（mtime、mtimecmp、msip）、总线上挂起的中断、用户态进程的堆与 mmap 区，以及整段 DRAM。
+ * 启动一次、保存快照之后，可以从同一个文件热启动任意多次。
+ *
+ * - 文件格式：各段起始位置按`SNAPSHOT_ALIGN`对齐，DRAM 段可以直接`mmap`：
+ * ```
+ *
+ *   +--------------------+  0
+ *   |   SNAPSHOT_HDR     |  魔数、版本、各段位置、机器与 CLINT 状态
+ *   +--------------------+  hart_off
+ *   | SNAPSHOT_HART[n]   |  每个处理器一项
+ *   +--------------------+  dram_off
+ *   |   DRAM_SIZE 字节   |  全 0 的页不写入（稀疏文件的空洞）
+ *   +--------------------+
+ *
+ * ```
+ * 字段以主机字节序保存，快照只在同一架构的主机之间通用；
+ * `hart_size`与`dram_size`不符（CSR 槽、向量长度或 DRAM 大小不同）的快照拒绝恢复。
+ *
+ * - 恢复时 DRAM 段以`MAP_PRIVATE`映射到来宾内存（见`dram_map_file()`），而不是读入：
+ * 恢复耗时与 DRAM 大小无关，页在来宾访问时才从页缓存读入，
+ * 从同一快照恢复的多个机器共用未被写过的页，写入时各自写时复制。
+ *
+ * - 保存先写临时文件再`rename()`，正在从旧快照运行的机器映射的仍是旧文件，不受影响。
+ *
+ * - 不保存的状态：挂载在总线上、连接主机资源的设备（数据通道、进程外设备等）
+ * 及其描述符，恢复后需要重新挂载；用户态进程打开的文件，恢复后只剩标准输入输出，
+ * 主线程之外的线程不保存；
+ * LR 保留在恢复后失效。
+ */
+
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+// ==================================================================== //
+//                             Include
+// ==================================================================== //
+
+#include "machine.h"
+
+// ==================================================================== //
+//                              Defines
+// ==================================================================== //
+
+#define SNAPSHOT_MAGIC      0x70616e73756d6563  /** "cemusnap" */
+#define SNAPSHOT_VERSION    2
+#define SNAPSHOT_ALIGN      0x10000     /** 段对齐：64 KB，不小于常见主机页大小 */
+
+
+// ==================================================================== //
+//                            Data: SNAPSHOT
+// ==================================================================== //
+
+/**
+ * @brief 快照文件头
+ */
+typedef struct SNAPSHOT_HDR_t {
+    u64 magic;                      /** SNAPSHOT_MAGIC */
+    u32 version;                    /** SNAPSHOT_VERSION */
+    u32 nhart;                      /** 处理器个数 */
+    u64 hart_off;                   /** 处理器段偏移 */
+    u64 hart_size;                  /** 每个处理器项的大小 */
+    u64 dram_off;                   /** DRAM 段偏移 */
+    u64 dram_size;                  /** DRAM 段大小 */
+    u64 alloc_size;                 /** DRAM 中已加载映像的大小 */
+    u64 quantum;                    /** 确定性时间片 */
+    u64 vinsn;                      /** 虚拟时钟中不足一个节拍的指令数 */
+    u64 irq_pending;                /** 总线挂起的中断位图 */
+    u64 mtime;                      /** 保存时的 mtime */
+    u64 mtimecmp[BUS_MAX_HART];     /** 定时器比较值 */
+    u32 msip[BUS_MAX_HART];         /** 软件中断挂起 */
+    u64 proc_user;                  /** 1：用户态进程 */
+    u64 brk_start;                  /** 用户态进程的堆与 mmap 区 */
+    u64 brk;
+    u64 mmap_top;
+    u64 mmap_cur;
+} SNAPSHOT_HDR;
+
+/**
+ * @brief 处理器状态（不含指向总线、译码表等主机对象的指针）
+ */
+typedef struct SNAPSHOT_HART_t {
+    u64 regs[32];
+    u64 pc;
+    u64 fregs[32];
+    u8 vregs[32 * CPU_VLENB];
+    u64 csr[CS_NUM];
+    u64 instret;
+    u64 seg;
+    u32 priv;
+    u32 xlen;
+} SNAPSHOT_HART;
+
+
+// ==================================================================== //
+//                          Declare API: SNAPSHOT
+// ==================================================================== //
+
+/**
+ * @brief 保存机器快照（机器须已停止，处理器不在运行）
+ * @param m 机器
+ * @param path 快照文件
+ * @return int 0 成功，-1 失败
+ */
+int snapshot_save(MACHINE* m, char* path);
+
+/**
+ * @brief 从快照恢复机器：按快照中的处理器个数初始化`m`，并映射 DRAM 段
+ * @param m 机器（未初始化或已释放）
+ * @param path 快照文件
+ * @return int 0 成功，-1 失败（此时`m`未初始化）
+ */
+int snapshot_load(MACHINE* m, char* path);
+
+
+#endif // SNAPSHOT_H
@@ -0,0 +1,1089 @@
+/**
+ * @file unit.h
+ * @author lancer (lancerstadium@163.com)
+ * @brief cemu 单元测试：`cemu test`
+ * @version 0.1
+ * @date 2024-03-20
+ * @copyright Copyright (c) 2024
+ * @note
+ * - 每个测试把一段来宾机器码写到`DRAM_BASE`，所有处理器从这里开始执行（`a0`为
+ * 处理器编号），以`jalr zero, 0(zero)`跳到 0 结束，结果写在`DRAM_BASE + UNIT_DATA`。
+ * - 机器码由注释中的汇编经`llvm-mc`汇编得到，链接地址为`DRAM_BASE`。
+ */
+
+
+#ifndef UNIT_H
+#define UNIT_H
+
+// ==================================================================== //
+//                             Include
+// ==================================================================== //
+
+#include "machine.h"
+#include "csr.h"
+#include "fpu.h"
+#include "chan.h"
+#include "rdev.h"
+#include "vnet.h"
+#include "vblk.h"
+#include "utils.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// ==================================================================== //
+//                              Defines
+// ==================================================================== //
+
+#define UNIT_DATA       0x400       /** 结果区相对 DRAM_BASE 的偏移 */
+#define UNIT_LEN(a)     (sizeof(a) / sizeof((a)[0]))
+#define UNIT_VQ_NUM     8           /** 测试驱动的虚拟队列长度 */
+
+// ==================================================================== //
+//                          Private Func: Unit
+// ==================================================================== //
+
+/**
+ * @brief 建立测试机器并写入机器码
+ * @param nhart 处理器个数
+ * @param quantum 确定性时间片，0 为各处理器自由并行
+ */
+static MACHINE* unit_machine(int nhart, u64 quantum, const u32* code, int n) {
+    MACHINE* m = malloc(sizeof(MACHINE));
+    machine_init(m, nhart);
+    machine_set_quantum(m, quantum);
+    for (int i = 0; i < n; i++)
+        bus_store(&m->bus, DRAM_BASE + 4 * i, 32, code[i]);
+    return m;
+}
+
+/** 读取结果区的 32 位字 */
+static u32 unit_word(MACHINE* m, u64 off) {
+    return bus_load(&m->bus, DRAM_BASE + UNIT_DATA + off, 32);
+}
+
+/** 读取结果区的 64 位字 */
+static u64 unit_dword(MACHINE* m, u64 off) {
+    return bus_load(&m->bus, DRAM_BASE + UNIT_DATA + off, 64);
+}
+
+static void unit_free(MACHINE* m) {
+    machine_free(m);
+    free(m);
+}
+
+/** 写 virtio-mmio 寄存器 */
+static void unit_mmio(MACHINE* m, u64 base, u64 reg, u32 value) {
+    bus_store(&m->bus, base + reg, 32, value);
+}
+
+/**
+ * @brief 充当 virtio 驱动：在来宾物理地址`gpa`处建立一个队列
+ * （描述符表 +0，可用环 +0x400，已用环 +0x800）
+ */
+static void unit_vq_init(MACHINE* m, u64 base, u32 queue, u64 gpa) {
+    unit_mmio(m, base, VIRTIO_MMIO_QUEUE_SEL, queue);
+    unit_mmio(m, base, VIRTIO_MMIO_QUEUE_NUM, UNIT_VQ_NUM);
+    unit_mmio(m, base, VIRTIO_MMIO_QUEUE_DESC_LOW, gpa);
+    unit_mmio(m, base, VIRTIO_MMIO_QUEUE_AVAIL_LOW, gpa + 0x400);
+    unit_mmio(m, base, VIRTIO_MMIO_QUEUE_USED_LOW, gpa + 0x800);
+    unit_mmio(m, base, VIRTIO_MMIO_QUEUE_READY, 1);
+}
+
+/**
+ * @brief 放入一条描述符链并 kick
+ * @param buf 各段来宾物理地址
+ * @param len 各段长度
+ * @param flags 各段标志（`VIRTQ_DESC_F_WRITE`为设备可写）
+ * @param n 段数
+ */
+static void unit_vq_add(MACHINE* m, u64 base, u32 queue, u64 gpa, u64* buf, u32* len, u16* flags, int n) {
+    BUS* bus = &m->bus;
+    u16 idx = bus_load(bus, gpa + 0x402, 16);
+    u16 head = (idx * n) % UNIT_VQ_NUM;
+    for (int i = 0; i < n; i++) {
+        u64 d = gpa + 16 * ((head + i) % UNIT_VQ_NUM);
+        bus_store(bus, d, 64, buf[i]);
+        bus_store(bus, d + 8, 32, len[i]);
+        bus_store(bus, d + 12, 16, flags[i] | (i + 1 < n ? VIRTQ_DESC_F_NEXT : 0));
+        bus_store(bus, d + 14, 16, (head + i + 1) % UNIT_VQ_NUM);
+    }
+    bus_store(bus, gpa + 0x404 + 2 * (idx % UNIT_VQ_NUM), 16, head);
+    bus_store(bus, gpa + 0x402, 16, (u16)(idx + 1));
+    unit_mmio(m, base, VIRTIO_MMIO_QUEUE_NOTIFY, queue);
+}
+
+/** 已用环的 idx 与第 i 项写入的长度 */
+static u16 unit_vq_used(MACHINE* m, u64 gpa) {
+    return bus_load(&m->bus, gpa + 0x802, 16);
+}
+static u32 unit_vq_used_len(MACHINE* m, u64 gpa, int i) {
+    return bus_load(&m->bus, gpa + 0x804 + 8 * (i % UNIT_VQ_NUM) + 4, 32);
+}
+
+// ==================================================================== //
+//                            Unit: FPU
+// ==================================================================== //
+
+/**
+ * 两个处理器轮转共用一个主机浮点环境：0 号处理器 frm=RTZ 并反复触发除零，
+ * 1 号处理器 frm=RNE；各自计算 200 次 1.0f/3.0f，记录结果不符的次数与最终 fflags
+ *   结果区：hart*16 + 0 不符次数，+4 fflags，+8 完成标志
+ */
+static const u32 unit_fpu_det_code[] = {
+    0x00100493,   // li s1, 1
+    0x01f49493,   // slli s1, s1, 31
+    0x40048493,   // addi s1, s1, 1024
+    0x00051a63,   // bnez a0, <_start+0x20>
+    0x0020d073,   // fsrmi 1
+    0x3eaab937,   // lui s2, 256683
+    0xaaa9091b,   // addiw s2, s2, -1366
+    0x0100006f,   // j <_start+0x2c>
+    0x00205073,   // fsrmi 0
+    0x3eaab937,   // lui s2, 256683
+    0xaab9091b,   // addiw s2, s2, -1365
+    0x3f8002b7,   // lui t0, 260096
+    0xf00280d3,   // fmv.w.x ft1, t0
+    0x00300293,   // li t0, 3
+    0xd002f153,   // fcvt.s.w ft2, t0
+    0xf00001d3,   // fmv.w.x ft3, zero
+    0x0c800313,   // li t1, 200
+    0x00000993,   // li s3, 0
+    0x1820f253,   // fdiv.s ft4, ft1, ft2
+    0xe00203d3,   // fmv.x.w t2, ft4
+    0x01238463,   // beq t2, s2, <_start+0x58>
+    0x00198993,   // addi s3, s3, 1
+    0x00051463,   // bnez a0, <_start+0x60>
+    0x1830f2d3,   // fdiv.s ft5, ft1, ft3
+    0xfff30313,   // addi t1, t1, -1
+    0xfe0312e3,   // bnez t1, <_start+0x48>
+    0x00102e73,   // frflags t3
+    0x00451e93,   // slli t4, a0, 4
+    0x01d48eb3,   // add t4, s1, t4
+    0x013ea023,   // sw s3, 0(t4)
+    0x01cea223,   // sw t3, 4(t4)
+    0x0ff0000f,   // fence
+    0x00100f13,   // li t5, 1
+    0x01eea423,   // sw t5, 8(t4)
+    0x00051663,   // bnez a0, <_start+0x94>
+    0x0184af03,   // lw t5, 24(s1)
+    0xfe0f0ee3,   // beqz t5, <_start+0x8c>
+    0x00000067,   // jr zero
+};
+
+ut_def_test(fpu_det, {
+    MACHINE* m = unit_machine(2, 7, unit_fpu_det_code, UNIT_LEN(unit_fpu_det_code));
+    machine_run(m);
+    ut_assert(unit_word(m, 0x00) == 0, "hart 0 rounds 1/3 toward zero\n");
+    ut_assert(unit_word(m, 0x10) == 0, "hart 1 rounds 1/3 to nearest\n");
+    ut_assert(unit_word(m, 0x04) == (FFLAGS_DZ | FFLAGS_NX), "hart 0 fflags: DZ NX\n");
+    ut_assert(unit_word(m, 0x14) == FFLAGS_NX, "hart 1 fflags: NX only\n");
+    unit_free(m);
+})
+
+/**
+ * 直接执行单条浮点指令：保留的舍入模式（静态 5、6，DYN 时 frm 为 5~7）是非法指令；
+ * 写浮点寄存器或置位 fflags 把 mstatus.FS 置为 Dirty，读 mstatus 时 SD 随之置位，
+ * 只读浮点状态的指令不改变 FS
+ */
+#define UNIT_FADD_S(rm)     (0x00208053 | (rm) << 12)   // fadd.s ft0, ft1, ft2, rm
+#define UNIT_FCVT_W_S(rm)   (0xc0008553 | (rm) << 12)   // fcvt.w.s a0, ft1, rm
+#define UNIT_FMADD_S(rm)    (0x18208043 | (rm) << 12)   // fmadd.s ft0, ft1, ft2, ft3, rm
+#define UNIT_FSGNJ_S        0x20208053                  // fsgnj.s ft0, ft1, ft2
+#define UNIT_FEQ_S          0xa020a553                  // feq.s a0, ft1, ft2
+#define UNIT_FMV_X_W        0xe0008553                  // fmv.x.w a0, ft1
+
+static int unit_fs_dirty(CPU* cpu) {
+    return (cpu->csr[CS_MSTATUS] & MSTATUS_FS) == MSTATUS_FS
+        && (csr_read(cpu, MSTATUS) & MSTATUS_SD);
+}
+
+ut_def_test(fpu_rm, {
+    MACHINE* m = unit_machine(1, 0, NULL, 0);
+    CPU* cpu = m->harts[0];
+    for (u32 rm = 0; rm < 7; rm++) {
+        int legal = rm <= FRM_RMM;
+        ut_assert(fpu_execute(cpu, UNIT_FADD_S(rm)) == legal, "fadd.s rm %u legal: %d\n", rm, legal);
+        ut_assert(fpu_execute(cpu, UNIT_FCVT_W_S(rm)) == legal, "fcvt.w.s rm %u legal: %d\n", rm, legal);
+        ut_assert(fpu_execute(cpu, UNIT_FMADD_S(rm)) == legal, "fmadd.s rm %u legal: %d\n", rm, legal);
+    }
+    for (u32 frm = 0; frm < 8; frm++) {
+        int legal = frm <= FRM_RMM;
+        cpu->csr[CS_FRM] = frm;
+        ut_assert(fpu_execute(cpu, UNIT_FADD_S(FRM_DYN)) == legal, "fadd.s dyn, frm %u legal: %d\n", frm, legal);
+    }
+    ut_assert(fpu_execute(cpu, UNIT_FSGNJ_S) == 1, "fsgnj.s ignores frm\n");
+    cpu->csr[CS_FRM] = FRM_RNE;
+
+    // FS = Initial：只读浮点状态的指令不改变 FS
+    cpu->csr[CS_MSTATUS] = (cpu->csr[CS_MSTATUS] & ~MSTATUS_FS) | (u64)1 << 13;
+    fpu_execute(cpu, UNIT_FMV_X_W);
+    ut_assert(!unit_fs_dirty(cpu), "fmv.x.w keeps FS clean\n");
+    fpu_execute(cpu, UNIT_FSGNJ_S);
+    ut_assert(unit_fs_dirty(cpu), "fsgnj.s sets FS dirty and SD\n");
+    // 只置位 fflags：feq.s 比较 sNaN
+    cpu->csr[CS_MSTATUS] = (cpu->csr[CS_MSTATUS] & ~MSTATUS_FS) | (u64)1 << 13;
+    cpu->fregs[1] = cpu->fregs[2] = 0xffffffff7f800001ull;
+    fpu_execute(cpu, UNIT_FEQ_S);
+    ut_assert(unit_fs_dirty(cpu), "feq.s on sNaN sets FS dirty\n");
+    unit_free(m);
+})
+
+// ==================================================================== //
+//                            Unit: A
+// ==================================================================== //
+
+/**
+ * 四个处理器各做 5000 次 amoadd.w 与 5000 次 LR/SC 自增（lr.w.rl），
+ * 0 号处理器等待完成计数到 4 后结束
+ *   结果区：+0 amoadd 计数，+8 LR/SC 计数，+16 完成计数
+ */
+static const u32 unit_lrsc_code[] = {
+    0x00100493,   // li s1, 1
+    0x01f49493,   // slli s1, s1, 31
+    0x40048493,   // addi s1, s1, 1024
+    0x00001337,   // lui t1, 1
+    0x3883031b,   // addiw t1, t1, 904
+    0x00100393,   // li t2, 1
+    0x0074a02f,   // amoadd.w zero, t2, (s1)
+    0x00848293,   // addi t0, s1, 8
+    0x1202ae2f,   // lr.w.rl t3, (t0)
+    0x001e0e13,   // addi t3, t3, 1
+    0x19c2aeaf,   // sc.w t4, t3, (t0)
+    0xfe0e9ae3,   // bnez t4, <_start+0x20>
+    0xfff30313,   // addi t1, t1, -1
+    0xfe0312e3,   // bnez t1, <_start+0x18>
+    0x01048293,   // addi t0, s1, 16
+    0x0672a02f,   // amoadd.w.aqrl zero, t2, (t0)
+    0x00051863,   // bnez a0, <_start+0x50>
+    0x0104ae03,   // lw t3, 16(s1)
+    0x00400e93,   // li t4, 4
+    0xffde1ce3,   // bne t3, t4, <_start+0x44>
+    0x00000067,   // jr zero
+};
+
+ut_def_test(lrsc_smp, {
+    // 自由并行（四个主机线程）与确定性轮转各跑一次
+    for (int q = 0; q <= 3; q += 3) {
+        MACHINE* m = unit_machine(4, q, unit_lrsc_code, UNIT_LEN(unit_lrsc_code));
+        machine_run(m);
+        ut_assert(unit_word(m, 0) == 4 * 5000, "amoadd.w count\n");
+        ut_assert(unit_word(m, 8) == 4 * 5000, "lr/sc count\n");
+        unit_free(m);
+    }
+})
+
+/**
+ * 保留按字比较值：写同一缓存行的其它字后 SC 成功，改写保留的字后 SC 失败
+ *   结果区：+0 最终值，+8 第一次 SC 结果，+12 第二次 SC 结果
+ */
+static const u32 unit_lrsc_word_code[] = {
+    0x00100493,   // li s1, 1
+    0x01f49493,   // slli s1, s1, 31
+    0x40048493,   // addi s1, s1, 1024
+    0x00700293,   // li t0, 7
+    0x1004a32f,   // lr.w t1, (s1)
+    0x0054a223,   // sw t0, 4(s1)
+    0x1854a3af,   // sc.w t2, t0, (s1)
+    0x0074a423,   // sw t2, 8(s1)
+    0x1004a32f,   // lr.w t1, (s1)
+    0x00130e13,   // addi t3, t1, 1
+    0x01c4a023,   // sw t3, 0(s1)
+    0x1854a3af,   // sc.w t2, t0, (s1)
+    0x0074a623,   // sw t2, 12(s1)
+    0x00000067,   // jr zero
+};
+
+ut_def_test(lrsc_word, {
+    MACHINE* m = unit_machine(1, 0, unit_lrsc_word_code, UNIT_LEN(unit_lrsc_word_code));
+    machine_run(m);
+    ut_assert(unit_word(m, 8) == 0, "sc.w succeeds after a store to another word\n");
+    ut_assert(unit_word(m, 12) == 1, "sc.w fails after the reserved word changed\n");
+    ut_assert(unit_word(m, 0) == 8, "failed sc.w does not store\n");
+    unit_free(m);
+})
+
+// ==================================================================== //
+//                            Unit: RVV
+// ==================================================================== //
+
+/**
+ * 向量扩展已知答案（VLEN = 256）：vsetvli/vsetvl 的 vl 与 VLMAX、非法 vtype，
+ * 13 个元素的 e32 加法、v0 掩码加法与（带掩码的）归约；输入 a[i] = 3i - 20 在 +0x400，
+ * b[i] = 100 - 7i 在 +0x800，掩码 0x1555
+ *   结果区：+0 ~ +20 各次 vl，+24 vill，+28 vredsum，+32 掩码 vredsum，+36 vredmax，
+ *   +0x100 vadd.vv，+0x140 掩码 vadd.vv（非活跃元素为 7）
+ */
+static const u32 unit_rvv_code[] = {
+    0x00100493,   // li s1, 1
+    0x01f49493,   // slli s1, s1, 31
+    0x40048493,   // addi s1, s1, 1024
+    0x40048913,   // addi s2, s1, 1024
+    0x40090993,   // addi s3, s2, 1024
+    0x00d00513,   // li a0, 13
+    0x0d1572d7,   // vsetvli t0, a0, e32, m2, ta, ma
+    0x0054a023,   // sw t0, 0(s1)
+    0x0d107357,   // vsetvli t1, zero, e32, m2, ta, ma
+    0x0064a223,   // sw t1, 4(s1)
+    0x0c307357,   // vsetvli t1, zero, e8, m8, ta, ma
+    0x0064a423,   // sw t1, 8(s1)
+    0x06400593,   // li a1, 100
+    0x0d85f357,   // vsetvli t1, a1, e64, m1, ta, ma
+    0x0064a623,   // sw t1, 12(s1)
+    0x01200e13,   // li t3, 18
+    0x81c07357,   // vsetvl t1, zero, t3
+    0x0064a823,   // sw t1, 16(s1)
+    0x0df5f357,   // vsetvli t1, a1, e64, mf2, ta, ma
+    0x0064aa23,   // sw t1, 20(s1)
+    0xc21023f3,   // csrr t2, vtype
+    0x03f3d393,   // srli t2, t2, 63
+    0x0074ac23,   // sw t2, 24(s1)
+    0x000013b7,   // lui t2, 1
+    0x5553839b,   // addiw t2, t2, 1365
+    0xcc80f057,   // vsetivli zero, 1, e16, m1, ta, ma
+    0x4203e057,   // vmv.s.x v0, t2
+    0x0d1572d7,   // vsetvli t0, a0, e32, m2, ta, ma
+    0x02096107,   // vle32.v v2, (s2)
+    0x0209e207,   // vle32.v v4, (s3)
+    0x02220357,   // vadd.vv v6, v2, v4
+    0x10048e93,   // addi t4, s1, 256
+    0x020ee327,   // vse32.v v6, (t4)
+    0x5e03b457,   // vmv.v.i v8, 7
+    0x00220457,   // vadd.vv v8, v2, v4, v0.t
+    0x14048e93,   // addi t4, s1, 320
+    0x020ee427,   // vse32.v v8, (t4)
+    0x02222557,   // vredsum.vs v10, v2, v4
+    0x42a027d7,   // vmv.x.s a5, v10
+    0x00f4ae23,   // sw a5, 28(s1)
+    0x00222557,   // vredsum.vs v10, v2, v4, v0.t
+    0x42a027d7,   // vmv.x.s a5, v10
+    0x02f4a023,   // sw a5, 32(s1)
+    0x1e412557,   // vredmax.vs v10, v4, v2
+    0x42a027d7,   // vmv.x.s a5, v10
+    0x02f4a223,   // sw a5, 36(s1)
+    0x00000067,   // jr zero
+};
+
+ut_def_test(rvv_known, {
+    MACHINE* m = unit_machine(1, 0, unit_rvv_code, UNIT_LEN(unit_rvv_code));
+    int32_t a[16], b[16];
+    for (int i = 0; i < 16; i++) {
+        a[i] = 3 * i - 20;
+        b[i] = 100 - 7 * i;
+        bus_store(&m->bus, DRAM_BASE + UNIT_DATA + 0x400 + 4 * i, 32, a[i]);
+        bus_store(&m->bus, DRAM_BASE + UNIT_DATA + 0x800 + 4 * i, 32, b[i]);
+    }
+    machine_run(m);
+    ut_assert(unit_word(m, 0) == 13, "vsetvli: vl = avl below VLMAX\n");
+    ut_assert(unit_word(m, 4) == 16, "vsetvli: VLMAX e32 m2\n");
+    ut_assert(unit_word(m, 8) == 256, "vsetvli: VLMAX e8 m8\n");
+    ut_assert(unit_word(m, 12) == 4, "vsetvli: vl clamped to VLMAX e64 m1\n");
+    ut_assert(unit_word(m, 16) == 32, "vsetvl: VLMAX e32 m4\n");
+    ut_assert(unit_word(m, 20) == 0 && unit_word(m, 24) == 1, "vsetvli: e64 mf2 sets vill\n");
+    int add = 1, masked = 1;
+    int32_t sum = b[0], msum = b[0];
+    for (int i = 0; i < 16; i++) {
+        int on = i < 13 && (0x1555 >> i) & 1;
+        add &= (int32_t)unit_word(m, 0x100 + 4 * i) == (i < 13 ? a[i] + b[i] : 0);
+        masked &= (int32_t)unit_word(m, 0x140 + 4 * i) == (on ? a[i] + b[i] : i < 13 ? 7 : 0);
+        sum += i < 13 ? a[i] : 0;
+        msum += on ? a[i] : 0;
+    }
+    ut_assert(add, "vadd.vv: 13 elements, tail undisturbed\n");
+    ut_assert(masked, "vadd.vv v0.t: inactive elements undisturbed\n");
+    ut_assert((int32_t)unit_word(m, 28) == sum, "vredsum.vs\n");
+    ut_assert((int32_t)unit_word(m, 32) == msum, "vredsum.vs v0.t\n");
+    ut_assert((int32_t)unit_word(m, 36) == 100, "vredmax.vs\n");
+    unit_free(m);
+})
+
+// ==================================================================== //
+//                            Unit: Zb
+// ==================================================================== //
+
+/**
+ * 位操作扩展已知答案：a1 = 0x0000123480a000f0，a2 = 0xfedcba9876543213，
+ * 每条 Zba/Zbb/Zbc 指令的结果依次存到结果区的 64 位字中；期望值按规范定义离线算出
+ */
+static const u32 unit_zb_code[] = {
+    0x00100493,   // li s1, 1
+    0x01f49493,   // slli s1, s1, 31
+    0x40048493,   // addi s1, s1, 1024
+    0x0091a5b7,   // lui a1, 2330
+    0x4055859b,   // addiw a1, a1, 1029
+    0x01559593,   // slli a1, a1, 21
+    0x0f058593,   // addi a1, a1, 240
+    0xfff6e637,   // lui a2, 1048430
+    0x5d56061b,   // addiw a2, a2, 1493
+    0x00c61613,   // slli a2, a2, 12
+    0xc3b60613,   // addi a2, a2, -965
+    0x00d61613,   // slli a2, a2, 13
+    0x54360613,   // addi a2, a2, 1347
+    0x00c61613,   // slli a2, a2, 12
+    0x21360613,   // addi a2, a2, 531
+    0x20c5c533,   // sh2add a0, a1, a2
+    0x00a4b023,   // sd a0, 0(s1)
+    0x08c5853b,   // add.uw a0, a1, a2
+    0x00a4b423,   // sd a0, 8(s1)
+    0x0a36151b,   // slli.uw a0, a2, 35
+    0x00a4b823,   // sd a0, 16(s1)
+    0x40c5f533,   // andn a0, a1, a2
+    0x00a4bc23,   // sd a0, 24(s1)
+    0x40c5c533,   // xnor a0, a1, a2
+    0x02a4b023,   // sd a0, 32(s1)
+    0x60059513,   // clz a0, a1
+    0x02a4b423,   // sd a0, 40(s1)
+    0x60159513,   // ctz a0, a1
+    0x02a4b823,   // sd a0, 48(s1)
+    0x60261513,   // cpop a0, a2
+    0x02a4bc23,   // sd a0, 56(s1)
+    0x6006151b,   // clzw a0, a2
+    0x04a4b023,   // sd a0, 64(s1)
+    0x6026151b,   // cpopw a0, a2
+    0x04a4b423,   // sd a0, 72(s1)
+    0x0ac5c533,   // min a0, a1, a2
+    0x04a4b823,   // sd a0, 80(s1)
+    0x0ac5d533,   // minu a0, a1, a2
+    0x04a4bc23,   // sd a0, 88(s1)
+    0x60459513,   // sext.b a0, a1
+    0x06a4b023,   // sd a0, 96(s1)
+    0x0806453b,   // zext.h a0, a2
+    0x06a4b423,   // sd a0, 104(s1)
+    0x60c5d513,   // rori a0, a1, 12
+    0x06a4b823,   // sd a0, 112(s1)
+    0x60b6153b,   // rolw a0, a2, a1
+    0x06a4bc23,   // sd a0, 120(s1)
+    0x2875d513,   // orc.b a0, a1
+    0x08a4b023,   // sd a0, 128(s1)
+    0x6b85d513,   // rev8 a0, a1
+    0x08a4b423,   // sd a0, 136(s1)
+    0x0ac59533,   // clmul a0, a1, a2
+    0x08a4b823,   // sd a0, 144(s1)
+    0x0ac5b533,   // clmulh a0, a1, a2
+    0x08a4bc23,   // sd a0, 152(s1)
+    0x0ac5a533,   // clmulr a0, a1, a2
+    0x0aa4b023,   // sd a0, 160(s1)
+    0x00000067,   // jr zero
+};
+static const struct { const char* name; u64 want; } unit_zb_want[] = {
+    { "sh2add a0, a1, a2", 0xfedd036a78d435d3ull },
+    { "add.uw a0, a1, a2", 0xfedcba98f6f43303ull },
+    { "slli.uw a0, a2, 35", 0xb2a1909800000000ull },
+    { "andn a0, a1, a2", 0x0000002480a000e0ull },
+    { "xnor a0, a1, a2", 0x01235753090bcd1cull },
+    { "clz a0, a1", 0x0000000000000013ull },
+    { "ctz a0, a1", 0x0000000000000004ull },
+    { "cpop a0, a2", 0x0000000000000022ull },
+    { "clzw a0, a2", 0x0000000000000001ull },
+    { "cpopw a0, a2", 0x000000000000000eull },
+    { "min a0, a1, a2", 0xfedcba9876543213ull },
+    { "minu a0, a1, a2", 0x0000123480a000f0ull },
+    { "sext.b a0, a1", 0xfffffffffffffff0ull },
+    { "zext.h a0, a2", 0x0000000000003213ull },
+    { "rori a0, a1, 12", 0x0f00000123480a00ull },
+    { "rolw a0, a2, a1", 0x0000000032137654ull },
+    { "orc.b a0, a1", 0x0000ffffffff00ffull },
+    { "rev8 a0, a1", 0xf000a08034120000ull },
+    { "clmul a0, a1, a2", 0x56e05425db30ee10ull },
+    { "clmulh a0, a1, a2", 0x00000e03c0fc4fb7ull },
+    { "clmulr a0, a1, a2", 0x00001c0781f89f6eull },
+};
+
+ut_def_test(zb_known, {
+    MACHINE* m = unit_machine(1, 0, unit_zb_code, UNIT_LEN(unit_zb_code));
+    machine_run(m);
+    for (int i = 0; i < (int)UNIT_LEN(unit_zb_want); i++)
+        ut_assert(unit_dword(m, 8 * i) == unit_zb_want[i].want, "%s\n", unit_zb_want[i].name);
+    unit_free(m);
+})
+
+// ==================================================================== //
+//                            Unit: Zk
+// ==================================================================== //
+
+/**
+ * 标量密码扩展已知答案：
+ * 1. FIPS-197 附录 C.1：AES-128 密钥扩展（aes64ks1i/aes64ks2），加密（aes64esm/aes64es），
+ * 再按等价逆密码解密（aes64im 变换轮密钥，aes64dsm/aes64ds）；
+ * 2. FIPS-180 "abc"：SHA-256 单块压缩，消息扩展用 sha256sig0/sig1，轮函数用 sha256sum0/sum1
+ *   数据区：+0 W[64]，+0x100 K[64]，+0x200 H[8]，+0x300 密钥，+0x310 明文，
+ *   +0x320 密文，+0x330 解密结果，+0x340 轮密钥
+ */
+static const u32 unit_zk_code[] = {
+    0x00100493,   // li s1, 1
+    0x01f49493,   // slli s1, s1, 31
+    0x40048493,   // addi s1, s1, 1024
+    0x34048913,   // addi s2, s1, 832
+    0x3004b503,   // ld a0, 768(s1)
+    0x3084b583,   // ld a1, 776(s1)
+    0x00a93023,   // sd a0, 0(s2)
+    0x00b93423,   // sd a1, 8(s2)
+    0x31059293,   // aes64ks1i t0, a1, 0
+    0x7ea28533,   // aes64ks2 a0, t0, a0
+    0x7eb505b3,   // aes64ks2 a1, a0, a1
+    0x00a93823,   // sd a0, 16(s2)
+    0x00b93c23,   // sd a1, 24(s2)
+    0x31159293,   // aes64ks1i t0, a1, 1
+    0x7ea28533,   // aes64ks2 a0, t0, a0
+    0x7eb505b3,   // aes64ks2 a1, a0, a1
+    0x02a93023,   // sd a0, 32(s2)
+    0x02b93423,   // sd a1, 40(s2)
+    0x31259293,   // aes64ks1i t0, a1, 2
+    0x7ea28533,   // aes64ks2 a0, t0, a0
+    0x7eb505b3,   // aes64ks2 a1, a0, a1
+    0x02a93823,   // sd a0, 48(s2)
+    0x02b93c23,   // sd a1, 56(s2)
+    0x31359293,   // aes64ks1i t0, a1, 3
+    0x7ea28533,   // aes64ks2 a0, t0, a0
+    0x7eb505b3,   // aes64ks2 a1, a0, a1
+    0x04a93023,   // sd a0, 64(s2)
+    0x04b93423,   // sd a1, 72(s2)
+    0x31459293,   // aes64ks1i t0, a1, 4
+    0x7ea28533,   // aes64ks2 a0, t0, a0
+    0x7eb505b3,   // aes64ks2 a1, a0, a1
+    0x04a93823,   // sd a0, 80(s2)
+    0x04b93c23,   // sd a1, 88(s2)
+    0x31559293,   // aes64ks1i t0, a1, 5
+    0x7ea28533,   // aes64ks2 a0, t0, a0
+    0x7eb505b3,   // aes64ks2 a1, a0, a1
+    0x06a93023,   // sd a0, 96(s2)
+    0x06b93423,   // sd a1, 104(s2)
+    0x31659293,   // aes64ks1i t0, a1, 6
+    0x7ea28533,   // aes64ks2 a0, t0, a0
+    0x7eb505b3,   // aes64ks2 a1, a0, a1
+    0x06a93823,   // sd a0, 112(s2)
+    0x06b93c23,   // sd a1, 120(s2)
+    0x31759293,   // aes64ks1i t0, a1, 7
+    0x7ea28533,   // aes64ks2 a0, t0, a0
+    0x7eb505b3,   // aes64ks2 a1, a0, a1
+    0x08a93023,   // sd a0, 128(s2)
+    0x08b93423,   // sd a1, 136(s2)
+    0x31859293,   // aes64ks1i t0, a1, 8
+    0x7ea28533,   // aes64ks2 a0, t0, a0
+    0x7eb505b3,   // aes64ks2 a1, a0, a1
+    0x08a93823,   // sd a0, 144(s2)
+    0x08b93c23,   // sd a1, 152(s2)
+    0x31959293,   // aes64ks1i t0, a1, 9
+    0x7ea28533,   // aes64ks2 a0, t0, a0
+    0x7eb505b3,   // aes64ks2 a1, a0, a1
+    0x0aa93023,   // sd a0, 160(s2)
+    0x0ab93423,   // sd a1, 168(s2)
+    0x3104b603,   // ld a2, 784(s1)
+    0x3184b683,   // ld a3, 792(s1)
+    0x00093383,   // ld t2, 0(s2)
+    0x00893e03,   // ld t3, 8(s2)
+    0x00764633,   // xor a2, a2, t2
+    0x01c6c6b3,   // xor a3, a3, t3
+    0x00090e93,   // mv t4, s2
+    0x00900f13,   // li t5, 9
+    0x010e8e93,   // addi t4, t4, 16
+    0x36d602b3,   // aes64esm t0, a2, a3
+    0x36c68333,   // aes64esm t1, a3, a2
+    0x000eb383,   // ld t2, 0(t4)
+    0x008ebe03,   // ld t3, 8(t4)
+    0x0072c633,   // xor a2, t0, t2
+    0x01c346b3,   // xor a3, t1, t3
+    0xffff0f13,   // addi t5, t5, -1
+    0xfe0f10e3,   // bnez t5, <enc>
+    0x32d602b3,   // aes64es t0, a2, a3
+    0x32c68333,   // aes64es t1, a3, a2
+    0x0a093383,   // ld t2, 160(s2)
+    0x0a893e03,   // ld t3, 168(s2)
+    0x0072c633,   // xor a2, t0, t2
+    0x01c346b3,   // xor a3, t1, t3
+    0x32c4b023,   // sd a2, 800(s1)
+    0x32d4b423,   // sd a3, 808(s1)
+    0x00764633,   // xor a2, a2, t2
+    0x01c6c6b3,   // xor a3, a3, t3
+    0x0a090e93,   // addi t4, s2, 160
+    0x00900f13,   // li t5, 9
+    0xff0e8e93,   // addi t4, t4, -16
+    0x3ed602b3,   // aes64dsm t0, a2, a3
+    0x3ec68333,   // aes64dsm t1, a3, a2
+    0x000eb383,   // ld t2, 0(t4)
+    0x008ebe03,   // ld t3, 8(t4)
+    0x30039393,   // aes64im t2, t2
+    0x300e1e13,   // aes64im t3, t3
+    0x0072c633,   // xor a2, t0, t2
+    0x01c346b3,   // xor a3, t1, t3
+    0xffff0f13,   // addi t5, t5, -1
+    0xfc0f1ce3,   // bnez t5, <dec>
+    0x3ad602b3,   // aes64ds t0, a2, a3
+    0x3ac68333,   // aes64ds t1, a3, a2
+    0x00093383,   // ld t2, 0(s2)
+    0x00893e03,   // ld t3, 8(s2)
+    0x0072c633,   // xor a2, t0, t2
+    0x01c346b3,   // xor a3, t1, t3
+    0x32c4b823,   // sd a2, 816(s1)
+    0x32d4bc23,   // sd a3, 824(s1)
+    0x00048f93,   // mv t6, s1
+    0x03000f13,   // li t5, 48
+    0x038fa283,   // lw t0, 56(t6)
+    0x10329293,   // sha256sig1 t0, t0
+    0x024fa303,   // lw t1, 36(t6)
+    0x004fa383,   // lw t2, 4(t6)
+    0x10239393,   // sha256sig0 t2, t2
+    0x000fae03,   // lw t3, 0(t6)
+    0x006282bb,   // addw t0, t0, t1
+    0x007282bb,   // addw t0, t0, t2
+    0x01c282bb,   // addw t0, t0, t3
+    0x045fa023,   // sw t0, 64(t6)
+    0x004f8f93,   // addi t6, t6, 4
+    0xffff0f13,   // addi t5, t5, -1
+    0xfc0f18e3,   // bnez t5, <sched>
+    0x2004a503,   // lw a0, 512(s1)
+    0x2044a583,   // lw a1, 516(s1)
+    0x2084a603,   // lw a2, 520(s1)
+    0x20c4a683,   // lw a3, 524(s1)
+    0x2104a703,   // lw a4, 528(s1)
+    0x2144a783,   // lw a5, 532(s1)
+    0x2184a803,   // lw a6, 536(s1)
+    0x21c4a883,   // lw a7, 540(s1)
+    0x00048f93,   // mv t6, s1
+    0x04000f13,   // li t5, 64
+    0x10171293,   // sha256sum1 t0, a4
+    0x011282bb,   // addw t0, t0, a7
+    0x00f77333,   // and t1, a4, a5
+    0xfff74393,   // not t2, a4
+    0x0103f3b3,   // and t2, t2, a6
+    0x00734333,   // xor t1, t1, t2
+    0x006282bb,   // addw t0, t0, t1
+    0x100fa303,   // lw t1, 256(t6)
+    0x006282bb,   // addw t0, t0, t1
+    0x000fa303,   // lw t1, 0(t6)
+    0x006282bb,   // addw t0, t0, t1
+    0x10051313,   // sha256sum0 t1, a0
+    0x00b573b3,   // and t2, a0, a1
+    0x00c57e33,   // and t3, a0, a2
+    0x01c3c3b3,   // xor t2, t2, t3
+    0x00c5fe33,   // and t3, a1, a2
+    0x01c3c3b3,   // xor t2, t2, t3
+    0x0073033b,   // addw t1, t1, t2
+    0x00080893,   // mv a7, a6
+    0x00078813,   // mv a6, a5
+    0x00070793,   // mv a5, a4
+    0x0056873b,   // addw a4, a3, t0
+    0x00060693,   // mv a3, a2
+    0x00058613,   // mv a2, a1
+    0x00050593,   // mv a1, a0
+    0x0062853b,   // addw a0, t0, t1
+    0x004f8f93,   // addi t6, t6, 4
+    0xffff0f13,   // addi t5, t5, -1
+    0xf80f18e3,   // bnez t5, <round>
+    0x2004a283,   // lw t0, 512(s1)
+    0x00a282bb,   // addw t0, t0, a0
+    0x2054a023,   // sw t0, 512(s1)
+    0x2044a283,   // lw t0, 516(s1)
+    0x00b282bb,   // addw t0, t0, a1
+    0x2054a223,   // sw t0, 516(s1)
+    0x2084a283,   // lw t0, 520(s1)
+    0x00c282bb,   // addw t0, t0, a2
+    0x2054a423,   // sw t0, 520(s1)
+    0x20c4a283,   // lw t0, 524(s1)
+    0x00d282bb,   // addw t0, t0, a3
+    0x2054a623,   // sw t0, 524(s1)
+    0x2104a283,   // lw t0, 528(s1)
+    0x00e282bb,   // addw t0, t0, a4
+    0x2054a823,   // sw t0, 528(s1)
+    0x2144a283,   // lw t0, 532(s1)
+    0x00f282bb,   // addw t0, t0, a5
+    0x2054aa23,   // sw t0, 532(s1)
+    0x2184a283,   // lw t0, 536(s1)
+    0x010282bb,   // addw t0, t0, a6
+    0x2054ac23,   // sw t0, 536(s1)
+    0x21c4a283,   // lw t0, 540(s1)
+    0x011282bb,   // addw t0, t0, a7
+    0x2054ae23,   // sw t0, 540(s1)
+    0x00000067,   // jr zero
+};
+
+static const u32 unit_sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+ut_def_test(zk_known, {
+    static const u32 h0[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+    static const u32 digest[8] = {
+        0xba7816bf, 0x8f01cfea, 0x414140de, 0x5dae2223, 0xb00361a3, 0x96177a9c, 0xb410ff61, 0xf20015ad,
+    };
+    static const u8 key[16] = {
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+    };
+    static const u8 plain[16] = {
+        0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff,
+    };
+    static const u8 cipher[16] = {
+        0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30, 0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a,
+    };
+    MACHINE* m = unit_machine(1, 0, unit_zk_code, UNIT_LEN(unit_zk_code));
+    u64 data = DRAM_BASE + UNIT_DATA;
+    // "abc" 填充后的单块：0x61626380，0 ...，位长 24
+    bus_store(&m->bus, data, 32, 0x61626380);
+    bus_store(&m->bus, data + 60, 32, 24);
+    for (int i = 0; i < 64; i++)
+        bus_store(&m->bus, data + 0x100 + 4 * i, 32, unit_sha256_k[i]);
+    for (int i = 0; i < 8; i++)
+        bus_store(&m->bus, data + 0x200 + 4 * i, 32, h0[i]);
+    for (int i = 0; i < 16; i++) {
+        bus_store(&m->bus, data + 0x300 + i, 8, key[i]);
+        bus_store(&m->bus, data + 0x310 + i, 8, plain[i]);
+    }
+    machine_run(m);
+    int enc = 1, dec = 1, sha = 1;
+    for (int i = 0; i < 16; i++) {
+        enc &= bus_load(&m->bus, data + 0x320 + i, 8) == cipher[i];
+        dec &= bus_load(&m->bus, data + 0x330 + i, 8) == plain[i];
+    }
+    for (int i = 0; i < 8; i++)
+        sha &= unit_word(m, 0x200 + 4 * i) == digest[i];
+    ut_assert(enc, "AES-128 encrypt (FIPS-197 C.1)\n");
+    ut_assert(dec, "AES-128 decrypt (FIPS-197 C.1)\n");
+    ut_assert(sha, "SHA-256 \"abc\" (FIPS-180)\n");
+    unit_free(m);
+})
+
+// ==================================================================== //
+//                            Unit: RV32
+// ==================================================================== //
+
+/**
+ * RV32 整数核：加载 ELF32 程序`test/rv32.s`，装载器按 EI_CLASS 选择 RV32 指令表；
+ * 结果区在`DRAM_BASE + 0x10000`（ELF 映像整体拷贝到`DRAM_BASE`），期望值见源文件注释
+ */
+ut_def_test(rv32_elf, {
+    static const struct { const char* name; u32 want; } want[] = {
+        { "mulh -8, 3", 0xffffffff },       { "mulhu -8, 3", 2 },
+        { "div INT_MIN, -1", 0x80000000 },  { "rem INT_MIN, 0", 0x80000000 },
+        { "srli INT_MIN, 4", 0x08000000 },  { "srai INT_MIN, 31", 0xffffffff },
+        { "sll 5, 33", 10 },                { "sltu 5, INT_MIN", 1 },
+        { "slt 5, INT_MIN", 0 },            { "addi INT_MIN, -1", 0x7fffffff },
+        { "misa.MXL", 1 },                  { "c.jal", 42 },
+        { "reached the end", 1 },
+    };
+    char* path = "./test/rv32.out";
+    ut_assert(access(path, R_OK) == 0, "%s not found, run from the source root\n", path);
+    if (access(path, R_OK) == 0) {
+        MACHINE* m = unit_machine(1, 0, NULL, 0);
+        machine_load_elf(m, path);
+        ut_assert(m->harts[0]->xlen == 32, "ELF32 selects RV32\n");
+        machine_run(m);
+        for (int i = 0; i < (int)UNIT_LEN(want); i++)
+            ut_assert(bus_load(&m->bus, DRAM_BASE + 0x10000 + 4 * i, 32) == want[i].want, "%s\n", want[i].name);
+        unit_free(m);
+    }
+})
+
+// ==================================================================== //
+//                            Unit: CHAN
+// ==================================================================== //
+
+/**
+ * 来宾改写数据通道头部：数据区偏移、大小只读；伪造的 head/tail 不会让主机越界读写
+ */
+ut_def_test(chan_guard, {
+    static CHAN chan;
+    MACHINE* m = unit_machine(1, 0, NULL, 0);
+    ut_assert(chan_init(&chan, &m->bus, CHAN_PAGE_SIZE * 3) == 0, "chan_init\n");
+    CHAN_SHM_HDR* hdr = (CHAN_SHM_HDR*)chan.shm;
+    u64 g2h = CHAN_SHM_BASE + offsetof(CHAN_SHM_HDR, ring[CHAN_RING_G2H]);
+    u64 h2g = CHAN_SHM_BASE + offsetof(CHAN_SHM_HDR, ring[CHAN_RING_H2G]);
+    u64 off = hdr->ring[CHAN_RING_G2H].data_off, size = hdr->ring[CHAN_RING_G2H].data_size;
+    bus_store(&m->bus, g2h + offsetof(CHAN_RING, data_off), 64, (u64)1 << 44);
+    bus_store(&m->bus, g2h + offsetof(CHAN_RING, data_size), 64, (u64)1 << 40);
+    bus_store(&m->bus, CHAN_SHM_BASE + offsetof(CHAN_SHM_HDR, size), 64, 0);
+    ut_assert(hdr->ring[CHAN_RING_G2H].data_off == off && hdr->ring[CHAN_RING_G2H].data_size == size
+              && hdr->size == chan.size, "ring geometry is read-only to the guest\n");
+
+    // g2h：来宾声称写了 64KB，主机最多读出一个数据区
+    static u8 buf[65536];
+    bus_store(&m->bus, g2h + offsetof(CHAN_RING, head), 64, 65536);
+    ut_assert(hdr->ring[CHAN_RING_G2H].head == 65536, "guest writes its own head\n");
+    ut_assert(chan_ring_read(chan.shm, CHAN_RING_G2H, buf, sizeof(buf)) == size, "read clamped to the data size\n");
+    // h2g：来宾把 tail 写到 head 之前很远处，主机按已满处理
+    bus_store(&m->bus, h2g + offsetof(CHAN_RING, tail), 64, (u64)-65536);
+    ut_assert(chan_ring_write(chan.shm, CHAN_RING_H2G, buf, sizeof(buf)) == 0, "write sees a full ring\n");
+    bus_store(&m->bus, h2g + offsetof(CHAN_RING, tail), 64, 0);
+    ut_assert(chan_ring_write(chan.shm, CHAN_RING_H2G, buf, sizeof(buf)) == size, "write clamped to the data size\n");
+    chan_free(&chan);
+    unit_free(m);
+})
+
+// ==================================================================== //
+//                            Unit: RDEV
+// ==================================================================== //
+
+/** 本进程打开的描述符个数 */
+static int unit_nfds(void) {
+    int n = 0;
+    DIR* d = opendir("/proc/self/fd");
+    if (!d)
+        return -1;
+    while (readdir(d))
+        n++;
+    closedir(d);
+    return n;
+}
+
+/** 冒充设备进程：每个回复都附带`RDEV_MAX_FDS`个多余的描述符，读寄存器回复 0x1234 */
+static void* unit_rdev_backend(void* arg) {
+    int conn = accept(*(int*)arg, NULL, NULL);
+    int fds[RDEV_MAX_FDS], extra[RDEV_MAX_FDS] = { 0 };
+    RDEV_MSG msg;
+    while (conn >= 0 && rdev_recv(conn, &msg, fds) == 0) {
+        for (u32 i = 0; i < msg.nfds; i++)
+            close(fds[i]);
+        if (msg.type == RDEV_SET_MEM || msg.type == RDEV_SET_KICK || msg.type == RDEV_SET_IRQ)
+            continue;
+        RDEV_MSG reply = { .type = msg.type | RDEV_REPLY, .nfds = RDEV_MAX_FDS };
+        if (msg.type == RDEV_HELLO) {
+            reply.args[0] = RDEV_VERSION;
+            reply.args[1] = 0x100;
+            reply.args[2] = RDEV_NO_DOORBELL;
+        } else if (msg.type == RDEV_MMIO_READ) {
+            reply.args[0] = 0x1234;
+        }
+        rdev_send(conn, &reply, extra);
+    }
+    close(conn);
+    return NULL;
+}
+
+/**
+ * 设备进程在回复中附带描述符：模拟器一侧不能写越界，也不能泄漏这些描述符
+ */
+ut_def_test(rdev_reply_fds, {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "/tmp/cemu-unit-rdev-%d.sock", getpid());
+    unlink(addr.sun_path);
+    int lfd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    bind(lfd, (struct sockaddr*)&addr, sizeof(addr));
+    listen(lfd, 1);
+    pthread_t th;
+    pthread_create(&th, NULL, unit_rdev_backend, &lfd);
+
+    static RDEV rdev;
+    MACHINE* m = unit_machine(1, 0, NULL, 0);
+    ut_assert(rdev_connect(&rdev, &m->bus, addr.sun_path, RDEV_MMIO_BASE, RDEV_IRQ) == 0, "rdev_connect\n");
+    int before = unit_nfds();
+    int good = 1;
+    for (int i = 0; i < 16; i++)
+        good &= bus_load(&m->bus, RDEV_MMIO_BASE, 32) == 0x1234;
+    ut_assert(good, "mmio reads return the device's value\n");
+    ut_assert(unit_nfds() == before, "descriptors in replies are closed: %d -> %d\n", before, unit_nfds());
+
+    unit_free(m);
+    close(rdev.sock);
+    close(rdev.kick_fd);
+    close(rdev.irq_fd);
+    pthread_join(th, NULL);
+    close(lfd);
+    unlink(addr.sun_path);
+})
+
+// ==================================================================== //
+//                            Unit: VNET
+// ==================================================================== //
+
+/**
+ * 网卡 a 同时接入交换机与主机数据报 socket（`vnet_connect`），网卡 b 接在同一交换机上：
+ * a 发送一个广播帧，b 的接收队列与主机 socket 都应收到同一帧
+ */
+ut_def_test(vnet_switch_fd, {
+    static VNET na, nb;
+    static VSWITCH sw;
+    static u8 mac_a[6] = { 0x52, 0x54, 0, 0, 0, 1 }, mac_b[6] = { 0x52, 0x54, 0, 0, 0, 2 };
+    MACHINE* a = unit_machine(1, 0, NULL, 0);
+    MACHINE* b = unit_machine(1, 0, NULL, 0);
+    vnet_init(&na, &a->bus, VNET_MMIO_BASE, VNET_IRQ, mac_a);
+    vnet_init(&nb, &b->bus, VNET_MMIO_BASE, VNET_IRQ, mac_b);
+    vswitch_init(&sw);
+    vnet_attach_switch(&na, &sw);
+    vnet_attach_switch(&nb, &sw);
+
+    // 主机端：绑定一个数据报 socket，网卡 a 连接过来
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "/tmp/cemu-unit-%d.sock", getpid());
+    unlink(addr.sun_path);
+    int host = socket(AF_UNIX, SOCK_DGRAM, 0);
+    bind(host, (struct sockaddr*)&addr, sizeof(addr));
+    ut_assert(vnet_connect(&na, addr.sun_path) == 0, "vnet_connect\n");
+
+    // b 放一个接收缓冲区，a 发送：报文头 12 字节 + 以太网头 14 字节 + "ping"
+    u64 rxq = DRAM_BASE + 0x1000, txq = DRAM_BASE + 0x2000, pkt = DRAM_BASE + 0x4000;
+    unit_vq_init(b, VNET_MMIO_BASE, VNET_RXQ, rxq);
+    unit_vq_init(a, VNET_MMIO_BASE, VNET_TXQ, txq);
+    unit_vq_add(b, VNET_MMIO_BASE, VNET_RXQ, rxq, (u64[]){ pkt }, (u32[]){ 256 }, (u16[]){ VIRTQ_DESC_F_WRITE }, 1);
+    u8 frame[18] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x52, 0x54, 0, 0, 0, 1, 0x88, 0xb5, 'p', 'i', 'n', 'g' };
+    for (int i = 0; i < VNET_HDR_SIZE; i++)
+        bus_store(&a->bus, pkt + i, 8, 0);
+    for (int i = 0; i < (int)sizeof(frame); i++)
+        bus_store(&a->bus, pkt + VNET_HDR_SIZE + i, 8, frame[i]);
+    unit_vq_add(a, VNET_MMIO_BASE, VNET_TXQ, txq, (u64[]){ pkt }, (u32[]){ VNET_HDR_SIZE + sizeof(frame) }, (u16[]){ 0 }, 1);
+
+    ut_assert(unit_vq_used(a, txq) == 1, "tx descriptor returned\n");
+    ut_assert(unit_vq_used(b, rxq) == 1 && unit_vq_used_len(b, rxq, 0) == VNET_HDR_SIZE + sizeof(frame),
+              "switch delivered the frame to b\n");
+    int same = 1;
+    for (int i = 0; i < (int)sizeof(frame); i++)
+        same &= bus_load(&b->bus, pkt + VNET_HDR_SIZE + i, 8) == frame[i];
+    ut_assert(same, "b received the same bytes\n");
+    u8 got[64];
+    ssize_t r = recv(host, got, sizeof(got), MSG_DONTWAIT);
+    ut_assert(r == sizeof(frame) && memcmp(got, frame, sizeof(frame)) == 0, "host socket received the frame\n");
+
+    close(host);
+    unlink(addr.sun_path);
+    unit_free(a);
+    unit_free(b);
+})
+
+/**
+ * 接收队列没有缓冲区时 socket 一直可读：第一次轮询后暂停该描述符，不再空转；
+ * 驱动补充缓冲区并 kick 后恢复，积压的报文写入接收队列
+ */
+ut_def_test(vnet_rx_pause, {
+    static VNET net;
+    static u8 mac[6] = { 0x52, 0x54, 0, 0, 0, 3 };
+    MACHINE* m = unit_machine(1, 0, NULL, 0);
+    int sv[2];
+    socketpair(AF_UNIX, SOCK_DGRAM, 0, sv);
+    vnet_init(&net, &m->bus, VNET_MMIO_BASE, VNET_IRQ, mac);
+    vnet_attach_fd(&net, sv[0]);
+
+    u8 frame[18] = { 0x52, 0x54, 0, 0, 0, 3, 0x52, 0x54, 0, 0, 0, 4, 0x88, 0xb5, 'p', 'o', 'n', 'g' };
+    send(sv[1], frame, sizeof(frame), 0);
+    ut_assert(bus_poll(&m->bus, 0) == 1, "socket readable\n");
+    ut_assert(bus_poll(&m->bus, 0) == 0, "no rx buffers: descriptor paused\n");
+
+    u64 rxq = DRAM_BASE + 0x1000, pkt = DRAM_BASE + 0x4000;
+    unit_vq_init(m, VNET_MMIO_BASE, VNET_RXQ, rxq);
+    unit_vq_add(m, VNET_MMIO_BASE, VNET_RXQ, rxq, (u64[]){ pkt }, (u32[]){ 256 }, (u16[]){ VIRTQ_DESC_F_WRITE }, 1);
+    ut_assert(unit_vq_used(m, rxq) == 1 && unit_vq_used_len(m, rxq, 0) == VNET_HDR_SIZE + sizeof(frame),
+              "kick resumes and delivers the queued frame\n");
+    // 还有空闲缓冲区时保持轮询：下一个报文由轮询直接收下
+    unit_vq_add(m, VNET_MMIO_BASE, VNET_RXQ, rxq, (u64[]){ pkt + 0x100 }, (u32[]){ 256 }, (u16[]){ VIRTQ_DESC_F_WRITE }, 1);
+    send(sv[1], frame, sizeof(frame), 0);
+    ut_assert(bus_poll(&m->bus, 0) == 1 && unit_vq_used(m, rxq) == 2, "descriptor polled again after resume\n");
+
+    unit_free(m);
+    close(sv[0]);
+    close(sv[1]);
+})
+
+// ==================================================================== //
+//                            Unit: DISK
+// ==================================================================== //
+
+/** 创建 1MB、4KB 簇的覆盖镜像，并把文件头中`field`处的 8 字节改为`value` */
+static int unit_disk_patch(char* path, char* base, size_t field, u64 value, size_t n) {
+    if (disk_create(path, base, 1 << 20, 12) < 0)
+        return -1;
+    int fd = open(path, O_RDWR);
+    int ok = fd >= 0 && (n == 0 || pwrite(fd, &value, n, field) == (ssize_t)n);
+    close(fd);
+    return ok ? 0 : -1;
+}
+
+ut_def_test(disk_validate, {
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/cemu-unit-%d.img", getpid());
+    DISK disk;
+
+    unit_disk_patch(path, NULL, 0, 0, 0);
+    ut_assert(disk_open(&disk, path) == 0, "fresh overlay opens\n");
+    u64 len = 4096;
+    ut_assert(disk_map(&disk, disk.size, &len) == NULL && len == 0, "disk_map past the end\n");
+    len = 4096;
+    disk_map(&disk, disk.size - 512, &len);
+    ut_assert(len == 512, "disk_map clamps to the disk size\n");
+    disk_close(&disk);
+
+    unit_disk_patch(path, NULL, offsetof(DISK_HDR, l1_offset), (u64)1 << 40, 8);
+    ut_assert(disk_open(&disk, path) < 0, "reject l1_offset past the file\n");
+    unit_disk_patch(path, NULL, offsetof(DISK_HDR, l1_entries), 1 << 20, 4);
+    ut_assert(disk_open(&disk, path) < 0, "reject l1_entries not matching the size\n");
+    unit_disk_patch(path, NULL, offsetof(DISK_HDR, size), ~(u64)0, 8);
+    ut_assert(disk_open(&disk, path) < 0, "reject a huge disk size\n");
+    // L1[0] 指向文件外
+    unit_disk_patch(path, NULL, 4096, (u64)1 << 30, 8);
+    ut_assert(disk_open(&disk, path) < 0, "reject an L1 entry past the file\n");
+    // L1[0] 指向文件内但未对齐
+    unit_disk_patch(path, NULL, 4096, 4096 + 8, 8);
+    ut_assert(disk_open(&disk, path) < 0, "reject a misaligned L1 entry\n");
+    unlink(path);
+})
+
+/**
+ * 块设备：基础镜像 3 个扇区分别填 0x11/0x22/0x33，覆盖镜像在其上；
+ * 写扇区 1，再读回扇区 0~2，基础镜像不变；越界读返回 I/O 错误
+ */
+ut_def_test(vblk_rw, {
+    char base[64], path[64];
+    snprintf(base, sizeof(base), "/tmp/cemu-unit-%d.base", getpid());
+    snprintf(path, sizeof(path), "/tmp/cemu-unit-%d.img", getpid());
+    u8 sect[3 * DISK_SECTOR_SIZE];
+    for (int i = 0; i < 3; i++)
+        memset(sect + i * DISK_SECTOR_SIZE, 0x11 * (i + 1), DISK_SECTOR_SIZE);
+    int fd = open(base, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    pwrite(fd, sect, sizeof(sect), 0);
+    close(fd);
+    disk_create(path, base, 0, 12);
+
+    static VBLK blk;
+    MACHINE* m = unit_machine(1, 0, NULL, 0);
+    ut_assert(vblk_init(&blk, &m->bus, VBLK_MMIO_BASE, VBLK_IRQ, path) == 0, "vblk_init\n");
+    ut_assert(bus_load(&m->bus, VBLK_MMIO_BASE + VIRTIO_MMIO_CONFIG, 64) == 3, "capacity in sectors\n");
+    u64 vq = DRAM_BASE + 0x1000, hdr = DRAM_BASE + 0x4000, buf = DRAM_BASE + 0x5000, st = DRAM_BASE + 0x6000;
+    unit_vq_init(m, VBLK_MMIO_BASE, 0, vq);
+    u16 dout[3] = { 0, 0, VIRTQ_DESC_F_WRITE }, din[3] = { 0, VIRTQ_DESC_F_WRITE, VIRTQ_DESC_F_WRITE };
+
+    // 写扇区 1
+    for (int i = 0; i < DISK_SECTOR_SIZE; i++)
+        bus_store(&m->bus, buf + i, 8, 0xab);
+    bus_store(&m->bus, hdr, 32, VIRTIO_BLK_T_OUT);
+    bus_store(&m->bus, hdr + 8, 64, 1);
+    unit_vq_add(m, VBLK_MMIO_BASE, 0, vq, (u64[]){ hdr, buf, st }, (u32[]){ VBLK_HDR_SIZE, DISK_SECTOR_SIZE, 1 }, dout, 3);
+    ut_assert(unit_vq_used(m, vq) == 1 && bus_load(&m->bus, st, 8) == VIRTIO_BLK_S_OK, "write sector 1\n");
+
+    // 读扇区 0 ~ 2
+    bus_store(&m->bus, hdr, 32, VIRTIO_BLK_T_IN);
+    bus_store(&m->bus, hdr + 8, 64, 0);
+    unit_vq_add(m, VBLK_MMIO_BASE, 0, vq, (u64[]){ hdr, buf, st }, (u32[]){ VBLK_HDR_SIZE, sizeof(sect), 1 }, din, 3);
+    ut_assert(unit_vq_used(m, vq) == 2 && bus_load(&m->bus, st, 8) == VIRTIO_BLK_S_OK
+              && unit_vq_used_len(m, vq, 1) == sizeof(sect) + 1, "read sectors 0-2\n");
+    int same = 1;
+    for (int i = 0; i < (int)sizeof(sect); i++)
+        same &= bus_load(&m->bus, buf + i, 8) == (i / DISK_SECTOR_SIZE == 1 ? 0xab : sect[i]);
+    ut_assert(same, "overlay data over base data\n");
+
+    // 越界读：扇区 2 起 2 个扇区
+    bus_store(&m->bus, hdr + 8, 64, 2);
+    unit_vq_add(m, VBLK_MMIO_BASE, 0, vq, (u64[]){ hdr, buf, st }, (u32[]){ VBLK_HDR_SIZE, 2 * DISK_SECTOR_SIZE, 1 }, din, 3);
+    ut_assert(bus_load(&m->bus, st, 8) == VIRTIO_BLK_S_IOERR, "read past the end fails\n");
+    vblk_close(&blk);
+    unit_free(m);
+
+    u8 check[sizeof(sect)];
+    fd = open(base, O_RDONLY);
+    ut_assert(pread(fd, check, sizeof(check), 0) == sizeof(check) && memcmp(check, sect, sizeof(sect)) == 0,
+              "base image unchanged\n");
+    close(fd);
+    unlink(base);
+    unlink(path);
+})
+
+#endif // UNIT_H
@@ -0,0 +1,141 @@
+/**
+ * @file vblk.c
+ * @author lancer (lancerstadium@163.com)
+ * @brief virtio-blk 块设备实现
+ * @version 0.1
+ * @date 2024-03-20
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+
+// ==================================================================== //
+//                             Include
+// ==================================================================== //
+
+#include "vblk.h"
+#include "log.h"
+#include "macro.h"
+
+
+// ==================================================================== //
+//                          Private Func: VBLK
+// ==================================================================== //
+
+/**
+ * @brief 处理一个请求并写回状态字节
+ * @param blk 块设备
+ * @param elem 请求描述符链
+ * @return u32 写入来宾的字节数（含状态字节），链中没有可写字节时为 0
+ */
+static u32 vblk_request(VBLK* blk, VQ_ELEM* elem) {
+    struct {
+        u32 type;
+        u32 reserved;
+        u64 sector;
+    } hdr;
+    if (elem->nin == 0 || elem->in[elem->nin - 1].iov_len == 0) {
+        log_warn("vblk: request without status byte");
+        return 0;
+    }
+    // 最后一个可写字节为状态，其余可写段为读缓冲区
+    struct iovec* last = &elem->in[elem->nin - 1];
+    u8* status = (u8*)last->iov_base + last->iov_len - 1;
+    last->iov_len--;
+    if (iov_to_buf(elem->out, elem->nout, 0, &hdr, sizeof(hdr)) < sizeof(hdr)) {
+        *status = VIRTIO_BLK_S_IOERR;
+        return 1;
+    }
+
+    struct iovec data[VIRTIO_MAX_SG];
+    int n = 0;
+    u32 written = 0;
+    *status = VIRTIO_BLK_S_OK;
+    switch (hdr.type) {
+        case VIRTIO_BLK_T_IN:
+            n = elem->nin;
+            memcpy(data, elem->in, n * sizeof(struct iovec));
+            written = iov_size(data, n);
+            break;
+        case VIRTIO_BLK_T_OUT:
+            n = iov_skip(data, elem->out, elem->nout, VBLK_HDR_SIZE);
+            break;
+        case VIRTIO_BLK_T_FLUSH:
+            disk_flush(&blk->disk);
+            return 1;
+        default:
+            *status = VIRTIO_BLK_S_UNSUPP;
+            return 1;
+    }
+
+    // 请求必须整体落在虚拟磁盘内
+    u64 size = iov_size(data, n);
+    u64 max_sector = blk->disk.size / DISK_SECTOR_SIZE;
+    if (hdr.sector > max_sector || size > (max_sector - hdr.sector) * DISK_SECTOR_SIZE) {
+        *status = VIRTIO_BLK_S_IOERR;
+        return 1;
+    }
+    u64 off = hdr.sector * DISK_SECTOR_SIZE;
+    for (int i = 0; i < n; i++) {
+        u64 len = data[i].iov_len;
+        u64 done = hdr.type == VIRTIO_BLK_T_IN ? disk_read(&blk->disk, off, data[i].iov_base, len)
+                                               : disk_write(&blk->disk, off, data[i].iov_base, len);
+        if (done < len) {
+            *status = VIRTIO_BLK_S_IOERR;
+            break;
+        }
+        off += len;
+    }
+    if (hdr.type == VIRTIO_BLK_T_IN)
+        blk->reads++;
+    else
+        blk->writes++;
+    return written + 1;
+}
+
+static void vblk_notify(VIRTIO* vdev, u32 queue) {
+    VBLK* blk = vdev->opaque;
+    VQ* vq = &vdev->vq[queue];
+    int done = 0;
+    while (virtq_pop(vdev, vq, &blk->elem) == 1) {
+        virtq_push(vdev, vq, blk->elem.head, vblk_request(blk, &blk->elem));
+        done = 1;
+    }
+    if (done)
+        virtio_notify(vdev);
+}
+
+static u64 vblk_config_load(VIRTIO* vdev, u64 offset, u64 size) {
+    VBLK* blk = vdev->opaque;
+    // 配置空间开头为以扇区计的容量（u64）
+    u64 capacity = blk->disk.size / DISK_SECTOR_SIZE;
+    u64 value = 0;
+    for (u64 i = 0; i < size / 8 && offset + i < sizeof(capacity); i++)
+        value |= ((capacity >> (8 * (offset + i))) & 0xff) << (8 * i);
+    return value;
+}
+
+
+// ==================================================================== //
+//                            Func API: VBLK
+// ==================================================================== //
+
+int vblk_init(VBLK* blk, BUS* bus, u64 base, u32 irq, char* path) {
+    if (disk_open(&blk->disk, path) < 0)
+        return -1;
+    if (virtio_init(&blk->vdev, bus, "virtio-blk", base, irq, VIRTIO_ID_BLOCK, 1) < 0) {
+        disk_close(&blk->disk);
+        return -1;
+    }
+    blk->vdev.features |= (u64)1 << VIRTIO_BLK_F_FLUSH;
+    blk->vdev.opaque = blk;
+    blk->vdev.notify = vblk_notify;
+    blk->vdev.config_load = vblk_config_load;
+    blk->reads = blk->writes = 0;
+    return 0;
+}
+
+void vblk_close(VBLK* blk) {
+    disk_flush(&blk->disk);
+    disk_close(&blk->disk);
+}
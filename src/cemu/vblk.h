@@ -0,0 +1,95 @@
+/**
+ * @file vblk.h
+ * @author lancer (lancerstadium@163.com)
+ * @brief virtio-blk 块设备头文件
+ * @version 0.1
+ * @date 2024-03-20
+ * @copyright Copyright (c) 2024
+ *
+ * # virtio-blk 介绍
+ * - 块设备只有一个请求队列，后端为稀疏写时复制磁盘`DISK`（见`disk.h`）。
+ * 每个请求是一条描述符链：
+ * ```
+ *
+ *   out: { type, reserved, sector }    请求头（16 字节）
+ *   out/in: data ...                    写请求的数据 / 读请求的缓冲区
+ *   in:  status                         最后一个可写字节：0 成功，1 I/O 错误，2 不支持
+ *
+ * ```
+ * - 读请求从覆盖镜像或基础镜像的映射直接拷入来宾缓冲区，写请求在覆盖镜像中分配簇；
+ * 一次 kick 取出的请求全部完成后只发一次中断。
+ *
+ * - `cemu default -b <overlay>`在`VBLK_MMIO_BASE`挂一个块设备，
+ * 覆盖镜像由`cemu mkdisk`创建。
+ */
+
+
+#ifndef VBLK_H
+#define VBLK_H
+
+// ==================================================================== //
+//                             Include
+// ==================================================================== //
+
+#include "virtio.h"
+#include "disk.h"
+
+// ==================================================================== //
+//                              Defines
+// ==================================================================== //
+
+#define VIRTIO_ID_BLOCK         2       /** virtio-blk 设备类型 */
+#define VIRTIO_BLK_F_FLUSH      9       /** 特性：支持 FLUSH 请求 */
+
+#define VIRTIO_BLK_T_IN         0       /** 读 */
+#define VIRTIO_BLK_T_OUT        1       /** 写 */
+#define VIRTIO_BLK_T_FLUSH      4       /** 刷盘 */
+
+#define VIRTIO_BLK_S_OK         0       /** 成功 */
+#define VIRTIO_BLK_S_IOERR      1       /** I/O 错误 */
+#define VIRTIO_BLK_S_UNSUPP     2       /** 不支持的请求 */
+
+#define VBLK_HDR_SIZE           16      /** 请求头大小 */
+#define VBLK_MMIO_BASE          VIRTIO_MMIO_BASE    /** 命令行块设备基址 */
+#define VBLK_IRQ                VIRTIO_MMIO_IRQ     /** 命令行块设备中断号 */
+
+
+// ==================================================================== //
+//                             Data: VBLK
+// ==================================================================== //
+
+/**
+ * @brief virtio-blk 块设备
+ */
+typedef struct VBLK_t {
+    VIRTIO vdev;                    /** virtio 设备 */
+    DISK disk;                      /** 后端磁盘 */
+    VQ_ELEM elem;                   /** 正在处理的请求 */
+    u64 reads;                      /** 已完成的读请求数 */
+    u64 writes;                     /** 已完成的写请求数 */
+} VBLK;
+
+
+// ==================================================================== //
+//                            Declare API: VBLK
+// ==================================================================== //
+
+/**
+ * @brief 打开覆盖镜像并将块设备挂载到总线
+ * @param blk 块设备
+ * @param bus 总线
+ * @param base 来宾物理基址
+ * @param irq 中断号
+ * @param path 覆盖镜像路径
+ * @return int 0 成功，-1 失败
+ */
+int vblk_init(VBLK* blk, BUS* bus, u64 base, u32 irq, char* path);
+
+/**
+ * @brief 将覆盖镜像同步到文件并关闭磁盘
+ * @param blk 块设备
+ */
+void vblk_close(VBLK* blk);
+
+
+#endif // VBLK_H
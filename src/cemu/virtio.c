@@ -0,0 +1,277 @@
+/**
+ * @file virtio.c
+ * @author lancer (lancerstadium@163.com)
+ * @brief virtio-mmio 传输层实现
+ * @version 0.1
+ * @date 2024-01-21
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+
+// ==================================================================== //
+//                             Include
+// ==================================================================== //
+
+#include "virtio.h"
+#include "log.h"
+#include "macro.h"
+
+
+// ==================================================================== //
+//                         Private Func: VIRTIO
+// ==================================================================== //
+
+/**
+ * @brief 虚拟队列描述符（来宾内存布局）
+ */
+typedef struct VQ_DESC_t {
+    u64 addr;
+    u32 len;
+    u16 flags;
+    u16 next;
+} VQ_DESC;
+
+/**
+ * @brief 将来宾物理地址区间转换为主机指针
+ * @return void* 主机指针，区间不在 DRAM 内时返回`NULL`
+ */
+static inline void* virtio_gpa(VIRTIO* vdev, u64 gpa, u64 len) {
+    if (gpa < DRAM_BASE || gpa - DRAM_BASE > DRAM_SIZE || len > DRAM_SIZE - (gpa - DRAM_BASE))
+        return NULL;
+    return (void*)mmu_GPA_to_HVA((u64)vdev->bus->dram.mem_addr, gpa);
+}
+
+static inline void virtio_lock(VIRTIO* vdev) {
+    if (vdev->vq_lock)
+        pthread_mutex_lock(vdev->vq_lock);
+}
+static inline void virtio_unlock(VIRTIO* vdev) {
+    if (vdev->vq_lock)
+        pthread_mutex_unlock(vdev->vq_lock);
+}
+
+static void virtio_reset(VIRTIO* vdev) {
+    vdev->driver_features = 0;
+    vdev->device_features_sel = vdev->driver_features_sel = 0;
+    vdev->queue_sel = 0;
+    vdev->status = 0;
+    vdev->isr = 0;
+    virtio_lock(vdev);
+    memset(vdev->vq, 0, sizeof(vdev->vq));
+    virtio_unlock(vdev);
+    bus_lower_irq(vdev->bus, vdev->irq);
+    if (vdev->reset)
+        vdev->reset(vdev);
+}
+
+static u64 virtio_load(void* opaque, u64 offset, u64 size) {
+    VIRTIO* vdev = opaque;
+    VQ* vq = &vdev->vq[vdev->queue_sel];
+    if (offset >= VIRTIO_MMIO_CONFIG)
+        return vdev->config_load ? vdev->config_load(vdev, offset - VIRTIO_MMIO_CONFIG, size) : 0;
+    switch (offset) {
+        case VIRTIO_MMIO_MAGIC_VALUE:       return VIRTIO_MAGIC;
+        case VIRTIO_MMIO_VERSION:           return VIRTIO_VERSION;
+        case VIRTIO_MMIO_DEVICE_ID:         return vdev->device_id;
+        case VIRTIO_MMIO_VENDOR_ID:         return VIRTIO_VENDOR;
+        case VIRTIO_MMIO_DEVICE_FEATURES:
+            return vdev->device_features_sel ? (u32)(vdev->features >> 32) : (u32)vdev->features;
+        case VIRTIO_MMIO_QUEUE_NUM_MAX:     return vdev->queue_sel < vdev->nvq ? VIRTIO_QUEUE_SIZE : 0;
+        case VIRTIO_MMIO_QUEUE_READY:       return vq->ready;
+        case VIRTIO_MMIO_INTERRUPT_STATUS:  return __atomic_load_n(&vdev->isr, __ATOMIC_ACQUIRE);
+        case VIRTIO_MMIO_STATUS:            return vdev->status;
+        case VIRTIO_MMIO_CONFIG_GENERATION: return vdev->config_generation;
+        default:
+            log_warn("%s: load unknown reg 0x%lx", vdev->name, offset);
+            return 0;
+    }
+}
+
+static void virtio_store(void* opaque, u64 offset, u64 size, u64 value) {
+    VIRTIO* vdev = opaque;
+    VQ* vq = &vdev->vq[vdev->queue_sel];
+    if (offset >= VIRTIO_MMIO_CONFIG) {
+        if (vdev->config_store)
+            vdev->config_store(vdev, offset - VIRTIO_MMIO_CONFIG, size, value);
+        return;
+    }
+    u32 val = (u32)value;
+    // 通知与复位会回调设备，设备自己取队列锁；其余寄存器写在队列锁下进行
+    if (offset == VIRTIO_MMIO_QUEUE_NOTIFY) {
+        if (val < vdev->nvq && vdev->vq[val].ready && vdev->notify)
+            vdev->notify(vdev, val);
+        return;
+    }
+    if (offset == VIRTIO_MMIO_STATUS && val == 0) {
+        virtio_reset(vdev);
+        return;
+    }
+    virtio_lock(vdev);
+    switch (offset) {
+        case VIRTIO_MMIO_DEVICE_FEATURES_SEL:   vdev->device_features_sel = val; break;
+        case VIRTIO_MMIO_DRIVER_FEATURES:
+            if (vdev->driver_features_sel)
+                vdev->driver_features = (vdev->driver_features & 0xffffffff) | ((u64)val << 32);
+            else
+                vdev->driver_features = (vdev->driver_features & ~(u64)0xffffffff) | val;
+            break;
+        case VIRTIO_MMIO_DRIVER_FEATURES_SEL:   vdev->driver_features_sel = val; break;
+        case VIRTIO_MMIO_QUEUE_SEL:
+            if (val < VIRTIO_MAX_QUEUE)
+                vdev->queue_sel = val;
+            break;
+        case VIRTIO_MMIO_QUEUE_NUM:
+            if (val && val <= VIRTIO_QUEUE_SIZE && !(val & (val - 1)))
+                vq->num = val;
+            break;
+        case VIRTIO_MMIO_QUEUE_READY:           vq->ready = val & 1; break;
+        case VIRTIO_MMIO_INTERRUPT_ACK:
+            if (!__atomic_and_fetch(&vdev->isr, ~val, __ATOMIC_ACQ_REL))
+                bus_lower_irq(vdev->bus, vdev->irq);
+            break;
+        case VIRTIO_MMIO_STATUS:                vdev->status = val; break;
+        case VIRTIO_MMIO_QUEUE_DESC_LOW:    vq->desc  = (vq->desc  & ~(u64)0xffffffff) | val; break;
+        case VIRTIO_MMIO_QUEUE_DESC_HIGH:   vq->desc  = (vq->desc  & 0xffffffff) | ((u64)val << 32); break;
+        case VIRTIO_MMIO_QUEUE_AVAIL_LOW:   vq->avail = (vq->avail & ~(u64)0xffffffff) | val; break;
+        case VIRTIO_MMIO_QUEUE_AVAIL_HIGH:  vq->avail = (vq->avail & 0xffffffff) | ((u64)val << 32); break;
+        case VIRTIO_MMIO_QUEUE_USED_LOW:    vq->used  = (vq->used  & ~(u64)0xffffffff) | val; break;
+        case VIRTIO_MMIO_QUEUE_USED_HIGH:   vq->used  = (vq->used  & 0xffffffff) | ((u64)val << 32); break;
+        default:
+            log_warn("%s: store unknown reg 0x%lx", vdev->name, offset);
+    }
+    virtio_unlock(vdev);
+}
+
+
+// ==================================================================== //
+//                            Func API: VIRTIO
+// ==================================================================== //
+
+int virtio_init(VIRTIO* vdev, BUS* bus, char* name, u64 base, u32 irq, u32 device_id, int nvq) {
+    memset(vdev, 0, sizeof(VIRTIO));
+    vdev->bus = bus;
+    vdev->name = name;
+    vdev->irq = irq;
+    vdev->device_id = device_id;
+    vdev->nvq = MIN(nvq, VIRTIO_MAX_QUEUE);
+    vdev->features = (u64)1 << VIRTIO_F_VERSION_1;
+    return bus_add_device(bus, (DEV){
+        .name = name, .base = base, .size = VIRTIO_MMIO_SIZE,
+        .opaque = vdev, .load = virtio_load, .store = virtio_store,
+    });
+}
+
+int virtq_pop(VIRTIO* vdev, VQ* vq, VQ_ELEM* elem) {
+    if (!vq->ready || !vq->num)
+        return 0;
+    u16* avail = virtio_gpa(vdev, vq->avail, 4 + 2 * vq->num);
+    VQ_DESC* desc = virtio_gpa(vdev, vq->desc, sizeof(VQ_DESC) * vq->num);
+    if (!avail || !desc)
+        return -1;
+    // 先读 avail->idx，再读环内容：与驱动侧的写屏障配对
+    u16 avail_idx = __atomic_load_n(&avail[1], __ATOMIC_ACQUIRE);
+    if (avail_idx == vq->last_avail)
+        return 0;
+
+    u16 head = avail[2 + (vq->last_avail & (vq->num - 1))];
+    elem->head = head;
+    elem->nout = elem->nin = 0;
+    u16 i = head;
+    for (int n = 0; ; n++) {
+        if (i >= vq->num || n >= vq->num || elem->nout + elem->nin >= VIRTIO_MAX_SG) {
+            log_error("%s: bad descriptor chain", vdev->name);
+            return -1;
+        }
+        VQ_DESC* d = &desc[i];
+        void* p = virtio_gpa(vdev, d->addr, d->len);
+        if (!p) {
+            log_error("%s: descriptor out of memory (0x%.8lx)", vdev->name, d->addr);
+            return -1;
+        }
+        if (d->flags & VIRTQ_DESC_F_WRITE)
+            elem->in[elem->nin++] = (struct iovec){ .iov_base = p, .iov_len = d->len };
+        else
+            elem->out[elem->nout++] = (struct iovec){ .iov_base = p, .iov_len = d->len };
+        if (!(d->flags & VIRTQ_DESC_F_NEXT))
+            break;
+        i = d->next;
+    }
+    vq->last_avail++;
+    return 1;
+}
+
+void virtq_unpop(VQ* vq, int n) {
+    vq->last_avail -= n;
+}
+
+void virtq_push(VIRTIO* vdev, VQ* vq, u16 head, u32 len) {
+    u8* used = virtio_gpa(vdev, vq->used, 4 + 8 * vq->num);
+    if (!used)
+        return;
+    u16* used_idx = (u16*)(used + 2);
+    u16 idx = *used_idx;
+    u32* ent = (u32*)(used + 4 + 8 * (idx & (vq->num - 1)));
+    ent[0] = head;
+    ent[1] = len;
+    // 先写环内容，再发布 used->idx
+    __atomic_store_n(used_idx, (u16)(idx + 1), __ATOMIC_RELEASE);
+}
+
+void virtio_notify(VIRTIO* vdev) {
+    // 其它机器的交换机端口也可能调用，中断状态需原子更新
+    __atomic_or_fetch(&vdev->isr, VIRTIO_INT_VRING, __ATOMIC_RELEASE);
+    bus_raise_irq(vdev->bus, vdev->irq);
+}
+
+size_t iov_to_buf(struct iovec* iov, int n, size_t skip, void* buf, size_t len) {
+    size_t done = 0;
+    for (int i = 0; i < n && done < len; i++) {
+        if (skip >= iov[i].iov_len) {
+            skip -= iov[i].iov_len;
+            continue;
+        }
+        size_t c = MIN(iov[i].iov_len - skip, len - done);
+        memcpy((u8*)buf + done, (u8*)iov[i].iov_base + skip, c);
+        done += c;
+        skip = 0;
+    }
+    return done;
+}
+
+size_t iov_from_buf(struct iovec* iov, int n, size_t skip, void* buf, size_t len) {
+    size_t done = 0;
+    for (int i = 0; i < n && done < len; i++) {
+        if (skip >= iov[i].iov_len) {
+            skip -= iov[i].iov_len;
+            continue;
+        }
+        size_t c = MIN(iov[i].iov_len - skip, len - done);
+        memcpy((u8*)iov[i].iov_base + skip, (u8*)buf + done, c);
+        done += c;
+        skip = 0;
+    }
+    return done;
+}
+
+int iov_skip(struct iovec* dst, struct iovec* src, int n, size_t skip) {
+    int m = 0;
+    for (int i = 0; i < n; i++) {
+        if (skip >= src[i].iov_len) {
+            skip -= src[i].iov_len;
+            continue;
+        }
+        dst[m].iov_base = (u8*)src[i].iov_base + skip;
+        dst[m].iov_len = src[i].iov_len - skip;
+        skip = 0;
+        m++;
+    }
+    return m;
+}
+
+size_t iov_size(struct iovec* iov, int n) {
+    size_t len = 0;
+    for (int i = 0; i < n; i++)
+        len += iov[i].iov_len;
+    return len;
+}
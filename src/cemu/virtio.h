@@ -0,0 +1,241 @@
+/**
+ * @file virtio.h
+ * @author lancer (lancerstadium@163.com)
+ * @brief virtio-mmio 传输层头文件
+ * @version 0.1
+ * @date 2024-01-21
+ * @copyright Copyright (c) 2024
+ *
+ * # virtio 介绍
+ * - virtio 是半虚拟化设备的标准接口。这里实现其 MMIO 传输层（版本 2）
+ * 与分离式虚拟队列（split virtqueue），具体设备（如 virtio-net）
+ * 只需实现队列通知与配置空间读写回调。
+ *
+ * - 虚拟队列由来宾内存中的三部分组成：
+ * ```
+ *
+ *   desc[num]   : { addr, len, flags, next }      描述符表
+ *   avail       : { flags, idx, ring[num] }       驱动 -> 设备
+ *   used        : { flags, idx, ring[num] }       设备 -> 驱动
+ *
+ * ```
+ *
+ * - 设备侧取出的描述符链直接以主机指针（`struct iovec`）的形式给出，
+ * 指向来宾 DRAM 的映射，后端可以不经中转缓冲区直接读写来宾数据。
+ */
+
+
+#ifndef VIRTIO_H
+#define VIRTIO_H
+
+// ==================================================================== //
+//                             Include
+// ==================================================================== //
+
+#include "bus.h"
+#include <sys/uio.h>
+
+// ==================================================================== //
+//                              Defines
+// ==================================================================== //
+
+#define VIRTIO_MMIO_BASE    0x10001000  /** 第一个 virtio-mmio 设备基址 */
+#define VIRTIO_MMIO_SIZE    0x1000      /** 每个 virtio-mmio 设备地址空间大小 */
+#define VIRTIO_MMIO_IRQ     1           /** 第一个 virtio-mmio 设备中断号 */
+
+#define VIRTIO_MAGIC        0x74726976  /** "virt" */
+#define VIRTIO_VERSION      2
+#define VIRTIO_VENDOR       0x554d4551  /** "QEMU"，与常见驱动兼容 */
+
+#define VIRTIO_MAX_QUEUE    4           /** 每设备最多虚拟队列数 */
+#define VIRTIO_QUEUE_SIZE   256         /** 虚拟队列最大长度 */
+#define VIRTIO_MAX_SG       32          /** 单条描述符链最多段数 */
+
+// MMIO 寄存器偏移
+#define VIRTIO_MMIO_MAGIC_VALUE         0x000
+#define VIRTIO_MMIO_VERSION             0x004
+#define VIRTIO_MMIO_DEVICE_ID           0x008
+#define VIRTIO_MMIO_VENDOR_ID           0x00c
+#define VIRTIO_MMIO_DEVICE_FEATURES     0x010
+#define VIRTIO_MMIO_DEVICE_FEATURES_SEL 0x014
+#define VIRTIO_MMIO_DRIVER_FEATURES     0x020
+#define VIRTIO_MMIO_DRIVER_FEATURES_SEL 0x024
+#define VIRTIO_MMIO_QUEUE_SEL           0x030
+#define VIRTIO_MMIO_QUEUE_NUM_MAX       0x034
+#define VIRTIO_MMIO_QUEUE_NUM           0x038
+#define VIRTIO_MMIO_QUEUE_READY         0x044
+#define VIRTIO_MMIO_QUEUE_NOTIFY        0x050
+#define VIRTIO_MMIO_INTERRUPT_STATUS    0x060
+#define VIRTIO_MMIO_INTERRUPT_ACK       0x064
+#define VIRTIO_MMIO_STATUS              0x070
+#define VIRTIO_MMIO_QUEUE_DESC_LOW      0x080
+#define VIRTIO_MMIO_QUEUE_DESC_HIGH     0x084
+#define VIRTIO_MMIO_QUEUE_AVAIL_LOW     0x090
+#define VIRTIO_MMIO_QUEUE_AVAIL_HIGH    0x094
+#define VIRTIO_MMIO_QUEUE_USED_LOW      0x0a0
+#define VIRTIO_MMIO_QUEUE_USED_HIGH     0x0a4
+#define VIRTIO_MMIO_CONFIG_GENERATION   0x0fc
+#define VIRTIO_MMIO_CONFIG              0x100
+
+// 描述符标志
+#define VIRTQ_DESC_F_NEXT       1
+#define VIRTQ_DESC_F_WRITE      2
+
+// 特性位
+#define VIRTIO_F_VERSION_1      32
+
+// 中断状态位
+#define VIRTIO_INT_VRING        1
+#define VIRTIO_INT_CONFIG       2
+
+
+// ==================================================================== //
+//                             Data: VIRTIO
+// ==================================================================== //
+
+/**
+ * @brief 虚拟队列
+ */
+typedef struct VQ_t {
+    u32 num;            /** 队列长度 */
+    u32 ready;          /** 驱动是否已就绪 */
+    u64 desc;           /** 描述符表来宾物理地址 */
+    u64 avail;          /** 可用环来宾物理地址 */
+    u64 used;           /** 已用环来宾物理地址 */
+    u16 last_avail;     /** 设备已处理到的可用环位置 */
+} VQ;
+
+/**
+ * @brief 从虚拟队列取出的一条描述符链
+ */
+typedef struct VQ_ELEM_t {
+    u16 head;                           /** 链首描述符下标 */
+    int nout;                           /** 设备只读段数 */
+    int nin;                            /** 设备可写段数 */
+    struct iovec out[VIRTIO_MAX_SG];    /** 设备只读段（驱动 -> 设备） */
+    struct iovec in[VIRTIO_MAX_SG];     /** 设备可写段（设备 -> 驱动） */
+} VQ_ELEM;
+
+typedef struct VIRTIO_t VIRTIO;
+
+/**
+ * @brief virtio-mmio 设备
+ */
+struct VIRTIO_t {
+    BUS* bus;                   /** 所在总线 */
+    char* name;                 /** 设备名 */
+    u32 device_id;              /** 设备类型 */
+    u32 irq;                    /** 中断号 */
+    u64 features;               /** 设备特性 */
+    u64 driver_features;        /** 驱动协商后的特性 */
+    u32 device_features_sel;    /** 设备特性选择 */
+    u32 driver_features_sel;    /** 驱动特性选择 */
+    u32 queue_sel;              /** 当前选择的队列 */
+    u32 status;                 /** 设备状态 */
+    u32 isr;                    /** 中断状态 */
+    u32 config_generation;      /** 配置空间版本 */
+    int nvq;                    /** 队列个数 */
+    VQ vq[VIRTIO_MAX_QUEUE];    /** 虚拟队列 */
+    void* opaque;               /** 具体设备私有数据 */
+    pthread_mutex_t* vq_lock;   /** 队列锁：其它线程也访问队列的设备设置，队列寄存器写与复位在此锁下进行 */
+    /** 队列通知（kick）回调 */
+    void (*notify)(VIRTIO* vdev, u32 queue);
+    /** 配置空间读回调 */
+    u64 (*config_load)(VIRTIO* vdev, u64 offset, u64 size);
+    /** 配置空间写回调 */
+    void (*config_store)(VIRTIO* vdev, u64 offset, u64 size, u64 value);
+    /** 设备复位回调 */
+    void (*reset)(VIRTIO* vdev);
+};
+
+
+// ==================================================================== //
+//                            Declare API: VIRTIO
+// ==================================================================== //
+
+/**
+ * @brief 初始化 virtio-mmio 设备并挂载到总线
+ * @param vdev 设备
+ * @param bus 总线
+ * @param name 设备名
+ * @param base 来宾物理基址
+ * @param irq 中断号
+ * @param device_id 设备类型
+ * @param nvq 队列个数
+ * @return int 0 成功，-1 失败
+ */
+int virtio_init(VIRTIO* vdev, BUS* bus, char* name, u64 base, u32 irq, u32 device_id, int nvq);
+
+/**
+ * @brief 从虚拟队列取出一条描述符链
+ * @param vdev 设备
+ * @param vq 虚拟队列
+ * @param elem 输出描述符链（主机指针）
+ * @return int 1 取到，0 队列为空，-1 描述符非法
+ */
+int virtq_pop(VIRTIO* vdev, VQ* vq, VQ_ELEM* elem);
+
+/**
+ * @brief 退回最近取出的若干条描述符链（未使用）
+ * @param vq 虚拟队列
+ * @param n 条数
+ */
+void virtq_unpop(VQ* vq, int n);
+
+/**
+ * @brief 将描述符链放回已用环（不发送中断）
+ * @param vdev 设备
+ * @param vq 虚拟队列
+ * @param head 链首描述符下标
+ * @param len 设备写入的字节数
+ */
+void virtq_push(VIRTIO* vdev, VQ* vq, u16 head, u32 len);
+
+/**
+ * @brief 通知驱动已用环有更新（置起中断）
+ * @param vdev 设备
+ */
+void virtio_notify(VIRTIO* vdev);
+
+/**
+ * @brief 从 iovec 中拷出数据
+ * @param iov 段数组
+ * @param n 段数
+ * @param skip 跳过的字节数
+ * @param buf 目标缓冲区
+ * @param len 长度
+ * @return size_t 实际拷贝字节数
+ */
+size_t iov_to_buf(struct iovec* iov, int n, size_t skip, void* buf, size_t len);
+
+/**
+ * @brief 向 iovec 中拷入数据
+ * @param iov 段数组
+ * @param n 段数
+ * @param skip 跳过的字节数
+ * @param buf 源缓冲区
+ * @param len 长度
+ * @return size_t 实际拷贝字节数
+ */
+size_t iov_from_buf(struct iovec* iov, int n, size_t skip, void* buf, size_t len);
+
+/**
+ * @brief 构造跳过前若干字节后的 iovec 视图（不拷贝数据）
+ * @param dst 输出段数组
+ * @param src 源段数组
+ * @param n 源段数
+ * @param skip 跳过的字节数
+ * @return int 输出段数
+ */
+int iov_skip(struct iovec* dst, struct iovec* src, int n, size_t skip);
+
+/**
+ * @brief 计算 iovec 总长度
+ * @param iov 段数组
+ * @param n 段数
+ * @return size_t 总长度
+ */
+size_t iov_size(struct iovec* iov, int n);
+
+
+#endif // VIRTIO_H
@@ -0,0 +1,311 @@
+/**
+ * @file vnet.c
+ * @author lancer (lancerstadium@163.com)
+ * @brief virtio-net 网卡实现
+ * @version 0.1
+ * @date 2024-01-21
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+
+// ==================================================================== //
+//                             Include
+// ==================================================================== //
+
+#define _GNU_SOURCE
+#include "vnet.h"
+#include "log.h"
+#include "macro.h"
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+
+// ==================================================================== //
+//                          Private Func: VNET
+// ==================================================================== //
+
+/** 接收报文头：不带卸载信息，num_buffers = 1 */
+static u8 vnet_rx_hdr[VNET_HDR_SIZE] = { [10] = 1 };
+
+static inline int vswitch_hash(u8* mac) {
+    return (mac[3] ^ mac[4] ^ mac[5]) % VSWITCH_FDB_SIZE;
+}
+
+/**
+ * @brief 将一个报文直接写入目标网卡的接收队列（需持有`rx_lock`）
+ * @param dst 目标网卡
+ * @param iov 报文（发送方来宾内存）
+ * @param n 段数
+ * @param len 报文长度
+ */
+static void vnet_deliver(VNET* dst, struct iovec* iov, int n, size_t len) {
+    VQ* vq = &dst->vdev.vq[VNET_RXQ];
+    VQ_ELEM* elem = &dst->rx_elems[0];
+    if (virtq_pop(&dst->vdev, vq, elem) != 1) {
+        dst->rx_dropped++;
+        return;
+    }
+    if (iov_size(elem->in, elem->nin) < VNET_HDR_SIZE + len) {
+        virtq_push(&dst->vdev, vq, elem->head, 0);
+        dst->rx_dropped++;
+        dst->rx_notify = 1;
+        return;
+    }
+    iov_from_buf(elem->in, elem->nin, 0, vnet_rx_hdr, VNET_HDR_SIZE);
+    size_t off = VNET_HDR_SIZE;
+    for (int i = 0; i < n; i++) {
+        iov_from_buf(elem->in, elem->nin, off, iov[i].iov_base, iov[i].iov_len);
+        off += iov[i].iov_len;
+    }
+    virtq_push(&dst->vdev, vq, elem->head, off);
+    dst->rx_packets++;
+    dst->rx_notify = 1;
+}
+
+/**
+ * @brief 交换机转发一个报文：学习源 MAC，单播命中则定向投递，否则泛洪
+ */
+static void vswitch_forward(VSWITCH* sw, int src_port, struct iovec* iov, int n, size_t len) {
+    u8 eth[12];
+    if (iov_to_buf(iov, n, 0, eth, sizeof(eth)) < sizeof(eth))
+        return;
+    u8* dst_mac = eth;
+    u8* src_mac = eth + 6;
+
+    pthread_mutex_lock(&sw->lock);
+    int h = vswitch_hash(src_mac);
+    memcpy(sw->fdb[h].mac, src_mac, 6);
+    sw->fdb[h].port = src_port;
+
+    int to = -1;
+    h = vswitch_hash(dst_mac);
+    if (!(dst_mac[0] & 1) && memcmp(sw->fdb[h].mac, dst_mac, 6) == 0)
+        to = sw->fdb[h].port;
+    for (int i = 0; i < sw->nport; i++) {
+        if (i == src_port || (to >= 0 && i != to))
+            continue;
+        VNET* dst = sw->ports[i];
+        pthread_mutex_lock(&dst->rx_lock);
+        vnet_deliver(dst, iov, n, len);
+        pthread_mutex_unlock(&dst->rx_lock);
+    }
+    pthread_mutex_unlock(&sw->lock);
+}
+
+/**
+ * @brief 批次结束后，为本批次收到报文的交换机端口各发一次中断
+ */
+static void vswitch_flush(VSWITCH* sw) {
+    pthread_mutex_lock(&sw->lock);
+    for (int i = 0; i < sw->nport; i++) {
+        VNET* dst = sw->ports[i];
+        pthread_mutex_lock(&dst->rx_lock);
+        if (dst->rx_notify) {
+            dst->rx_notify = 0;
+            virtio_notify(&dst->vdev);
+        }
+        pthread_mutex_unlock(&dst->rx_lock);
+    }
+    pthread_mutex_unlock(&sw->lock);
+}
+
+/**
+ * @brief 发送一批报文：报文段直接指向来宾内存，socket 后端一次 sendmmsg 发出
+ * @param net 网卡
+ * @param n 报文数
+ */
+static void vnet_tx_batch(VNET* net, int n) {
+    struct iovec iovs[VNET_BATCH][VIRTIO_MAX_SG];
+    struct mmsghdr msgs[VNET_BATCH];
+    VQ* vq = &net->vdev.vq[VNET_TXQ];
+
+    for (int i = 0; i < n; i++) {
+        VQ_ELEM* elem = &net->tx_elems[i];
+        int cnt = iov_skip(iovs[i], elem->out, elem->nout, VNET_HDR_SIZE);
+        // 两种后端可以同时接入：交换机逐个转发，socket 整批发出
+        memset(&msgs[i], 0, sizeof(msgs[i]));
+        msgs[i].msg_hdr.msg_iov = iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = cnt;
+        if (net->sw)
+            vswitch_forward(net->sw, net->port, iovs[i], cnt, iov_size(iovs[i], cnt));
+    }
+    if (net->fd >= 0) {
+        int sent = 0;
+        while (sent < n) {
+            int r = sendmmsg(net->fd, msgs + sent, n - sent, MSG_DONTWAIT);
+            if (r <= 0)
+                break;
+            sent += r;
+        }
+        if (sent < n)
+            log_warn("vnet: tx dropped %d packets", n - sent);
+    }
+    for (int i = 0; i < n; i++)
+        virtq_push(&net->vdev, vq, net->tx_elems[i].head, 0);
+    net->tx_packets += n;
+    virtio_notify(&net->vdev);
+    if (net->sw)
+        vswitch_flush(net->sw);
+}
+
+/**
+ * @brief 接收：一次 recvmmsg 直接写入来宾接收缓冲区；
+ * 接收缓冲区用完（或队列未就绪）时暂停轮询描述符，驱动补充缓冲区时恢复
+ * @param opaque 网卡
+ */
+static void vnet_rx_poll(void* opaque) {
+    VNET* net = opaque;
+    VQ* vq = &net->vdev.vq[VNET_RXQ];
+    struct iovec iovs[VNET_BATCH][VIRTIO_MAX_SG];
+    struct mmsghdr msgs[VNET_BATCH];
+
+    pthread_mutex_lock(&net->rx_lock);
+    for (;;) {
+        int n = 0;
+        while (n < VNET_BATCH && virtq_pop(&net->vdev, vq, &net->rx_elems[n]) == 1) {
+            VQ_ELEM* elem = &net->rx_elems[n];
+            memset(&msgs[n], 0, sizeof(msgs[n]));
+            msgs[n].msg_hdr.msg_iov = iovs[n];
+            msgs[n].msg_hdr.msg_iovlen = iov_skip(iovs[n], elem->in, elem->nin, VNET_HDR_SIZE);
+            n++;
+        }
+        if (n == 0) {
+            bus_pause_poll(net->vdev.bus, net->fd, 1);
+            break;
+        }
+        int r = recvmmsg(net->fd, msgs, n, MSG_DONTWAIT, NULL);
+        if (r < 0)
+            r = 0;
+        for (int i = 0; i < r; i++) {
+            VQ_ELEM* elem = &net->rx_elems[i];
+            iov_from_buf(elem->in, elem->nin, 0, vnet_rx_hdr, VNET_HDR_SIZE);
+            virtq_push(&net->vdev, vq, elem->head, VNET_HDR_SIZE + msgs[i].msg_len);
+        }
+        virtq_unpop(vq, n - r);
+        net->rx_packets += r;
+        if (r)
+            net->rx_notify = 1;
+        if (r < n)
+            break;
+    }
+    if (net->rx_notify) {
+        net->rx_notify = 0;
+        virtio_notify(&net->vdev);
+    }
+    pthread_mutex_unlock(&net->rx_lock);
+}
+
+static void vnet_notify(VIRTIO* vdev, u32 queue) {
+    VNET* net = vdev->opaque;
+    if (queue == VNET_RXQ) {
+        // 驱动补充了接收缓冲区：恢复轮询，并取出积压在 socket 中的报文
+        if (net->fd >= 0) {
+            bus_pause_poll(vdev->bus, net->fd, 0);
+            vnet_rx_poll(net);
+        }
+        return;
+    }
+    int n = 0;
+    while (virtq_pop(vdev, &vdev->vq[VNET_TXQ], &net->tx_elems[n]) == 1) {
+        if (++n == VNET_BATCH) {
+            vnet_tx_batch(net, n);
+            n = 0;
+        }
+    }
+    if (n)
+        vnet_tx_batch(net, n);
+}
+
+static u64 vnet_config_load(VIRTIO* vdev, u64 offset, u64 size) {
+    VNET* net = vdev->opaque;
+    u8 cfg[8];
+    memcpy(cfg, net->mac, 6);
+    cfg[6] = VIRTIO_NET_S_LINK_UP;
+    cfg[7] = 0;
+    u64 value = 0;
+    for (u64 i = 0; i < size / 8 && offset + i < sizeof(cfg); i++)
+        value |= (u64)cfg[offset + i] << (8 * i);
+    return value;
+}
+
+
+// ==================================================================== //
+//                            Func API: VNET
+// ==================================================================== //
+
+int vnet_init(VNET* net, BUS* bus, u64 base, u32 irq, u8 mac[6]) {
+    if (virtio_init(&net->vdev, bus, "virtio-net", base, irq, VIRTIO_ID_NET, 2) < 0)
+        return -1;
+    net->vdev.features |= ((u64)1 << VIRTIO_NET_F_MAC) | ((u64)1 << VIRTIO_NET_F_STATUS);
+    net->vdev.opaque = net;
+    net->vdev.notify = vnet_notify;
+    net->vdev.config_load = vnet_config_load;
+    memcpy(net->mac, mac, 6);
+    net->fd = -1;
+    net->sw = NULL;
+    net->port = -1;
+    net->rx_notify = 0;
+    net->tx_packets = net->rx_packets = net->rx_dropped = 0;
+    pthread_mutex_init(&net->rx_lock, NULL);
+    // 交换机上其它机器在 rx_lock 下投递：队列寄存器写与复位也须持有它
+    net->vdev.vq_lock = &net->rx_lock;
+    return 0;
+}
+
+int vnet_attach_fd(VNET* net, int fd) {
+    net->fd = fd;
+    return bus_add_poll(net->vdev.bus, fd, vnet_rx_poll, net);
+}
+
+int vnet_socketpair(VNET* a, VNET* b) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_DGRAM, 0, sv) < 0) {
+        log_error("vnet: socketpair failed");
+        return -1;
+    }
+    if (vnet_attach_fd(a, sv[0]) < 0 || vnet_attach_fd(b, sv[1]) < 0)
+        return -1;
+    return 0;
+}
+
+int vnet_connect(VNET* net, char* path) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    // 自动绑定一个抽象地址，对端才能向网卡回发报文
+    if (fd < 0 || bind(fd, (struct sockaddr*)&addr, sizeof(sa_family_t)) < 0) {
+        log_error("vnet: socket failed");
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        log_error("vnet: connect %s failed", path);
+        close(fd);
+        return -1;
+    }
+    return vnet_attach_fd(net, fd);
+}
+
+void vswitch_init(VSWITCH* sw) {
+    memset(sw, 0, sizeof(VSWITCH));
+    pthread_mutex_init(&sw->lock, NULL);
+    for (int i = 0; i < VSWITCH_FDB_SIZE; i++)
+        sw->fdb[i].port = -1;
+}
+
+int vnet_attach_switch(VNET* net, VSWITCH* sw) {
+    pthread_mutex_lock(&sw->lock);
+    if (sw->nport >= VSWITCH_MAX_PORT) {
+        pthread_mutex_unlock(&sw->lock);
+        log_error("vswitch: no free port");
+        return -1;
+    }
+    net->sw = sw;
+    net->port = sw->nport;
+    sw->ports[sw->nport++] = net;
+    pthread_mutex_unlock(&sw->lock);
+    return 0;
+}
@@ -0,0 +1,149 @@
+/**
+ * @file vnet.h
+ * @author lancer (lancerstadium@163.com)
+ * @brief virtio-net 网卡头文件
+ * @version 0.1
+ * @date 2024-01-21
+ * @copyright Copyright (c) 2024
+ *
+ * # virtio-net 介绍
+ * - 网卡有两个虚拟队列：0 号为接收队列（rx），1 号为发送队列（tx）。
+ * 每个报文前带有 12 字节的`virtio_net_hdr`，这里不提供任何卸载特性，
+ * 报文头在发送时被跳过，接收时填 0。
+ *
+ * - 网卡后端有两种，都不依赖 tap 设备或外部网络：
+ * 1. 主机`socketpair`：报文以数据报形式收发，发送时一次 kick 取出的所有报文
+ * 通过一次`sendmmsg()`发出，接收时通过一次`recvmmsg()`直接写入来宾缓冲区；
+ * 2. 进程内交换机`VSWITCH`：同一进程中的多台模拟机器接在交换机端口上，
+ * 交换机按源 MAC 学习转发表，报文从发送方来宾内存直接拷贝到接收方来宾内存。
+ *
+ * - 两种后端都以 kick 为批处理单位：一批报文处理完后每个目标网卡只发一次中断。
+ *
+ * - `cemu default -n <path>`在`VNET_MMIO_BASE`挂一块网卡，后端为连接到`path`的
+ * 主机 Unix 数据报 socket，每个数据报是一个不带`virtio_net_hdr`的以太网帧。
+ */
+
+
+#ifndef VNET_H
+#define VNET_H
+
+// ==================================================================== //
+//                             Include
+// ==================================================================== //
+
+#include "virtio.h"
+#include <pthread.h>
+
+// ==================================================================== //
+//                              Defines
+// ==================================================================== //
+
+#define VIRTIO_ID_NET           1       /** virtio-net 设备类型 */
+#define VIRTIO_NET_F_MAC        5       /** 特性：配置空间提供 MAC */
+#define VIRTIO_NET_F_STATUS     16      /** 特性：配置空间提供链路状态 */
+#define VIRTIO_NET_S_LINK_UP    1       /** 链路状态：已连接 */
+
+#define VNET_HDR_SIZE           12      /** virtio_net_hdr（含 num_buffers）大小 */
+#define VNET_RXQ                0       /** 接收队列 */
+#define VNET_TXQ                1       /** 发送队列 */
+#define VNET_BATCH              32      /** 每批最多处理的报文数 */
+#define VNET_MMIO_BASE          (VIRTIO_MMIO_BASE + VIRTIO_MMIO_SIZE)   /** 命令行网卡基址 */
+#define VNET_IRQ                (VIRTIO_MMIO_IRQ + 1)                   /** 命令行网卡中断号 */
+
+#define VSWITCH_MAX_PORT        16      /** 交换机最多端口数 */
+#define VSWITCH_FDB_SIZE        64      /** 交换机转发表大小 */
+
+
+// ==================================================================== //
+//                             Data: VNET
+// ==================================================================== //
+
+typedef struct VSWITCH_t VSWITCH;
+
+/**
+ * @brief virtio-net 网卡
+ */
+typedef struct VNET_t {
+    VIRTIO vdev;                    /** virtio 设备 */
+    u8 mac[6];                      /** MAC 地址 */
+    int fd;                         /** socketpair 后端描述符，-1 表示无 */
+    VSWITCH* sw;                    /** 进程内交换机后端，NULL 表示无 */
+    int port;                       /** 交换机端口号 */
+    int rx_notify;                  /** 本批次内是否有报文写入接收队列 */
+    pthread_mutex_t rx_lock;        /** 接收队列锁：交换机上其它机器可能并发投递，也是 virtio 的`vq_lock` */
+    VQ_ELEM tx_elems[VNET_BATCH];   /** 发送批次 */
+    VQ_ELEM rx_elems[VNET_BATCH];   /** 接收批次 */
+    u64 tx_packets;                 /** 已发送报文数 */
+    u64 rx_packets;                 /** 已接收报文数 */
+    u64 rx_dropped;                 /** 因无接收缓冲区丢弃的报文数 */
+} VNET;
+
+/**
+ * @brief 进程内以太网交换机
+ */
+struct VSWITCH_t {
+    pthread_mutex_t lock;               /** 端口与转发表锁 */
+    int nport;                          /** 端口数 */
+    VNET* ports[VSWITCH_MAX_PORT];      /** 端口上的网卡 */
+    struct {
+        u8 mac[6];
+        int port;
+    } fdb[VSWITCH_FDB_SIZE];            /** 转发表（按 MAC 哈希） */
+};
+
+
+// ==================================================================== //
+//                            Declare API: VNET
+// ==================================================================== //
+
+/**
+ * @brief 初始化网卡并挂载到总线
+ * @param net 网卡
+ * @param bus 总线
+ * @param base 来宾物理基址
+ * @param irq 中断号
+ * @param mac MAC 地址
+ * @return int 0 成功，-1 失败
+ */
+int vnet_init(VNET* net, BUS* bus, u64 base, u32 irq, u8 mac[6]);
+
+/**
+ * @brief 为网卡接入数据报描述符后端（如 socketpair 的一端）
+ * @param net 网卡
+ * @param fd 数据报描述符
+ * @return int 0 成功，-1 失败
+ */
+int vnet_attach_fd(VNET* net, int fd);
+
+/**
+ * @brief 为网卡接入主机 Unix 数据报 socket 后端
+ * @param net 网卡
+ * @param path 对端 socket 路径
+ * @return int 0 成功，-1 失败
+ */
+int vnet_connect(VNET* net, char* path);
+
+/**
+ * @brief 用一对`socketpair`将两块网卡直连
+ * @param a 网卡 a
+ * @param b 网卡 b
+ * @return int 0 成功，-1 失败
+ */
+int vnet_socketpair(VNET* a, VNET* b);
+
+/**
+ * @brief 初始化进程内交换机
+ * @param sw 交换机
+ */
+void vswitch_init(VSWITCH* sw);
+
+/**
+ * @brief 将网卡接入进程内交换机
+ * @param net 网卡
+ * @param sw 交换机
+ * @return int 0 成功，-1 失败
+ */
+int vnet_attach_switch(VNET* net, VSWITCH* sw);
+
+
+#endif // VNET_H
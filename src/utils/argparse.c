@@ -269,13 +269,16 @@ static inline void _ap_parser_command_line(int argc, char *argv[])
         int need_parse_len = strlen(need_parse);
 
         // 判断是否为一个参数名
-        int is_short = strncmp(need_parse, AP_SHORT_FLAG, ap_min(need_parse_len, short_flag_len)) == 0;
-        int is_long = strncmp(need_parse, AP_LONG_FLAG, ap_min(need_parse_len, long_flag_len)) == 0;
+        // 单独的 "-" 是参数值（如 `-o -` 表示标准输出）
+        int is_short = need_parse_len > short_flag_len && strncmp(need_parse, AP_SHORT_FLAG, short_flag_len) == 0;
+        int is_long = need_parse_len > long_flag_len && strncmp(need_parse, AP_LONG_FLAG, long_flag_len) == 0;
         int is_file = 0;
 
         FILE *fp = fopen(need_parse, "r");
-        if(fp) is_file = 1;
-        free(fp);
+        if(fp) {
+            is_file = 1;
+            fclose(fp);
+        }
 
         if (is_short || is_long)
         {
@@ -33,6 +33,9 @@ static const char *level_colors[] = {
     ANSI_BRIGHT_BLUE, ANSI_CYAN, ANSI_GREEN, ANSI_YELLOW, ANSI_RED, ANSI_MAGENTA, ANSI_BRIGHT_GREEN, ANSI_BRIGHT_RED};
 #endif
 
+/** 跟踪开关，见 `log_set_trace` */
+bool log_trace_on = false;
+
 
 // ==================================================================== //
 //                            Func API: LOG
@@ -108,6 +111,11 @@ void log_set_quiet(bool enable)
     L.quiet = enable;
 }
 
+void log_set_trace(bool enable)
+{
+    log_trace_on = enable;
+}
+
 int log_add_callback(log_LogFn fn, void *udata, int level)
 {
     for (int i = 0; i < MAX_CALLBACKS; i++)
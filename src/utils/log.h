@@ -107,6 +107,11 @@ static struct {
     Callback callbacks[MAX_CALLBACKS];              /** 回调函数 */
 } L;
 
+/**
+ * @brief 跟踪开关：控制 TRACE 级别日志与逐条指令跟踪输出，默认关闭
+ * @note 逐条指令的输出会让多线程客户机在 stdout 锁上串行，只在调试时打开
+ */
+extern bool log_trace_on;
 
 
 // ==================================================================== //
@@ -123,8 +128,8 @@ static inline const char *filename_from_path(const char *path) {
     return (bname != NULL) ? bname + 1 : path;
 }
 
-/** 日志跟踪级别输出 */
-#define log_trace(...) log_log(LOG_TRACE, __FILE__, __LINE__, __VA_ARGS__)
+/** 日志跟踪级别输出：跟踪开关关闭时不求值参数 */
+#define log_trace(...) do { if (log_trace_on) log_log(LOG_TRACE, __FILE__, __LINE__, __VA_ARGS__); } while (0)
 
 /** 日志调试级别输出 */
 #define log_debug(...) log_log(LOG_DEBUG, __FILE__, __LINE__, __VA_ARGS__)
@@ -203,6 +208,12 @@ void log_set_level(int level);
  */
 void log_set_quiet(bool enable);
 
+/**
+ * @brief 设置跟踪开关
+ * @param enable 布尔值：`true` 输出 `log_trace` 与逐条指令跟踪，`false` 关闭（默认）
+ */
+void log_set_trace(bool enable);
+
 /**
  * @brief 添加日志回调
  * @param fn 日志锁回调函数，参考 `log_LockFn`
@@ -23,10 +23,19 @@ void arg_parser(int argc, char *argv[], char *envp[]) {
     // Step3: 初始化解析器
     ap_init_parser("uemu - a simple emulator", NULL);
     // Step4: 添加命令
-    ap_add_command("default", "Cemu main func.", "cemu", default_callback, default_args);
+    ap_add_command("default", "Cemu main func.", "cemu -i <elf> [-e host|none] [-- guest args...]", default_callback, default_args);
     ap_add_command("hello", "Print `Hello, World!`.", "cemu hello", hello_callback, default_args);
     ap_add_command("debug", "Enter debug mode.", "This is usage.", debug_callback, debug_args);
     ap_add_command("test", "Unit test", "This is usage.", test_callback, test_args);
-    // Step5: 开始解析
-    ap_do_parser(argc, argv, envp);
+    ap_add_command("chan", "Stream stdin/stdout through a data channel.", "cemu chan -i <socket>", chan_callback, chan_args);
+    ap_add_command("batch", "Run a manifest of jobs on a thread pool.", "cemu batch -i <manifest> [-j N] [-o out.jsonl]", batch_callback, batch_args);
+    ap_add_command("footprint", "Measure memory per idle instance.", "cemu footprint [-n N] [-m max_bytes] [-i <elf>]", footprint_callback, footprint_args);
+    ap_add_command("serve", "Fork a pre-started guest per socket request.", "cemu serve -i <elf> [-l socket] [-a entry|marker] [-n N] [-j max] [-t ms]", serve_callback, serve_args);
+    ap_add_command("snapshot", "Save or restore a machine snapshot.", "cemu snapshot -i <elf> -w <file> [-a entry|marker] | -r <file> [-n N]", snapshot_callback, snapshot_args);
+    ap_add_command("mkdisk", "Create a copy-on-write disk overlay.", "cemu mkdisk -o <overlay> [-b base] [-z bytes] [-c cluster_bits]", mkdisk_callback, mkdisk_args);
+    // Step5: 开始解析，`--`之后的参数原样留给来宾程序（见`cemu_guest_args()`）
+    int n = 0;
+    while (n < argc && strcmp(argv[n], "--") != 0)
+        n++;
+    ap_do_parser(n, argv, envp);
 }
\ No newline at end of file
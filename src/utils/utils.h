@@ -36,6 +36,14 @@
 ap_def_args(default_args) = {
     {.short_arg = "o", .long_arg = "output", .init.s = "./a.out", .help = "set output path"},
     {.short_arg = "q", .long_arg = "quiet",  .init.i = 3, .help = "set quiet level"},
+    {.short_arg = "c", .long_arg = "chan",   .init.s = "", .help = "export data channel on socket"},
+    {.short_arg = "r", .long_arg = "rdev",   .init.s = "", .help = "connect out-of-process device on socket"},
+    {.short_arg = "n", .long_arg = "net",    .init.s = "", .help = "connect virtio-net to datagram socket"},
+    {.short_arg = "b", .long_arg = "disk",   .init.s = "", .help = "attach virtio-blk backed by overlay image"},
+    {.short_arg = "s", .long_arg = "smp",    .init.i = 1, .help = "set number of harts"},
+    {.short_arg = "d", .long_arg = "det",    .init.i = 0, .help = "run harts round-robin in quanta of N insts (deterministic)"},
+    {.short_arg = "e", .long_arg = "env",    .init.s = "host", .help = "guest environment for Linux programs: host or none"},
+    {.short_arg = "t", .long_arg = "trace",  .init.i = 0, .help = "print per-instruction trace, 1 to enable"},
     AP_INPUT_ARG,
     AP_END_ARG};
 
@@ -50,6 +58,53 @@ ap_def_args(debug_args) = {
     AP_INPUT_ARG,
     AP_END_ARG};
 
+ap_def_args(chan_args) = {
+    AP_INPUT_ARG,
+    AP_END_ARG};
+
+ap_def_args(batch_args) = {
+    {.short_arg = "o", .long_arg = "output", .init.s = "./batch.jsonl", .help = "set JSON lines output path, - for stdout"},
+    {.short_arg = "j", .long_arg = "jobs",   .init.i = 0, .help = "set number of worker threads, 0 for all host cpus"},
+    {.short_arg = "s", .long_arg = "smp",    .init.i = 1, .help = "set number of harts per job"},
+    {.short_arg = "d", .long_arg = "det",    .init.i = 0, .help = "run harts round-robin in quanta of N insts (deterministic)"},
+    AP_INPUT_ARG,
+    AP_END_ARG};
+
+ap_def_args(serve_args) = {
+    {.short_arg = "l", .long_arg = "listen", .init.s = "./cemu.sock", .help = "set request socket path"},
+    {.short_arg = "a", .long_arg = "at",     .init.s = "entry", .help = "set fork point: entry or marker (slti x0, x0, 1)"},
+    {.short_arg = "n", .long_arg = "count",  .init.i = 0, .help = "exit after N requests, 0 for no limit"},
+    {.short_arg = "j", .long_arg = "jobs",   .init.i = 0, .help = "set max concurrent requests, 0 for all host cpus"},
+    {.short_arg = "t", .long_arg = "timeout", .init.i = 0, .help = "kill a request after N ms, 0 for no limit"},
+    {.short_arg = "o", .long_arg = "output", .init.s = "./serve.jsonl", .help = "append JSON lines results to path, - for stdout"},
+    {.short_arg = "s", .long_arg = "smp",    .init.i = 1, .help = "set number of harts"},
+    {.short_arg = "d", .long_arg = "det",    .init.i = 0, .help = "run harts round-robin in quanta of N insts (deterministic)"},
+    AP_INPUT_ARG,
+    AP_END_ARG};
+
+ap_def_args(snapshot_args) = {
+    {.short_arg = "w", .long_arg = "save",   .init.s = "", .help = "boot input ELF and save snapshot to path"},
+    {.short_arg = "r", .long_arg = "load",   .init.s = "", .help = "restore snapshot from path and run"},
+    {.short_arg = "a", .long_arg = "at",     .init.s = "entry", .help = "save at: entry or marker (slti x0, x0, 1)"},
+    {.short_arg = "n", .long_arg = "count",  .init.i = 1, .help = "restore and run N times"},
+    {.short_arg = "s", .long_arg = "smp",    .init.i = 1, .help = "set number of harts"},
+    {.short_arg = "d", .long_arg = "det",    .init.i = 0, .help = "run harts round-robin in quanta of N insts (deterministic)"},
+    AP_INPUT_ARG,
+    AP_END_ARG};
+
+ap_def_args(mkdisk_args) = {
+    {.short_arg = "o", .long_arg = "output",  .init.s = "", .help = "set overlay image path"},
+    {.short_arg = "b", .long_arg = "base",    .init.s = "", .help = "set read-only base image"},
+    {.short_arg = "z", .long_arg = "size",    .init.i = 0, .help = "set disk size in bytes, 0 for base image size"},
+    {.short_arg = "c", .long_arg = "cluster", .init.i = 0, .help = "set cluster size bits, 0 for 64KB"},
+    AP_END_ARG};
+
+ap_def_args(footprint_args) = {
+    {.short_arg = "n", .long_arg = "count",  .init.i = 10000, .help = "set number of idle instances"},
+    {.short_arg = "m", .long_arg = "max",    .init.i = 0, .help = "fail if bytes per instance exceed this, 0 for no limit"},
+    AP_INPUT_ARG,
+    AP_END_ARG};
+
 
 
 // ==================================================================== //
@@ -63,6 +118,12 @@ ap_def_callback(default_callback);
 ap_def_callback(hello_callback);
 ap_def_callback(debug_callback);
 ap_def_callback(test_callback);
+ap_def_callback(chan_callback);
+ap_def_callback(batch_callback);
+ap_def_callback(footprint_callback);
+ap_def_callback(serve_callback);
+ap_def_callback(snapshot_callback);
+ap_def_callback(mkdisk_callback);
 
 /**
  * @brief 参数解析
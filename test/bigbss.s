@@ -0,0 +1,11 @@
+# 装载失败测试：.bss 为 1MB，超出 DRAM，cemu batch 应为该任务输出 "status":"error" 并继续
+# 构建：同 thread.s
+.globl _start
+_start:
+  li a0, 0
+  li a7, 93
+  ecall
+
+.bss
+big:
+  .space 0x100000
@@ -0,0 +1,121 @@
+#!/bin/sh
+# cemu 回归测试：运行 test/ 下的客户机程序并检查退出码与输出
+# 用法：test/check.sh [cemu 路径]（默认 ./build 下由 xmake 构建的 cemu）
+cd "$(dirname "$0")/.." || exit 1
+CEMU=${1:-$(find build -type f -name cemu 2>/dev/null | head -n 1)}
+[ -x "$CEMU" ] || { echo "cemu not found, build first or pass its path"; exit 1; }
+pass=0
+fail=0
+
+ok()  { pass=$((pass + 1)); echo "[PASS] $1"; }
+bad() { fail=$((fail + 1)); echo "[FAIL] $1"; }
+
+# expect_rc <名称> <期望退出码> <cemu 参数...>
+expect_rc() {
+    name=$1; want=$2; shift 2
+    timeout 60 "$CEMU" "$@" >/dev/null 2>&1
+    rc=$?
+    [ "$rc" = "$want" ] && ok "$name" || bad "$name (rc $rc, want $want)"
+}
+
+# expect_same <名称> <cemu 参数...>：连续两次运行的退出码相同
+expect_same() {
+    name=$1; shift
+    timeout 60 "$CEMU" "$@" >/dev/null 2>&1
+    rc1=$?
+    timeout 60 "$CEMU" "$@" >/dev/null 2>&1
+    rc=$?
+    [ "$rc" = "$rc1" ] && ok "$name" || bad "$name (rc $rc1, then $rc)"
+}
+
+# expect_out <名称> <期望输出行> <cemu 参数...>
+expect_out() {
+    name=$1; want=$2; shift 2
+    timeout 60 "$CEMU" "$@" 2>/dev/null | grep -qxF "$want" && ok "$name" || bad "$name"
+}
+
+expect_rc  "unit tests"               0 test
+expect_out "user: static glibc"       "trg idx: 2" default -i test/temp_02.out
+expect_rc  "user: writev bounds"      0 default -i test/writev.out
+expect_rc  "user: elf over DRAM"      1 default -i test/bigbss.out
+expect_rc  "user: clone/futex"        2 default -i test/thread.out
+expect_rc  "user: clone/futex --det"  2 default -i test/thread.out -d 100
+expect_rc  "user: thread exit_group"   42 default -i test/thread_exit.out
+expect_rc  "user: thread exit_group --det" 42 default -i test/thread_exit.out -d 100
+expect_same "user: thread race --det"  default -i test/race.out -d 7
+
+# 空闲实例开销：超过阈值（字节/实例）时 footprint 返回 1；当前约 6 KB 与 450 KB，阈值留出余量
+expect_rc  "footprint: idle"          0 footprint -n 1000 -m 16384
+expect_rc  "footprint: static glibc"  0 footprint -n 200 -m 1048576 -i test/temp_02.out
+expect_rc  "footprint: over limit"    1 footprint -n 100 -m 1024
+
+# 块设备：创建覆盖镜像并挂到机器上
+img=$(mktemp -u)
+expect_rc  "mkdisk"                   0 mkdisk -o "$img" -z 1048576
+expect_out "user: with virtio-blk"    "trg idx: 2" default -i test/temp_02.out -b "$img"
+expect_rc  "mkdisk: size 0"           255 mkdisk -o "$img"
+rm -f "$img"
+
+# 快照：完整快照可恢复，截断的快照被拒绝（而不是访问映射时 SIGBUS）
+snap=$(mktemp -u)
+expect_rc  "snapshot: save"           0 snapshot -i test/thread_exit.out -w "$snap"
+expect_rc  "snapshot: restore"        0 snapshot -r "$snap"
+truncate -s 70000 "$snap"
+expect_rc  "snapshot: truncated"      255 snapshot -r "$snap"
+rm -f "$snap"
+
+# 批量运行：每个任务一行 JSON，按完成顺序输出
+out=$(mktemp)
+timeout 60 "$CEMU" batch -i test/batch.txt -o "$out" -j 2 >/dev/null 2>&1
+expect_json() {
+    grep -qF "$2" "$out" && ok "batch: $1" || bad "batch: $1"
+}
+[ "$(wc -l < "$out")" = 7 ] && ok "batch: 7 lines" || bad "batch: 7 lines"
+expect_json "args job"      '{"id":0,"elf":"test/temp_02.out","args":"foo bar","status":"exit","code":0,'
+expect_json "thread job"    '{"id":1,"elf":"test/thread.out","args":"","status":"exit","code":2,'
+expect_json "exit_group job" '{"id":2,"elf":"test/thread_exit.out","args":"","status":"exit","code":42,'
+expect_json "missing elf"   '{"id":3,"elf":"test/missing.out","args":"","status":"error",'
+expect_json "elf over DRAM" '{"id":4,"elf":"test/bigbss.out","args":"","status":"error",'
+expect_json "not an elf"    '{"id":5,"elf":"test/batch.txt","args":"","status":"error",'
+expect_json "after errors"  '{"id":6,"elf":"test/thread_exit.out","args":"","status":"exit","code":42,'
+rm -f "$out"
+
+# 预启动服务：用户态来宾的标准输入输出接到连接上；死循环的请求超时后被终止
+if command -v python3 >/dev/null 2>&1; then
+    sock=$(mktemp -u)
+    out=$(mktemp)
+    timeout 60 "$CEMU" serve -i test/echo.out -l "$sock" -n 3 -j 2 -t 500 -o "$out" >/dev/null 2>&1 &
+    srv=$!
+    reply=$(timeout 30 python3 - "$sock" <<'PY'
+import socket, sys, time
+def req(data):
+    s = socket.socket(socket.AF_UNIX)
+    for _ in range(100):
+        try:
+            s.connect(sys.argv[1])
+            break
+        except OSError:
+            time.sleep(0.1)
+    s.sendall(data)
+    s.shutdown(socket.SHUT_WR)
+    got = b""
+    while True:
+        r = s.recv(65536)
+        if not r:
+            return got
+        got += r
+print(req(b"hello serve").decode(), req(b"!spin").decode() == "", len(req(b"x" * 100000)))
+PY
+)
+    wait $srv
+    [ "$reply" = "hello serve True 100000" ] && ok "serve: stdio echo" || bad "serve: stdio echo ($reply)"
+    grep -qF '{"id":0,"status":"exit","code":11,' "$out" && ok "serve: exit code" || bad "serve: exit code"
+    grep -qF '{"id":1,"status":"timeout",' "$out" && ok "serve: timeout" || bad "serve: timeout"
+    grep -qF '{"id":2,"status":"exit","code":100000,' "$out" && ok "serve: large input" || bad "serve: large input"
+    rm -f "$sock" "$out"
+else
+    echo "[SKIP] serve: python3 not found"
+fi
+
+echo "$pass passed, $fail failed"
+[ "$fail" = 0 ]
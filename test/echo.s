@@ -0,0 +1,35 @@
+# 预启动服务测试：cemu serve -i test/echo.out，把标准输入原样写回标准输出，退出码为读到的字节数
+#   输入以 ! 开头时进入死循环，用于检查请求超时
+# 构建：同 thread.s
+.globl _start
+_start:
+  li s0, 0
+loop:
+  li a0, 0
+  la a1, buf
+  li a2, 4096
+  li a7, 63
+  ecall
+  blez a0, done
+  la a1, buf
+  bnez s0, echo
+  lbu t0, 0(a1)
+  li t1, '!'
+  beq t0, t1, spin
+echo:
+  add s0, s0, a0
+  mv a2, a0
+  li a0, 1
+  li a7, 64
+  ecall
+  j loop
+spin:
+  j spin
+done:
+  mv a0, s0
+  li a7, 93
+  ecall
+
+.bss
+buf:
+  .space 4096
@@ -0,0 +1,57 @@
+# 确定性模式的线程交错测试：cemu default -i test/race.out -d N，同一 N 下退出码逐次相同
+#   主线程 clone 一个子线程，两个线程各做 K 次非原子的 lw/addi/sw 累加，互相覆盖的次数取决于交错，
+#   主线程在 tid 上 FUTEX_WAIT 直到子线程退出清零，以丢失的累加次数（2K - counter）的低 8 位退出
+# 构建：同 thread.s
+.equ K, 20000
+.globl _start
+_start:
+  li a0, 0x250100       # VM|THREAD|PARENT_SETTID|CHILD_CLEARTID
+  la a1, stack_top
+  la a2, tid
+  li a3, 0
+  mv a4, a2
+  li a7, 220            # clone
+  ecall
+  beqz a0, child
+  bltz a0, fail
+  call work
+1: la a0, tid
+  lw a2, 0(a0)
+  beqz a2, 2f
+  li a1, 0              # FUTEX_WAIT
+  li a3, 0
+  li a7, 98
+  ecall
+  j 1b
+2: la t0, counter
+  lw t1, 0(t0)
+  li a0, 2 * K
+  sub a0, a0, t1
+  li a7, 94             # exit_group
+  ecall
+fail:
+  li a0, 99
+  li a7, 94
+  ecall
+child:
+  call work
+  li a0, 0
+  li a7, 93             # exit
+  ecall
+work:
+  li t2, K
+  la t3, counter
+3: lw t4, 0(t3)
+  addi t4, t4, 1
+  sw t4, 0(t3)
+  addi t2, t2, -1
+  bnez t2, 3b
+  ret
+.data
+.align 3
+counter: .word 0
+tid: .word 0
+.bss
+.align 12
+stack: .space 4096
+stack_top:
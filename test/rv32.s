@@ -0,0 +1,48 @@
+# RV32 裸机测试：cemu test 中的 rv32_elf 加载本文件（ELF32，按 EI_CLASS 选择 RV32）
+#   各条指令的结果依次存到 DRAM_BASE + 0x10000 起的 32 位字，期望值按 RV32 语义算出
+#   （与 RV64 的结果低 32 位不同），最后 jr zero 结束
+# 构建：llvm-mc -triple=riscv32 -mattr=+m,+a,+c -filetype=obj rv32.s -o rv32.o
+#       ld.lld -m elf32lriscv -static -e _start --image-base=0 -Ttext=0x100 rv32.o -o rv32.out
+#   （裸机 ELF 整体拷贝到 DRAM_BASE，代码的虚拟地址须等于文件偏移）
+.globl _start
+_start:
+  lui s1, 0x80010
+  li a1, -8
+  li a2, 3
+  mulh a0, a1, a2
+  sw a0, 0(s1)
+  mulhu a0, a1, a2
+  sw a0, 4(s1)
+  lui a1, 0x80000
+  li a2, -1
+  div a0, a1, a2
+  sw a0, 8(s1)
+  rem a0, a1, zero
+  sw a0, 12(s1)
+  srli a0, a1, 4
+  sw a0, 16(s1)
+  srai a0, a1, 31
+  sw a0, 20(s1)
+  li a2, 33
+  li a3, 5
+  sll a0, a3, a2
+  sw a0, 24(s1)
+  sltu a0, a3, a1
+  sw a0, 28(s1)
+  slt a0, a3, a1
+  sw a0, 32(s1)
+  addi a0, a1, -1
+  sw a0, 36(s1)
+  csrr a0, misa
+  srli a0, a0, 30
+  sw a0, 40(s1)
+  csrr a0, cycleh
+  li a0, 7
+  c.jal ret7
+  sw a0, 44(s1)
+  li a0, 1
+  sw a0, 48(s1)
+  jr zero
+ret7:
+  addi a0, a0, 35
+  ret
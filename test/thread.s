@@ -0,0 +1,76 @@
+# 双线程 clone/futex 测试：cemu default -i test/thread.out，期望退出码 2
+#   主线程 clone 一个子线程（CLONE_CHILD_CLEARTID），子线程 FUTEX_WAIT 等待 go，
+#   主线程置 go 后 FUTEX_WAKE；两个线程各做 K 次 amoadd，
+#   主线程再在 tid 上 FUTEX_WAIT 直到子线程退出清零，最后以 counter / K 退出
+# 构建：llvm-mc -triple=riscv64 -mattr=+a,+m -filetype=obj thread.s -o thread.o
+#       ld.lld -static -e _start thread.o -o thread.out
+.equ K, 20000
+.globl _start
+_start:
+  li a0, 0x390100       # VM|THREAD|SETTLS|PARENT_SETTID|CHILD_CLEARTID
+  la a1, stack_top
+  la a2, tid
+  li a3, 0
+  mv a4, a2
+  li a7, 220            # clone
+  ecall
+  beqz a0, child
+  bltz a0, fail
+  la t0, go             # 放行子线程
+  li t1, 1
+  sw t1, 0(t0)
+  mv a0, t0
+  li a1, 1              # FUTEX_WAKE
+  li a2, 1
+  li a7, 98
+  ecall
+  call work
+1: la a0, tid           # 等待子线程退出：内核清零 tid 并唤醒
+  lw a2, 0(a0)
+  beqz a2, 2f
+  li a1, 0              # FUTEX_WAIT
+  li a3, 0
+  li a7, 98
+  ecall
+  j 1b
+2: la t0, counter
+  lw a0, 0(t0)
+  li t1, K
+  divu a0, a0, t1
+  li a7, 94             # exit_group
+  ecall
+fail:
+  li a0, 99
+  li a7, 94
+  ecall
+child:
+3: la a0, go
+  lw t0, 0(a0)
+  bnez t0, 4f
+  li a1, 0              # FUTEX_WAIT(go, 0)
+  li a2, 0
+  li a3, 0
+  li a7, 98
+  ecall
+  j 3b
+4: call work
+  li a0, 0
+  li a7, 93             # exit
+  ecall
+work:
+  li t2, K
+  la t3, counter
+  li t4, 1
+5: amoadd.w zero, t4, (t3)
+  addi t2, t2, -1
+  bnez t2, 5b
+  ret
+.data
+.align 3
+counter: .word 0
+go: .word 0
+tid: .word 0
+.bss
+.align 12
+stack: .space 4096
+stack_top:
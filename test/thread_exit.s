@@ -0,0 +1,34 @@
+# 线程 exit_group 测试：cemu default -i test/thread_exit.out [-d N]，期望退出码 42
+#   子线程调用 exit_group 结束整个进程，主线程此时阻塞在无超时的 FUTEX_WAIT 上
+# 构建：同 thread.s
+.globl _start
+_start:
+  li a0, 0x10100
+  la a1, stk_top
+  li a2, 0
+  li a3, 0
+  li a4, 0
+  li a7, 220
+  ecall
+  beqz a0, child
+1: la a0, word
+  li a1, 128            # FUTEX_WAIT | PRIVATE
+  li a2, 0
+  li a3, 0
+  li a7, 98
+  ecall
+  j 1b
+child:
+  li t0, 100000
+2: addi t0, t0, -1
+  bnez t0, 2b
+  li a0, 42
+  li a7, 94
+  ecall
+.data
+.align 3
+word: .word 0
+.bss
+.align 12
+stk: .space 4096
+stk_top:
@@ -0,0 +1,38 @@
+# writev 参数检查：cemu default -i test/writev.out，期望输出 ok、退出码 0
+#   iovcnt 为 1025 或 1 << 60 时返回 -EINVAL（后者换算长度会溢出），正常调用写出 3 字节
+# 构建：同 thread.s
+.globl _start
+_start:
+  li a0, 1
+  la a1, iov
+  li a2, 1025
+  li a7, 66
+  ecall
+  li t0, -22
+  bne a0, t0, bad
+  li a0, 1
+  la a1, iov
+  li a2, 1
+  slli a2, a2, 60
+  li a7, 66
+  ecall
+  li t0, -22
+  bne a0, t0, bad
+  li a0, 1
+  la a1, iov
+  li a2, 1
+  li a7, 66
+  ecall
+  li t0, 3
+  bne a0, t0, bad
+  li a0, 0
+  li a7, 93
+  ecall
+bad:
+  li a0, 1
+  li a7, 93
+  ecall
+.data
+msg: .ascii "ok\n"
+.align 3
+iov: .dword msg, 3
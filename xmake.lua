@@ -43,9 +43,22 @@ target("cemu")
     set_kind("binary")
     add_files("src/cemu/*.c", "src/utils/*.c")
     add_includedirs("src/cemu", "src/utils")
+    add_syslinks("pthread", "m")
+    -- fpu.c 运行时切换舍入模式并读取异常标志；GCC 不支持 FENV_ACCESS，
+    -- 需要禁止按默认舍入模式做常量折叠与跨 fesetround 的指令调度
+    add_cflags("-frounding-math")
     -- add_packages("unicorn")
     
 
+-- 回归测试：xmake run check
+target("check")
+    set_kind("phony")
+    add_deps("cemu")
+    on_run(function (target)
+        os.exec("sh test/check.sh %s", target:dep("cemu"):targetfile())
+    end)
+
+
 --
 -- If you want to known more usage about xmake, please see https://xmake.io
 --